@@ -0,0 +1,55 @@
+#ifndef AMP_H
+#define AMP_H
+
+#include "array.h"
+#include "tensor.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define AUTOCAST_MAX_DEPTH 16
+
+/*
+ * Autocast regions are thread-local and nest. Inside an enabled region
+ * `tensor_matmul` and the elementwise arithmetic ops cast DTYPE_FLOAT
+ * operands to the region's dtype (DTYPE_BF16 or DTYPE_HALF) before running,
+ * while `tensor_sum` promotes 16-bit inputs back to DTYPE_FLOAT. Losses,
+ * softmax, convolutions, pooling and normalizations go through
+ * `autocast_fp32_tensor` and run in DTYPE_FLOAT. The casts are
+ * differentiable, so fp32 parameters keep fp32 gradients, and a parameter is
+ * cast once per outermost region. 16-bit matmuls still widen their panels
+ * for an fp32 GEMM, so regions halve activation memory rather than compute.
+ */
+void autocast_enter(DType dtype, bool enabled);
+void autocast_exit();
+
+bool is_autocast_enabled();
+DType get_autocast_dtype();
+
+Tensor *autocast_tensor(Tensor *tensor, Environment *env);
+Tensor *autocast_fp32_tensor(Tensor *tensor, Environment *env);
+
+/*
+ * Dynamic loss scaling for 16-bit training. The loss is multiplied by the
+ * current scale before `backward`; `grad_scaler_unscale` divides the
+ * gradients back and returns false when any of them overflowed, in which
+ * case the parameter update should be skipped. `grad_scaler_update` backs the
+ * scale off after an overflow and grows it after `growth_interval`
+ * consecutive finite steps.
+ */
+typedef struct GradScaler GradScaler;
+
+GradScaler *grad_scaler_init(float init_scale, float growth_factor,
+                             float backoff_factor, size_t growth_interval);
+void free_grad_scaler(GradScaler *scaler);
+
+float get_grad_scale(const GradScaler *scaler);
+
+Tensor *grad_scaler_scale(GradScaler *scaler, Tensor *loss);
+bool grad_scaler_unscale(GradScaler *scaler, size_t num_params,
+                         Tensor **params);
+void grad_scaler_update(GradScaler *scaler);
+
+#define GradScalerDefault() grad_scaler_init(65536.0f, 2.0f, 0.5f, 2000)
+
+#endif // !AMP_H
@@ -3,16 +3,23 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 
 typedef enum DType {
     DTYPE_INT,
     DTYPE_FLOAT,
     DTYPE_DOUBLE,
     DTYPE_LONG,
+    DTYPE_BF16,
+    DTYPE_HALF,
 } DType;
 
 extern const char *DTypeNames[];
 
+/*
+ * DTYPE_BF16 and DTYPE_HALF values are carried widened in `float_val`, the
+ * narrowing happens only when they are stored back into an array.
+ */
 typedef union ArrayVal {
     int int_val;
     float float_val;
@@ -22,6 +29,18 @@ typedef union ArrayVal {
 
 #define FLOAT_EQ_TOL 1e-6
 #define DOUBLE_EQ_TOL 1e-9
+#define HALF_EQ_TOL 1e-3
+#define BF16_EQ_TOL 1e-2
+
+float bf16_to_float(uint16_t x);
+uint16_t float_to_bf16(float x);
+float half_to_float(uint16_t x);
+uint16_t float_to_half(float x);
+
+void bf16_to_float_buffer(const uint16_t *src, float *dst, size_t n);
+void float_to_bf16_buffer(const float *src, uint16_t *dst, size_t n);
+void half_to_float_buffer(const uint16_t *src, float *dst, size_t n);
+void float_to_half_buffer(const float *src, uint16_t *dst, size_t n);
 
 ArrayVal array_val_one(DType dtype);
 ArrayVal array_val_zero(DType dtype);
@@ -31,6 +50,9 @@ ArrayVal array_val_mul(ArrayVal v1, ArrayVal v2, DType dtype);
 ArrayVal array_val_div(ArrayVal v1, ArrayVal v2, DType dtype);
 ArrayVal array_val_neg(ArrayVal value, DType dtype);
 bool array_val_equal(ArrayVal v1, ArrayVal v2, DType dtype);
+// one element of `dtype` storage, 16-bit floats travel as `float_val`
+ArrayVal array_val_load(const void *ptr, DType dtype);
+void array_val_store(void *ptr, ArrayVal value, DType dtype);
 
 #define MAX_NDIM 32
 
@@ -39,6 +61,10 @@ typedef struct ndArray ndArray;
 ndArray *array_init(int ndim, const size_t *shape, DType dtype);
 void free_array(ndArray *array);
 
+// the array borrows `data`, which must outlive it and is not freed with it
+ndArray *array_from_buffer(int ndim, const size_t *shape, DType dtype,
+                           void *data);
+
 int get_ndim(const ndArray *array);
 size_t get_itemsize(const ndArray *array);
 size_t get_total_size(const ndArray *array);
@@ -57,7 +83,26 @@ void offset_to_index(size_t offset, size_t *idx, const size_t *shape, int ndim);
 size_t index_to_offset(const size_t *idx, const size_t *strides, int ndim);
 
 ndArray *copy_array(const ndArray *array);
+ndArray *array_cast(const ndArray *array, DType dtype);
+
+/*
+ * Binary ops reject mismatched dtypes unless promotion is enabled, in which
+ * case the result takes `promote_types` of the operands. The setting is
+ * thread-local, like the grad modes.
+ */
+void set_dtype_promotion(bool enabled);
+bool get_dtype_promotion();
+DType promote_types(DType dtype1, DType dtype2);
+
 bool is_array_contiguous(const ndArray *array);
+// the array reads and writes a buffer it does not own
+bool is_array_view(const ndArray *array);
+// same shape and strides, elementwise kernels can then share offsets
+bool same_layout(const ndArray *arr1, const ndArray *arr2);
+// a copy of `array` in `like`'s layout, NULL when it already has it
+ndArray *array_align_layout(const ndArray *array, const ndArray *like);
+// a row-major copy of `array`, NULL when it already is one
+ndArray *array_align_contiguous(const ndArray *array);
 
 ndArray *eye(size_t m, size_t n, DType dtype);
 ndArray *zeros(int ndim, const size_t *shape, DType dtype);
@@ -85,6 +130,25 @@ ndArray *array_sub(ndArray *arr1, ndArray *arr2);
 ndArray *array_mul(ndArray *arr1, ndArray *arr2);
 ndArray *array_div(ndArray *arr1, ndArray *arr2);
 
+/*
+ * `_out` variants write into a preallocated array of the result's shape and
+ * dtype, e.g. when replaying a captured graph.
+ */
+void array_add_out(ndArray *arr1, ndArray *arr2, ndArray *out);
+void array_sub_out(ndArray *arr1, ndArray *arr2, ndArray *out);
+void array_mul_out(ndArray *arr1, ndArray *arr2, ndArray *out);
+void array_div_out(ndArray *arr1, ndArray *arr2, ndArray *out);
+void array_max_out(ndArray *arr1, ndArray *arr2, ndArray *out);
+void array_min_out(ndArray *arr1, ndArray *arr2, ndArray *out);
+void array_gt_out(ndArray *arr1, ndArray *arr2, ndArray *out);
+void array_ge_out(ndArray *arr1, ndArray *arr2, ndArray *out);
+void array_lt_out(ndArray *arr1, ndArray *arr2, ndArray *out);
+void array_le_out(ndArray *arr1, ndArray *arr2, ndArray *out);
+void array_eq_out(ndArray *arr1, ndArray *arr2, ndArray *out);
+void array_sum_out(ndArray *array, ndArray *out);
+void matmul_out(ndArray *arr1, ndArray *arr2, ndArray *out);
+void array_cast_out(const ndArray *array, ndArray *out);
+
 ndArray *negative(ndArray *array);
 ndArray *inverse(ndArray *array);
 ndArray *matmul(ndArray *arr1, ndArray *arr2);
@@ -103,6 +167,218 @@ void array_sum_dimi(ndArray **array, int dim, bool keepdims);
 void negativei(ndArray **array);
 void inversei(ndArray **array);
 
+/*
+ * Rectifiers: x between 0 and `cap`, `cap` above it and `negative_slope * x`
+ * below zero. A `cap` of RELU_UNCAPPED leaves positive values unbounded, so
+ * ReLU is (0, RELU_UNCAPPED), LeakyReLU (slope, RELU_UNCAPPED) and ReLU6
+ * (0, 6). `array_relu_grad` backpropagates `grad` through the rectifier's
+ * output, which requires a non-negative slope.
+ */
+#define RELU_UNCAPPED 0.0
+
+ndArray *array_relu(const ndArray *array, double negative_slope, double cap);
+void array_relu_out(const ndArray *array, ndArray *out, double negative_slope,
+                    double cap);
+ndArray *array_relu_grad(const ndArray *grad, const ndArray *output,
+                         double negative_slope, double cap);
+
+/*
+ * Smooth activations over floating point arrays, GELU in its tanh
+ * approximation. `array_activation_grad` backpropagates `grad` from the
+ * input for GELU and SiLU and from the output for Tanh and Sigmoid, see
+ * `activation_reads_output`.
+ */
+typedef enum ActivationKind {
+    ACTIVATION_GELU,
+    ACTIVATION_SILU,
+    ACTIVATION_TANH,
+    ACTIVATION_SIGMOID,
+} ActivationKind;
+
+// GELU(x) = x (1 + tanh(GELU_K (x + GELU_C x^3))) / 2
+#define GELU_K 0.7978845608028654 // sqrt(2 / pi)
+#define GELU_C 0.044715
+
+bool activation_reads_output(ActivationKind kind);
+
+ndArray *array_activation(const ndArray *array, ActivationKind kind);
+void array_activation_out(const ndArray *array, ndArray *out,
+                          ActivationKind kind);
+ndArray *array_activation_grad(const ndArray *grad, const ndArray *saved,
+                               ActivationKind kind);
+
+/*
+ * Softmax (LogSoftmax with `log_space`) along `dim`, negative dims count
+ * from the end. Every line is shifted by its max before exponentiating. The
+ * gradient and the Jacobian-vector product only read the output.
+ */
+int softmax_dim(const ndArray *array, int dim);
+
+ndArray *array_softmax(const ndArray *array, int dim, bool log_space);
+void array_softmax_out(const ndArray *array, ndArray *out, int dim,
+                       bool log_space);
+ndArray *array_softmax_grad(const ndArray *grad, const ndArray *output,
+                            int dim, bool log_space);
+ndArray *array_softmax_jvp(const ndArray *tangent, const ndArray *output,
+                           int dim, bool log_space);
+
+/*
+ * Losses reduce to a 0-d array (mean or sum) or keep one value per sample
+ * (REDUCTION_NONE). Class losses take an (N, C) input and (N,) DTYPE_INT or
+ * DTYPE_LONG class indices: NLL is -input[i, target[i]], cross-entropy the
+ * same on logits shifted by their row's logsumexp. Cross-entropy reads each
+ * row once, gathering the target logit while it takes the logsumexp, and
+ * hands the (N,) DTYPE_DOUBLE logsumexps back in `lse` for the gradient
+ * (`lse` NULL there for NLL).
+ * Their gradient is softmax - one_hot, written row by row without
+ * materializing the one-hot. Pointwise losses compare same-shaped input and
+ * target, `wrt_target` selects which one the gradient is taken for.
+ */
+typedef enum Reduction {
+    REDUCTION_NONE,
+    REDUCTION_MEAN,
+    REDUCTION_SUM,
+} Reduction;
+
+typedef enum LossKind {
+    LOSS_NLL,
+    LOSS_CROSS_ENTROPY,
+    LOSS_MSE,
+    LOSS_BCE_WITH_LOGITS,
+} LossKind;
+
+// (N,) DTYPE_DOUBLE row logsumexps of (N, C) logits
+ndArray *array_logsumexp(const ndArray *logits);
+void array_logsumexp_out(const ndArray *logits, ndArray *out);
+
+ndArray *array_nll_loss(const ndArray *input, const ndArray *target,
+                        Reduction reduction);
+void array_nll_loss_out(const ndArray *input, const ndArray *target,
+                        Reduction reduction, ndArray *out);
+ndArray *array_cross_entropy(const ndArray *logits, const ndArray *target,
+                             Reduction reduction, ndArray **lse);
+void array_cross_entropy_out(const ndArray *logits, const ndArray *target,
+                             Reduction reduction, ndArray *lse, ndArray *out);
+ndArray *array_nll_loss_grad(const ndArray *grad, const ndArray *input,
+                             const ndArray *target, const ndArray *lse,
+                             Reduction reduction);
+
+ndArray *array_pointwise_loss(const ndArray *input, const ndArray *target,
+                              LossKind kind, Reduction reduction);
+void array_pointwise_loss_out(const ndArray *input, const ndArray *target,
+                              LossKind kind, Reduction reduction,
+                              ndArray *out);
+ndArray *array_pointwise_loss_grad(const ndArray *grad, const ndArray *input,
+                                   const ndArray *target, LossKind kind,
+                                   Reduction reduction, bool wrt_target);
+
+/*
+ * Convolutions (cross-correlations) of (N, C_in, W) or (N, C_in, H, W)
+ * inputs with (C_out, C_in / groups, [kH,] kW) weights and an optional
+ * (C_out,) bias, over DTYPE_FLOAT or DTYPE_DOUBLE. The per-dim parameters
+ * are listed outermost first, `ndim` is the number of spatial dims. Few
+ * channels per group with kernels up to 3x3 are convolved directly, others
+ * through im2col and a GEMM per sample and group. The gradients take the
+ * shape of the operand they are for.
+ */
+typedef struct ConvParams {
+    int ndim;
+    size_t stride[2];
+    size_t padding[2];
+    size_t dilation[2];
+    size_t groups;
+} ConvParams;
+
+void conv_output_shape(const size_t *input_shape, const size_t *weight_shape,
+                       const ConvParams *params, size_t *shape);
+
+ndArray *array_conv(const ndArray *input, const ndArray *weight,
+                    const ndArray *bias, const ConvParams *params);
+ndArray *array_conv_grad_input(const ndArray *grad, const ndArray *weight,
+                               const size_t *input_shape,
+                               const ConvParams *params);
+ndArray *array_conv_grad_weight(const ndArray *grad, const ndArray *input,
+                                const size_t *weight_shape,
+                                const ConvParams *params);
+ndArray *array_conv_grad_bias(const ndArray *grad);
+
+/*
+ * Pooling over the spatial dims of (N, C, W) or (N, C, H, W) arrays of
+ * DTYPE_FLOAT or DTYPE_DOUBLE, per-dim sizes listed outermost first.
+ * Fixed windows take `kernel_size`, `stride` and `padding` (at most half
+ * the kernel); averages count the padding as zeros. Adaptive averages
+ * split each dim into `output_size` near-equal windows instead. Max
+ * pooling hands back the DTYPE_INT argmax of every window as an offset
+ * into its (H, W) plane through `indices` (NULL to drop them), which is
+ * all its gradient and tangent read.
+ */
+typedef enum PoolKind {
+    POOL_MAX,
+    POOL_AVG,
+    POOL_ADAPTIVE_AVG,
+} PoolKind;
+
+typedef struct PoolParams {
+    PoolKind kind;
+    int ndim;
+    size_t kernel_size[2];
+    size_t stride[2];
+    size_t padding[2];
+    size_t output_size[2];
+} PoolParams;
+
+void pool_output_shape(const size_t *input_shape, const PoolParams *params,
+                       size_t *shape);
+
+ndArray *array_pool(const ndArray *input, const PoolParams *params,
+                    ndArray **indices);
+ndArray *array_pool_grad(const ndArray *grad, const ndArray *indices,
+                         const size_t *input_shape, const PoolParams *params);
+ndArray *array_pool_jvp(const ndArray *tangent, const ndArray *indices,
+                        const PoolParams *params);
+
+/*
+ * Normalization of DTYPE_FLOAT or DTYPE_DOUBLE arrays. Layer and RMS norms
+ * normalize each sample over its trailing `normalized_ndim` dims, with
+ * affine parameters of that trailing shape; batch norm normalizes each
+ * channel of an (N, C, *) array over N and the spatial dims, with (C,)
+ * parameters. `weight` and `bias` are optional.
+ *
+ * The forward is two passes: one reading mean and variance (blocked
+ * Welford), one writing the normalized, scaled and shifted output. Batch
+ * norm outside training reads `running_mean` and `running_var` instead and
+ * folds them with the affine into one scale and shift per channel; in
+ * training it updates them by `momentum` (unbiased variance) when given.
+ * `stats` receives a (2, groups) DTYPE_DOUBLE array of the mean and the
+ * reciprocal standard deviation used, all the gradient and tangent read.
+ */
+typedef enum NormKind {
+    NORM_LAYER,
+    NORM_RMS,
+    NORM_BATCH,
+} NormKind;
+
+typedef struct NormParams {
+    NormKind kind;
+    int normalized_ndim; // layer and RMS norms
+    double eps;
+    double momentum; // batch norm
+    bool training;   // batch norm
+} NormParams;
+
+ndArray *array_norm(const ndArray *input, const ndArray *weight,
+                    const ndArray *bias, ndArray *running_mean,
+                    ndArray *running_var, const NormParams *params,
+                    ndArray **stats);
+void array_norm_grad(const ndArray *grad, const ndArray *input,
+                     const ndArray *weight, const ndArray *stats,
+                     const NormParams *params, ndArray **input_grad,
+                     ndArray **weight_grad, ndArray **bias_grad);
+ndArray *array_norm_jvp(const ndArray *input, const ndArray *weight,
+                        const ndArray *stats, const NormParams *params,
+                        const ndArray *tangent, const ndArray *weight_tangent,
+                        const ndArray *bias_tangent);
+
 ndArray *array_max(ndArray *arr1, ndArray *arr2);
 ndArray *array_min(ndArray *arr1, ndArray *arr2);
 
@@ -112,4 +388,6 @@ ndArray *array_lt(ndArray *arr1, ndArray *arr2);
 ndArray *array_le(ndArray *arr1, ndArray *arr2);
 ndArray *array_eq(ndArray *arr1, ndArray *arr2);
 
+bool array_all_finite(const ndArray *array);
+
 #endif // !ARRAY_H
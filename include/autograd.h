@@ -1,12 +1,25 @@
 #ifndef AUTOGRAD_H
 #define AUTOGRAD_H
 
+#include "fusion.h"
+#include "sparse.h"
 #include "tensor.h"
 #include <stddef.h>
 
 typedef enum Ctx {
     NULL_CTX,
     TRANSPOSE_CTX,
+    SPMM_CTX,
+    CHECKPOINT_CTX,
+    FUSED_CTX,
+    MASK_CTX,
+    RELU_CTX,
+    ACTIVATION_CTX,
+    SOFTMAX_CTX,
+    LOSS_CTX,
+    CONV_CTX,
+    POOL_CTX,
+    NORM_CTX,
 } Ctx;
 
 typedef struct TransposeCtx {
@@ -14,9 +27,88 @@ typedef struct TransposeCtx {
     int *dims;
 } TransposeCtx;
 
+typedef struct SpMMCtx {
+    SparseArray *sparse;
+    bool sparse_grad;
+} SpMMCtx;
+
+// the module is borrowed, it has to outlive the graph
+typedef struct CheckpointCtx {
+    Tensor *(*forward)(void *module, Tensor *input);
+    void *module;
+} CheckpointCtx;
+
+// instructions [0, num_instrs) of a fused expression, the last is its root
+typedef struct FusedCtx {
+    FusedInstr *instrs;
+    size_t num_instrs;
+} FusedCtx;
+
+// one bit per element of the op's output, set where it picked operand one
+typedef struct MaskCtx {
+    size_t size;
+    unsigned char *bits;
+} MaskCtx;
+
+// the rectifier's parameters, see `array_relu`
+typedef struct ReluCtx {
+    double negative_slope;
+    double cap;
+} ReluCtx;
+
+typedef struct ActivationCtx {
+    ActivationKind kind;
+} ActivationCtx;
+
+// `dim` is non-negative
+typedef struct SoftmaxCtx {
+    int dim;
+    bool log_space;
+} SoftmaxCtx;
+
+// `lse` holds cross-entropy's row logsumexps, NULL for the other losses
+typedef struct LossCtx {
+    LossKind kind;
+    Reduction reduction;
+    ndArray *lse;
+} LossCtx;
+
+typedef struct ConvCtx {
+    ConvParams params;
+} ConvCtx;
+
+// `indices` holds max pooling's argmax, NULL for averages
+typedef struct PoolCtx {
+    PoolParams params;
+    ndArray *indices;
+} PoolCtx;
+
+// `stats` holds the (2, groups) mean and rstd, see `array_norm`
+typedef struct NormCtx {
+    NormParams params;
+    ndArray *stats;
+    bool has_weight;
+    bool has_bias;
+} NormCtx;
+
 void *deep_copy_ctx(void *ctx, Ctx ctx_kind);
+// copies the struct alone, the copy takes over whatever it points to
+void *shallow_copy_ctx(void *ctx, Ctx ctx_kind);
 void free_ctx(void *ctx, Ctx ctx_kind);
 
+/*
+ * What a node's grad_fn reads besides the incoming gradient, in terms of the
+ * forward op. Tensors no node saves are only needed for their shape and
+ * dtype, `tensor_release` drops the buffers of such temporaries even while
+ * a graph is recorded.
+ */
+typedef enum SavedKind {
+    SAVE_SHAPES,
+    SAVE_INPUTS,
+    SAVE_OUTPUT,
+    SAVE_MASK, // a MaskCtx of which operand a max/min selected
+} SavedKind;
+
 typedef void (*CallableGradFn)(Tensor **output_grads, Tensor **inputs,
                                Tensor **outputs, Tensor **input_grads,
                                size_t num_inputs, size_t num_outputs,
@@ -25,7 +117,13 @@ typedef void (*CallableGradFn)(Tensor **output_grads, Tensor **inputs,
 BackwardFn *backward_fn_init(CallableGradFn grad_fn, Tensor **input_tensors,
                              Tensor **output_tensors, size_t num_inputs,
                              size_t num_outputs, const char *name);
+/*
+ * Nodes are shared by the tensor that produced them and the `next_functions`
+ * edges of their consumers, `free_backward_fn` drops one reference.
+ */
 void free_backward_fn(BackwardFn *backward_fn);
+void release_backward_fn(BackwardFn *backward_fn);
+bool is_backward_fn_released(const BackwardFn *backward_fn);
 BackwardFn **create_next_fns(Tensor **output_tensors, size_t num_outputs);
 
 BackwardFn **get_next_functions(const BackwardFn *backward_fn);
@@ -34,32 +132,210 @@ size_t get_backward_inputs(const BackwardFn *backward_fn);
 size_t get_backward_outputs(const BackwardFn *backward_fn);
 Tensor **get_backward_fn_ip_tensors(const BackwardFn *backward_fn);
 Tensor **get_backward_fn_op_tensors(const BackwardFn *backward_fn);
+size_t get_backward_refcount(const BackwardFn *backward_fn);
 CallableGradFn get_grad_fn(const BackwardFn *backward_fn);
+bool is_leaf_tensor(const Tensor *tensor);
 
 void *get_ctx(const BackwardFn *backward_fn);
 Ctx get_ctx_kind(const BackwardFn *backward_fn);
+SavedKind get_saved(const BackwardFn *backward_fn);
 
 void set_ctx(BackwardFn *backward_fn, void *ctx, Ctx ctx_kind);
+// set_ctx without the deep copy, the node owns the arrays `ctx` points to
+void move_ctx(BackwardFn *backward_fn, void *ctx, Ctx ctx_kind);
+void set_saved(BackwardFn *backward_fn, SavedKind saved);
 void set_next_functions(BackwardFn *backward_fn, BackwardFn **next_functions);
 
+/*
+ * Packs `data1 >= data2` (`<=` unless `max`) into the node's MaskCtx,
+ * `mask_ctx_array` expands it back to a 0/1 array of the output's shape,
+ * inverted with `complement` for the second operand.
+ */
+void set_select_mask(BackwardFn *backward_fn, ndArray *data1, ndArray *data2,
+                     bool max);
+ndArray *mask_ctx_array(const MaskCtx *ctx, int ndim, const size_t *shape,
+                        DType dtype, bool complement);
+
+/*
+ * Thread-local grad modes, both nest. Under no_grad ops build no graph; in
+ * inference mode their outputs are additionally not registered in any
+ * environment (the caller owns them) and temporaries created inside
+ * composite ops and modules are freed eagerly.
+ */
+int ctorch_no_grad_enter();
+void ctorch_no_grad_exit();
+int ctorch_inference_mode_enter();
+void ctorch_inference_mode_exit();
+
+bool is_grad_enabled();
+bool is_inference_mode();
+
+/*
+ * Set while a checkpointed segment reruns its forward in backward. Modules
+ * with side effects in their forward (batch norm's running statistics)
+ * skip them, they already happened in the original forward.
+ */
+int ctorch_recompute_enter();
+void ctorch_recompute_exit();
+bool is_recomputing();
+
+/*
+ * Saved-tensor hooks: a tensor saved by a node while a region is active
+ * keeps the region's hooks, and is handed to `pack` and loses its buffer
+ * once its composite op releases it, so a packed copy never sits next to a
+ * live buffer. Backward `unpack`s a dropped buffer on demand for each node
+ * that reads it (`like` carries its shape, dtype and strides) and drops it
+ * again afterwards; `free_packed` runs when the tensor is freed. Regions
+ * nest.
+ */
+typedef struct SavedTensorHooks {
+    void *(*pack)(void *ctx, const ndArray *data);
+    ndArray *(*unpack)(void *ctx, void *packed, const ndArray *like);
+    void (*free_packed)(void *ctx, void *packed);
+    void *ctx;
+} SavedTensorHooks;
+
+int saved_tensor_hooks_enter(const SavedTensorHooks *hooks);
+void saved_tensor_hooks_exit();
+const SavedTensorHooks *get_saved_tensor_hooks();
+
+// floating point buffers are kept as bf16, others are copied unchanged
+SavedTensorHooks bf16_saved_hooks();
+/*
+ * Buffers are spilled to one anonymous scratch file per call, which lives
+ * until free_disk_saved_hooks and the last tensor packed with it are gone.
+ * Release the temporaries saved under the hooks before freeing them.
+ */
+SavedTensorHooks disk_saved_hooks();
+void free_disk_saved_hooks(SavedTensorHooks *hooks);
+
+void unpack_saved_tensors(const BackwardFn *backward_fn);
+void repack_saved_tensors(const BackwardFn *backward_fn);
+
 void gradient(Tensor **grads, size_t num_inputs, Tensor **inputs,
               size_t num_outputs, Tensor **outputs, Tensor **grad_outputs,
               bool create_graph);
+
+/*
+ * Runs the graph of `tensor` in topological order. Unless `retain_graph` is
+ * set, every node is freed as soon as it has been processed, so a second
+ * backward through the same graph is an error. Temporaries given up with
+ * `tensor_release` go with the node that produced them, unless another graph
+ * still consumes them.
+ */
+void run_backward(Tensor *tensor, Tensor *grad, bool retain_graph);
 void backward(Tensor *tensor, Tensor *grad);
 
+/*
+ * Graphs with independent branches run their ready nodes as OpenMP tasks
+ * (on by default). Gradient sums are accumulated in a nondeterministic
+ * order, disable it for bitwise reproducible gradients.
+ */
+void set_parallel_backward(bool enabled);
+bool get_parallel_backward();
+
+/*
+ * Forward mode: every op fed by a tensor carrying a tangent (see
+ * `set_tensor_tangent`) also sets its output's tangent, the derivative along
+ * the input tangents. Tangents are plain arrays that reverse mode does not
+ * differentiate. Gradients built with `create_graph` are tensor ops too, so
+ * they carry tangents, which is how forward-over-reverse gives
+ * Hessian-vector products.
+ */
+void tangent_add(Tensor *out, Tensor *t1, Tensor *t2);
+void tangent_sub(Tensor *out, Tensor *t1, Tensor *t2);
+void tangent_mul(Tensor *out, Tensor *t1, Tensor *t2);
+void tangent_div(Tensor *out, Tensor *t1, Tensor *t2);
+void tangent_max(Tensor *out, Tensor *t1, Tensor *t2);
+void tangent_min(Tensor *out, Tensor *t1, Tensor *t2);
+void tangent_neg(Tensor *out, Tensor *tensor);
+void tangent_inv(Tensor *out, Tensor *tensor);
+void tangent_transpose(Tensor *out, Tensor *tensor, const int *dims);
+void tangent_matmul(Tensor *out, Tensor *t1, Tensor *t2);
+void tangent_sum(Tensor *out, Tensor *tensor);
+void tangent_cast(Tensor *out, Tensor *tensor);
+void tangent_spmm(Tensor *out, const SparseArray *sparse, Tensor *dense);
+void tangent_relu(Tensor *out, Tensor *tensor, double negative_slope,
+                  double cap);
+void tangent_activation(Tensor *out, Tensor *tensor, ActivationKind kind);
+void tangent_softmax(Tensor *out, Tensor *tensor, int dim, bool log_space);
+void tangent_loss(Tensor *out, Tensor *input, Tensor *target, LossKind kind,
+                  Reduction reduction, const ndArray *lse);
+void tangent_conv(Tensor *out, Tensor *input, Tensor *weight, Tensor *bias,
+                  const ConvParams *params);
+void tangent_pool(Tensor *out, Tensor *tensor, const PoolParams *params,
+                  const ndArray *indices);
+void tangent_norm(Tensor *out, Tensor *input, Tensor *weight, Tensor *bias,
+                  const NormParams *params, const ndArray *stats);
+
+/*
+ * Evaluates `fn(ctx, inputs)` with `tangents` (copied, NULL for none) on the
+ * inputs and returns its output, `output_tangent` receives a copy of the
+ * output's tangent, the Jacobian-vector product.
+ */
+typedef Tensor *(*JvpFn)(void *ctx, Tensor **inputs);
+Tensor *jvp(JvpFn fn, void *ctx, size_t num_inputs, Tensor **inputs,
+            ndArray **tangents, ndArray **output_tangent);
+
+/*
+ * Forward-over-reverse: for each direction `fn` runs with the direction as
+ * its inputs' tangents and its scalar output's gradient is built with a
+ * graph, whose tangents are the Hessian-vector products. A direction costs
+ * one forward and one reverse pass, no graph outlives it. `vectors[i]`
+ * stacks k directions along a leading dimension, shaped
+ * (k, *inputs[i] shape), `hvps[i]` receives the stacked products. Like
+ * `gradient`, leaves outside `inputs` accumulate into their grad.
+ */
+void hvp(JvpFn fn, void *ctx, size_t num_inputs, Tensor **inputs,
+         ndArray **vectors, ndArray **hvps);
+
+/*
+ * `jacobians[i]` is (*output shape, *inputs[i] shape), built row by row
+ * with reverse passes or column by column with `jvp`, whichever takes
+ * fewer passes.
+ */
+void jacobian(JvpFn fn, void *ctx, size_t num_inputs, Tensor **inputs,
+              ndArray **jacobians);
+
 #define _DECLARE_BACKWARD_FN(NAME)                                             \
     BackwardFn *NAME(Tensor **input_tensors, Tensor **output_tensors,          \
                      size_t num_inputs, size_t num_outputs);
 
+// for ops that pick their node per kind
+typedef BackwardFn *(*BackwardFnInit)(Tensor **input_tensors,
+                                      Tensor **output_tensors,
+                                      size_t num_inputs, size_t num_outputs);
+
 BackwardFn *AccumulateGrad(Tensor *input);
 
 _DECLARE_BACKWARD_FN(AddBackward)
+_DECLARE_BACKWARD_FN(SubBackward)
 _DECLARE_BACKWARD_FN(MulBackward)
+_DECLARE_BACKWARD_FN(DivBackward)
 _DECLARE_BACKWARD_FN(NegBackward)
 _DECLARE_BACKWARD_FN(InvBackward)
 _DECLARE_BACKWARD_FN(MatMulBackward)
 _DECLARE_BACKWARD_FN(TransposeBackward)
 _DECLARE_BACKWARD_FN(SumBackward)
+_DECLARE_BACKWARD_FN(SpMMBackward)
+_DECLARE_BACKWARD_FN(CastBackward)
+_DECLARE_BACKWARD_FN(CheckpointBackward)
+_DECLARE_BACKWARD_FN(FusedBackward)
+_DECLARE_BACKWARD_FN(ReluBackward)
+_DECLARE_BACKWARD_FN(GeluBackward)
+_DECLARE_BACKWARD_FN(SiluBackward)
+_DECLARE_BACKWARD_FN(TanhBackward)
+_DECLARE_BACKWARD_FN(SigmoidBackward)
+_DECLARE_BACKWARD_FN(SoftmaxBackward)
+_DECLARE_BACKWARD_FN(LogSoftmaxBackward)
+_DECLARE_BACKWARD_FN(NllLossBackward)
+_DECLARE_BACKWARD_FN(CrossEntropyBackward)
+_DECLARE_BACKWARD_FN(MseLossBackward)
+_DECLARE_BACKWARD_FN(BceWithLogitsBackward)
+_DECLARE_BACKWARD_FN(ConvBackward)
+_DECLARE_BACKWARD_FN(MaxPoolBackward)
+_DECLARE_BACKWARD_FN(AvgPoolBackward)
+_DECLARE_BACKWARD_FN(NormBackward)
 
 _DECLARE_BACKWARD_FN(MaxBackward)
 _DECLARE_BACKWARD_FN(MinBackward)
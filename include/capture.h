@@ -0,0 +1,93 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include "array.h"
+#include "tensor.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef enum CaptureOp {
+    CAPTURE_ADD,
+    CAPTURE_SUB,
+    CAPTURE_MUL,
+    CAPTURE_DIV,
+    CAPTURE_MAX,
+    CAPTURE_MIN,
+    CAPTURE_GT,
+    CAPTURE_GE,
+    CAPTURE_LT,
+    CAPTURE_LE,
+    CAPTURE_EQ,
+    CAPTURE_NEG,
+    CAPTURE_INV,
+    CAPTURE_TRANSPOSE,
+    CAPTURE_MATMUL,
+    CAPTURE_SUM,
+    CAPTURE_CAST,
+    CAPTURE_RELU,       // params: negative slope, cap
+    CAPTURE_ACTIVATION, // params: ActivationKind
+    CAPTURE_SOFTMAX,    // params: dim, log_space
+    CAPTURE_LOSS,       // params: LossKind, Reduction
+} CaptureOp;
+
+typedef struct CapturedGraph CapturedGraph;
+
+/*
+ * Records the forward tensor ops run on this thread between `capture_begin`
+ * and `capture_end`. `graph_replay` re-executes them into the tensors
+ * created during capture, so inputs are fed by replacing their data with
+ * arrays of the same shape and no forward op allocates an output or builds
+ * a BackwardFn.
+ *
+ * When the captured output requires grad, `capture_end` also records its
+ * backward as a tape of nodes in a fixed topological order, with a gradient
+ * slot per node input. Replay runs the tape on the calling thread instead of
+ * `run_backward`: nothing is scheduled or hashed, the seed gradient is
+ * allocated once and a slot fed by several nodes sums in place. The output
+ * must be a scalar, and `backward` must not free its graph while the
+ * captured graph is alive.
+ */
+void capture_begin();
+CapturedGraph *capture_end(Tensor *output);
+bool is_capturing();
+// ops with no captured form call this first, it raises while capturing
+void capture_unsupported(const char *op);
+
+void capture_record(CaptureOp op, Tensor *t1, Tensor *t2, Tensor *out);
+// for ops with scalar parameters, replayed with the recorded values
+void capture_record_params(CaptureOp op, Tensor *t1, Tensor *t2, Tensor *out,
+                           double param1, double param2);
+
+void graph_replay(CapturedGraph *graph);
+void free_captured_graph(CapturedGraph *graph);
+
+size_t get_num_captured_ops(const CapturedGraph *graph);
+Tensor *get_captured_output(const CapturedGraph *graph);
+
+typedef struct MemoryPlan MemoryPlan;
+
+/*
+ * Plans the intermediates of a captured step into a single slab: the
+ * tensors produced by the forward ops and the gradient slots of the
+ * backward tape (see `capture_end`). Forward ops and backward nodes share
+ * one timeline. A forward tensor lives from its op to its last reader, or to
+ * the backward node that reads it when it is saved, and a gradient slot
+ * from the first node feeding it to the node consuming it. Buffers with
+ * disjoint lifetimes share offsets, and `get_planned_peak` reports the slab
+ * size before anything is allocated. `apply_memory_plan` moves the planned
+ * tensors into the slab, their contents are only valid until a later op
+ * reuses the offset and are recomputed by the next `graph_replay`. A backward
+ * node still allocates its own result, which replay copies into the slot and
+ * frees before the next node runs. The captured output keeps its own buffer,
+ * and the plan must outlive any replay and any read of the planned tensors.
+ */
+MemoryPlan *plan_memory(CapturedGraph *graph);
+void apply_memory_plan(MemoryPlan *plan);
+void free_memory_plan(MemoryPlan *plan);
+
+size_t get_planned_peak(const MemoryPlan *plan);
+size_t get_unplanned_bytes(const MemoryPlan *plan);
+size_t get_num_planned_buffers(const MemoryPlan *plan);
+
+#endif // !CAPTURE_H
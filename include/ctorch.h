@@ -1,6 +1,7 @@
 #ifndef CTORCH_H
 #define CTORCH_H
 
+#include "autograd.h"
 #include "tensor.h"
 #include <stdint.h>
 
@@ -11,4 +12,14 @@ void CTorchClose();
 void auto_free_env(Environment **env);
 #define AutoEnvironment __attribute__((cleanup(auto_free_env))) Environment *
 
+/*
+ * Scoped grad modes, e.g.
+ *     AutoNoGrad guard = ctorch_no_grad_enter();
+ * leaves the region when `guard` goes out of scope.
+ */
+void auto_no_grad_exit(int *depth);
+void auto_inference_mode_exit(int *depth);
+#define AutoNoGrad __attribute__((cleanup(auto_no_grad_exit))) int
+#define AutoInferenceMode __attribute__((cleanup(auto_inference_mode_exit))) int
+
 #endif // !CTORCH_H
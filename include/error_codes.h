@@ -13,6 +13,8 @@ typedef enum {
     INVALID_DTYPE = 106,
     REPEATED_ARRAY_DIMS = 107,
     INVALID_DIM = 108,
+    SPARSE_INIT_FAILURE = 109,
+    INVALID_FUSED_EXPR = 110,
 
     /* tensor related error codes 20<x> */
     TENSOR_INIT_FAILURE = 201,
@@ -24,6 +26,8 @@ typedef enum {
     FILE_READ_FAILURE = 207,
     FILE_FORMAT_ERROR = 208,
     ENV_RESOLVE_FAILURE = 209,
+    INVALID_CAPTURE_STATE = 210,
+    MEMORY_PLAN_FAILURE = 211,
 
     /* autograd related error codes 30<x> */
     BACKWARD_FN_INIT_FAILURE = 301,
@@ -31,6 +35,11 @@ typedef enum {
     GRAD_INIT_FAILURE = 303,
     INVALID_BACKWARD_PASS = 304,
     INVALID_NUM_INPUTS_OUTPUTS = 305,
+    INVALID_AUTOCAST_STATE = 306,
+    GRAD_SCALER_INIT_FAILURE = 307,
+    INVALID_GRAD_MODE = 308,
+    GRAPH_TASK_INIT_FAILURE = 309,
+    SAVED_TENSOR_HOOK_FAILURE = 310,
 
     /* random related error codes 40<x> */
     PRNG_INIT_FAILURE = 401,
@@ -38,6 +47,7 @@ typedef enum {
 
     /* neural nets related error codes 50<x> */
     MODULE_ALLOC_FAILURE = 501,
+    OPTIM_INIT_FAILURE = 502,
 } ErrorCode;
 
 extern const char *ErrorCodes[];
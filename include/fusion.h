@@ -0,0 +1,81 @@
+#ifndef FUSION_H
+#define FUSION_H
+
+#include "array.h"
+#include "tensor.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef enum FusedOpKind {
+    FUSED_INPUT,
+    FUSED_SCALAR,
+    FUSED_ADD,
+    FUSED_SUB,
+    FUSED_MUL,
+    FUSED_DIV,
+    FUSED_MAX,
+    FUSED_MIN,
+    FUSED_NEG,
+} FusedOpKind;
+
+/*
+ * One SSA instruction of a fused elementwise program, its result is the
+ * value with the instruction's index. FUSED_INPUT reads input `a`,
+ * FUSED_SCALAR broadcasts `value`, the rest combine the values `a` and `b`.
+ */
+typedef struct FusedInstr {
+    FusedOpKind op;
+    int a, b;
+    double value;
+} FusedInstr;
+
+/*
+ * Evaluates instructions [0, root] in a single tiled pass over the
+ * broadcast of the inputs, which must share a DTYPE_FLOAT or DTYPE_DOUBLE
+ * dtype. `array_fused_grad` recomputes the tile and backpropagates `grad`
+ * through it, `adjoints[k]` is left with the output-shaped gradient of
+ * input k (NULL where `requires_grad[k]` is false).
+ */
+ndArray *array_fused_eval(const FusedInstr *instrs, int root, ndArray **inputs,
+                          size_t num_inputs);
+void array_fused_grad(const FusedInstr *instrs, int root, ndArray **inputs,
+                      size_t num_inputs, ndArray *grad,
+                      const bool *requires_grad, ndArray **adjoints);
+
+/*
+ * Reruns instructions [0, root] over `inputs` as separate tensor ops into
+ * `values`, which records a differentiable graph and carries tangents.
+ * Scalars are made in `dtype` and `env`.
+ */
+void fused_replay(const FusedInstr *instrs, int root, Tensor **inputs,
+                  DType dtype, Environment *env, Tensor **values);
+
+typedef struct FusedExpr FusedExpr;
+
+/*
+ * Builds an elementwise expression without materializing intermediates,
+ * `fused_eval` runs it as one kernel with a single FusedBackward node, e.g.
+ *
+ *     FusedExpr *expr = fused_expr_init();
+ *     int one = fused_scalar(expr, 1.0);
+ *     int diff = fused_sub(expr, fused_input(expr, norm2), one);
+ *     Tensor *loss = fused_eval(expr, fused_mul(expr, diff, diff));
+ *     free_fused_expr(expr);
+ */
+FusedExpr *fused_expr_init();
+void free_fused_expr(FusedExpr *expr);
+
+int fused_input(FusedExpr *expr, Tensor *tensor);
+int fused_scalar(FusedExpr *expr, double value);
+int fused_add(FusedExpr *expr, int a, int b);
+int fused_sub(FusedExpr *expr, int a, int b);
+int fused_mul(FusedExpr *expr, int a, int b);
+int fused_div(FusedExpr *expr, int a, int b);
+int fused_max(FusedExpr *expr, int a, int b);
+int fused_min(FusedExpr *expr, int a, int b);
+int fused_neg(FusedExpr *expr, int a);
+
+Tensor *fused_eval(FusedExpr *expr, int root);
+
+#endif // !FUSION_H
@@ -7,16 +7,22 @@
 
 typedef Tensor *(*CallableModule)(void *module, Tensor *input);
 typedef struct Module Module;
+typedef struct FlatParameters FlatParameters;
 
 struct Module {
     Module **modules;
     size_t num_modules;
 
     Environment *env;
+    Environment *buffers; // state outside `parameters`, e.g. running stats
     CallableModule forward;
 
     const char *repr;
     bool repr_dynamic;
+
+    FlatParameters *flat; // set by `flatten_parameters`
+
+    bool training; // see `set_training`
 };
 
 Tensor *Parameter(int ndim, const size_t *shape, float bound, Environment *env);
@@ -24,6 +30,14 @@ Tensor *Parameter(int ndim, const size_t *shape, float bound, Environment *env);
 void freeze(Module *module);
 void unfreeze(Module *module);
 
+/*
+ * Modules start in training mode. Outside it, batch norm normalizes by its
+ * running statistics instead of the batch's and stops updating them.
+ * Applies to every child.
+ */
+void set_training(Module *module, bool training);
+bool is_training(const Module *module);
+
 void module_init(Module *module);
 void add_module(Module *base, Module *child);
 void add_tensor(Module *base, Tensor *tensor);
@@ -36,24 +50,122 @@ void add_tensor(Module *base, Tensor *tensor);
 
 size_t num_parameters(Module *module);
 void parameters(Module *module, Tensor **out);
+/*
+ * Buffers are tensors a module updates itself, such as batch norm's running
+ * statistics. They are never trained, flattened or handed to an optimizer,
+ * but count as non-trainable variables and are saved with the parameters.
+ */
+size_t num_buffers(Module *module);
+void buffers(Module *module, Tensor **out);
 size_t num_trainable_variables(Module *module);
 size_t num_non_trainable_variables(Module *module);
 
 Tensor *module_call(Module *module, Tensor *tensor);
 
+/*
+ * Moves every parameter of `module` (children included, in `parameters`
+ * order) into one contiguous, 64-byte aligned slab and their gradients into
+ * a second one, which backward accumulates into in place. The parameters
+ * keep their tensors and shapes, their data become views into the slab, so
+ * whole-model passes (zeroing, clipping, optimizer steps, checkpoints) run
+ * as single kernels over `get_flat_parameters`/`get_flat_grads`, 1-d views
+ * that are NULL for modules that were not flattened. All parameters must
+ * share a dtype and the module owns the slabs.
+ */
+void flatten_parameters(Module *module);
+void free_flat_parameters(FlatParameters *flat);
+bool is_flattened(const Module *module);
+ndArray *get_flat_parameters(const Module *module);
+ndArray *get_flat_grads(const Module *module);
+
+/*
+ * Resets the gradients of every parameter of `module`. Existing gradients
+ * are zeroed by a parallel memset over their (coalesced) buffers. With
+ * `set_to_none` they are freed instead, so the next backward writes them
+ * rather than accumulating into zeros; gradients that are views into a
+ * flat slab are zeroed either way.
+ */
+void module_zero_grad(Module *module, bool set_to_none);
+
+/*
+ * In-place clipping of the gradients of every parameter that has one.
+ * `clip_grad_norm` computes their global L2 norm in one parallel reduction
+ * and, when it exceeds `max_norm`, rescales them all by max_norm / norm in
+ * a second pass; it returns the norm before clipping. `clip_grad_value`
+ * clamps each element to [-clip_value, clip_value].
+ */
+double clip_grad_norm(Module *module, double max_norm);
+void clip_grad_value(Module *module, double clip_value);
+
+// parameter values in `parameters` order, then buffers, for the same
+// architecture
+void save_module(Module *module, const char *path);
+void load_module(Module *module, const char *path);
+
 Environment *get_environ(const Module *module);
+Environment *get_buffers_environ(const Module *module);
 CallableModule get_callable(const Module *module);
 
 Tensor *_linear(Tensor *input, Tensor *weight, Tensor *bias);
 Tensor *_relu(Tensor *input);
+Tensor *_leaky_relu(Tensor *input, double negative_slope);
+Tensor *_relu6(Tensor *input);
+Tensor *_gelu(Tensor *input);
+Tensor *_silu(Tensor *input);
+Tensor *_tanh(Tensor *input);
+Tensor *_sigmoid(Tensor *input);
+Tensor *_softmax(Tensor *input, int dim);
+Tensor *_log_softmax(Tensor *input, int dim);
+Tensor *_conv(Tensor *input, Tensor *weight, Tensor *bias,
+              const ConvParams *params);
+Tensor *_pool(Tensor *input, const PoolParams *params);
+Tensor *_norm(Tensor *input, Tensor *weight, Tensor *bias,
+              Tensor *running_mean, Tensor *running_var,
+              const NormParams *params);
+Tensor *_nll_loss(Tensor *input, Tensor *target, Reduction reduction);
+Tensor *_cross_entropy(Tensor *input, Tensor *target, Reduction reduction);
+Tensor *_mse_loss(Tensor *input, Tensor *target, Reduction reduction);
+Tensor *_bce_with_logits(Tensor *input, Tensor *target, Reduction reduction);
+Tensor *_checkpoint(Module *module, Tensor *input);
 
 typedef struct linear linear;
 typedef struct relu relu;
+typedef struct leaky_relu leaky_relu;
+typedef struct relu6 relu6;
+typedef struct gelu gelu;
+typedef struct silu silu;
+typedef struct tanh_layer tanh_layer;
+typedef struct sigmoid sigmoid;
+typedef struct softmax softmax;
+typedef struct conv conv;
+typedef struct pool pool;
+typedef struct norm norm;
 typedef struct sequential sequential;
+typedef struct checkpoint checkpoint;
 
 linear *_Linear(size_t in_features, size_t out_features, bool bias);
 relu *_ReLU();
+leaky_relu *_LeakyReLU(double negative_slope);
+relu6 *_ReLU6();
+gelu *_GELU();
+silu *_SiLU();
+tanh_layer *_Tanh();
+sigmoid *_Sigmoid();
+softmax *_Softmax(int dim, bool log_space);
+conv *_Conv(int ndim, size_t in_channels, size_t out_channels,
+            size_t kernel_size, size_t stride, size_t padding,
+            size_t dilation, size_t groups, bool bias);
+pool *_Pool(PoolKind kind, int ndim, size_t kernel_size, size_t stride,
+            size_t padding);
+pool *_AdaptiveAvgPool(int ndim, const size_t *output_size);
+norm *_LayerNorm(int ndim, const size_t *normalized_shape, double eps,
+                 bool elementwise_affine);
+norm *_RMSNorm(int ndim, const size_t *normalized_shape, double eps,
+               bool elementwise_affine);
+norm *_BatchNorm(int ndim, size_t num_features, double eps, double momentum,
+                 bool affine);
 sequential *_Sequential(size_t num_modules, Module **modules);
+checkpoint *_Checkpoint(Module *module);
 
 #define Linear(in_features, out_features)                                      \
     (Module *)_Linear(in_features, out_features, true)
@@ -61,14 +173,104 @@ sequential *_Sequential(size_t num_modules, Module **modules);
     (Module *)_Linear(in_features, out_features, bias)
 
 #define ReLU() (Module *)_ReLU()
+#define LeakyReLU(negative_slope) (Module *)_LeakyReLU(negative_slope)
+#define ReLU6() (Module *)_ReLU6()
+#define GELU() (Module *)_GELU()
+#define SiLU() (Module *)_SiLU()
+#define Tanh() (Module *)_Tanh()
+#define Sigmoid() (Module *)_Sigmoid()
+#define Softmax(dim) (Module *)_Softmax(dim, false)
+#define LogSoftmax(dim) (Module *)_Softmax(dim, true)
+
+/*
+ * Square kernels with the same stride, padding and dilation along every
+ * spatial dim, `_conv` takes them per dim.
+ */
+#define Conv1d(in_channels, out_channels, kernel_size)                         \
+    (Module *)_Conv(1, in_channels, out_channels, kernel_size, 1, 0, 1, 1, true)
+#define Conv2d(in_channels, out_channels, kernel_size)                         \
+    (Module *)_Conv(2, in_channels, out_channels, kernel_size, 1, 0, 1, 1, true)
+#define Conv1dEx(in_channels, out_channels, kernel_size, stride, padding,      \
+                 dilation, groups, bias)                                       \
+    (Module *)_Conv(1, in_channels, out_channels, kernel_size, stride,         \
+                    padding, dilation, groups, bias)
+#define Conv2dEx(in_channels, out_channels, kernel_size, stride, padding,      \
+                 dilation, groups, bias)                                       \
+    (Module *)_Conv(2, in_channels, out_channels, kernel_size, stride,         \
+                    padding, dilation, groups, bias)
+
+// windows default to a stride of `kernel_size` and no padding
+#define MaxPool1d(kernel_size)                                                 \
+    (Module *)_Pool(POOL_MAX, 1, kernel_size, kernel_size, 0)
+#define MaxPool2d(kernel_size)                                                 \
+    (Module *)_Pool(POOL_MAX, 2, kernel_size, kernel_size, 0)
+#define MaxPool1dEx(kernel_size, stride, padding)                              \
+    (Module *)_Pool(POOL_MAX, 1, kernel_size, stride, padding)
+#define MaxPool2dEx(kernel_size, stride, padding)                              \
+    (Module *)_Pool(POOL_MAX, 2, kernel_size, stride, padding)
+#define AvgPool1d(kernel_size)                                                 \
+    (Module *)_Pool(POOL_AVG, 1, kernel_size, kernel_size, 0)
+#define AvgPool2d(kernel_size)                                                 \
+    (Module *)_Pool(POOL_AVG, 2, kernel_size, kernel_size, 0)
+#define AvgPool1dEx(kernel_size, stride, padding)                              \
+    (Module *)_Pool(POOL_AVG, 1, kernel_size, stride, padding)
+#define AvgPool2dEx(kernel_size, stride, padding)                              \
+    (Module *)_Pool(POOL_AVG, 2, kernel_size, stride, padding)
+#define AdaptiveAvgPool1d(output_size)                                         \
+    (Module *)_AdaptiveAvgPool(1, SHAPE_(output_size))
+#define AdaptiveAvgPool2d(output_h, output_w)                                  \
+    (Module *)_AdaptiveAvgPool(2, SHAPE_(output_h, output_w))
+
+/*
+ * Layer and RMS norms take the normalized (trailing) shape, batch norms
+ * the channel count of (N, C), (N, C, L) or (N, C, H, W) inputs. Running
+ * statistics are non-trainable variables of the module.
+ */
+#define LayerNorm(...) (Module *)_LayerNorm(SHAPE(__VA_ARGS__), 1e-5, true)
+#define RMSNorm(...) (Module *)_RMSNorm(SHAPE(__VA_ARGS__), 1e-6, true)
+#define BatchNorm1d(num_features)                                              \
+    (Module *)_BatchNorm(1, num_features, 1e-5, 0.1, true)
+#define BatchNorm2d(num_features)                                              \
+    (Module *)_BatchNorm(2, num_features, 1e-5, 0.1, true)
 
 #define Sequential(...)                                                        \
     (Module *)_Sequential(                                                     \
         (sizeof((Module *[]){__VA_ARGS__}) / sizeof(Module *)),                \
         ((Module *[]){__VA_ARGS__}));
 
+/*
+ * Runs `module` without keeping its activations, only the input is saved
+ * and the forward is recomputed during backward. Checkpointing every
+ * sqrt(n)-th segment of an n layer Sequential keeps O(sqrt(n)) activations.
+ */
+#define Checkpoint(module) (Module *)_Checkpoint(module)
+
 void free_module(Module *module);
 
+/*
+ * Losses take the target as a second input, so they are plain values
+ * rather than modules and own nothing, e.g.
+ *
+ *     Loss criterion = CrossEntropyLoss(REDUCTION_MEAN);
+ *     Tensor *loss = loss_call(&criterion, logits, labels);
+ */
+typedef Tensor *(*LossFn)(Tensor *input, Tensor *target, Reduction reduction);
+
+typedef struct Loss {
+    LossFn forward;
+    Reduction reduction;
+    const char *repr;
+} Loss;
+
+Tensor *loss_call(const Loss *loss, Tensor *input, Tensor *target);
+
+#define NLLLoss(reduction) ((Loss){_nll_loss, (reduction), "NLLLoss()"})
+#define CrossEntropyLoss(reduction)                                            \
+    ((Loss){_cross_entropy, (reduction), "CrossEntropyLoss()"})
+#define MSELoss(reduction) ((Loss){_mse_loss, (reduction), "MSELoss()"})
+#define BCEWithLogitsLoss(reduction)                                           \
+    ((Loss){_bce_with_logits, (reduction), "BCEWithLogitsLoss()"})
+
 #define ModuleInit(ptr, type, name)                                            \
     do {                                                                       \
         (ptr) = calloc(1, sizeof(type));                                       \
@@ -0,0 +1,51 @@
+#ifndef OPTIM_H
+#define OPTIM_H
+
+#include "nn.h"
+#include "tensor.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * Optimizers update the trainable parameters of a module in place, outside
+ * of any graph. The parameters are collected when the optimizer is created
+ * and must share a dtype (DTYPE_FLOAT or DTYPE_DOUBLE), their state lives in
+ * flat buffers laid out one parameter after another. A step splits every
+ * parameter that has a gradient into fixed-size chunks and runs one fused
+ * kernel per chunk across threads, so the parameter, its gradient and its
+ * state are each read and written once. The chunks of a flattened module
+ * (see `flatten_parameters`) cover its whole slab as a single span.
+ *
+ * SGD with momentum keeps buf = momentum * buf + (1 - dampening) * grad and
+ * steps along buf, or along grad + momentum * buf with `nesterov`. Adam
+ * steps along bias-corrected moment estimates; its weight decay is added to
+ * the gradient, while AdamW (`decoupled`) shrinks the parameter itself by
+ * lr * weight_decay.
+ */
+typedef struct Optimizer Optimizer;
+
+Optimizer *sgd_init(Module *module, double lr, double momentum,
+                    double dampening, double weight_decay, bool nesterov);
+Optimizer *adam_init(Module *module, double lr, double beta1, double beta2,
+                     double eps, double weight_decay, bool decoupled);
+void free_optimizer(Optimizer *optim);
+
+void optim_step(Optimizer *optim);
+
+double get_lr(const Optimizer *optim);
+void set_lr(Optimizer *optim, double lr);
+size_t get_num_optim_params(const Optimizer *optim);
+Tensor **get_optim_params(const Optimizer *optim);
+
+#define SGD(module, lr) sgd_init(module, lr, 0.0, 0.0, 0.0, false)
+#define SGDMomentum(module, lr, momentum)                                      \
+    sgd_init(module, lr, momentum, 0.0, 0.0, false)
+#define SGDNesterov(module, lr, momentum)                                      \
+    sgd_init(module, lr, momentum, 0.0, 0.0, true)
+
+#define Adam(module, lr) adam_init(module, lr, 0.9, 0.999, 1e-8, 0.0, false)
+#define AdamW(module, lr, weight_decay)                                        \
+    adam_init(module, lr, 0.9, 0.999, 1e-8, weight_decay, true)
+
+#endif // !OPTIM_H
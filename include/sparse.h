@@ -0,0 +1,76 @@
+#ifndef SPARSE_H
+#define SPARSE_H
+
+#include "array.h"
+#include "tensor.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define SPARSE_GRAD true
+#define DENSE_GRAD false
+
+typedef enum SparseFormat {
+    SPARSE_COO,
+    SPARSE_CSR,
+} SparseFormat;
+
+extern const char *SparseFormatNames[];
+
+/*
+ * 2-D sparse matrix of shape (rows, cols).
+ *
+ * SPARSE_COO: `row_idx` and `col_idx` hold `nnz` coordinates each.
+ * SPARSE_CSR: `row_idx` holds `rows + 1` row pointers into `col_idx` and
+ *             `values`, column indices are sorted within a row.
+ */
+typedef struct SparseArray SparseArray;
+
+SparseArray *sparse_coo_init(size_t rows, size_t cols, size_t nnz,
+                             const size_t *row_idx, const size_t *col_idx,
+                             const void *values, DType dtype);
+SparseArray *sparse_csr_init(size_t rows, size_t cols, size_t nnz,
+                             const size_t *row_ptr, const size_t *col_idx,
+                             const void *values, DType dtype);
+void free_sparse(SparseArray *sparse);
+
+SparseFormat get_sparse_format(const SparseArray *sparse);
+DType get_sparse_dtype(const SparseArray *sparse);
+size_t get_sparse_rows(const SparseArray *sparse);
+size_t get_sparse_cols(const SparseArray *sparse);
+size_t get_sparse_nnz(const SparseArray *sparse);
+size_t *get_sparse_row_idx(const SparseArray *sparse);
+size_t *get_sparse_col_idx(const SparseArray *sparse);
+void *get_sparse_values(const SparseArray *sparse);
+
+SparseArray *copy_sparse(const SparseArray *sparse);
+SparseArray *sparse_to_csr(const SparseArray *sparse);
+SparseArray *sparse_to_coo(const SparseArray *sparse);
+SparseArray *sparse_transpose(const SparseArray *sparse);
+
+SparseArray *sparse_from_dense(const ndArray *array, SparseFormat format);
+ndArray *sparse_to_dense(const SparseArray *sparse);
+
+/*
+(m, k) sparse, (k, n) dense -> (m, n) dense
+*/
+ndArray *spmm(const SparseArray *sparse, const ndArray *dense);
+ndArray *spmm_t(const SparseArray *sparse, const ndArray *dense);
+void spmm_t_accumulate(const SparseArray *sparse, const ndArray *dense,
+                       ndArray *out);
+
+Tensor *tensor_spmm(SparseArray *sparse, Tensor *dense, bool sparse_grad,
+                    Environment *env);
+
+/*
+ * SPARSE_GRAD SpMM nodes hand back deferred gradients: the tensor holds the
+ * upstream gradient and owns `sparse`, it stands for `sparse^T @ data`.
+ * AccumulateGrad scatters it into the touched rows of the leaf's `grad`,
+ * every other consumer materializes it in place with `sparse_grad_densify`.
+ */
+Tensor *sparse_grad_init(SparseArray *sparse, ndArray *data,
+                         Environment *env);
+SparseArray *get_sparse_grad_factor(const Tensor *tensor);
+void sparse_grad_densify(Tensor *grad);
+
+#endif // !SPARSE_H
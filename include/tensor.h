@@ -11,6 +11,9 @@
 #define CREATE_GRAPH true
 #define NO_GRAPH false
 
+#define RETAIN_GRAPH true
+#define FREE_GRAPH false
+
 typedef struct Environment Environment;
 typedef struct Tensor Tensor;
 typedef struct BackwardFn BackwardFn;
@@ -22,6 +25,14 @@ void env_push(Environment *env, Tensor *tensor);
 Tensor *env_pop(Environment *env);
 bool env_remove_and_free(Environment *env, const Tensor *target);
 
+/*
+ * Tensors the calling thread pushes into any environment after
+ * `env_scratch_begin` are freed by the matching `env_scratch_end`, which
+ * takes the mark it returned. Scopes nest.
+ */
+size_t env_scratch_begin();
+void env_scratch_end(size_t mark);
+
 Tensor **get_tensors(const Environment *env);
 size_t get_num_tensors(const Environment *env);
 
@@ -34,12 +45,16 @@ Environment *resolve_environ(Tensor *t1, Tensor *t2);
 
 Tensor *tensor_init(ndArray *data, bool requires_grad, Environment *env);
 void free_tensor(Tensor *tensor);
+void tensor_release(Tensor *tensor);
+void tensor_unpack(Tensor *tensor);
+void tensor_repack(Tensor *tensor);
 
 void save_tensor(Tensor *tensor, const char *path);
 Tensor *load_tensor(const char *path, bool requires_grad, Environment *env);
 
 ndArray *get_tensor_data(const Tensor *tensor);
 Tensor *get_tensor_grad(const Tensor *tensor);
+ndArray *get_tensor_tangent(const Tensor *tensor);
 
 bool get_requires_grad(const Tensor *tensor);
 int get_tensor_ndim(const Tensor *tensor);
@@ -48,12 +63,20 @@ DType get_tensor_dtype(const Tensor *tensor);
 Environment *get_tensor_environ(const Tensor *tensor);
 
 BackwardFn *get_backward_fn(const Tensor *tensor);
+bool is_tensor_released(const Tensor *tensor);
+bool is_tensor_saved(const Tensor *tensor);
 
 void set_requires_grad(Tensor *tensor, bool requires_grad);
+void set_tensor_environ(Tensor *tensor, Environment *env);
 
 void replace_tensor_data(Tensor *tensor, ndArray *data);
 void set_tensor_grad(Tensor *tensor, Tensor *grad);
+void set_tensor_tangent(Tensor *tensor, ndArray *tangent);
 void set_backward_fn(Tensor *tensor, BackwardFn *backward_fn);
+void mark_tensor_saved(Tensor *tensor);
+// autocast's per-region cast of a parameter, see `autocast_tensor`
+Tensor *get_autocast_copy(const Tensor *tensor, unsigned long region);
+void set_autocast_copy(Tensor *tensor, Tensor *copy, unsigned long region);
 
 void zero_grad(Tensor *tensor);
 
@@ -82,9 +105,45 @@ Tensor *tensor_transpose(Tensor *tensor, int *dims);
 Tensor *tensor_transpose_env(Tensor *tensor, int *dims, Environment *env);
 Tensor *tensor_matmul(Tensor *t1, Tensor *t2);
 
+Tensor *tensor_to(Tensor *tensor, DType dtype);
+Tensor *tensor_to_env(Tensor *tensor, DType dtype, Environment *env);
+
 Tensor *tensor_max(Tensor *t1, Tensor *t2);
 Tensor *tensor_min(Tensor *t1, Tensor *t2);
 
+// the negative slope must be non-negative for tensors that require grad
+Tensor *tensor_relu(Tensor *tensor);
+Tensor *tensor_leaky_relu(Tensor *tensor, double negative_slope);
+Tensor *tensor_relu6(Tensor *tensor);
+
+Tensor *tensor_gelu(Tensor *tensor);
+Tensor *tensor_silu(Tensor *tensor);
+Tensor *tensor_tanh(Tensor *tensor);
+Tensor *tensor_sigmoid(Tensor *tensor);
+// negative dims count from the end
+Tensor *tensor_softmax(Tensor *tensor, int dim);
+Tensor *tensor_log_softmax(Tensor *tensor, int dim);
+
+// see `array_nll_loss`, class targets never require grad
+Tensor *tensor_nll_loss(Tensor *input, Tensor *target, Reduction reduction);
+Tensor *tensor_cross_entropy(Tensor *logits, Tensor *target,
+                             Reduction reduction);
+Tensor *tensor_mse_loss(Tensor *input, Tensor *target, Reduction reduction);
+Tensor *tensor_bce_with_logits(Tensor *logits, Tensor *target,
+                               Reduction reduction);
+
+// `bias` may be NULL, see `array_conv`
+Tensor *tensor_conv(Tensor *input, Tensor *weight, Tensor *bias,
+                    const ConvParams *params);
+Tensor *tensor_pool(Tensor *tensor, const PoolParams *params);
+/*
+ * `weight`, `bias` and the running statistics may be NULL, see `array_norm`;
+ * batch norm in training updates the running statistics' data in place.
+ */
+Tensor *tensor_norm(Tensor *input, Tensor *weight, Tensor *bias,
+                    Tensor *running_mean, Tensor *running_var,
+                    const NormParams *params);
+
 Tensor *tensor_gt(Tensor *t1, Tensor *t2);
 Tensor *tensor_ge(Tensor *t1, Tensor *t2);
 Tensor *tensor_lt(Tensor *t1, Tensor *t2);
@@ -0,0 +1,110 @@
+#include "amp.h"
+#include "array.h"
+#include "autograd.h"
+#include "capture.h"
+#include "error_codes.h"
+#include "tensor.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+
+typedef struct AutocastState {
+    bool enabled;
+    DType dtype;
+} AutocastState;
+
+static _Thread_local AutocastState autocast_stack[AUTOCAST_MAX_DEPTH];
+static _Thread_local int autocast_depth = 0;
+
+// every outermost region gets its own id, cached casts are valid within it
+static unsigned long num_regions = 0;
+static _Thread_local unsigned long autocast_region = 0;
+
+void autocast_enter(DType dtype, bool enabled) {
+    if (enabled && dtype != DTYPE_BF16 && dtype != DTYPE_HALF)
+        RUNTIME_ERRORF(INVALID_DTYPE,
+                       "Invalid autocast dtype - `%s`, only DTYPE_BF16 and "
+                       "DTYPE_HALF are supported",
+                       DTypeNames[dtype]);
+
+    if (autocast_depth == AUTOCAST_MAX_DEPTH)
+        RUNTIME_ERRORF(INVALID_AUTOCAST_STATE,
+                       "Autocast regions nested deeper than %d",
+                       AUTOCAST_MAX_DEPTH);
+
+    if (autocast_depth == 0) {
+        unsigned long region;
+        _Pragma("omp atomic capture") region = ++num_regions;
+        autocast_region = region;
+    }
+
+    autocast_stack[autocast_depth++] =
+        (AutocastState){.enabled = enabled, .dtype = dtype};
+}
+
+void autocast_exit() {
+    if (autocast_depth == 0)
+        RUNTIME_ERROR(INVALID_AUTOCAST_STATE,
+                      "autocast_exit called outside of an autocast region");
+
+    autocast_depth--;
+}
+
+bool is_autocast_enabled() {
+    return autocast_depth > 0 && autocast_stack[autocast_depth - 1].enabled;
+}
+
+DType get_autocast_dtype() {
+    return autocast_depth > 0 ? autocast_stack[autocast_depth - 1].dtype
+                              : DTYPE_FLOAT;
+}
+
+// parameters, whose casts stay valid while they are not stepped
+static bool _cacheable(const Tensor *tensor) {
+    return is_leaf_tensor(tensor) && get_requires_grad(tensor) &&
+           !get_tensor_tangent(tensor) && !is_inference_mode() &&
+           !is_capturing();
+}
+
+static bool _reusable(const Tensor *copy, DType dtype, Environment *env) {
+    const BackwardFn *backward_fn = get_backward_fn(copy);
+    return get_tensor_dtype(copy) == dtype &&
+           get_tensor_environ(copy) == env &&
+           get_requires_grad(copy) == is_grad_enabled() &&
+           (!backward_fn || !is_backward_fn_released(backward_fn)) &&
+           get_array_data(get_tensor_data(copy));
+}
+
+/*
+ * Parameters are cast once per outermost region and the copy is handed to
+ * every op that reads them, so a weight used by several ops (or several
+ * microbatches) is not re-rounded each time. A parameter updated in place
+ * inside the region keeps its stale copy until the region ends.
+ */
+Tensor *autocast_tensor(Tensor *tensor, Environment *env) {
+    if (!is_autocast_enabled() || get_tensor_dtype(tensor) != DTYPE_FLOAT)
+        return tensor;
+
+    DType dtype = get_autocast_dtype();
+    if (!_cacheable(tensor))
+        return tensor_to_env(tensor, dtype, env);
+
+    Tensor *copy;
+    _Pragma("omp critical(ctorch_autocast_cache)") {
+        copy = get_autocast_copy(tensor, autocast_region);
+        if (!copy || !_reusable(copy, dtype, env)) {
+            copy = tensor_to_env(tensor, dtype, env);
+            set_autocast_copy(tensor, copy, autocast_region);
+        }
+    }
+
+    return copy;
+}
+
+Tensor *autocast_fp32_tensor(Tensor *tensor, Environment *env) {
+    DType dtype = get_tensor_dtype(tensor);
+    if (!is_autocast_enabled() || (dtype != DTYPE_BF16 && dtype != DTYPE_HALF))
+        return tensor;
+
+    return tensor_to_env(tensor, DTYPE_FLOAT, env);
+}
@@ -0,0 +1,119 @@
+#include "amp.h"
+#include "array.h"
+#include "error_codes.h"
+#include "tensor.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+struct GradScaler {
+    float scale;
+    float growth_factor;
+    float backoff_factor;
+    size_t growth_interval;
+
+    size_t growth_tracker; // consecutive steps without overflow
+    bool found_inf;
+};
+
+GradScaler *grad_scaler_init(float init_scale, float growth_factor,
+                             float backoff_factor, size_t growth_interval) {
+    if (init_scale <= 0.0f || growth_factor <= 1.0f ||
+        backoff_factor <= 0.0f || backoff_factor >= 1.0f)
+        RUNTIME_ERROR(GRAD_SCALER_INIT_FAILURE,
+                      "Invalid GradScaler arguments, expected init_scale > 0, "
+                      "growth_factor > 1 and 0 < backoff_factor < 1");
+
+    GradScaler *scaler = malloc(sizeof(GradScaler));
+    if (!scaler)
+        RUNTIME_ERROR(GRAD_SCALER_INIT_FAILURE,
+                      "Failure to allocate GradScaler");
+
+    scaler->scale = init_scale;
+    scaler->growth_factor = growth_factor;
+    scaler->backoff_factor = backoff_factor;
+    scaler->growth_interval = growth_interval;
+
+    scaler->growth_tracker = 0;
+    scaler->found_inf = false;
+
+    return scaler;
+}
+
+void free_grad_scaler(GradScaler *scaler) { free(scaler); }
+
+float get_grad_scale(const GradScaler *scaler) { return scaler->scale; }
+
+static ndArray *_scale_array(double value, DType dtype) {
+    ndArray *array = array_init(0, (const size_t[]){}, dtype);
+
+    ArrayVal val;
+    if (dtype == DTYPE_DOUBLE)
+        val.double_val = value;
+    else
+        val.float_val = (float)value;
+
+    set_value(array, NULL, val);
+    return array;
+}
+
+Tensor *grad_scaler_scale(GradScaler *scaler, Tensor *loss) {
+    DType dtype = get_tensor_dtype(loss);
+    if (dtype == DTYPE_INT || dtype == DTYPE_LONG)
+        RUNTIME_ERRORF(INVALID_DTYPE, "Cannot scale loss with dtype - `%s`",
+                       DTypeNames[dtype]);
+
+    Environment *env = get_tensor_environ(loss);
+    Tensor *scale =
+        tensor_init(_scale_array(scaler->scale, dtype), NO_GRAD, env);
+
+    // the scale is a power of two, keep the multiply in the loss's dtype
+    autocast_enter(dtype, false);
+    Tensor *scaled = tensor_mul(loss, scale);
+    autocast_exit();
+
+    return scaled;
+}
+
+bool grad_scaler_unscale(GradScaler *scaler, size_t num_params,
+                         Tensor **params) {
+    bool found_inf = false;
+    double inv_scale = 1.0 / scaler->scale;
+
+    for (size_t i = 0; i < num_params; i++) {
+        Tensor *grad = get_tensor_grad(params[i]);
+        if (!grad)
+            continue;
+
+        ndArray *data = get_tensor_data(grad);
+        if (!array_all_finite(data))
+            found_inf = true;
+
+        // in place, the gradient may be a view into a flat buffer
+        ndArray *inv = _scale_array(inv_scale, get_dtype(data));
+        if (get_dtype(inv) == get_dtype(data))
+            array_mul_out(data, inv, data);
+        else
+            replace_tensor_data(grad, array_mul(data, inv));
+        free_array(inv);
+    }
+
+    scaler->found_inf = found_inf;
+    return !found_inf;
+}
+
+void grad_scaler_update(GradScaler *scaler) {
+    if (scaler->found_inf) {
+        scaler->scale *= scaler->backoff_factor;
+        scaler->growth_tracker = 0;
+        scaler->found_inf = false;
+        return;
+    }
+
+    if (++scaler->growth_tracker >= scaler->growth_interval) {
+        scaler->scale *= scaler->growth_factor;
+        scaler->growth_tracker = 0;
+    }
+}
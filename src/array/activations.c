@@ -0,0 +1,535 @@
+#include "array.h"
+#include "error_codes.h"
+#include "kernel/half.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef void (*ReluKernel)(const void *src, void *dst, size_t n,
+                           double negative_slope, double cap);
+typedef void (*ReluGradKernel)(const void *grad, const void *out, void *dst,
+                               size_t n, double negative_slope, double cap);
+
+#define _LOAD(x) (x)
+
+// computes in CT, float for the 16-bit types
+#define _RELU_KERNEL(NAME, T, CT, LOAD, STORE)                                 \
+    static void NAME(const void *src, void *dst, size_t n,                     \
+                     double negative_slope, double cap) {                      \
+        const T *A = src;                                                      \
+        T *B = dst;                                                            \
+        const CT slope = (CT)negative_slope, c = (CT)cap;                      \
+        const bool capped = cap > 0;                                           \
+        _Pragma("omp parallel for simd schedule(static)") for (size_t i = 0;   \
+                                                               i < n; i++) {   \
+            CT x = LOAD(A[i]);                                                 \
+            CT y = (x > 0) ? ((capped && x > c) ? c : x) : slope * x;          \
+            B[i] = STORE(y);                                                   \
+        }                                                                      \
+    }
+
+// at zero and at the cap the derivative is taken from the flat side
+#define _RELU_GRAD_KERNEL(NAME, T, CT, LOAD, STORE)                            \
+    static void NAME(const void *grad, const void *out, void *dst, size_t n,   \
+                     double negative_slope, double cap) {                      \
+        const T *G = grad, *Y = out;                                           \
+        T *B = dst;                                                            \
+        const CT slope = (CT)negative_slope, c = (CT)cap;                      \
+        const bool capped = cap > 0;                                           \
+        _Pragma("omp parallel for simd schedule(static)") for (size_t i = 0;   \
+                                                               i < n; i++) {   \
+            CT g = LOAD(G[i]), y = LOAD(Y[i]);                                 \
+            CT dx = (y > 0) ? ((capped && y >= c) ? (CT)0 : g) : slope * g;    \
+            B[i] = STORE(dx);                                                  \
+        }                                                                      \
+    }
+
+#define _STORE_I(x) ((int)(x))
+#define _STORE_L(x) ((long int)(x))
+#define _STORE_F(x) ((float)(x))
+#define _STORE_D(x) ((double)(x))
+
+_RELU_KERNEL(_relu_i, int, double, _LOAD, _STORE_I)
+_RELU_KERNEL(_relu_l, long int, double, _LOAD, _STORE_L)
+_RELU_KERNEL(_relu_f, float, float, _LOAD, _STORE_F)
+_RELU_KERNEL(_relu_d, double, double, _LOAD, _STORE_D)
+_RELU_KERNEL(_relu_bf, uint16_t, float, _bf16_to_float, _float_to_bf16)
+_RELU_KERNEL(_relu_h, uint16_t, float, _half_to_float, _float_to_half)
+
+_RELU_GRAD_KERNEL(_relu_grad_f, float, float, _LOAD, _STORE_F)
+_RELU_GRAD_KERNEL(_relu_grad_d, double, double, _LOAD, _STORE_D)
+_RELU_GRAD_KERNEL(_relu_grad_bf, uint16_t, float, _bf16_to_float,
+                  _float_to_bf16)
+_RELU_GRAD_KERNEL(_relu_grad_h, uint16_t, float, _half_to_float,
+                  _float_to_half)
+
+static const ReluKernel relu_kernels[6] = {
+    [DTYPE_INT] = _relu_i,   [DTYPE_LONG] = _relu_l, [DTYPE_FLOAT] = _relu_f,
+    [DTYPE_DOUBLE] = _relu_d, [DTYPE_BF16] = _relu_bf, [DTYPE_HALF] = _relu_h,
+};
+
+// integer arrays never require grad
+static const ReluGradKernel relu_grad_kernels[6] = {
+    [DTYPE_FLOAT] = _relu_grad_f,
+    [DTYPE_DOUBLE] = _relu_grad_d,
+    [DTYPE_BF16] = _relu_grad_bf,
+    [DTYPE_HALF] = _relu_grad_h,
+};
+
+// like array_cast, the result keeps the source strides over a dense buffer
+ndArray *array_relu(const ndArray *array, double negative_slope, double cap) {
+    ndArray *result = array_init(get_ndim(array), get_shape(array),
+                                 get_dtype(array));
+    set_strides(result, get_strides(array));
+
+    array_relu_out(array, result, negative_slope, cap);
+    return result;
+}
+
+void array_relu_out(const ndArray *array, ndArray *out, double negative_slope,
+                    double cap) {
+    DType dtype = get_dtype(array);
+    size_t total_size = get_total_size(array);
+
+    if (get_dtype(out) != dtype || get_total_size(out) != total_size)
+        RUNTIME_ERROR(SHAPE_MISMATCH,
+                      "Output array does not match the rectifier input");
+
+    relu_kernels[dtype](get_array_data(array), get_array_data(out), total_size,
+                        negative_slope, cap);
+}
+
+/*
+ * The derivative is read off the output: positive outputs below the cap pass
+ * the gradient, the rest scale it by the negative slope. This needs a
+ * non-negative slope, which makes the output's sign the input's.
+ */
+ndArray *array_relu_grad(const ndArray *grad, const ndArray *output,
+                         double negative_slope, double cap) {
+    DType dtype = get_dtype(output);
+    ReluGradKernel kernel = relu_grad_kernels[dtype];
+    if (!kernel || get_dtype(grad) != dtype)
+        RUNTIME_ERRORF(INVALID_DTYPE,
+                       "Invalid rectifier gradient dtype `%s` for output `%s`",
+                       DTypeNames[get_dtype(grad)], DTypeNames[dtype]);
+
+    ndArray *aligned = array_align_layout(grad, output);
+    if (aligned)
+        grad = aligned;
+
+    ndArray *result = array_init(get_ndim(output), get_shape(output), dtype);
+    set_strides(result, get_strides(output));
+
+    kernel(get_array_data(grad), get_array_data(output),
+           get_array_data(result), get_total_size(output), negative_slope,
+           cap);
+
+    if (aligned)
+        free_array(aligned);
+
+    return result;
+}
+
+/*
+ * Smooth activations, each a single pass in CT. tanh is libm's, which keeps
+ * full relative precision near zero where 1 - 2 / (exp(2x) + 1) cancels,
+ * and has vector variants in libmvec. sigmoid clamps its argument where it
+ * has already saturated so exp never overflows. GELU uses the tanh
+ * approximation.
+ */
+#define _ACTIVATION_MATH(M, CT, EXP, TANH, SIGMOID_BOUND)                      \
+    static inline CT _clamp_##M(CT x, CT bound) {                              \
+        return x > bound ? bound : (x < -bound ? -bound : x);                  \
+    }                                                                          \
+    static inline CT _tanh_##M(CT x) { return TANH(x); }                       \
+    static inline CT _sigmoid_##M(CT x) {                                      \
+        return (CT)1 / ((CT)1 + EXP(-_clamp_##M(x, (CT)SIGMOID_BOUND)));       \
+    }                                                                          \
+    static inline CT _silu_##M(CT x) { return x * _sigmoid_##M(x); }           \
+    static inline CT _gelu_##M(CT x) {                                         \
+        CT u = (CT)GELU_K * (x + (CT)GELU_C * x * x * x);                      \
+        return (CT)0.5 * x * ((CT)1 + _tanh_##M(u));                           \
+    }                                                                          \
+    static inline CT _tanh_grad_##M(CT g, CT y) {                              \
+        return g * ((CT)1 - y * y);                                            \
+    }                                                                          \
+    static inline CT _sigmoid_grad_##M(CT g, CT y) {                           \
+        return g * y * ((CT)1 - y);                                            \
+    }                                                                          \
+    static inline CT _silu_grad_##M(CT g, CT x) {                              \
+        CT s = _sigmoid_##M(x);                                                \
+        return g * s * ((CT)1 + x * ((CT)1 - s));                              \
+    }                                                                          \
+    static inline CT _gelu_grad_##M(CT g, CT x) {                              \
+        CT t = _tanh_##M((CT)GELU_K * (x + (CT)GELU_C * x * x * x));           \
+        CT du = (CT)GELU_K * ((CT)1 + (CT)(3 * GELU_C) * x * x);               \
+        return g * (CT)0.5 * ((CT)1 + t + x * ((CT)1 - t * t) * du);           \
+    }
+
+_ACTIVATION_MATH(f, float, expf, tanhf, 80)
+_ACTIVATION_MATH(d, double, exp, tanh, 700)
+
+typedef void (*ActivationKernel)(const void *src, void *dst, size_t n);
+// `saved` is the input or the output, whichever the derivative reads
+typedef void (*ActivationGradKernel)(const void *grad, const void *saved,
+                                     void *dst, size_t n);
+
+#define _ACTIVATION_KERNEL(NAME, T, CT, LOAD, STORE, FN)                       \
+    static void NAME(const void *src, void *dst, size_t n) {                   \
+        const T *A = src;                                                      \
+        T *B = dst;                                                            \
+        _Pragma("omp parallel for simd schedule(static)") for (size_t i = 0;   \
+                                                               i < n; i++) {   \
+            B[i] = STORE(FN(LOAD(A[i])));                                      \
+        }                                                                      \
+    }
+
+#define _ACTIVATION_GRAD_KERNEL(NAME, T, CT, LOAD, STORE, FN)                  \
+    static void NAME(const void *grad, const void *saved, void *dst,           \
+                     size_t n) {                                               \
+        const T *G = grad, *S = saved;                                         \
+        T *B = dst;                                                            \
+        _Pragma("omp parallel for simd schedule(static)") for (size_t i = 0;   \
+                                                               i < n; i++) {   \
+            B[i] = STORE(FN(LOAD(G[i]), LOAD(S[i])));                          \
+        }                                                                      \
+    }
+
+#define _ACTIVATION_KERNELS(S, T, CT, M, LOAD, STORE)                          \
+    _ACTIVATION_KERNEL(_gelu_##S, T, CT, LOAD, STORE, _gelu_##M)               \
+    _ACTIVATION_KERNEL(_silu_##S, T, CT, LOAD, STORE, _silu_##M)               \
+    _ACTIVATION_KERNEL(_tanh_##S, T, CT, LOAD, STORE, _tanh_##M)               \
+    _ACTIVATION_KERNEL(_sigmoid_##S, T, CT, LOAD, STORE, _sigmoid_##M)         \
+    _ACTIVATION_GRAD_KERNEL(_gelu_grad_##S, T, CT, LOAD, STORE,                \
+                            _gelu_grad_##M)                                    \
+    _ACTIVATION_GRAD_KERNEL(_silu_grad_##S, T, CT, LOAD, STORE,                \
+                            _silu_grad_##M)                                    \
+    _ACTIVATION_GRAD_KERNEL(_tanh_grad_##S, T, CT, LOAD, STORE,                \
+                            _tanh_grad_##M)                                    \
+    _ACTIVATION_GRAD_KERNEL(_sigmoid_grad_##S, T, CT, LOAD, STORE,             \
+                            _sigmoid_grad_##M)
+
+_ACTIVATION_KERNELS(F, float, float, f, _LOAD, _STORE_F)
+_ACTIVATION_KERNELS(D, double, double, d, _LOAD, _STORE_D)
+_ACTIVATION_KERNELS(BF, uint16_t, float, f, _bf16_to_float, _float_to_bf16)
+_ACTIVATION_KERNELS(H, uint16_t, float, f, _half_to_float, _float_to_half)
+
+// floating point dtypes only, indexed by ActivationKind then DType
+static const ActivationKernel activation_kernels[4][6] = {
+    [ACTIVATION_GELU] = {[DTYPE_FLOAT] = _gelu_F, [DTYPE_DOUBLE] = _gelu_D,
+                         [DTYPE_BF16] = _gelu_BF, [DTYPE_HALF] = _gelu_H},
+    [ACTIVATION_SILU] = {[DTYPE_FLOAT] = _silu_F, [DTYPE_DOUBLE] = _silu_D,
+                         [DTYPE_BF16] = _silu_BF, [DTYPE_HALF] = _silu_H},
+    [ACTIVATION_TANH] = {[DTYPE_FLOAT] = _tanh_F, [DTYPE_DOUBLE] = _tanh_D,
+                         [DTYPE_BF16] = _tanh_BF, [DTYPE_HALF] = _tanh_H},
+    [ACTIVATION_SIGMOID] = {[DTYPE_FLOAT] = _sigmoid_F,
+                            [DTYPE_DOUBLE] = _sigmoid_D,
+                            [DTYPE_BF16] = _sigmoid_BF,
+                            [DTYPE_HALF] = _sigmoid_H},
+};
+
+static const ActivationGradKernel activation_grad_kernels[4][6] = {
+    [ACTIVATION_GELU] = {[DTYPE_FLOAT] = _gelu_grad_F,
+                         [DTYPE_DOUBLE] = _gelu_grad_D,
+                         [DTYPE_BF16] = _gelu_grad_BF,
+                         [DTYPE_HALF] = _gelu_grad_H},
+    [ACTIVATION_SILU] = {[DTYPE_FLOAT] = _silu_grad_F,
+                         [DTYPE_DOUBLE] = _silu_grad_D,
+                         [DTYPE_BF16] = _silu_grad_BF,
+                         [DTYPE_HALF] = _silu_grad_H},
+    [ACTIVATION_TANH] = {[DTYPE_FLOAT] = _tanh_grad_F,
+                         [DTYPE_DOUBLE] = _tanh_grad_D,
+                         [DTYPE_BF16] = _tanh_grad_BF,
+                         [DTYPE_HALF] = _tanh_grad_H},
+    [ACTIVATION_SIGMOID] = {[DTYPE_FLOAT] = _sigmoid_grad_F,
+                            [DTYPE_DOUBLE] = _sigmoid_grad_D,
+                            [DTYPE_BF16] = _sigmoid_grad_BF,
+                            [DTYPE_HALF] = _sigmoid_grad_H},
+};
+
+static const char *ActivationNames[] = {"GELU", "SiLU", "Tanh", "Sigmoid"};
+
+static ActivationKernel _activation_kernel(ActivationKind kind, DType dtype) {
+    ActivationKernel kernel = activation_kernels[kind][dtype];
+    if (!kernel)
+        RUNTIME_ERRORF(INVALID_DTYPE, "Invalid dtype `%s` for %s",
+                       DTypeNames[dtype], ActivationNames[kind]);
+
+    return kernel;
+}
+
+bool activation_reads_output(ActivationKind kind) {
+    return kind == ACTIVATION_TANH || kind == ACTIVATION_SIGMOID;
+}
+
+ndArray *array_activation(const ndArray *array, ActivationKind kind) {
+    ndArray *result = array_init(get_ndim(array), get_shape(array),
+                                 get_dtype(array));
+    set_strides(result, get_strides(array));
+
+    array_activation_out(array, result, kind);
+    return result;
+}
+
+void array_activation_out(const ndArray *array, ndArray *out,
+                          ActivationKind kind) {
+    DType dtype = get_dtype(array);
+    size_t total_size = get_total_size(array);
+
+    if (get_dtype(out) != dtype || get_total_size(out) != total_size)
+        RUNTIME_ERRORF(SHAPE_MISMATCH,
+                       "Output array does not match the %s input",
+                       ActivationNames[kind]);
+
+    _activation_kernel(kind, dtype)(get_array_data(array), get_array_data(out),
+                                    total_size);
+}
+
+ndArray *array_activation_grad(const ndArray *grad, const ndArray *saved,
+                               ActivationKind kind) {
+    DType dtype = get_dtype(saved);
+    ActivationGradKernel kernel = activation_grad_kernels[kind][dtype];
+    if (!kernel || get_dtype(grad) != dtype)
+        RUNTIME_ERRORF(INVALID_DTYPE,
+                       "Invalid %s gradient dtype `%s` for `%s`",
+                       ActivationNames[kind], DTypeNames[get_dtype(grad)],
+                       DTypeNames[dtype]);
+
+    ndArray *aligned = array_align_layout(grad, saved);
+    if (aligned)
+        grad = aligned;
+
+    ndArray *result = array_init(get_ndim(saved), get_shape(saved), dtype);
+    set_strides(result, get_strides(saved));
+
+    kernel(get_array_data(grad), get_array_data(saved), get_array_data(result),
+           get_total_size(saved));
+
+    if (aligned)
+        free_array(aligned);
+
+    return result;
+}
+
+/*
+ * Softmax runs over lines along `dim`: `bases` holds the element offset of
+ * every line's first element and `step` the distance between its elements,
+ * so any layout is read in place. One pass keeps a running max and the sum
+ * of exponentials shifted by it, rescaling the sum whenever the max grows,
+ * and a second writes them normalized.
+ */
+typedef void (*SoftmaxKernel)(const void *src, void *dst, size_t num_lines,
+                              const size_t *bases, size_t n, size_t step,
+                              bool log_space);
+typedef void (*SoftmaxGradKernel)(const void *grad, const void *out,
+                                  void *dst, size_t num_lines,
+                                  const size_t *bases, size_t n, size_t step,
+                                  bool log_space, bool jvp);
+
+#define _SOFTMAX_KERNEL(NAME, T, CT, LOAD, STORE, EXP, LOG)                    \
+    static void NAME(const void *src, void *dst, size_t num_lines,             \
+                     const size_t *bases, size_t n, size_t step,               \
+                     bool log_space) {                                         \
+        const T *A = src;                                                      \
+        T *B = dst;                                                            \
+        _Pragma("omp parallel for schedule(static)") for (size_t l = 0;        \
+                                                          l < num_lines;       \
+                                                          l++) {               \
+            const T *a = A + bases[l];                                         \
+            T *b = B + bases[l];                                               \
+                                                                               \
+            CT max = LOAD(a[0]), sum = 1;                                      \
+            for (size_t j = 1; j < n; j++) {                                   \
+                CT x = LOAD(a[j * step]);                                      \
+                if (x > max) {                                                 \
+                    sum = sum * EXP(max - x) + (CT)1;                          \
+                    max = x;                                                   \
+                } else {                                                       \
+                    sum += EXP(x - max);                                       \
+                }                                                              \
+            }                                                                  \
+                                                                               \
+            if (log_space) {                                                   \
+                CT lse = max + LOG(sum);                                       \
+                for (size_t j = 0; j < n; j++)                                 \
+                    b[j * step] = STORE(LOAD(a[j * step]) - lse);              \
+            } else {                                                           \
+                CT inv = (CT)1 / sum;                                          \
+                for (size_t j = 0; j < n; j++)                                 \
+                    b[j * step] = STORE(EXP(LOAD(a[j * step]) - max) * inv);   \
+            }                                                                  \
+        }                                                                      \
+    }
+
+/*
+ * Softmax's Jacobian diag(y) - y y^T is symmetric, both products are
+ * y * (g - <g, y>). LogSoftmax's is I - 1 exp(y)^T, so the vector-Jacobian
+ * product is g - exp(y) * sum(g) and the Jacobian-vector one
+ * g - <g, exp(y)>.
+ */
+#define _SOFTMAX_GRAD_KERNEL(NAME, T, CT, LOAD, STORE, EXP)                    \
+    static void NAME(const void *grad, const void *out, void *dst,             \
+                     size_t num_lines, const size_t *bases, size_t n,          \
+                     size_t step, bool log_space, bool jvp) {                  \
+        const T *G = grad, *Y = out;                                           \
+        T *B = dst;                                                            \
+        _Pragma("omp parallel for schedule(static)") for (size_t l = 0;        \
+                                                          l < num_lines;       \
+                                                          l++) {               \
+            const T *g = G + bases[l], *y = Y + bases[l];                      \
+            T *b = B + bases[l];                                               \
+                                                                               \
+            CT dot = 0;                                                        \
+            for (size_t j = 0; j < n; j++) {                                   \
+                CT gj = LOAD(g[j * step]), yj = LOAD(y[j * step]);             \
+                dot += log_space ? (jvp ? gj * EXP(yj) : gj) : gj * yj;        \
+            }                                                                  \
+            for (size_t j = 0; j < n; j++) {                                   \
+                CT gj = LOAD(g[j * step]), yj = LOAD(y[j * step]);             \
+                CT dx = log_space ? gj - (jvp ? dot : EXP(yj) * dot)           \
+                                  : yj * (gj - dot);                           \
+                b[j * step] = STORE(dx);                                       \
+            }                                                                  \
+        }                                                                      \
+    }
+
+_SOFTMAX_KERNEL(_softmax_f, float, float, _LOAD, _STORE_F, expf, logf)
+_SOFTMAX_KERNEL(_softmax_d, double, double, _LOAD, _STORE_D, exp, log)
+_SOFTMAX_KERNEL(_softmax_bf, uint16_t, float, _bf16_to_float, _float_to_bf16,
+                expf, logf)
+_SOFTMAX_KERNEL(_softmax_h, uint16_t, float, _half_to_float, _float_to_half,
+                expf, logf)
+
+_SOFTMAX_GRAD_KERNEL(_softmax_grad_f, float, float, _LOAD, _STORE_F, expf)
+_SOFTMAX_GRAD_KERNEL(_softmax_grad_d, double, double, _LOAD, _STORE_D, exp)
+_SOFTMAX_GRAD_KERNEL(_softmax_grad_bf, uint16_t, float, _bf16_to_float,
+                     _float_to_bf16, expf)
+_SOFTMAX_GRAD_KERNEL(_softmax_grad_h, uint16_t, float, _half_to_float,
+                     _float_to_half, expf)
+
+static const SoftmaxKernel softmax_kernels[6] = {
+    [DTYPE_FLOAT] = _softmax_f,
+    [DTYPE_DOUBLE] = _softmax_d,
+    [DTYPE_BF16] = _softmax_bf,
+    [DTYPE_HALF] = _softmax_h,
+};
+
+static const SoftmaxGradKernel softmax_grad_kernels[6] = {
+    [DTYPE_FLOAT] = _softmax_grad_f,
+    [DTYPE_DOUBLE] = _softmax_grad_d,
+    [DTYPE_BF16] = _softmax_grad_bf,
+    [DTYPE_HALF] = _softmax_grad_h,
+};
+
+int softmax_dim(const ndArray *array, int dim) {
+    int ndim = get_ndim(array);
+    if (dim < -ndim || dim >= ndim || ndim == 0)
+        RUNTIME_ERRORF(INVALID_DIM, "Invalid softmax dim %d for ndim %d", dim,
+                       ndim);
+
+    return dim < 0 ? dim + ndim : dim;
+}
+
+// the caller frees the returned offsets
+static size_t *_line_bases(const ndArray *array, int dim, size_t *num_lines,
+                           size_t *step) {
+    int ndim = get_ndim(array);
+    const size_t *shape = get_shape(array), *strides = get_strides(array);
+    size_t itemsize = get_itemsize(array);
+
+    *num_lines = get_total_size(array) / shape[dim];
+    *step = strides[dim] / itemsize;
+
+    size_t *bases = malloc((*num_lines ? *num_lines : 1) * sizeof(size_t));
+    if (!bases)
+        RUNTIME_ERROR(ARRAY_INIT_FAILURE, "Failed to allocate softmax lines");
+
+    for (size_t l = 0; l < *num_lines; l++) {
+        size_t tmp = l, base = 0;
+        for (int d = ndim - 1; d >= 0; d--) {
+            if (d == dim)
+                continue;
+
+            base += (tmp % shape[d]) * (strides[d] / itemsize);
+            tmp /= shape[d];
+        }
+        bases[l] = base;
+    }
+
+    return bases;
+}
+
+ndArray *array_softmax(const ndArray *array, int dim, bool log_space) {
+    ndArray *result = array_init(get_ndim(array), get_shape(array),
+                                 get_dtype(array));
+    set_strides(result, get_strides(array));
+
+    array_softmax_out(array, result, dim, log_space);
+    return result;
+}
+
+void array_softmax_out(const ndArray *array, ndArray *out, int dim,
+                       bool log_space) {
+    DType dtype = get_dtype(array);
+    SoftmaxKernel kernel = softmax_kernels[dtype];
+    if (!kernel)
+        RUNTIME_ERRORF(INVALID_DTYPE, "Invalid dtype `%s` for softmax",
+                       DTypeNames[dtype]);
+    if (!same_layout(array, out) || get_dtype(out) != dtype)
+        RUNTIME_ERROR(SHAPE_MISMATCH,
+                      "Output array does not match the softmax input");
+
+    dim = softmax_dim(array, dim);
+    size_t num_lines, step;
+    size_t *bases = _line_bases(array, dim, &num_lines, &step);
+
+    kernel(get_array_data(array), get_array_data(out), num_lines, bases,
+           get_shape(array)[dim], step, log_space);
+    free(bases);
+}
+
+static ndArray *_softmax_product(const ndArray *vector, const ndArray *output,
+                                 int dim, bool log_space, bool jvp) {
+    DType dtype = get_dtype(output);
+    SoftmaxGradKernel kernel = softmax_grad_kernels[dtype];
+    if (!kernel || get_dtype(vector) != dtype)
+        RUNTIME_ERRORF(INVALID_DTYPE,
+                       "Invalid softmax gradient dtype `%s` for `%s`",
+                       DTypeNames[get_dtype(vector)], DTypeNames[dtype]);
+
+    ndArray *aligned = array_align_layout(vector, output);
+    if (aligned)
+        vector = aligned;
+
+    ndArray *result = array_init(get_ndim(output), get_shape(output), dtype);
+    set_strides(result, get_strides(output));
+
+    dim = softmax_dim(output, dim);
+    size_t num_lines, step;
+    size_t *bases = _line_bases(output, dim, &num_lines, &step);
+
+    kernel(get_array_data(vector), get_array_data(output),
+           get_array_data(result), num_lines, bases, get_shape(output)[dim],
+           step, log_space, jvp);
+
+    free(bases);
+    if (aligned)
+        free_array(aligned);
+
+    return result;
+}
+
+ndArray *array_softmax_grad(const ndArray *grad, const ndArray *output,
+                            int dim, bool log_space) {
+    return _softmax_product(grad, output, dim, log_space, false);
+}
+
+ndArray *array_softmax_jvp(const ndArray *tangent, const ndArray *output,
+                           int dim, bool log_space) {
+    return _softmax_product(tangent, output, dim, log_space, true);
+}
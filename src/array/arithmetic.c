@@ -1,7 +1,9 @@
 #include "array.h"
 #include "error_codes.h"
+#include "kernel/half.h"
 
 #include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -26,6 +28,32 @@
         }                                                                      \
     }
 
+/*
+ * 16-bit float kernels widen both operands to fp32, apply `OP` and round the
+ * result back on store.
+ */
+#define _ARRAY_OP_16(NAME, OP, LOAD, STORE)                                    \
+    static void NAME(const uint16_t *A, const uint16_t *B, uint16_t *C,        \
+                     const size_t *sA, const size_t *sB, const size_t *sC,     \
+                     int ndim, size_t total_size, const size_t *shapeC) {      \
+        _Pragma("omp parallel for schedule(static)") for (size_t i = 0;        \
+                                                          i < total_size;      \
+                                                          i++) {               \
+            size_t tmp = i;                                                    \
+            size_t offsetA = 0, offsetB = 0, offsetC = 0;                      \
+            for (int d = ndim - 1; d >= 0; d--) {                              \
+                size_t idx = tmp % shapeC[d];                                  \
+                tmp /= shapeC[d];                                              \
+                                                                               \
+                offsetA += idx * sA[d];                                        \
+                offsetB += idx * sB[d];                                        \
+                offsetC += idx * sC[d];                                        \
+            }                                                                  \
+            float a = LOAD(A[offsetA]), b = LOAD(B[offsetB]);                  \
+            C[offsetC] = STORE(OP(a, b));                                      \
+        }                                                                      \
+    }
+
 #define OP_ADD(a, b) ((a) + (b))
 #define OP_SUB(a, b) ((a) - (b))
 #define OP_MUL(a, b) ((a) * (b))
@@ -37,31 +65,43 @@ _ARRAY_OP(int, _array_add_i, OP_ADD)
 _ARRAY_OP(float, _array_add_f, OP_ADD)
 _ARRAY_OP(double, _array_add_d, OP_ADD)
 _ARRAY_OP(long int, _array_add_l, OP_ADD)
+_ARRAY_OP_16(_array_add_bf, OP_ADD, _bf16_to_float, _float_to_bf16)
+_ARRAY_OP_16(_array_add_h, OP_ADD, _half_to_float, _float_to_half)
 
 _ARRAY_OP(int, _array_sub_i, OP_SUB)
 _ARRAY_OP(float, _array_sub_f, OP_SUB)
 _ARRAY_OP(double, _array_sub_d, OP_SUB)
 _ARRAY_OP(long int, _array_sub_l, OP_SUB)
+_ARRAY_OP_16(_array_sub_bf, OP_SUB, _bf16_to_float, _float_to_bf16)
+_ARRAY_OP_16(_array_sub_h, OP_SUB, _half_to_float, _float_to_half)
 
 _ARRAY_OP(int, _array_mul_i, OP_MUL)
 _ARRAY_OP(float, _array_mul_f, OP_MUL)
 _ARRAY_OP(double, _array_mul_d, OP_MUL)
 _ARRAY_OP(long int, _array_mul_l, OP_MUL)
+_ARRAY_OP_16(_array_mul_bf, OP_MUL, _bf16_to_float, _float_to_bf16)
+_ARRAY_OP_16(_array_mul_h, OP_MUL, _half_to_float, _float_to_half)
 
 _ARRAY_OP(int, _array_div_i, OP_DIV)
 _ARRAY_OP(float, _array_div_f, OP_DIV)
 _ARRAY_OP(double, _array_div_d, OP_DIV)
 _ARRAY_OP(long int, _array_div_l, OP_DIV)
+_ARRAY_OP_16(_array_div_bf, OP_DIV, _bf16_to_float, _float_to_bf16)
+_ARRAY_OP_16(_array_div_h, OP_DIV, _half_to_float, _float_to_half)
 
 _ARRAY_OP(int, _array_max_i, OP_MAX)
 _ARRAY_OP(float, _array_max_f, OP_MAX)
 _ARRAY_OP(double, _array_max_d, OP_MAX)
 _ARRAY_OP(long int, _array_max_l, OP_MAX)
+_ARRAY_OP_16(_array_max_bf, OP_MAX, _bf16_to_float, _float_to_bf16)
+_ARRAY_OP_16(_array_max_h, OP_MAX, _half_to_float, _float_to_half)
 
 _ARRAY_OP(int, _array_min_i, OP_MIN)
 _ARRAY_OP(float, _array_min_f, OP_MIN)
 _ARRAY_OP(double, _array_min_d, OP_MIN)
 _ARRAY_OP(long int, _array_min_l, OP_MIN)
+_ARRAY_OP_16(_array_min_bf, OP_MIN, _bf16_to_float, _float_to_bf16)
+_ARRAY_OP_16(_array_min_h, OP_MIN, _half_to_float, _float_to_half)
 
 #define CAT(a, b) a##b
 
@@ -98,27 +138,167 @@ _ARRAY_OP(long int, _array_min_l, OP_MIN)
                           total_size, shape);                                  \
             break;                                                             \
         }                                                                      \
+        case DTYPE_BF16: {                                                     \
+            const uint16_t *A = get_array_data(arr1),                          \
+                           *B = get_array_data(arr2);                          \
+            uint16_t *C = get_array_data(result);                              \
+            CAT(func, _bf)(A, B, C, b_strides1, b_strides2, strides, ndim,     \
+                           total_size, shape);                                 \
+            break;                                                             \
+        }                                                                      \
+        case DTYPE_HALF: {                                                     \
+            const uint16_t *A = get_array_data(arr1),                          \
+                           *B = get_array_data(arr2);                          \
+            uint16_t *C = get_array_data(result);                              \
+            CAT(func, _h)(A, B, C, b_strides1, b_strides2, strides, ndim,      \
+                          total_size, shape);                                  \
+            break;                                                             \
+        }                                                                      \
         }                                                                      \
     } while (0);
 
-static ndArray *array_binary_op(ndArray *arr1, ndArray *arr2,
-                                void (*dispatch)(DType, ndArray *, ndArray *,
-                                                 ndArray *, size_t *, size_t *,
-                                                 size_t *, int, size_t,
-                                                 size_t *)) {
+/*
+ * Integer/floating kernels convert the integer operand on load, so promoting
+ * an int or long operand never materializes a converted copy.
+ */
+#define _ARRAY_OP_MIXED(TA, TB, TC, NAME, OP)                                  \
+    static void NAME(const void *A_, const void *B_, void *C_,                 \
+                     const size_t *sA, const size_t *sB, const size_t *sC,     \
+                     int ndim, size_t total_size, const size_t *shapeC) {      \
+        const TA *A = A_;                                                      \
+        const TB *B = B_;                                                      \
+        TC *C = C_;                                                            \
+        _Pragma("omp parallel for schedule(static)") for (size_t i = 0;        \
+                                                          i < total_size;      \
+                                                          i++) {               \
+            size_t tmp = i;                                                    \
+            size_t offsetA = 0, offsetB = 0, offsetC = 0;                      \
+            for (int d = ndim - 1; d >= 0; d--) {                              \
+                size_t idx = tmp % shapeC[d];                                  \
+                tmp /= shapeC[d];                                              \
+                                                                               \
+                offsetA += idx * sA[d];                                        \
+                offsetB += idx * sB[d];                                        \
+                offsetC += idx * sC[d];                                        \
+            }                                                                  \
+            C[offsetC] = OP((TC)A[offsetA], (TC)B[offsetB]);                   \
+        }                                                                      \
+    }
+
+#define _ARRAY_OP_MIXED_ALL(NAME, OP)                                          \
+    _ARRAY_OP_MIXED(int, float, float, CAT(NAME, _if), OP)                     \
+    _ARRAY_OP_MIXED(float, int, float, CAT(NAME, _fi), OP)                     \
+    _ARRAY_OP_MIXED(int, double, double, CAT(NAME, _id), OP)                   \
+    _ARRAY_OP_MIXED(double, int, double, CAT(NAME, _di), OP)                   \
+    _ARRAY_OP_MIXED(long int, float, float, CAT(NAME, _lf), OP)                \
+    _ARRAY_OP_MIXED(float, long int, float, CAT(NAME, _fl), OP)                \
+    _ARRAY_OP_MIXED(long int, double, double, CAT(NAME, _ld), OP)              \
+    _ARRAY_OP_MIXED(double, long int, double, CAT(NAME, _dl), OP)
+
+_ARRAY_OP_MIXED_ALL(_array_add, OP_ADD)
+_ARRAY_OP_MIXED_ALL(_array_sub, OP_SUB)
+_ARRAY_OP_MIXED_ALL(_array_mul, OP_MUL)
+_ARRAY_OP_MIXED_ALL(_array_div, OP_DIV)
+_ARRAY_OP_MIXED_ALL(_array_max, OP_MAX)
+_ARRAY_OP_MIXED_ALL(_array_min, OP_MIN)
+
+#define DTYPE_PAIR(d1, d2) ((d1) * 8 + (d2))
+
+#define MIXED_CASE(d1, d2, func, suffix)                                       \
+    case DTYPE_PAIR(d1, d2):                                                   \
+        CAT(func, suffix)(A, B, C, s1, s2, sc, n, ts, sh);                     \
+        break;
+
+#define DEFINE_MIXED_DISPATCH_FUNC(name, kernel)                               \
+    static inline void dispatch_mixed_##name(                                  \
+        DType d1, DType d2, ndArray *a, ndArray *b, ndArray *c, size_t *s1,    \
+        size_t *s2, size_t *sc, int n, size_t ts, size_t *sh) {                \
+        const void *A = get_array_data(a), *B = get_array_data(b);             \
+        void *C = get_array_data(c);                                           \
+        switch (DTYPE_PAIR(d1, d2)) {                                          \
+            MIXED_CASE(DTYPE_INT, DTYPE_FLOAT, kernel, _if)                    \
+            MIXED_CASE(DTYPE_FLOAT, DTYPE_INT, kernel, _fi)                    \
+            MIXED_CASE(DTYPE_INT, DTYPE_DOUBLE, kernel, _id)                   \
+            MIXED_CASE(DTYPE_DOUBLE, DTYPE_INT, kernel, _di)                   \
+            MIXED_CASE(DTYPE_LONG, DTYPE_FLOAT, kernel, _lf)                   \
+            MIXED_CASE(DTYPE_FLOAT, DTYPE_LONG, kernel, _fl)                   \
+            MIXED_CASE(DTYPE_LONG, DTYPE_DOUBLE, kernel, _ld)                  \
+            MIXED_CASE(DTYPE_DOUBLE, DTYPE_LONG, kernel, _dl)                  \
+        default:                                                               \
+            break;                                                             \
+        }                                                                      \
+    }
+
+DEFINE_MIXED_DISPATCH_FUNC(add, _array_add)
+DEFINE_MIXED_DISPATCH_FUNC(sub, _array_sub)
+DEFINE_MIXED_DISPATCH_FUNC(mul, _array_mul)
+DEFINE_MIXED_DISPATCH_FUNC(div, _array_div)
+DEFINE_MIXED_DISPATCH_FUNC(max, _array_max)
+DEFINE_MIXED_DISPATCH_FUNC(min, _array_min)
+
+typedef void (*DispatchFn)(DType, ndArray *, ndArray *, ndArray *, size_t *,
+                           size_t *, size_t *, int, size_t, size_t *);
+typedef void (*MixedDispatchFn)(DType, DType, ndArray *, ndArray *, ndArray *,
+                                size_t *, size_t *, size_t *, int, size_t,
+                                size_t *);
+
+static inline bool _has_mixed_kernel(DType dtype1, DType dtype2) {
+    bool int1 = dtype1 == DTYPE_INT || dtype1 == DTYPE_LONG,
+         int2 = dtype2 == DTYPE_INT || dtype2 == DTYPE_LONG;
+    bool float1 = dtype1 == DTYPE_FLOAT || dtype1 == DTYPE_DOUBLE,
+         float2 = dtype2 == DTYPE_FLOAT || dtype2 == DTYPE_DOUBLE;
+
+    return (int1 && float2) || (float1 && int2);
+}
+
+// `out` must already have the broadcast shape and the result dtype
+static void _check_out(const ndArray *out, int ndim, const size_t *shape,
+                       DType dtype) {
+    bool match = get_ndim(out) == ndim && get_dtype(out) == dtype;
+    for (int d = 0; match && d < ndim; d++)
+        match = get_shape(out)[d] == shape[d];
+
+    if (!match)
+        RUNTIME_ERROR(SHAPE_MISMATCH,
+                      "Output array does not match the result shape or dtype");
+}
+
+/*
+ * With dtype promotion enabled, mismatched operands run through a mixed
+ * kernel when one exists; otherwise the operand of lower dtype is cast once
+ * before the same-dtype kernel runs. The result is written to `out` when
+ * given instead of a freshly allocated array.
+ */
+static ndArray *array_binary_op(ndArray *arr1, ndArray *arr2, ndArray *out,
+                                DispatchFn dispatch,
+                                MixedDispatchFn mixed_dispatch) {
     int ndim1 = get_ndim(arr1), ndim2 = get_ndim(arr2);
     int ndim = (ndim1 > ndim2) ? ndim1 : ndim2;
 
     DType dtype1 = get_dtype(arr1), dtype2 = get_dtype(arr2), dtype;
-    if (dtype1 != dtype2)
+    if (dtype1 != dtype2 && !get_dtype_promotion())
         RUNTIME_ERRORF(INVALID_DTYPE, "Dtype mismatch `%s` and `%s`",
                        DTypeNames[dtype1], DTypeNames[dtype2]);
-    dtype = dtype1;
+    dtype = promote_types(dtype1, dtype2);
+
+    ndArray *cast1 = NULL, *cast2 = NULL;
+    bool mixed = mixed_dispatch && _has_mixed_kernel(dtype1, dtype2);
+    if (dtype1 != dtype2 && !mixed) {
+        if (dtype1 != dtype)
+            arr1 = cast1 = array_cast(arr1, dtype);
+        if (dtype2 != dtype)
+            arr2 = cast2 = array_cast(arr2, dtype);
+    }
 
     size_t *shape1 = get_shape(arr1), *shape2 = get_shape(arr2);
     size_t shape[ndim];
     broadcast_shape(shape1, shape2, shape, ndim1, ndim2, ndim);
-    ndArray *result = array_init(ndim, shape, dtype);
+
+    ndArray *result = out;
+    if (out)
+        _check_out(out, ndim, shape, dtype);
+    else
+        result = array_init(ndim, shape, dtype);
 
     size_t *strides1 = get_strides(arr1), *strides2 = get_strides(arr2);
     const size_t *strides = get_strides(result);
@@ -129,16 +309,26 @@ static ndArray *array_binary_op(ndArray *arr1, ndArray *arr2,
     broadcasted_strides(b_strides2, strides2, shape2, ndim2, shape, ndim);
 
     size_t total_size = get_total_size(result);
-    size_t itemsize = get_itemsize(result);
+    size_t itemsize1 = get_itemsize(arr1), itemsize2 = get_itemsize(arr2),
+           itemsize = get_itemsize(result);
 
     for (int i = 0; i < ndim; i++) {
-        b_strides1[i] /= itemsize;
-        b_strides2[i] /= itemsize;
+        b_strides1[i] /= itemsize1;
+        b_strides2[i] /= itemsize2;
         sC[i] = strides[i] / itemsize;
     }
 
-    dispatch(dtype, arr1, arr2, result, b_strides1, b_strides2, sC, ndim,
-             total_size, shape);
+    if (mixed)
+        mixed_dispatch(dtype1, dtype2, arr1, arr2, result, b_strides1,
+                       b_strides2, sC, ndim, total_size, shape);
+    else
+        dispatch(dtype, arr1, arr2, result, b_strides1, b_strides2, sC, ndim,
+                 total_size, shape);
+
+    if (cast1)
+        free_array(cast1);
+    if (cast2)
+        free_array(cast2);
 
     return result;
 }
@@ -158,27 +348,57 @@ DEFINE_DISPATCH_FUNC(max, _array_max)
 DEFINE_DISPATCH_FUNC(min, _array_min)
 
 ndArray *array_add(ndArray *arr1, ndArray *arr2) {
-    return array_binary_op(arr1, arr2, dispatch_add);
+    return array_binary_op(arr1, arr2, NULL, dispatch_add,
+                           dispatch_mixed_add);
+}
+
+void array_add_out(ndArray *arr1, ndArray *arr2, ndArray *out) {
+    array_binary_op(arr1, arr2, out, dispatch_add, dispatch_mixed_add);
 }
 
 ndArray *array_sub(ndArray *arr1, ndArray *arr2) {
-    return array_binary_op(arr1, arr2, dispatch_sub);
+    return array_binary_op(arr1, arr2, NULL, dispatch_sub,
+                           dispatch_mixed_sub);
+}
+
+void array_sub_out(ndArray *arr1, ndArray *arr2, ndArray *out) {
+    array_binary_op(arr1, arr2, out, dispatch_sub, dispatch_mixed_sub);
 }
 
 ndArray *array_mul(ndArray *arr1, ndArray *arr2) {
-    return array_binary_op(arr1, arr2, dispatch_mul);
+    return array_binary_op(arr1, arr2, NULL, dispatch_mul,
+                           dispatch_mixed_mul);
+}
+
+void array_mul_out(ndArray *arr1, ndArray *arr2, ndArray *out) {
+    array_binary_op(arr1, arr2, out, dispatch_mul, dispatch_mixed_mul);
 }
 
 ndArray *array_div(ndArray *arr1, ndArray *arr2) {
-    return array_binary_op(arr1, arr2, dispatch_div);
+    return array_binary_op(arr1, arr2, NULL, dispatch_div,
+                           dispatch_mixed_div);
+}
+
+void array_div_out(ndArray *arr1, ndArray *arr2, ndArray *out) {
+    array_binary_op(arr1, arr2, out, dispatch_div, dispatch_mixed_div);
 }
 
 ndArray *array_max(ndArray *arr1, ndArray *arr2) {
-    return array_binary_op(arr1, arr2, dispatch_max);
+    return array_binary_op(arr1, arr2, NULL, dispatch_max,
+                           dispatch_mixed_max);
+}
+
+void array_max_out(ndArray *arr1, ndArray *arr2, ndArray *out) {
+    array_binary_op(arr1, arr2, out, dispatch_max, dispatch_mixed_max);
 }
 
 ndArray *array_min(ndArray *arr1, ndArray *arr2) {
-    return array_binary_op(arr1, arr2, dispatch_min);
+    return array_binary_op(arr1, arr2, NULL, dispatch_min,
+                           dispatch_mixed_min);
+}
+
+void array_min_out(ndArray *arr1, ndArray *arr2, ndArray *out) {
+    array_binary_op(arr1, arr2, out, dispatch_min, dispatch_mixed_min);
 }
 
 #define _ARRAY_CMP(T, NAME, OP)                                                \
@@ -201,30 +421,61 @@ ndArray *array_min(ndArray *arr1, ndArray *arr2) {
         }                                                                      \
     }
 
+#define _ARRAY_CMP_16(NAME, OP, LOAD, STORE)                                   \
+    static void NAME(const uint16_t *A, const uint16_t *B, uint16_t *C,        \
+                     const size_t *sA, const size_t *sB, const size_t *sC,     \
+                     int ndim, size_t total_size, const size_t *shapeC) {      \
+        const uint16_t one = STORE(1.0f), zero = STORE(0.0f);                  \
+        _Pragma("omp parallel for schedule(static)") for (size_t i = 0;        \
+                                                          i < total_size;      \
+                                                          i++) {               \
+            size_t tmp = i;                                                    \
+            size_t offsetA = 0, offsetB = 0, offsetC = 0;                      \
+            for (int d = ndim - 1; d >= 0; d--) {                              \
+                size_t idx = tmp % shapeC[d];                                  \
+                tmp /= shapeC[d];                                              \
+                offsetA += idx * sA[d];                                        \
+                offsetB += idx * sB[d];                                        \
+                offsetC += idx * sC[d];                                        \
+            }                                                                  \
+            C[offsetC] = (LOAD(A[offsetA]) OP LOAD(B[offsetB])) ? one : zero;  \
+        }                                                                      \
+    }
+
 _ARRAY_CMP(int, _array_gt_i, >)
 _ARRAY_CMP(float, _array_gt_f, >)
 _ARRAY_CMP(double, _array_gt_d, >)
 _ARRAY_CMP(long int, _array_gt_l, >)
+_ARRAY_CMP_16(_array_gt_bf, >, _bf16_to_float, _float_to_bf16)
+_ARRAY_CMP_16(_array_gt_h, >, _half_to_float, _float_to_half)
 
 _ARRAY_CMP(int, _array_ge_i, >=)
 _ARRAY_CMP(float, _array_ge_f, >=)
 _ARRAY_CMP(double, _array_ge_d, >=)
 _ARRAY_CMP(long int, _array_ge_l, >=)
+_ARRAY_CMP_16(_array_ge_bf, >=, _bf16_to_float, _float_to_bf16)
+_ARRAY_CMP_16(_array_ge_h, >=, _half_to_float, _float_to_half)
 
 _ARRAY_CMP(int, _array_lt_i, <)
 _ARRAY_CMP(float, _array_lt_f, <)
 _ARRAY_CMP(double, _array_lt_d, <)
 _ARRAY_CMP(long int, _array_lt_l, <)
+_ARRAY_CMP_16(_array_lt_bf, <, _bf16_to_float, _float_to_bf16)
+_ARRAY_CMP_16(_array_lt_h, <, _half_to_float, _float_to_half)
 
 _ARRAY_CMP(int, _array_le_i, <=)
 _ARRAY_CMP(float, _array_le_f, <=)
 _ARRAY_CMP(double, _array_le_d, <=)
 _ARRAY_CMP(long int, _array_le_l, <=)
+_ARRAY_CMP_16(_array_le_bf, <=, _bf16_to_float, _float_to_bf16)
+_ARRAY_CMP_16(_array_le_h, <=, _half_to_float, _float_to_half)
 
 _ARRAY_CMP(int, _array_eq_i, ==)
 _ARRAY_CMP(float, _array_eq_f, ==)
 _ARRAY_CMP(double, _array_eq_d, ==)
 _ARRAY_CMP(long int, _array_eq_l, ==)
+_ARRAY_CMP_16(_array_eq_bf, ==, _bf16_to_float, _float_to_bf16)
+_ARRAY_CMP_16(_array_eq_h, ==, _half_to_float, _float_to_half)
 
 DEFINE_DISPATCH_FUNC(gt, _array_gt)
 DEFINE_DISPATCH_FUNC(ge, _array_ge)
@@ -233,23 +484,43 @@ DEFINE_DISPATCH_FUNC(le, _array_le)
 DEFINE_DISPATCH_FUNC(eq, _array_eq)
 
 ndArray *array_gt(ndArray *arr1, ndArray *arr2) {
-    return array_binary_op(arr1, arr2, dispatch_gt);
+    return array_binary_op(arr1, arr2, NULL, dispatch_gt, NULL);
+}
+
+void array_gt_out(ndArray *arr1, ndArray *arr2, ndArray *out) {
+    array_binary_op(arr1, arr2, out, dispatch_gt, NULL);
 }
 
 ndArray *array_ge(ndArray *arr1, ndArray *arr2) {
-    return array_binary_op(arr1, arr2, dispatch_ge);
+    return array_binary_op(arr1, arr2, NULL, dispatch_ge, NULL);
+}
+
+void array_ge_out(ndArray *arr1, ndArray *arr2, ndArray *out) {
+    array_binary_op(arr1, arr2, out, dispatch_ge, NULL);
 }
 
 ndArray *array_lt(ndArray *arr1, ndArray *arr2) {
-    return array_binary_op(arr1, arr2, dispatch_lt);
+    return array_binary_op(arr1, arr2, NULL, dispatch_lt, NULL);
+}
+
+void array_lt_out(ndArray *arr1, ndArray *arr2, ndArray *out) {
+    array_binary_op(arr1, arr2, out, dispatch_lt, NULL);
 }
 
 ndArray *array_le(ndArray *arr1, ndArray *arr2) {
-    return array_binary_op(arr1, arr2, dispatch_le);
+    return array_binary_op(arr1, arr2, NULL, dispatch_le, NULL);
+}
+
+void array_le_out(ndArray *arr1, ndArray *arr2, ndArray *out) {
+    array_binary_op(arr1, arr2, out, dispatch_le, NULL);
 }
 
 ndArray *array_eq(ndArray *arr1, ndArray *arr2) {
-    return array_binary_op(arr1, arr2, dispatch_eq);
+    return array_binary_op(arr1, arr2, NULL, dispatch_eq, NULL);
+}
+
+void array_eq_out(ndArray *arr1, ndArray *arr2, ndArray *out) {
+    array_binary_op(arr1, arr2, out, dispatch_eq, NULL);
 }
 
 ndArray *negative(ndArray *array) {
@@ -288,16 +559,37 @@ ndArray *inverse(ndArray *array) {
         B[0] = sum;                                                            \
     }
 
+// 16-bit floats accumulate in fp32 and round once on store
+#define _ARRAY_SUM_KERNEL_16(NAME, LOAD, STORE)                                \
+    static void NAME(const uint16_t *A, uint16_t *B, size_t total_size) {      \
+        float sum = 0.0f;                                                      \
+                                                                               \
+        _Pragma("omp parallel for reduction(+:sum) schedule(static)") for (    \
+            size_t i = 0; i < total_size; i++) {                               \
+            sum += LOAD(A[i]);                                                 \
+        }                                                                      \
+                                                                               \
+        B[0] = STORE(sum);                                                     \
+    }
+
 _ARRAY_SUM_KERNEL(int, _array_sum_i)
 _ARRAY_SUM_KERNEL(float, _array_sum_f)
 _ARRAY_SUM_KERNEL(double, _array_sum_d)
 _ARRAY_SUM_KERNEL(long int, _array_sum_l)
+_ARRAY_SUM_KERNEL_16(_array_sum_bf, _bf16_to_float, _float_to_bf16)
+_ARRAY_SUM_KERNEL_16(_array_sum_h, _half_to_float, _float_to_half)
 
 ndArray *array_sum(ndArray *array) {
+    ndArray *result = array_init(0, (size_t[]){}, get_dtype(array));
+    array_sum_out(array, result);
+
+    return result;
+}
+
+void array_sum_out(ndArray *array, ndArray *result) {
     DType dtype = get_dtype(array);
     size_t total_size = get_total_size(array);
-
-    ndArray *result = array_init(0, (size_t[]){}, dtype);
+    _check_out(result, 0, NULL, dtype);
 
     switch (dtype) {
     case DTYPE_INT: {
@@ -324,9 +616,19 @@ ndArray *array_sum(ndArray *array) {
         _array_sum_l(A, B, total_size);
         break;
     }
+    case DTYPE_BF16: {
+        const uint16_t *A = get_array_data(array);
+        uint16_t *B = get_array_data(result);
+        _array_sum_bf(A, B, total_size);
+        break;
+    }
+    case DTYPE_HALF: {
+        const uint16_t *A = get_array_data(array);
+        uint16_t *B = get_array_data(result);
+        _array_sum_h(A, B, total_size);
+        break;
+    }
     }
-
-    return result;
 }
 
 #define _ARRAY_SUM_DIM_KERNEL(T, NAME)                                         \
@@ -358,10 +660,41 @@ ndArray *array_sum(ndArray *array) {
         }                                                                      \
     }
 
+#define _ARRAY_SUM_DIM_KERNEL_16(NAME, LOAD, STORE)                            \
+    static void NAME(const uint16_t *A, uint16_t *B, int ndimA, int ndimB,     \
+                     int dim, bool keepdims, const size_t *shapeA,             \
+                     const size_t *stridesA, size_t total_sizeB) {             \
+        _Pragma("omp parallel for schedule(static)") for (size_t i = 0;        \
+                                                          i < total_sizeB;     \
+                                                          i++) {               \
+            size_t tmp = i;                                                    \
+            size_t offsetA = 0;                                                \
+                                                                               \
+            for (int dA = ndimA - 1; dA >= 0; dA--) {                          \
+                if (dA == dim)                                                 \
+                    continue;                                                  \
+                                                                               \
+                size_t idx = tmp % shapeA[dA];                                 \
+                tmp /= shapeA[dA];                                             \
+                                                                               \
+                offsetA += idx * stridesA[dA];                                 \
+            }                                                                  \
+                                                                               \
+            float sum = 0.0f;                                                  \
+            size_t stride_dim = stridesA[dim];                                 \
+            for (size_t k = 0; k < shapeA[dim]; k++)                           \
+                sum += LOAD(A[offsetA + k * stride_dim]);                      \
+                                                                               \
+            B[i] = STORE(sum);                                                 \
+        }                                                                      \
+    }
+
 _ARRAY_SUM_DIM_KERNEL(int, _array_sum_dim_i)
 _ARRAY_SUM_DIM_KERNEL(float, _array_sum_dim_f)
 _ARRAY_SUM_DIM_KERNEL(double, _array_sum_dim_d)
 _ARRAY_SUM_DIM_KERNEL(long, _array_sum_dim_l)
+_ARRAY_SUM_DIM_KERNEL_16(_array_sum_dim_bf, _bf16_to_float, _float_to_bf16)
+_ARRAY_SUM_DIM_KERNEL_16(_array_sum_dim_h, _half_to_float, _float_to_half)
 
 ndArray *array_sum_dim(ndArray *array, int dim, bool keepdims) {
     int ndim = get_ndim(array);
@@ -419,7 +752,62 @@ ndArray *array_sum_dim(ndArray *array, int dim, bool keepdims) {
                          totalB);
         break;
     }
+    case DTYPE_BF16: {
+        const uint16_t *A = get_array_data(array);
+        uint16_t *B = get_array_data(result);
+        _array_sum_dim_bf(A, B, ndim, new_ndim, dim, keepdims, shape, stridesA,
+                          totalB);
+        break;
+    }
+    case DTYPE_HALF: {
+        const uint16_t *A = get_array_data(array);
+        uint16_t *B = get_array_data(result);
+        _array_sum_dim_h(A, B, ndim, new_ndim, dim, keepdims, shape, stridesA,
+                         totalB);
+        break;
+    }
     }
 
     return result;
 }
+
+/*
+ * Checks are done on the exponent bits, `-ffast-math` lets the compiler
+ * assume isinf/isnan are always false.
+ */
+#define _ARRAY_FINITE_KERNEL(T, NAME, EXP_MASK)                                \
+    static bool NAME(const T *A, size_t total_size) {                          \
+        int nonfinite = 0;                                                     \
+                                                                               \
+        _Pragma("omp parallel for reduction(|:nonfinite) schedule(static)")    \
+            for (size_t i = 0; i < total_size; i++)                            \
+                nonfinite |= (A[i] & (EXP_MASK)) == (EXP_MASK);                \
+                                                                               \
+        return !nonfinite;                                                     \
+    }
+
+_ARRAY_FINITE_KERNEL(uint32_t, _array_finite_f, 0x7f800000u)
+_ARRAY_FINITE_KERNEL(uint64_t, _array_finite_d, 0x7ff0000000000000ull)
+_ARRAY_FINITE_KERNEL(uint16_t, _array_finite_bf, 0x7f80u)
+_ARRAY_FINITE_KERNEL(uint16_t, _array_finite_h, 0x7c00u)
+
+bool array_all_finite(const ndArray *array) {
+    size_t total_size = get_total_size(array);
+    const void *data = get_array_data(array);
+
+    switch (get_dtype(array)) {
+    case DTYPE_INT:
+    case DTYPE_LONG:
+        return true;
+    case DTYPE_FLOAT:
+        return _array_finite_f(data, total_size);
+    case DTYPE_DOUBLE:
+        return _array_finite_d(data, total_size);
+    case DTYPE_BF16:
+        return _array_finite_bf(data, total_size);
+    case DTYPE_HALF:
+        return _array_finite_h(data, total_size);
+    }
+
+    return true;
+}
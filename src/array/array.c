@@ -3,6 +3,7 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -12,6 +13,8 @@ const char *DTypeNames[] = {
     "DTYPE_FLOAT",
     "DTYPE_DOUBLE",
     "DTYPE_LONG",
+    "DTYPE_BF16",
+    "DTYPE_HALF",
 };
 
 struct ndArray {
@@ -22,9 +25,10 @@ struct ndArray {
     size_t itemsize;
     size_t total_size;
     DType dtype;
+    bool owns_data; // false for arrays placed in an external buffer
 };
 
-ndArray *array_init(int ndim, const size_t *shape, DType dtype) {
+static ndArray *_array_header(int ndim, const size_t *shape, DType dtype) {
     if (ndim > MAX_NDIM)
         RUNTIME_ERRORF(ARRAY_INIT_FAILURE,
                        "Given array with ndim (%d) > MAX_NDIM (%d)", ndim,
@@ -51,6 +55,10 @@ ndArray *array_init(int ndim, const size_t *shape, DType dtype) {
     case DTYPE_LONG:
         itemsize = sizeof(long);
         break;
+    case DTYPE_BF16:
+    case DTYPE_HALF:
+        itemsize = sizeof(uint16_t);
+        break;
     }
 
     array->itemsize = itemsize;
@@ -63,14 +71,34 @@ ndArray *array_init(int ndim, const size_t *shape, DType dtype) {
         array->strides[i] = size * itemsize;
         size = size * shape[i];
     }
-    array->data = malloc(size * itemsize);
+    array->data = NULL;
     array->total_size = size;
+    array->owns_data = false;
+
+    return array;
+}
+
+ndArray *array_init(int ndim, const size_t *shape, DType dtype) {
+    ndArray *array = _array_header(ndim, shape, dtype);
+    array->data = malloc(array->total_size * array->itemsize);
+    array->owns_data = true;
+
+    return array;
+}
+
+ndArray *array_from_buffer(int ndim, const size_t *shape, DType dtype,
+                           void *data) {
+    ndArray *array = _array_header(ndim, shape, dtype);
+    array->data = data;
 
     return array;
 }
 
+bool is_array_view(const ndArray *array) { return !array->owns_data; }
+
 void free_array(ndArray *array) {
-    free(array->data);
+    if (array->owns_data)
+        free(array->data);
     free(array->shape);
     free(array->strides);
     free(array);
@@ -109,48 +137,15 @@ size_t *get_strides(const ndArray *array) { return array->strides; }
 void *get_array_data(const ndArray *array) { return array->data; }
 
 ArrayVal get_value(const ndArray *array, const size_t *indices) {
-    const void *ptr = array_idx(array, indices);
-
-    ArrayVal value;
-    switch (array->dtype) {
-    case DTYPE_INT:
-        value.int_val = *(int *)ptr;
-        break;
-    case DTYPE_FLOAT:
-        value.float_val = *(float *)ptr;
-        break;
-    case DTYPE_DOUBLE:
-        value.double_val = *(double *)ptr;
-        break;
-    case DTYPE_LONG:
-        value.long_val = *(long *)ptr;
-        break;
-    }
-
-    return value;
+    return array_val_load(array_idx(array, indices), array->dtype);
 }
 
 void set_value(ndArray *array, const size_t *indices, ArrayVal value) {
-    void *ptr = array_idx(array, indices);
-
-    switch (array->dtype) {
-    case DTYPE_INT:
-        *(int *)ptr = value.int_val;
-        break;
-    case DTYPE_FLOAT:
-        *(float *)ptr = value.float_val;
-        break;
-    case DTYPE_DOUBLE:
-        *(double *)ptr = value.double_val;
-        break;
-    case DTYPE_LONG:
-        *(long *)ptr = value.long_val;
-        break;
-    }
+    array_val_store(array_idx(array, indices), value, array->dtype);
 }
 
 void set_strides(ndArray *array, const size_t *strides) {
-    memcpy(array->strides, strides, array->ndim);
+    memcpy(array->strides, strides, array->ndim * sizeof(size_t));
 }
 
 void populate_array(ndArray *array, const void *data) {
@@ -217,16 +212,11 @@ ndArray *eye(size_t m, size_t n, DType dtype) {
     return array;
 }
 
+// all-zero bits are zero in every dtype
 ndArray *zeros(int ndim, const size_t *shape, DType dtype) {
-    ndArray *array = array_init(ndim, shape, dtype);
-    size_t indices[ndim];
-
-    ArrayVal zero = array_val_zero(array->dtype);
-    size_t total_size = array->total_size;
-    for (size_t i = 0; i < total_size; i++) {
-        offset_to_index(i, indices, shape, ndim);
-        set_value(array, indices, zero);
-    }
+    ndArray *array = _array_header(ndim, shape, dtype);
+    array->data = calloc(array->total_size, array->itemsize);
+    array->owns_data = true;
 
     return array;
 }
@@ -1,4 +1,5 @@
 #include "array.h"
+#include <stdint.h>
 #include <stdio.h>
 
 ArrayVal array_val_one(DType dtype) {
@@ -9,6 +10,8 @@ ArrayVal array_val_one(DType dtype) {
         value.int_val = 1;
         break;
     case DTYPE_FLOAT:
+    case DTYPE_BF16:
+    case DTYPE_HALF:
         value.float_val = 1.0f;
         break;
     case DTYPE_DOUBLE:
@@ -30,6 +33,8 @@ ArrayVal array_val_zero(DType dtype) {
         value.int_val = 0;
         break;
     case DTYPE_FLOAT:
+    case DTYPE_BF16:
+    case DTYPE_HALF:
         value.float_val = 0.0f;
         break;
     case DTYPE_DOUBLE:
@@ -51,6 +56,8 @@ ArrayVal array_val_add(ArrayVal v1, ArrayVal v2, DType dtype) {
         value.int_val = v1.int_val + v2.int_val;
         break;
     case DTYPE_FLOAT:
+    case DTYPE_BF16:
+    case DTYPE_HALF:
         value.float_val = v1.float_val + v2.float_val;
         break;
     case DTYPE_DOUBLE:
@@ -72,6 +79,8 @@ ArrayVal array_val_sub(ArrayVal v1, ArrayVal v2, DType dtype) {
         value.int_val = v1.int_val - v2.int_val;
         break;
     case DTYPE_FLOAT:
+    case DTYPE_BF16:
+    case DTYPE_HALF:
         value.float_val = v1.float_val - v2.float_val;
         break;
     case DTYPE_DOUBLE:
@@ -93,6 +102,8 @@ ArrayVal array_val_mul(ArrayVal v1, ArrayVal v2, DType dtype) {
         value.int_val = v1.int_val * v2.int_val;
         break;
     case DTYPE_FLOAT:
+    case DTYPE_BF16:
+    case DTYPE_HALF:
         value.float_val = v1.float_val * v2.float_val;
         break;
     case DTYPE_DOUBLE:
@@ -116,6 +127,8 @@ ArrayVal array_val_div(ArrayVal v1, ArrayVal v2, DType dtype) {
         value.int_val = v1.int_val / v2.int_val;
         break;
     case DTYPE_FLOAT:
+    case DTYPE_BF16:
+    case DTYPE_HALF:
         if (v2.float_val == 0)
             printf("Invalid value (0) encountered in division\n");
         value.float_val = v1.float_val / v2.float_val;
@@ -154,6 +167,12 @@ bool array_val_equal(ArrayVal v1, ArrayVal v2, DType dtype) {
     case DTYPE_LONG:
         is_equal = v1.long_val == v2.long_val;
         break;
+    case DTYPE_BF16:
+        is_equal = float_abs(v1.float_val - v2.float_val) < BF16_EQ_TOL;
+        break;
+    case DTYPE_HALF:
+        is_equal = float_abs(v1.float_val - v2.float_val) < HALF_EQ_TOL;
+        break;
     }
 
     return is_equal;
@@ -166,6 +185,8 @@ ArrayVal array_val_neg(ArrayVal value, DType dtype) {
         result.int_val = -value.int_val;
         break;
     case DTYPE_FLOAT:
+    case DTYPE_BF16:
+    case DTYPE_HALF:
         result.float_val = -value.float_val;
         break;
     case DTYPE_DOUBLE:
@@ -178,3 +199,52 @@ ArrayVal array_val_neg(ArrayVal value, DType dtype) {
 
     return result;
 }
+
+ArrayVal array_val_load(const void *ptr, DType dtype) {
+    ArrayVal value;
+    switch (dtype) {
+    case DTYPE_INT:
+        value.int_val = *(const int *)ptr;
+        break;
+    case DTYPE_FLOAT:
+        value.float_val = *(const float *)ptr;
+        break;
+    case DTYPE_DOUBLE:
+        value.double_val = *(const double *)ptr;
+        break;
+    case DTYPE_LONG:
+        value.long_val = *(const long *)ptr;
+        break;
+    case DTYPE_BF16:
+        value.float_val = bf16_to_float(*(const uint16_t *)ptr);
+        break;
+    case DTYPE_HALF:
+        value.float_val = half_to_float(*(const uint16_t *)ptr);
+        break;
+    }
+
+    return value;
+}
+
+void array_val_store(void *ptr, ArrayVal value, DType dtype) {
+    switch (dtype) {
+    case DTYPE_INT:
+        *(int *)ptr = value.int_val;
+        break;
+    case DTYPE_FLOAT:
+        *(float *)ptr = value.float_val;
+        break;
+    case DTYPE_DOUBLE:
+        *(double *)ptr = value.double_val;
+        break;
+    case DTYPE_LONG:
+        *(long *)ptr = value.long_val;
+        break;
+    case DTYPE_BF16:
+        *(uint16_t *)ptr = float_to_bf16(value.float_val);
+        break;
+    case DTYPE_HALF:
+        *(uint16_t *)ptr = float_to_half(value.float_val);
+        break;
+    }
+}
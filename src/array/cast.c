@@ -0,0 +1,233 @@
+#include "array.h"
+#include "error_codes.h"
+#include "kernel/half.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef void (*CastKernel)(const void *src, void *dst, size_t n);
+
+#define _LOAD(x) (x)
+#define _STORE_F(x) ((float)(x))
+#define _STORE_D(x) ((double)(x))
+#define _STORE_BF(x) _float_to_bf16((float)(x))
+#define _STORE_H(x) _float_to_half((float)(x))
+
+#define _CAST_KERNEL(NAME, SRC_T, DST_T, LOAD, STORE)                          \
+    static void NAME(const void *src, void *dst, size_t n) {                   \
+        const SRC_T *A = src;                                                  \
+        DST_T *B = dst;                                                        \
+        _Pragma("omp parallel for simd schedule(static)") for (size_t i = 0;   \
+                                                               i < n; i++)     \
+            B[i] = STORE(LOAD(A[i]));                                          \
+    }
+
+#define _STORE_I(x) ((int)(x))
+#define _STORE_L(x) ((long int)(x))
+
+_CAST_KERNEL(_cast_i_f, int, float, _LOAD, _STORE_F)
+_CAST_KERNEL(_cast_i_d, int, double, _LOAD, _STORE_D)
+_CAST_KERNEL(_cast_i_l, int, long int, _LOAD, _STORE_L)
+_CAST_KERNEL(_cast_i_bf, int, uint16_t, _LOAD, _STORE_BF)
+_CAST_KERNEL(_cast_i_h, int, uint16_t, _LOAD, _STORE_H)
+
+_CAST_KERNEL(_cast_l_i, long int, int, _LOAD, _STORE_I)
+_CAST_KERNEL(_cast_l_f, long int, float, _LOAD, _STORE_F)
+_CAST_KERNEL(_cast_l_d, long int, double, _LOAD, _STORE_D)
+_CAST_KERNEL(_cast_l_bf, long int, uint16_t, _LOAD, _STORE_BF)
+_CAST_KERNEL(_cast_l_h, long int, uint16_t, _LOAD, _STORE_H)
+
+_CAST_KERNEL(_cast_f_i, float, int, _LOAD, _STORE_I)
+_CAST_KERNEL(_cast_f_l, float, long int, _LOAD, _STORE_L)
+_CAST_KERNEL(_cast_f_d, float, double, _LOAD, _STORE_D)
+
+_CAST_KERNEL(_cast_d_i, double, int, _LOAD, _STORE_I)
+_CAST_KERNEL(_cast_d_l, double, long int, _LOAD, _STORE_L)
+_CAST_KERNEL(_cast_d_f, double, float, _LOAD, _STORE_F)
+_CAST_KERNEL(_cast_d_bf, double, uint16_t, _LOAD, _STORE_BF)
+_CAST_KERNEL(_cast_d_h, double, uint16_t, _LOAD, _STORE_H)
+
+_CAST_KERNEL(_cast_bf_i, uint16_t, int, _bf16_to_float, _STORE_I)
+_CAST_KERNEL(_cast_bf_l, uint16_t, long int, _bf16_to_float, _STORE_L)
+_CAST_KERNEL(_cast_bf_d, uint16_t, double, _bf16_to_float, _STORE_D)
+_CAST_KERNEL(_cast_bf_h, uint16_t, uint16_t, _bf16_to_float, _STORE_H)
+
+_CAST_KERNEL(_cast_h_i, uint16_t, int, _half_to_float, _STORE_I)
+_CAST_KERNEL(_cast_h_l, uint16_t, long int, _half_to_float, _STORE_L)
+_CAST_KERNEL(_cast_h_d, uint16_t, double, _half_to_float, _STORE_D)
+_CAST_KERNEL(_cast_h_bf, uint16_t, uint16_t, _half_to_float, _STORE_BF)
+
+// fp32 <-> 16-bit casts go through the vectorized buffer converters
+static void _cast_f_bf(const void *src, void *dst, size_t n) {
+    float_to_bf16_buffer(src, dst, n);
+}
+
+static void _cast_bf_f(const void *src, void *dst, size_t n) {
+    bf16_to_float_buffer(src, dst, n);
+}
+
+static void _cast_f_h(const void *src, void *dst, size_t n) {
+    float_to_half_buffer(src, dst, n);
+}
+
+static void _cast_h_f(const void *src, void *dst, size_t n) {
+    half_to_float_buffer(src, dst, n);
+}
+
+// indexed by [source dtype][target dtype], floating -> integer truncates
+static const CastKernel cast_kernels[6][6] = {
+    [DTYPE_INT] = {[DTYPE_FLOAT] = _cast_i_f,
+                   [DTYPE_DOUBLE] = _cast_i_d,
+                   [DTYPE_LONG] = _cast_i_l,
+                   [DTYPE_BF16] = _cast_i_bf,
+                   [DTYPE_HALF] = _cast_i_h},
+    [DTYPE_FLOAT] = {[DTYPE_INT] = _cast_f_i,
+                     [DTYPE_DOUBLE] = _cast_f_d,
+                     [DTYPE_LONG] = _cast_f_l,
+                     [DTYPE_BF16] = _cast_f_bf,
+                     [DTYPE_HALF] = _cast_f_h},
+    [DTYPE_DOUBLE] = {[DTYPE_INT] = _cast_d_i,
+                      [DTYPE_FLOAT] = _cast_d_f,
+                      [DTYPE_LONG] = _cast_d_l,
+                      [DTYPE_BF16] = _cast_d_bf,
+                      [DTYPE_HALF] = _cast_d_h},
+    [DTYPE_LONG] = {[DTYPE_INT] = _cast_l_i,
+                    [DTYPE_FLOAT] = _cast_l_f,
+                    [DTYPE_DOUBLE] = _cast_l_d,
+                    [DTYPE_BF16] = _cast_l_bf,
+                    [DTYPE_HALF] = _cast_l_h},
+    [DTYPE_BF16] = {[DTYPE_INT] = _cast_bf_i,
+                    [DTYPE_FLOAT] = _cast_bf_f,
+                    [DTYPE_DOUBLE] = _cast_bf_d,
+                    [DTYPE_LONG] = _cast_bf_l,
+                    [DTYPE_HALF] = _cast_bf_h},
+    [DTYPE_HALF] = {[DTYPE_INT] = _cast_h_i,
+                    [DTYPE_FLOAT] = _cast_h_f,
+                    [DTYPE_DOUBLE] = _cast_h_d,
+                    [DTYPE_LONG] = _cast_h_l,
+                    [DTYPE_BF16] = _cast_h_bf},
+};
+
+static _Thread_local bool dtype_promotion = false;
+
+void set_dtype_promotion(bool enabled) { dtype_promotion = enabled; }
+bool get_dtype_promotion() { return dtype_promotion; }
+
+static int _dtype_rank(DType dtype) {
+    switch (dtype) {
+    case DTYPE_INT:
+        return 0;
+    case DTYPE_LONG:
+        return 1;
+    case DTYPE_BF16:
+    case DTYPE_HALF:
+        return 2;
+    case DTYPE_FLOAT:
+        return 3;
+    case DTYPE_DOUBLE:
+        return 4;
+    }
+
+    return 0;
+}
+
+/*
+ * int < long < bf16, half < float < double, mixing bf16 with half gives
+ * float since neither holds the other's range and precision.
+ */
+DType promote_types(DType dtype1, DType dtype2) {
+    if (dtype1 == dtype2)
+        return dtype1;
+
+    int rank1 = _dtype_rank(dtype1), rank2 = _dtype_rank(dtype2);
+    if (rank1 == rank2)
+        return DTYPE_FLOAT;
+
+    return (rank1 > rank2) ? dtype1 : dtype2;
+}
+
+/*
+ * Arrays always own a dense buffer of `total_size` elements (transposition
+ * only permutes strides), so the cast converts the buffer linearly and the
+ * result keeps the source strides.
+ */
+ndArray *array_cast(const ndArray *array, DType dtype) {
+    int ndim = get_ndim(array);
+    ndArray *result = array_init(ndim, get_shape(array), dtype);
+
+    size_t strides[ndim];
+    size_t src_itemsize = get_itemsize(array), itemsize = get_itemsize(result);
+    for (int d = 0; d < ndim; d++)
+        strides[d] = get_strides(array)[d] / src_itemsize * itemsize;
+    set_strides(result, strides);
+
+    array_cast_out(array, result);
+    return result;
+}
+
+// `out` keeps its own strides, it must share the source's buffer layout
+void array_cast_out(const ndArray *array, ndArray *out) {
+    DType src_dtype = get_dtype(array), dtype = get_dtype(out);
+    size_t total_size = get_total_size(array);
+
+    if (get_total_size(out) != total_size)
+        RUNTIME_ERROR(SHAPE_MISMATCH,
+                      "Output array does not match the cast source size");
+
+    if (src_dtype == dtype) {
+        memcpy(get_array_data(out), get_array_data(array),
+               total_size * get_itemsize(array));
+        return;
+    }
+
+    CastKernel kernel = cast_kernels[src_dtype][dtype];
+    if (!kernel)
+        RUNTIME_ERRORF(INVALID_DTYPE, "Cannot cast array from `%s` to `%s`",
+                       DTypeNames[src_dtype], DTypeNames[dtype]);
+
+    kernel(get_array_data(array), get_array_data(out), total_size);
+}
+
+bool same_layout(const ndArray *arr1, const ndArray *arr2) {
+    int ndim = get_ndim(arr1);
+    if (ndim != get_ndim(arr2))
+        return false;
+
+    for (int d = 0; d < ndim; d++)
+        if (get_shape(arr1)[d] != get_shape(arr2)[d] ||
+            get_strides(arr1)[d] != get_strides(arr2)[d])
+            return false;
+
+    return true;
+}
+
+ndArray *array_align_layout(const ndArray *array, const ndArray *like) {
+    if (same_layout(array, like))
+        return NULL;
+
+    DType dtype = get_dtype(like);
+    ndArray *aligned = array_init(get_ndim(like), get_shape(like), dtype);
+    set_strides(aligned, get_strides(like));
+
+    ndArray *zero = zeros(0, (const size_t[]){}, dtype);
+    array_add_out((ndArray *)array, zero, aligned);
+    free_array(zero);
+
+    return aligned;
+}
+
+ndArray *array_align_contiguous(const ndArray *array) {
+    if (is_array_contiguous(array))
+        return NULL;
+
+    ndArray *like = array_from_buffer(get_ndim(array), get_shape(array),
+                                      get_dtype(array), NULL);
+    ndArray *copy = array_align_layout(array, like);
+    free_array(like);
+
+    return copy;
+}
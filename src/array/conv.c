@@ -0,0 +1,618 @@
+#include "array.h"
+#include "error_codes.h"
+#include "kernel/ops.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// im2col/col2im loops fork only past this many elements
+#define CONV_PARALLEL_MIN 32768
+
+/*
+ * Below this many channel pairs per group, kernels up to 3x3 convolve
+ * directly: the column matrix would cost more than the few multiply-adds
+ * per output it feeds to the GEMM.
+ */
+#define CONV_DIRECT_MAX_PAIRS 64
+#define CONV_DIRECT_MAX_TAPS 9
+
+// a 1-d convolution is a 2-d one over a single row
+typedef struct ConvGeometry {
+    size_t N, C_in, C_out, groups, Cg_in, Cg_out;
+    size_t H, W, kH, kW, oH, oW;
+    size_t sH, sW, pH, pW, dH, dW;
+    size_t K, L; // column matrix rows (Cg_in kH kW) and columns (oH oW)
+    bool direct, pointwise;
+} ConvGeometry;
+
+static size_t _conv_out_size(size_t in, size_t k, size_t s, size_t p,
+                             size_t d) {
+    size_t span = d * (k - 1) + 1;
+    if (k == 0 || in + 2 * p < span)
+        RUNTIME_ERRORF(SHAPE_MISMATCH,
+                       "Convolution kernel (%zu, dilation %zu) larger than "
+                       "the padded input (%zu)",
+                       k, d, in + 2 * p);
+
+    return (in + 2 * p - span) / s + 1;
+}
+
+static ConvGeometry _conv_geometry(const size_t *input_shape,
+                                   const size_t *weight_shape,
+                                   const ConvParams *params) {
+    int sd = params->ndim;
+    if (sd != 1 && sd != 2)
+        RUNTIME_ERRORF(INVALID_DIM,
+                       "Convolutions have 1 or 2 spatial dims, got %d", sd);
+
+    ConvGeometry g = {
+        .N = input_shape[0],
+        .C_in = input_shape[1],
+        .C_out = weight_shape[0],
+        .groups = params->groups,
+        .H = sd == 2 ? input_shape[2] : 1,
+        .W = input_shape[sd + 1],
+        .kH = sd == 2 ? weight_shape[2] : 1,
+        .kW = weight_shape[sd + 1],
+        .sH = sd == 2 ? params->stride[0] : 1,
+        .sW = params->stride[sd - 1],
+        .pH = sd == 2 ? params->padding[0] : 0,
+        .pW = params->padding[sd - 1],
+        .dH = sd == 2 ? params->dilation[0] : 1,
+        .dW = params->dilation[sd - 1],
+    };
+
+    if (g.groups == 0 || g.sH == 0 || g.sW == 0 || g.dH == 0 || g.dW == 0)
+        RUNTIME_ERROR(INVALID_ARRAY,
+                      "Convolution groups, strides and dilations must be "
+                      "positive");
+    if (g.C_in % g.groups || g.C_out % g.groups)
+        RUNTIME_ERRORF(SHAPE_MISMATCH,
+                       "Channels (%zu in, %zu out) are not divisible by "
+                       "%zu groups",
+                       g.C_in, g.C_out, g.groups);
+
+    g.Cg_in = g.C_in / g.groups;
+    g.Cg_out = g.C_out / g.groups;
+    if (weight_shape[1] != g.Cg_in)
+        RUNTIME_ERRORF(SHAPE_MISMATCH,
+                       "Weight expects %zu input channels per group, input "
+                       "has %zu",
+                       weight_shape[1], g.Cg_in);
+
+    g.oH = _conv_out_size(g.H, g.kH, g.sH, g.pH, g.dH);
+    g.oW = _conv_out_size(g.W, g.kW, g.sW, g.pW, g.dW);
+    g.K = g.Cg_in * g.kH * g.kW;
+    g.L = g.oH * g.oW;
+
+    g.pointwise = g.kH == 1 && g.kW == 1 && g.sH == 1 && g.sW == 1 &&
+                  g.pH == 0 && g.pW == 0;
+    g.direct = g.kH * g.kW <= CONV_DIRECT_MAX_TAPS &&
+               g.Cg_in * g.Cg_out <= CONV_DIRECT_MAX_PAIRS;
+
+    return g;
+}
+
+static void _check_conv_operands(const ndArray *input, const ndArray *weight,
+                                 const ConvParams *params) {
+    int ndim = params->ndim + 2;
+    if (get_ndim(input) != ndim || get_ndim(weight) != ndim)
+        RUNTIME_ERRORF(SHAPE_MISMATCH,
+                       "Conv%dd expects %d-d input and weight, got %d and %d",
+                       params->ndim, ndim, get_ndim(input), get_ndim(weight));
+
+    DType dtype = get_dtype(input);
+    if (dtype != get_dtype(weight))
+        RUNTIME_ERRORF(INVALID_DTYPE,
+                       "Cannot convolve `%s` input with `%s` weight",
+                       DTypeNames[dtype], DTypeNames[get_dtype(weight)]);
+    if (dtype != DTYPE_FLOAT && dtype != DTYPE_DOUBLE)
+        RUNTIME_ERRORF(INVALID_DTYPE,
+                       "Convolutions need DTYPE_FLOAT or DTYPE_DOUBLE, got "
+                       "`%s`",
+                       DTypeNames[dtype]);
+}
+
+/*
+ * The outputs o in [*lo, *hi) whose tap at `offset` (kernel index times
+ * dilation) lands inside the input: 0 <= o s - p + offset < in.
+ */
+static inline void _valid_range(size_t out, size_t in, size_t s, size_t p,
+                                size_t offset, size_t *lo, size_t *hi) {
+    size_t begin = p > offset ? (p - offset + s - 1) / s : 0;
+    size_t end = in + p > offset ? (in + p - offset + s - 1) / s : 0;
+
+    *hi = end < out ? end : out;
+    *lo = begin < *hi ? begin : *hi;
+}
+
+// a (rows, cols) matrix over `data`, transposed views swap the strides
+static ndArray *_matrix_view(void *data, size_t rows, size_t cols,
+                             DType dtype, bool transposed) {
+    ndArray *view = array_from_buffer(2, (const size_t[]){rows, cols}, dtype,
+                                      data);
+    if (transposed) {
+        size_t itemsize = get_itemsize(view);
+        set_strides(view, (const size_t[]){itemsize, rows * itemsize});
+    }
+
+    return view;
+}
+
+// C = A B on borrowed buffers, C is row-major
+static void _gemm(void *A, bool trans_A, void *B, bool trans_B, void *C,
+                  size_t m, size_t k, size_t n, DType dtype) {
+    ndArray *a = _matrix_view(A, m, k, dtype, trans_A),
+            *b = _matrix_view(B, k, n, dtype, trans_B),
+            *c = _matrix_view(C, m, n, dtype, false);
+
+    const size_t idx[1] = {0};
+    matmul_kernel(a, b, c, idx, idx, idx);
+
+    free_array(a);
+    free_array(b);
+    free_array(c);
+}
+
+/*
+ * The column matrix of one sample and group: row (ci, kh, kw) holds the
+ * input pixels that tap meets at every output position, zero over the
+ * padding. `col2im` scatters such a matrix back, adding where windows
+ * overlap, each channel plane is owned by one thread.
+ */
+#define _IM2COL_KERNEL(NAME, T)                                                \
+    static void NAME(const T *x, T *col, const ConvGeometry *g) {              \
+        size_t rows = g->K;                                                    \
+        _Pragma("omp parallel for if (g->K * g->L > CONV_PARALLEL_MIN)")       \
+            for (size_t r = 0; r < rows; r++) {                                \
+            size_t kw = r % g->kW, kh = r / g->kW % g->kH,                     \
+                   ci = r / (g->kW * g->kH);                                   \
+            size_t w_lo, w_hi, h_lo, h_hi;                                     \
+            _valid_range(g->oW, g->W, g->sW, g->pW, kw * g->dW, &w_lo, &w_hi); \
+            _valid_range(g->oH, g->H, g->sH, g->pH, kh * g->dH, &h_lo, &h_hi); \
+                                                                               \
+            T *row = col + r * g->L;                                           \
+            memset(row, 0, g->L * sizeof(T));                                  \
+            for (size_t oh = h_lo; oh < h_hi; oh++) {                          \
+                size_t ih = oh * g->sH - g->pH + kh * g->dH;                   \
+                const T *src = x + (ci * g->H + ih) * g->W + kw * g->dW;       \
+                T *dst = row + oh * g->oW;                                     \
+                _Pragma("omp simd") for (size_t ow = w_lo; ow < w_hi; ow++)    \
+                    dst[ow] = src[ow * g->sW - g->pW];                         \
+            }                                                                  \
+        }                                                                      \
+    }
+
+#define _COL2IM_KERNEL(NAME, T)                                                \
+    static void NAME(const T *col, T *x, const ConvGeometry *g) {              \
+        size_t channels = g->Cg_in;                                            \
+        _Pragma("omp parallel for if (g->K * g->L > CONV_PARALLEL_MIN)")       \
+            for (size_t ci = 0; ci < channels; ci++) {                         \
+            for (size_t kh = 0; kh < g->kH; kh++) {                            \
+                for (size_t kw = 0; kw < g->kW; kw++) {                        \
+                    size_t w_lo, w_hi, h_lo, h_hi;                             \
+                    _valid_range(g->oW, g->W, g->sW, g->pW, kw * g->dW, &w_lo, \
+                                 &w_hi);                                       \
+                    _valid_range(g->oH, g->H, g->sH, g->pH, kh * g->dH, &h_lo, \
+                                 &h_hi);                                       \
+                                                                               \
+                    const T *row =                                             \
+                        col + ((ci * g->kH + kh) * g->kW + kw) * g->L;         \
+                    for (size_t oh = h_lo; oh < h_hi; oh++) {                  \
+                        size_t ih = oh * g->sH - g->pH + kh * g->dH;           \
+                        T *dst = x + (ci * g->H + ih) * g->W + kw * g->dW;     \
+                        const T *src = row + oh * g->oW;                       \
+                        for (size_t ow = w_lo; ow < w_hi; ow++)                \
+                            dst[ow * g->sW - g->pW] += src[ow];                \
+                    }                                                          \
+                }                                                              \
+            }                                                                  \
+        }                                                                      \
+    }
+
+/*
+ * Direct kernels for few channels per group, one output (or input, or
+ * weight) plane per work item. Every tap is a strided axpy over the valid
+ * span of an output row, so the inner loops vectorize and need no bounds
+ * checks.
+ */
+#define _DIRECT_FORWARD_KERNEL(NAME, T)                                        \
+    static void NAME(const T *x, const T *w, const T *b, T *y,                 \
+                     const ConvGeometry *g) {                                  \
+        size_t N = g->N, C_out = g->C_out;                                     \
+        _Pragma("omp parallel for collapse(2)") for (size_t n = 0; n < N;      \
+                                                     n++) {                    \
+            for (size_t co = 0; co < C_out; co++) {                            \
+                T *out = y + (n * C_out + co) * g->L;                          \
+                T init = b ? b[co] : (T)0;                                     \
+                for (size_t l = 0; l < g->L; l++)                              \
+                    out[l] = init;                                             \
+                                                                               \
+                size_t grp = co / g->Cg_out;                                   \
+                for (size_t ci = 0; ci < g->Cg_in; ci++) {                     \
+                    const T *in =                                              \
+                        x + (n * g->C_in + grp * g->Cg_in + ci) * g->H * g->W; \
+                    const T *taps = w + (co * g->Cg_in + ci) * g->kH * g->kW;  \
+                    for (size_t kh = 0; kh < g->kH; kh++) {                    \
+                        size_t h_lo, h_hi;                                     \
+                        _valid_range(g->oH, g->H, g->sH, g->pH, kh * g->dH,    \
+                                     &h_lo, &h_hi);                            \
+                        for (size_t kw = 0; kw < g->kW; kw++) {                \
+                            size_t w_lo, w_hi;                                 \
+                            _valid_range(g->oW, g->W, g->sW, g->pW,            \
+                                         kw * g->dW, &w_lo, &w_hi);            \
+                            T tap = taps[kh * g->kW + kw];                     \
+                            for (size_t oh = h_lo; oh < h_hi; oh++) {          \
+                                size_t ih = oh * g->sH - g->pH + kh * g->dH;   \
+                                const T *src = in + ih * g->W + kw * g->dW;    \
+                                T *dst = out + oh * g->oW;                     \
+                                _Pragma("omp simd") for (size_t ow = w_lo;     \
+                                                         ow < w_hi; ow++)      \
+                                    dst[ow] += tap * src[ow * g->sW - g->pW];  \
+                            }                                                  \
+                        }                                                      \
+                    }                                                          \
+                }                                                              \
+            }                                                                  \
+        }                                                                      \
+    }
+
+#define _DIRECT_GRAD_INPUT_KERNEL(NAME, T)                                     \
+    static void NAME(const T *dy, const T *w, T *dx, const ConvGeometry *g) {  \
+        size_t N = g->N, C_in = g->C_in;                                       \
+        _Pragma("omp parallel for collapse(2)") for (size_t n = 0; n < N;      \
+                                                     n++) {                    \
+            for (size_t c = 0; c < C_in; c++) {                                \
+                T *in = dx + (n * C_in + c) * g->H * g->W;                     \
+                size_t grp = c / g->Cg_in, ci = c % g->Cg_in;                  \
+                for (size_t j = 0; j < g->Cg_out; j++) {                       \
+                    size_t co = grp * g->Cg_out + j;                           \
+                    const T *out = dy + (n * g->C_out + co) * g->L;            \
+                    const T *taps = w + (co * g->Cg_in + ci) * g->kH * g->kW;  \
+                    for (size_t kh = 0; kh < g->kH; kh++) {                    \
+                        size_t h_lo, h_hi;                                     \
+                        _valid_range(g->oH, g->H, g->sH, g->pH, kh * g->dH,    \
+                                     &h_lo, &h_hi);                            \
+                        for (size_t kw = 0; kw < g->kW; kw++) {                \
+                            size_t w_lo, w_hi;                                 \
+                            _valid_range(g->oW, g->W, g->sW, g->pW,            \
+                                         kw * g->dW, &w_lo, &w_hi);            \
+                            T tap = taps[kh * g->kW + kw];                     \
+                            for (size_t oh = h_lo; oh < h_hi; oh++) {          \
+                                size_t ih = oh * g->sH - g->pH + kh * g->dH;   \
+                                T *dst = in + ih * g->W + kw * g->dW;          \
+                                const T *src = out + oh * g->oW;               \
+                                for (size_t ow = w_lo; ow < w_hi; ow++)        \
+                                    dst[ow * g->sW - g->pW] += tap * src[ow];  \
+                            }                                                  \
+                        }                                                      \
+                    }                                                          \
+                }                                                              \
+            }                                                                  \
+        }                                                                      \
+    }
+
+#define _DIRECT_GRAD_WEIGHT_KERNEL(NAME, T)                                    \
+    static void NAME(const T *dy, const T *x, T *dw, const ConvGeometry *g) {  \
+        size_t C_out = g->C_out, Cg_in = g->Cg_in;                             \
+        _Pragma("omp parallel for collapse(2)") for (size_t co = 0;            \
+                                                     co < C_out; co++) {       \
+            for (size_t ci = 0; ci < Cg_in; ci++) {                            \
+                size_t c = co / g->Cg_out * Cg_in + ci;                        \
+                T *taps = dw + (co * Cg_in + ci) * g->kH * g->kW;              \
+                for (size_t kh = 0; kh < g->kH; kh++) {                        \
+                    size_t h_lo, h_hi;                                         \
+                    _valid_range(g->oH, g->H, g->sH, g->pH, kh * g->dH, &h_lo, \
+                                 &h_hi);                                       \
+                    for (size_t kw = 0; kw < g->kW; kw++) {                    \
+                        size_t w_lo, w_hi;                                     \
+                        _valid_range(g->oW, g->W, g->sW, g->pW, kw * g->dW,    \
+                                     &w_lo, &w_hi);                            \
+                        T acc = 0;                                             \
+                        for (size_t n = 0; n < g->N; n++) {                    \
+                            const T *in = x + (n * g->C_in + c) * g->H * g->W; \
+                            const T *out = dy + (n * C_out + co) * g->L;       \
+                            for (size_t oh = h_lo; oh < h_hi; oh++) {          \
+                                size_t ih = oh * g->sH - g->pH + kh * g->dH;   \
+                                const T *src = in + ih * g->W + kw * g->dW;    \
+                                const T *grad = out + oh * g->oW;              \
+                                _Pragma("omp simd reduction(+ : acc)") for (   \
+                                    size_t ow = w_lo; ow < w_hi; ow++) acc +=  \
+                                    grad[ow] * src[ow * g->sW - g->pW];        \
+                            }                                                  \
+                        }                                                      \
+                        taps[kh * g->kW + kw] = acc;                           \
+                    }                                                          \
+                }                                                              \
+            }                                                                  \
+        }                                                                      \
+    }
+
+/*
+ * GEMM paths, a sample and group at a time so the column matrix stays one
+ * (K, L) buffer: y_g = W_g col, dcol = W_g^T dy_g and dW_g += dy_g col^T.
+ * Pointwise convolutions (1x1, unit stride, no padding) use the input as
+ * their column matrix and skip im2col/col2im altogether.
+ */
+// scratch for the column matrix and the per-group weight gradient
+static void *_gemm_buffer(size_t size) {
+    void *buffer = malloc(size ? size : 1);
+    if (!buffer)
+        RUNTIME_ERROR(ARRAY_INIT_FAILURE,
+                      "Failure to allocate convolution scratch buffer");
+
+    return buffer;
+}
+
+#define _GEMM_KERNELS(S, T, DTYPE)                                             \
+    static void _gemm_forward_##S(const T *x, const T *w, const T *b, T *y,    \
+                                  const ConvGeometry *g) {                     \
+        T *col =                                                               \
+            g->pointwise ? NULL : _gemm_buffer(g->K * g->L * sizeof(T));       \
+        for (size_t n = 0; n < g->N; n++) {                                    \
+            for (size_t grp = 0; grp < g->groups; grp++) {                     \
+                const T *in =                                                  \
+                    x + (n * g->C_in + grp * g->Cg_in) * g->H * g->W;          \
+                T *out = y + (n * g->C_out + grp * g->Cg_out) * g->L;          \
+                if (col)                                                       \
+                    _im2col_##S(in, col, g);                                   \
+                _gemm((void *)(w + grp * g->Cg_out * g->K), false,             \
+                      col ? col : (void *)in, false, out, g->Cg_out, g->K,     \
+                      g->L, DTYPE);                                            \
+            }                                                                  \
+            if (b) {                                                           \
+                T *out = y + n * g->C_out * g->L;                              \
+                size_t C_out = g->C_out, L = g->L;                             \
+                _Pragma("omp parallel for if (C_out * L > CONV_PARALLEL_MIN)") \
+                for (size_t co = 0; co < C_out; co++)                          \
+                    for (size_t l = 0; l < L; l++)                             \
+                        out[co * L + l] += b[co];                              \
+            }                                                                  \
+        }                                                                      \
+        free(col);                                                             \
+    }                                                                          \
+                                                                               \
+    static void _gemm_grad_input_##S(const T *dy, const T *w, T *dx,           \
+                                     const ConvGeometry *g) {                  \
+        T *col =                                                               \
+            g->pointwise ? NULL : _gemm_buffer(g->K * g->L * sizeof(T));       \
+        for (size_t n = 0; n < g->N; n++) {                                    \
+            for (size_t grp = 0; grp < g->groups; grp++) {                     \
+                T *in = dx + (n * g->C_in + grp * g->Cg_in) * g->H * g->W;     \
+                const T *out = dy + (n * g->C_out + grp * g->Cg_out) * g->L;   \
+                _gemm((void *)(w + grp * g->Cg_out * g->K), true,              \
+                      (void *)out, false, col ? col : in, g->K, g->Cg_out,     \
+                      g->L, DTYPE);                                            \
+                if (col)                                                       \
+                    _col2im_##S(col, in, g);                                   \
+            }                                                                  \
+        }                                                                      \
+        free(col);                                                             \
+    }                                                                          \
+                                                                               \
+    static void _gemm_grad_weight_##S(const T *dy, const T *x, T *dw,          \
+                                      const ConvGeometry *g) {                 \
+        T *col =                                                               \
+            g->pointwise ? NULL : _gemm_buffer(g->K * g->L * sizeof(T));       \
+        T *partial = _gemm_buffer(g->Cg_out * g->K * sizeof(T));               \
+        size_t size = g->Cg_out * g->K;                                        \
+        for (size_t n = 0; n < g->N; n++) {                                    \
+            for (size_t grp = 0; grp < g->groups; grp++) {                     \
+                const T *in =                                                  \
+                    x + (n * g->C_in + grp * g->Cg_in) * g->H * g->W;          \
+                const T *out = dy + (n * g->C_out + grp * g->Cg_out) * g->L;   \
+                if (col)                                                       \
+                    _im2col_##S(in, col, g);                                   \
+                _gemm((void *)out, false, col ? col : (void *)in, true,        \
+                      partial, g->Cg_out, g->L, g->K, DTYPE);                  \
+                                                                               \
+                T *acc = dw + grp * size;                                      \
+                _Pragma("omp simd") for (size_t i = 0; i < size; i++)          \
+                    acc[i] += partial[i];                                      \
+            }                                                                  \
+        }                                                                      \
+        free(partial);                                                         \
+        free(col);                                                             \
+    }
+
+#define _CONV_KERNELS(S, T, DTYPE)                                             \
+    _IM2COL_KERNEL(_im2col_##S, T)                                             \
+    _COL2IM_KERNEL(_col2im_##S, T)                                             \
+    _DIRECT_FORWARD_KERNEL(_direct_forward_##S, T)                             \
+    _DIRECT_GRAD_INPUT_KERNEL(_direct_grad_input_##S, T)                       \
+    _DIRECT_GRAD_WEIGHT_KERNEL(_direct_grad_weight_##S, T)                     \
+    _GEMM_KERNELS(S, T, DTYPE)
+
+_CONV_KERNELS(F, float, DTYPE_FLOAT)
+_CONV_KERNELS(D, double, DTYPE_DOUBLE)
+
+void conv_output_shape(const size_t *input_shape, const size_t *weight_shape,
+                       const ConvParams *params, size_t *shape) {
+    ConvGeometry g = _conv_geometry(input_shape, weight_shape, params);
+
+    shape[0] = g.N;
+    shape[1] = g.C_out;
+    if (params->ndim == 2)
+        shape[2] = g.oH;
+    shape[params->ndim + 1] = g.oW;
+}
+
+ndArray *array_conv(const ndArray *input, const ndArray *weight,
+                    const ndArray *bias, const ConvParams *params) {
+    _check_conv_operands(input, weight, params);
+    ConvGeometry g =
+        _conv_geometry(get_shape(input), get_shape(weight), params);
+    if (bias && (get_ndim(bias) != 1 || get_shape(bias)[0] != g.C_out ||
+                 get_dtype(bias) != get_dtype(input)))
+        RUNTIME_ERRORF(SHAPE_MISMATCH,
+                       "Convolution bias must be a (%zu,) array of the "
+                       "input's dtype",
+                       g.C_out);
+
+    ndArray *x_copy = array_align_contiguous(input),
+            *w_copy = array_align_contiguous(weight),
+            *b_copy = bias ? array_align_contiguous(bias) : NULL;
+    const void *x = get_array_data(x_copy ? x_copy : input),
+               *w = get_array_data(w_copy ? w_copy : weight),
+               *b = bias ? get_array_data(b_copy ? b_copy : bias) : NULL;
+
+    size_t shape[params->ndim + 2];
+    conv_output_shape(get_shape(input), get_shape(weight), params, shape);
+    ndArray *result = array_init(params->ndim + 2, shape, get_dtype(input));
+    void *y = get_array_data(result);
+
+    if (get_dtype(input) == DTYPE_DOUBLE) {
+        if (g.direct)
+            _direct_forward_D(x, w, b, y, &g);
+        else
+            _gemm_forward_D(x, w, b, y, &g);
+    } else {
+        if (g.direct)
+            _direct_forward_F(x, w, b, y, &g);
+        else
+            _gemm_forward_F(x, w, b, y, &g);
+    }
+
+    if (x_copy)
+        free_array(x_copy);
+    if (w_copy)
+        free_array(w_copy);
+    if (b_copy)
+        free_array(b_copy);
+
+    return result;
+}
+
+// `grad` is shaped like the convolution's output
+static ConvGeometry _grad_geometry(const ndArray *grad,
+                                   const size_t *input_shape,
+                                   const size_t *weight_shape,
+                                   const ConvParams *params) {
+    ConvGeometry g = _conv_geometry(input_shape, weight_shape, params);
+
+    size_t shape[params->ndim + 2];
+    conv_output_shape(input_shape, weight_shape, params, shape);
+    bool valid = get_ndim(grad) == params->ndim + 2;
+    for (int d = 0; valid && d < params->ndim + 2; d++)
+        valid = get_shape(grad)[d] == shape[d];
+
+    if (!valid)
+        RUNTIME_ERROR(SHAPE_MISMATCH,
+                      "Gradient does not match the convolution's output");
+
+    return g;
+}
+
+ndArray *array_conv_grad_input(const ndArray *grad, const ndArray *weight,
+                               const size_t *input_shape,
+                               const ConvParams *params) {
+    ConvGeometry g =
+        _grad_geometry(grad, input_shape, get_shape(weight), params);
+
+    ndArray *dy_copy = array_align_contiguous(grad),
+            *w_copy = array_align_contiguous(weight);
+    const void *dy = get_array_data(dy_copy ? dy_copy : grad),
+               *w = get_array_data(w_copy ? w_copy : weight);
+
+    DType dtype = get_dtype(weight);
+    ndArray *result = zeros(params->ndim + 2, input_shape, dtype);
+    void *dx = get_array_data(result);
+
+    if (dtype == DTYPE_DOUBLE) {
+        if (g.direct)
+            _direct_grad_input_D(dy, w, dx, &g);
+        else
+            _gemm_grad_input_D(dy, w, dx, &g);
+    } else {
+        if (g.direct)
+            _direct_grad_input_F(dy, w, dx, &g);
+        else
+            _gemm_grad_input_F(dy, w, dx, &g);
+    }
+
+    if (dy_copy)
+        free_array(dy_copy);
+    if (w_copy)
+        free_array(w_copy);
+
+    return result;
+}
+
+ndArray *array_conv_grad_weight(const ndArray *grad, const ndArray *input,
+                                const size_t *weight_shape,
+                                const ConvParams *params) {
+    ConvGeometry g =
+        _grad_geometry(grad, get_shape(input), weight_shape, params);
+
+    ndArray *dy_copy = array_align_contiguous(grad),
+            *x_copy = array_align_contiguous(input);
+    const void *dy = get_array_data(dy_copy ? dy_copy : grad),
+               *x = get_array_data(x_copy ? x_copy : input);
+
+    DType dtype = get_dtype(input);
+    ndArray *result = zeros(params->ndim + 2, weight_shape, dtype);
+    void *dw = get_array_data(result);
+
+    if (dtype == DTYPE_DOUBLE) {
+        if (g.direct)
+            _direct_grad_weight_D(dy, x, dw, &g);
+        else
+            _gemm_grad_weight_D(dy, x, dw, &g);
+    } else {
+        if (g.direct)
+            _direct_grad_weight_F(dy, x, dw, &g);
+        else
+            _gemm_grad_weight_F(dy, x, dw, &g);
+    }
+
+    if (dy_copy)
+        free_array(dy_copy);
+    if (x_copy)
+        free_array(x_copy);
+
+    return result;
+}
+
+#define _BIAS_GRAD_KERNEL(NAME, T)                                             \
+    static void NAME(const T *dy, T *db, size_t N, size_t C, size_t L) {       \
+        _Pragma("omp parallel for if (N * C * L > CONV_PARALLEL_MIN)") for (   \
+            size_t c = 0; c < C; c++) {                                        \
+            T acc = 0;                                                         \
+            for (size_t n = 0; n < N; n++) {                                   \
+                const T *row = dy + (n * C + c) * L;                           \
+                _Pragma("omp simd reduction(+ : acc)") for (size_t l = 0;      \
+                                                            l < L; l++)        \
+                    acc += row[l];                                             \
+            }                                                                  \
+            db[c] = acc;                                                       \
+        }                                                                      \
+    }
+
+_BIAS_GRAD_KERNEL(_bias_grad_F, float)
+_BIAS_GRAD_KERNEL(_bias_grad_D, double)
+
+ndArray *array_conv_grad_bias(const ndArray *grad) {
+    if (get_ndim(grad) < 2)
+        RUNTIME_ERROR(SHAPE_MISMATCH,
+                      "Convolution gradients are at least (N, C) shaped");
+
+    ndArray *dy_copy = array_align_contiguous(grad);
+    const void *dy = get_array_data(dy_copy ? dy_copy : grad);
+
+    size_t N = get_shape(grad)[0], C = get_shape(grad)[1], planes = N * C;
+    size_t L = planes ? get_total_size(grad) / planes : 0;
+    ndArray *result = array_init(1, (const size_t[]){C}, get_dtype(grad));
+
+    if (get_dtype(grad) == DTYPE_DOUBLE)
+        _bias_grad_D(dy, get_array_data(result), N, C, L);
+    else
+        _bias_grad_F(dy, get_array_data(result), N, C, L);
+
+    if (dy_copy)
+        free_array(dy_copy);
+
+    return result;
+}
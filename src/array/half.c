@@ -0,0 +1,63 @@
+#include "array.h"
+#include "kernel/half.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+float bf16_to_float(uint16_t x) { return _bf16_to_float(x); }
+uint16_t float_to_bf16(float x) { return _float_to_bf16(x); }
+float half_to_float(uint16_t x) { return _half_to_float(x); }
+uint16_t float_to_half(float x) { return _float_to_half(x); }
+
+void bf16_to_float_buffer(const uint16_t *src, float *dst, size_t n) {
+#pragma omp parallel for simd schedule(static)
+    for (size_t i = 0; i < n; i++)
+        dst[i] = _bf16_to_float(src[i]);
+}
+
+void float_to_bf16_buffer(const float *src, uint16_t *dst, size_t n) {
+#pragma omp parallel for simd schedule(static)
+    for (size_t i = 0; i < n; i++)
+        dst[i] = _float_to_bf16(src[i]);
+}
+
+#if defined(__F16C__)
+void half_to_float_buffer(const uint16_t *src, float *dst, size_t n) {
+    size_t blocks = n / 8;
+
+#pragma omp parallel for schedule(static)
+    for (size_t b = 0; b < blocks; b++) {
+        __m128i h = _mm_loadu_si128((const __m128i *)(src + 8 * b));
+        _mm256_storeu_ps(dst + 8 * b, _mm256_cvtph_ps(h));
+    }
+
+    for (size_t i = 8 * blocks; i < n; i++)
+        dst[i] = _half_to_float(src[i]);
+}
+
+void float_to_half_buffer(const float *src, uint16_t *dst, size_t n) {
+    size_t blocks = n / 8;
+
+#pragma omp parallel for schedule(static)
+    for (size_t b = 0; b < blocks; b++) {
+        __m256 f = _mm256_loadu_ps(src + 8 * b);
+        _mm_storeu_si128((__m128i *)(dst + 8 * b),
+                         _mm256_cvtps_ph(f, _MM_FROUND_TO_NEAREST_INT));
+    }
+
+    for (size_t i = 8 * blocks; i < n; i++)
+        dst[i] = _float_to_half(src[i]);
+}
+#else
+void half_to_float_buffer(const uint16_t *src, float *dst, size_t n) {
+#pragma omp parallel for simd schedule(static)
+    for (size_t i = 0; i < n; i++)
+        dst[i] = _half_to_float(src[i]);
+}
+
+void float_to_half_buffer(const float *src, uint16_t *dst, size_t n) {
+#pragma omp parallel for simd schedule(static)
+    for (size_t i = 0; i < n; i++)
+        dst[i] = _float_to_half(src[i]);
+}
+#endif
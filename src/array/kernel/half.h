@@ -0,0 +1,104 @@
+#ifndef KERNEL_HALF_H
+#define KERNEL_HALF_H
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__F16C__)
+#include <immintrin.h>
+#endif
+
+/*
+ * Scalar fp32 <-> bf16/fp16 conversions, kept branch-light so the loops in
+ * the kernels vectorize. Rounding is round-to-nearest-even in both cases.
+ */
+
+static inline float _bf16_to_float(uint16_t x) {
+    uint32_t bits = (uint32_t)x << 16;
+    float f;
+    memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+static inline uint16_t _float_to_bf16(float f) {
+    uint32_t bits;
+    memcpy(&bits, &f, sizeof(bits));
+
+    // quiet NaNs instead of rounding them into infinities
+    if ((bits & 0x7fffffffu) > 0x7f800000u)
+        return (uint16_t)((bits >> 16) | 0x0040u);
+
+    bits += 0x7fffu + ((bits >> 16) & 1u);
+    return (uint16_t)(bits >> 16);
+}
+
+static inline float _half_to_float(uint16_t x) {
+#if defined(__F16C__)
+    return _cvtsh_ss(x);
+#else
+    uint32_t sign = (uint32_t)(x & 0x8000u) << 16;
+    uint32_t exp = (x >> 10) & 0x1fu;
+    uint32_t mant = x & 0x3ffu;
+    uint32_t bits;
+
+    if (exp == 0x1fu) {
+        bits = sign | 0x7f800000u | (mant << 13);
+    } else if (exp != 0) {
+        bits = sign | ((exp + 112u) << 23) | (mant << 13);
+    } else if (mant == 0) {
+        bits = sign;
+    } else {
+        // subnormal half, renormalize into an fp32 normal
+        exp = 113u;
+        while (!(mant & 0x400u)) {
+            mant <<= 1;
+            exp--;
+        }
+        bits = sign | (exp << 23) | ((mant & 0x3ffu) << 13);
+    }
+
+    float f;
+    memcpy(&f, &bits, sizeof(f));
+    return f;
+#endif
+}
+
+static inline uint16_t _float_to_half(float f) {
+#if defined(__F16C__)
+    return _cvtss_sh(f, _MM_FROUND_TO_NEAREST_INT);
+#else
+    uint32_t bits;
+    memcpy(&bits, &f, sizeof(bits));
+
+    uint16_t sign = (uint16_t)((bits >> 16) & 0x8000u);
+    uint32_t abs = bits & 0x7fffffffu;
+
+    if (abs > 0x7f800000u)
+        return sign | 0x7e00u;
+    if (abs >= 0x477ff000u) // rounds to or above 65520
+        return sign | 0x7c00u;
+
+    if (abs < 0x38800000u) {
+        // result is a half subnormal (or zero)
+        if (abs < 0x33000000u)
+            return sign;
+
+        uint32_t exp = abs >> 23;
+        uint32_t mant = (abs & 0x7fffffu) | 0x800000u;
+        uint32_t shift = 126u - exp;
+
+        uint32_t half_mant = mant >> shift;
+        uint32_t rem = mant & ((1u << shift) - 1u);
+        uint32_t halfway = 1u << (shift - 1u);
+        if (rem > halfway || (rem == halfway && (half_mant & 1u)))
+            half_mant++;
+
+        return sign | (uint16_t)half_mant;
+    }
+
+    abs += 0xfffu + ((abs >> 13) & 1u);
+    return sign | (uint16_t)((abs - 0x38000000u) >> 13);
+#endif
+}
+
+#endif // !KERNEL_HALF_H
@@ -1,15 +1,81 @@
 #include "array.h"
+#include "error_codes.h"
+#include "half.h"
 #include "ops.h"
 
 #include <cblas.h>
 #include <omp.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdlib.h>
 
 static inline bool is_contig(size_t rows, size_t cols, size_t sR, size_t sC) {
     return (sR == cols && sC == 1);
 }
 
+/*
+ * Widen a 16-bit (rows, cols) panel into an fp32 buffer. Row-major and
+ * transposed contiguous panels go through the vectorized buffer converters
+ * in one call (a transposed one is left transposed for the GEMM), rows with
+ * padding one row at a time, anything else element by element.
+ */
+static float *_widen_panel(const uint16_t *src, size_t rows, size_t cols,
+                           size_t sR, size_t sC, DType dtype,
+                           CBLAS_TRANSPOSE *trans) {
+    float *dst = malloc(rows * cols * sizeof(float));
+    if (!dst)
+        RUNTIME_ERROR(ARRAY_INIT_FAILURE, "Failed to allocate matmul panel");
+
+    void (*widen)(const uint16_t *, float *, size_t) =
+        dtype == DTYPE_BF16 ? bf16_to_float_buffer : half_to_float_buffer;
+
+    *trans = CblasNoTrans;
+    if (is_contig(rows, cols, sR, sC)) {
+        widen(src, dst, rows * cols);
+    } else if (is_contig(cols, rows, sC, sR)) {
+        widen(src, dst, rows * cols);
+        *trans = CblasTrans;
+    } else if (sC == 1) {
+        for (size_t r = 0; r < rows; r++)
+            widen(src + r * sR, dst + r * cols, cols);
+    } else if (dtype == DTYPE_BF16) {
+#pragma omp parallel for schedule(static)
+        for (size_t r = 0; r < rows; r++)
+            for (size_t c = 0; c < cols; c++)
+                dst[r * cols + c] = _bf16_to_float(src[r * sR + c * sC]);
+    } else {
+#pragma omp parallel for schedule(static)
+        for (size_t r = 0; r < rows; r++)
+            for (size_t c = 0; c < cols; c++)
+                dst[r * cols + c] = _half_to_float(src[r * sR + c * sC]);
+    }
+
+    return dst;
+}
+
+static void _narrow_panel(const float *src, uint16_t *dst, size_t rows,
+                          size_t cols, size_t sR, size_t sC, DType dtype) {
+    void (*narrow)(const float *, uint16_t *, size_t) =
+        dtype == DTYPE_BF16 ? float_to_bf16_buffer : float_to_half_buffer;
+
+    if (is_contig(rows, cols, sR, sC)) {
+        narrow(src, dst, rows * cols);
+    } else if (sC == 1) {
+        for (size_t r = 0; r < rows; r++)
+            narrow(src + r * cols, dst + r * sR, cols);
+    } else if (dtype == DTYPE_BF16) {
+#pragma omp parallel for schedule(static)
+        for (size_t r = 0; r < rows; r++)
+            for (size_t c = 0; c < cols; c++)
+                dst[r * sR + c * sC] = _float_to_bf16(src[r * cols + c]);
+    } else {
+#pragma omp parallel for schedule(static)
+        for (size_t r = 0; r < rows; r++)
+            for (size_t c = 0; c < cols; c++)
+                dst[r * sR + c * sC] = _float_to_half(src[r * cols + c]);
+    }
+}
+
 void matmul_kernel(const ndArray *arr1, const ndArray *arr2, ndArray *result,
                    const size_t *idx1, const size_t *idx2, const size_t *idx) {
     size_t m = get_shape(result)[get_ndim(result) - 2],
@@ -58,5 +124,30 @@ void matmul_kernel(const ndArray *arr1, const ndArray *arr2, ndArray *result,
         cblas_dgemm(CblasRowMajor, transA, transB, (int)m, (int)n, (int)k, 1.0f,
                     A, lda, B, ldb, 0.0f, C, (int)n);
     } break;
+    case DTYPE_BF16:
+    case DTYPE_HALF: {
+        // fp32 accumulation on widened panels, rounded once into C
+        const uint16_t *A = (uint16_t *)(get_array_data(arr1) + offsetA);
+        const uint16_t *B = (uint16_t *)(get_array_data(arr2) + offsetB);
+        uint16_t *C = (uint16_t *)(get_array_data(result) + offsetC);
+
+        CBLAS_TRANSPOSE transA_f, transB_f;
+        float *A_f = _widen_panel(A, m, k, sAr, sAc, dtype, &transA_f);
+        float *B_f = _widen_panel(B, k, n, sBr, sBc, dtype, &transB_f);
+        float *C_f = malloc(m * n * sizeof(float));
+        if (!C_f)
+            RUNTIME_ERROR(ARRAY_INIT_FAILURE,
+                          "Failed to allocate matmul panel");
+
+        int lda_f = transA_f == CblasTrans ? (int)m : (int)k,
+            ldb_f = transB_f == CblasTrans ? (int)k : (int)n;
+        cblas_sgemm(CblasRowMajor, transA_f, transB_f, (int)m, (int)n, (int)k,
+                    1.0f, A_f, lda_f, B_f, ldb_f, 0.0f, C_f, (int)n);
+        _narrow_panel(C_f, C, m, n, sCr, sCc, dtype);
+
+        free(A_f);
+        free(B_f);
+        free(C_f);
+    } break;
     }
 }
@@ -3,6 +3,7 @@
 
 #include "array.h"
 
+#include <stdbool.h>
 #include <stddef.h>
 
 void matmul_kernel(const ndArray *arr1, const ndArray *arr2, ndArray *result,
@@ -0,0 +1,579 @@
+#include "array.h"
+#include "error_codes.h"
+#include "kernel/half.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define _LOAD(x) (x)
+#define _STORE_F(x) ((float)(x))
+#define _STORE_D(x) ((double)(x))
+
+static double _load_double(const void *data, DType dtype, size_t i) {
+    switch (dtype) {
+    case DTYPE_INT:
+        return ((const int *)data)[i];
+    case DTYPE_LONG:
+        return ((const long int *)data)[i];
+    case DTYPE_FLOAT:
+        return ((const float *)data)[i];
+    case DTYPE_DOUBLE:
+        return ((const double *)data)[i];
+    case DTYPE_BF16:
+        return _bf16_to_float(((const uint16_t *)data)[i]);
+    case DTYPE_HALF:
+        return _half_to_float(((const uint16_t *)data)[i]);
+    }
+
+    return 0.0;
+}
+
+static void _store_double(void *data, DType dtype, size_t i, double value) {
+    switch (dtype) {
+    case DTYPE_INT:
+        ((int *)data)[i] = (int)value;
+        break;
+    case DTYPE_LONG:
+        ((long int *)data)[i] = (long int)value;
+        break;
+    case DTYPE_FLOAT:
+        ((float *)data)[i] = (float)value;
+        break;
+    case DTYPE_DOUBLE:
+        ((double *)data)[i] = value;
+        break;
+    case DTYPE_BF16:
+        ((uint16_t *)data)[i] = _float_to_bf16((float)value);
+        break;
+    case DTYPE_HALF:
+        ((uint16_t *)data)[i] = _float_to_half((float)value);
+        break;
+    }
+}
+
+static bool _is_floating(DType dtype) {
+    return dtype == DTYPE_FLOAT || dtype == DTYPE_DOUBLE ||
+           dtype == DTYPE_BF16 || dtype == DTYPE_HALF;
+}
+
+static double _reduction_scale(Reduction reduction, size_t n) {
+    return (reduction == REDUCTION_MEAN && n > 0) ? 1.0 / (double)n : 1.0;
+}
+
+// (N,) for REDUCTION_NONE, 0-d otherwise
+static void _check_loss_out(const ndArray *out, size_t n, DType dtype,
+                            Reduction reduction) {
+    bool valid = get_dtype(out) == dtype;
+    if (reduction == REDUCTION_NONE)
+        valid = valid && get_total_size(out) == n;
+    else
+        valid = valid && get_ndim(out) == 0;
+
+    if (!valid)
+        RUNTIME_ERROR(SHAPE_MISMATCH, "Output array does not match the loss");
+}
+
+/*
+ * Class losses read an (N, C) input in any layout, one row per sample, and
+ * (N,) DTYPE_INT or DTYPE_LONG class indices.
+ */
+typedef struct RowLayout {
+    size_t num_rows, num_cols;
+    size_t row_stride, col_stride; // in elements
+} RowLayout;
+
+static RowLayout _row_layout(const ndArray *input) {
+    if (get_ndim(input) != 2)
+        RUNTIME_ERRORF(INVALID_DIM,
+                       "Class losses expect (N, C) inputs, got ndim %d",
+                       get_ndim(input));
+    if (!_is_floating(get_dtype(input)))
+        RUNTIME_ERRORF(INVALID_DTYPE, "Invalid loss input dtype `%s`",
+                       DTypeNames[get_dtype(input)]);
+
+    size_t itemsize = get_itemsize(input);
+    return (RowLayout){.num_rows = get_shape(input)[0],
+                       .num_cols = get_shape(input)[1],
+                       .row_stride = get_strides(input)[0] / itemsize,
+                       .col_stride = get_strides(input)[1] / itemsize};
+}
+
+// the caller frees the returned element offsets of the target classes
+static size_t *_target_offsets(const ndArray *target, RowLayout layout) {
+    DType dtype = get_dtype(target);
+    if (dtype != DTYPE_INT && dtype != DTYPE_LONG)
+        RUNTIME_ERRORF(INVALID_DTYPE,
+                       "Class targets must be integers, got `%s`",
+                       DTypeNames[dtype]);
+    if (get_ndim(target) != 1 || get_shape(target)[0] != layout.num_rows)
+        RUNTIME_ERROR(SHAPE_MISMATCH, "Class targets must have shape (N,)");
+
+    size_t *offsets = malloc((layout.num_rows ? layout.num_rows : 1) *
+                             sizeof(size_t));
+    if (!offsets)
+        RUNTIME_ERROR(ARRAY_INIT_FAILURE, "Failed to allocate loss targets");
+
+    const void *data = get_array_data(target);
+    size_t stride = get_strides(target)[0] / get_itemsize(target);
+    for (size_t i = 0; i < layout.num_rows; i++) {
+        double label = _load_double(data, dtype, i * stride);
+        if (label < 0 || label >= (double)layout.num_cols)
+            RUNTIME_ERRORF(INVALID_IDX, "Class index %ld out of range [0, %zu)",
+                           (long)label, layout.num_cols);
+        offsets[i] = i * layout.row_stride + (size_t)label * layout.col_stride;
+    }
+
+    return offsets;
+}
+
+/*
+ * `target_offsets` NULL only writes the row logsumexps. Otherwise the target
+ * logit is picked up while its row is read and the row's cross-entropy
+ * lse - x_t goes to `dst` (NULL when reduced) and into `total`.
+ */
+typedef void (*LogSumExpKernel)(const void *src, double *lse,
+                                const size_t *target_offsets, void *dst,
+                                double *total, RowLayout layout);
+typedef void (*NllGradKernel)(const void *src, void *dst, const double *lse,
+                              const double *row_grads,
+                              const size_t *target_offsets, RowLayout layout);
+
+// one pass per row, the running sum is rescaled whenever the max grows
+#define _LSE_KERNEL(NAME, T, CT, LOAD, STORE, EXP, LOG)                        \
+    static void NAME(const void *src, double *lse,                             \
+                     const size_t *target_offsets, void *dst, double *total,   \
+                     RowLayout layout) {                                       \
+        const T *A = src;                                                      \
+        T *B = dst;                                                            \
+        double acc = 0.0;                                                      \
+        _Pragma("omp parallel for schedule(static) reduction(+ : acc)") for (  \
+            size_t i = 0; i < layout.num_rows; i++) {                          \
+            size_t base = i * layout.row_stride, step = layout.col_stride;     \
+            size_t t = target_offsets ? target_offsets[i] - base : 0;          \
+            const T *a = A + base;                                             \
+                                                                               \
+            CT max = LOAD(a[0]), sum = 1, picked = max;                        \
+            for (size_t j = 1; j < layout.num_cols; j++) {                     \
+                CT x = LOAD(a[j * step]);                                      \
+                if (j * step == t)                                             \
+                    picked = x;                                                \
+                if (x > max) {                                                 \
+                    sum = sum * EXP(max - x) + (CT)1;                          \
+                    max = x;                                                   \
+                } else {                                                       \
+                    sum += EXP(x - max);                                       \
+                }                                                              \
+            }                                                                  \
+                                                                               \
+            lse[i] = (double)(max + LOG(sum));                                 \
+            if (target_offsets) {                                              \
+                double loss = lse[i] - (double)picked;                         \
+                if (B)                                                         \
+                    B[i] = STORE(loss);                                        \
+                acc += loss;                                                   \
+            }                                                                  \
+        }                                                                      \
+        if (total)                                                             \
+            *total = acc;                                                      \
+    }
+
+/*
+ * d/dx_ij of lse_i - x_it is softmax_ij - [j == t], with `lse` NULL (NLL)
+ * only the target entry is non-zero. The one-hot is never materialized.
+ */
+#define _NLL_GRAD_KERNEL(NAME, T, CT, LOAD, STORE, EXP)                        \
+    static void NAME(const void *src, void *dst, const double *lse,            \
+                     const double *row_grads, const size_t *target_offsets,    \
+                     RowLayout layout) {                                       \
+        const T *A = src;                                                      \
+        T *B = dst;                                                            \
+        _Pragma("omp parallel for schedule(static)") for (size_t i = 0;        \
+                                                          i < layout.num_rows; \
+                                                          i++) {               \
+            size_t base = i * layout.row_stride, step = layout.col_stride;     \
+            CT g = (CT)row_grads[i];                                           \
+            if (lse) {                                                         \
+                CT shift = (CT)lse[i];                                         \
+                for (size_t j = 0; j < layout.num_cols; j++)                   \
+                    B[base + j * step] =                                       \
+                        STORE(g * EXP(LOAD(A[base + j * step]) - shift));      \
+            } else {                                                           \
+                for (size_t j = 0; j < layout.num_cols; j++)                   \
+                    B[base + j * step] = STORE((CT)0);                         \
+            }                                                                  \
+            size_t t = target_offsets[i];                                      \
+            B[t] = STORE(LOAD(B[t]) - g);                                      \
+        }                                                                      \
+    }
+
+_LSE_KERNEL(_lse_f, float, float, _LOAD, _STORE_F, expf, logf)
+_LSE_KERNEL(_lse_d, double, double, _LOAD, _STORE_D, exp, log)
+_LSE_KERNEL(_lse_bf, uint16_t, float, _bf16_to_float, _float_to_bf16, expf,
+            logf)
+_LSE_KERNEL(_lse_h, uint16_t, float, _half_to_float, _float_to_half, expf,
+            logf)
+
+_NLL_GRAD_KERNEL(_nll_grad_f, float, float, _LOAD, _STORE_F, expf)
+_NLL_GRAD_KERNEL(_nll_grad_d, double, double, _LOAD, _STORE_D, exp)
+_NLL_GRAD_KERNEL(_nll_grad_bf, uint16_t, float, _bf16_to_float,
+                 _float_to_bf16, expf)
+_NLL_GRAD_KERNEL(_nll_grad_h, uint16_t, float, _half_to_float, _float_to_half,
+                 expf)
+
+static const LogSumExpKernel lse_kernels[6] = {
+    [DTYPE_FLOAT] = _lse_f,
+    [DTYPE_DOUBLE] = _lse_d,
+    [DTYPE_BF16] = _lse_bf,
+    [DTYPE_HALF] = _lse_h,
+};
+
+static const NllGradKernel nll_grad_kernels[6] = {
+    [DTYPE_FLOAT] = _nll_grad_f,
+    [DTYPE_DOUBLE] = _nll_grad_d,
+    [DTYPE_BF16] = _nll_grad_bf,
+    [DTYPE_HALF] = _nll_grad_h,
+};
+
+ndArray *array_logsumexp(const ndArray *logits) {
+    RowLayout layout = _row_layout(logits);
+    ndArray *lse = array_init(1, (const size_t[]){layout.num_rows},
+                              DTYPE_DOUBLE);
+
+    array_logsumexp_out(logits, lse);
+    return lse;
+}
+
+void array_logsumexp_out(const ndArray *logits, ndArray *out) {
+    RowLayout layout = _row_layout(logits);
+    if (get_dtype(out) != DTYPE_DOUBLE ||
+        get_total_size(out) != layout.num_rows)
+        RUNTIME_ERROR(SHAPE_MISMATCH,
+                      "Output array does not match the logsumexp rows");
+
+    lse_kernels[get_dtype(logits)](get_array_data(logits), get_array_data(out),
+                                   NULL, NULL, NULL, layout);
+}
+
+static ndArray *_loss_array(size_t n, DType dtype, Reduction reduction) {
+    if (reduction == REDUCTION_NONE)
+        return array_init(1, (const size_t[]){n}, dtype);
+
+    return array_init(0, (const size_t[]){}, dtype);
+}
+
+ndArray *array_nll_loss(const ndArray *input, const ndArray *target,
+                        Reduction reduction) {
+    RowLayout layout = _row_layout(input);
+    ndArray *out = _loss_array(layout.num_rows, get_dtype(input), reduction);
+
+    array_nll_loss_out(input, target, reduction, out);
+    return out;
+}
+
+void array_nll_loss_out(const ndArray *input, const ndArray *target,
+                        Reduction reduction, ndArray *out) {
+    RowLayout layout = _row_layout(input);
+    DType dtype = get_dtype(input);
+    _check_loss_out(out, layout.num_rows, dtype, reduction);
+
+    size_t *offsets = _target_offsets(target, layout);
+    const void *data = get_array_data(input);
+    void *out_data = get_array_data(out);
+
+    // one element per row
+    double total = 0.0;
+    for (size_t i = 0; i < layout.num_rows; i++) {
+        double loss = -_load_double(data, dtype, offsets[i]);
+        if (reduction == REDUCTION_NONE)
+            _store_double(out_data, dtype, i, loss);
+        total += loss;
+    }
+    if (reduction != REDUCTION_NONE)
+        _store_double(out_data, dtype, 0,
+                      total * _reduction_scale(reduction, layout.num_rows));
+
+    free(offsets);
+}
+
+ndArray *array_cross_entropy(const ndArray *logits, const ndArray *target,
+                             Reduction reduction, ndArray **lse) {
+    RowLayout layout = _row_layout(logits);
+    ndArray *out = _loss_array(layout.num_rows, get_dtype(logits), reduction);
+    *lse = array_init(1, (const size_t[]){layout.num_rows}, DTYPE_DOUBLE);
+
+    array_cross_entropy_out(logits, target, reduction, *lse, out);
+    return out;
+}
+
+void array_cross_entropy_out(const ndArray *logits, const ndArray *target,
+                             Reduction reduction, ndArray *lse, ndArray *out) {
+    RowLayout layout = _row_layout(logits);
+    DType dtype = get_dtype(logits);
+    _check_loss_out(out, layout.num_rows, dtype, reduction);
+    if (get_dtype(lse) != DTYPE_DOUBLE ||
+        get_total_size(lse) != layout.num_rows)
+        RUNTIME_ERROR(SHAPE_MISMATCH, "logsumexp does not match the rows");
+
+    size_t *offsets = _target_offsets(target, layout);
+    void *dst = reduction == REDUCTION_NONE ? get_array_data(out) : NULL;
+
+    double total;
+    lse_kernels[dtype](get_array_data(logits), get_array_data(lse), offsets,
+                       dst, &total, layout);
+    if (reduction != REDUCTION_NONE)
+        _store_double(get_array_data(out), dtype, 0,
+                      total * _reduction_scale(reduction, layout.num_rows));
+
+    free(offsets);
+}
+
+// upstream gradients per row (per element), with the reduction folded in
+static double *_upstream_grads(const ndArray *grad, size_t n,
+                               Reduction reduction) {
+    double *grads = malloc((n ? n : 1) * sizeof(double));
+    if (!grads)
+        RUNTIME_ERROR(ARRAY_INIT_FAILURE, "Failed to allocate loss gradients");
+
+    DType dtype = get_dtype(grad);
+    const void *data = get_array_data(grad);
+    if (reduction == REDUCTION_NONE) {
+        if (get_total_size(grad) != n)
+            RUNTIME_ERROR(SHAPE_MISMATCH, "Loss gradient does not match");
+
+        int ndim = get_ndim(grad);
+        size_t stride = ndim ? get_strides(grad)[ndim - 1] / get_itemsize(grad)
+                             : 1;
+        for (size_t i = 0; i < n; i++)
+            grads[i] = _load_double(data, dtype, i * stride);
+    } else {
+        double g =
+            _load_double(data, dtype, 0) * _reduction_scale(reduction, n);
+        for (size_t i = 0; i < n; i++)
+            grads[i] = g;
+    }
+
+    return grads;
+}
+
+ndArray *array_nll_loss_grad(const ndArray *grad, const ndArray *input,
+                             const ndArray *target, const ndArray *lse,
+                             Reduction reduction) {
+    RowLayout layout = _row_layout(input);
+    DType dtype = get_dtype(input);
+
+    ndArray *result = array_init(2, get_shape(input), dtype);
+    set_strides(result, get_strides(input));
+
+    size_t *offsets = _target_offsets(target, layout);
+    double *row_grads = _upstream_grads(grad, layout.num_rows, reduction);
+
+    nll_grad_kernels[dtype](get_array_data(input), get_array_data(result),
+                            lse ? get_array_data(lse) : NULL, row_grads,
+                            offsets, layout);
+
+    free(offsets);
+    free(row_grads);
+    return result;
+}
+
+/*
+ * Pointwise losses between an input and a target of the same shape and
+ * dtype. BCE with logits is max(x, 0) - x y + log(1 + exp(-|x|)), stable
+ * for logits of any magnitude.
+ */
+typedef void (*PointwiseLossKernel)(const void *x, const void *y, void *dst,
+                                    size_t n, double *total);
+// `g` holds one upstream gradient per element, NULL to broadcast `g_scalar`
+typedef void (*PointwiseLossGradKernel)(const void *x, const void *y,
+                                        const void *g, double g_scalar,
+                                        void *dst, size_t n, bool wrt_target);
+#define _POINTWISE_LOSS_MATH(M, CT, EXP, LOG)                                  \
+    static inline CT _mse_##M(CT x, CT y) { return (x - y) * (x - y); }        \
+    static inline CT _bce_##M(CT x, CT y) {                                    \
+        CT abs_x = x < 0 ? -x : x;                                             \
+        return (x > 0 ? x : (CT)0) - x * y + LOG((CT)1 + EXP(-abs_x));         \
+    }                                                                          \
+    static inline CT _mse_grad_##M(CT x, CT y, bool wrt_target) {              \
+        return wrt_target ? (CT)2 * (y - x) : (CT)2 * (x - y);                 \
+    }                                                                          \
+    static inline CT _bce_grad_##M(CT x, CT y, bool wrt_target) {              \
+        if (wrt_target)                                                        \
+            return -x;                                                         \
+        CT abs_x = x < 0 ? -x : x, e = EXP(-abs_x);                            \
+        CT sigmoid = x >= 0 ? (CT)1 / ((CT)1 + e) : e / ((CT)1 + e);           \
+        return sigmoid - y;                                                    \
+    }
+
+_POINTWISE_LOSS_MATH(f, float, expf, logf)
+_POINTWISE_LOSS_MATH(d, double, exp, log)
+
+// writes the elementwise losses unless `dst` is NULL, `total` their sum if set
+#define _POINTWISE_LOSS_KERNEL(NAME, T, CT, LOAD, STORE, FN)                   \
+    static void NAME(const void *x, const void *y, void *dst, size_t n,        \
+                     double *total) {                                          \
+        const T *X = x, *Y = y;                                                \
+        T *B = dst;                                                            \
+        double acc = 0.0;                                                      \
+        _Pragma("omp parallel for simd schedule(static) reduction(+ : acc)")   \
+            for (size_t i = 0; i < n; i++) {                                   \
+            CT loss = FN(LOAD(X[i]), LOAD(Y[i]));                              \
+            if (B)                                                             \
+                B[i] = STORE(loss);                                            \
+            acc += (double)loss;                                               \
+        }                                                                      \
+        if (total)                                                             \
+            *total = acc;                                                      \
+    }
+
+#define _POINTWISE_LOSS_GRAD_KERNEL(NAME, T, CT, LOAD, STORE, FN)              \
+    static void NAME(const void *x, const void *y, const void *g,              \
+                     double g_scalar, void *dst, size_t n, bool wrt_target) {  \
+        const T *X = x, *Y = y, *G = g;                                        \
+        T *B = dst;                                                            \
+        _Pragma("omp parallel for simd schedule(static)") for (size_t i = 0;   \
+                                                               i < n; i++) {   \
+            CT gi = G ? LOAD(G[i]) : (CT)g_scalar;                             \
+            B[i] = STORE(gi * FN(LOAD(X[i]), LOAD(Y[i]), wrt_target));         \
+        }                                                                      \
+    }
+
+#define _POINTWISE_LOSS_KERNELS(S, T, CT, M, LOAD, STORE)                      \
+    _POINTWISE_LOSS_KERNEL(_mse_##S, T, CT, LOAD, STORE, _mse_##M)             \
+    _POINTWISE_LOSS_KERNEL(_bce_##S, T, CT, LOAD, STORE, _bce_##M)             \
+    _POINTWISE_LOSS_GRAD_KERNEL(_mse_grad_##S, T, CT, LOAD, STORE,             \
+                                _mse_grad_##M)                                 \
+    _POINTWISE_LOSS_GRAD_KERNEL(_bce_grad_##S, T, CT, LOAD, STORE,             \
+                                _bce_grad_##M)
+
+_POINTWISE_LOSS_KERNELS(F, float, float, f, _LOAD, _STORE_F)
+_POINTWISE_LOSS_KERNELS(D, double, double, d, _LOAD, _STORE_D)
+_POINTWISE_LOSS_KERNELS(BF, uint16_t, float, f, _bf16_to_float, _float_to_bf16)
+_POINTWISE_LOSS_KERNELS(H, uint16_t, float, f, _half_to_float, _float_to_half)
+
+static const PointwiseLossKernel pointwise_loss_kernels[4][6] = {
+    [LOSS_MSE] = {[DTYPE_FLOAT] = _mse_F, [DTYPE_DOUBLE] = _mse_D,
+                  [DTYPE_BF16] = _mse_BF, [DTYPE_HALF] = _mse_H},
+    [LOSS_BCE_WITH_LOGITS] = {[DTYPE_FLOAT] = _bce_F, [DTYPE_DOUBLE] = _bce_D,
+                              [DTYPE_BF16] = _bce_BF, [DTYPE_HALF] = _bce_H},
+};
+
+static const PointwiseLossGradKernel pointwise_loss_grad_kernels[4][6] = {
+    [LOSS_MSE] = {[DTYPE_FLOAT] = _mse_grad_F,
+                  [DTYPE_DOUBLE] = _mse_grad_D,
+                  [DTYPE_BF16] = _mse_grad_BF,
+                  [DTYPE_HALF] = _mse_grad_H},
+    [LOSS_BCE_WITH_LOGITS] = {[DTYPE_FLOAT] = _bce_grad_F,
+                              [DTYPE_DOUBLE] = _bce_grad_D,
+                              [DTYPE_BF16] = _bce_grad_BF,
+                              [DTYPE_HALF] = _bce_grad_H},
+};
+
+static ndArray *_check_pointwise(const ndArray *input, const ndArray *target,
+                                 LossKind kind) {
+    DType dtype = get_dtype(input);
+    if (kind != LOSS_MSE && kind != LOSS_BCE_WITH_LOGITS)
+        RUNTIME_ERROR(INVALID_ARRAY, "Not a pointwise loss");
+    if (!_is_floating(dtype) || get_dtype(target) != dtype)
+        RUNTIME_ERRORF(INVALID_DTYPE, "Invalid loss dtypes `%s` and `%s`",
+                       DTypeNames[dtype], DTypeNames[get_dtype(target)]);
+
+    int ndim = get_ndim(input);
+    bool same_shape = get_ndim(target) == ndim;
+    for (int d = 0; same_shape && d < ndim; d++)
+        same_shape = get_shape(input)[d] == get_shape(target)[d];
+    if (!same_shape)
+        RUNTIME_ERROR(SHAPE_MISMATCH, "Loss input and target shapes differ");
+
+    return array_align_layout(target, input);
+}
+
+ndArray *array_pointwise_loss(const ndArray *input, const ndArray *target,
+                              LossKind kind, Reduction reduction) {
+    ndArray *out;
+    if (reduction == REDUCTION_NONE) {
+        out = array_init(get_ndim(input), get_shape(input), get_dtype(input));
+        set_strides(out, get_strides(input));
+    } else {
+        out = array_init(0, (const size_t[]){}, get_dtype(input));
+    }
+
+    array_pointwise_loss_out(input, target, kind, reduction, out);
+    return out;
+}
+
+void array_pointwise_loss_out(const ndArray *input, const ndArray *target,
+                              LossKind kind, Reduction reduction,
+                              ndArray *out) {
+    ndArray *aligned = _check_pointwise(input, target, kind);
+    if (aligned)
+        target = aligned;
+
+    DType dtype = get_dtype(input);
+    size_t n = get_total_size(input);
+    PointwiseLossKernel kernel = pointwise_loss_kernels[kind][dtype];
+
+    if (reduction == REDUCTION_NONE) {
+        if (!same_layout(input, out) || get_dtype(out) != dtype)
+            RUNTIME_ERROR(SHAPE_MISMATCH,
+                          "Output array does not match the loss input");
+        kernel(get_array_data(input), get_array_data(target),
+               get_array_data(out), n, NULL);
+    } else {
+        _check_loss_out(out, 1, dtype, reduction);
+
+        double total;
+        kernel(get_array_data(input), get_array_data(target), NULL, n, &total);
+        _store_double(get_array_data(out), dtype, 0,
+                      total * _reduction_scale(reduction, n));
+    }
+
+    if (aligned)
+        free_array(aligned);
+}
+
+ndArray *array_pointwise_loss_grad(const ndArray *grad, const ndArray *input,
+                                   const ndArray *target, LossKind kind,
+                                   Reduction reduction, bool wrt_target) {
+    ndArray *aligned = _check_pointwise(input, target, kind);
+    if (aligned)
+        target = aligned;
+
+    // per-element upstream gradients follow the input's buffer order
+    ndArray *aligned_grad = NULL;
+    if (reduction == REDUCTION_NONE) {
+        aligned_grad = array_align_layout(grad, input);
+        if (aligned_grad)
+            grad = aligned_grad;
+    }
+
+    DType dtype = get_dtype(input);
+    size_t n = get_total_size(input);
+    if (get_dtype(grad) != dtype)
+        RUNTIME_ERRORF(INVALID_DTYPE, "Invalid loss gradient dtype `%s`",
+                       DTypeNames[get_dtype(grad)]);
+
+    double g_scalar = 0.0;
+    if (reduction != REDUCTION_NONE)
+        g_scalar = _load_double(get_array_data(grad), dtype, 0) *
+                   _reduction_scale(reduction, n);
+
+    ndArray *result = array_init(get_ndim(input), get_shape(input), dtype);
+    set_strides(result, get_strides(input));
+
+    const void *grad_data =
+        reduction == REDUCTION_NONE ? get_array_data(grad) : NULL;
+    pointwise_loss_grad_kernels[kind][dtype](
+        get_array_data(input), get_array_data(target), grad_data, g_scalar,
+        get_array_data(result), n, wrt_target);
+
+    if (aligned)
+        free_array(aligned);
+    if (aligned_grad)
+        free_array(aligned_grad);
+
+    return result;
+}
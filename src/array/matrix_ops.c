@@ -25,10 +25,8 @@ static void _batch_matmul(ndArray *arr1, ndArray *arr2, ndArray *result) {
     }
 }
 
-/*
-(..., m, k), (..., k, n) -> (..., m, n)
-*/
-ndArray *matmul(ndArray *arr1, ndArray *arr2) {
+// validates the operands and fills the result shape, returns its ndim
+static int _matmul_shape(ndArray *arr1, ndArray *arr2, size_t *shape) {
     if (get_ndim(arr1) < 2 || get_ndim(arr2) < 2)
         RUNTIME_ERROR(INVALID_ARRAY, "matmul requires arrays with ndim >= 2");
 
@@ -43,7 +41,7 @@ ndArray *matmul(ndArray *arr1, ndArray *arr2) {
     if (dtype == DTYPE_INT || dtype == DTYPE_LONG)
         RUNTIME_ERRORF(INVALID_DTYPE,
                        "Cannot matmul arrays with dtype - `%s`, only "
-                       "DTYPE_FLOAT and DTYPE_DOUBLE are supported",
+                       "floating point dtypes are supported",
                        DTypeNames[dtype]);
 
     size_t m = get_shape(arr1)[get_ndim(arr1) - 2],
@@ -64,7 +62,6 @@ ndArray *matmul(ndArray *arr1, ndArray *arr2) {
     size_t batch_shape[batch_ndim];
     broadcast_shape(get_shape(arr1), get_shape(arr2), batch_shape, batch_ndim1,
                     batch_ndim2, batch_ndim);
-    size_t shape[batch_ndim + 2];
 
     for (int i = 0; i < batch_ndim; i++)
         shape[i] = batch_shape[i];
@@ -73,12 +70,37 @@ ndArray *matmul(ndArray *arr1, ndArray *arr2) {
     shape[batch_ndim] = m;
     shape[batch_ndim + 1] = n;
 
-    ndArray *result = array_init(batch_ndim + 2, shape, dtype);
+    return batch_ndim + 2;
+}
+
+/*
+(..., m, k), (..., k, n) -> (..., m, n)
+*/
+ndArray *matmul(ndArray *arr1, ndArray *arr2) {
+    size_t shape[MAX_NDIM];
+    int ndim = _matmul_shape(arr1, arr2, shape);
+
+    ndArray *result = array_init(ndim, shape, get_dtype(arr1));
     _batch_matmul(arr1, arr2, result);
 
     return result;
 }
 
+void matmul_out(ndArray *arr1, ndArray *arr2, ndArray *out) {
+    size_t shape[MAX_NDIM];
+    int ndim = _matmul_shape(arr1, arr2, shape);
+
+    bool match = get_ndim(out) == ndim && get_dtype(out) == get_dtype(arr1);
+    for (int d = 0; match && d < ndim; d++)
+        match = get_shape(out)[d] == shape[d];
+
+    if (!match)
+        RUNTIME_ERROR(SHAPE_MISMATCH,
+                      "Output array does not match the matmul result");
+
+    _batch_matmul(arr1, arr2, out);
+}
+
 static bool _repeated_dims(const int *dims, int ndim) {
     for (int i = 0; i < ndim; i++) {
         for (int j = i + 1; j < ndim; j++) {
@@ -0,0 +1,636 @@
+#include "array.h"
+#include "error_codes.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// segment loops fork only past this many elements
+#define NORM_PARALLEL_MIN 16384
+
+// elements per Welford block, a block's two passes stay in L1
+#define NORM_BLOCK 256
+
+/*
+ * A normalized array is `outer * groups` contiguous segments of `inner`
+ * elements, segment s belonging to group s % groups; each group has its own
+ * statistics. Layer and RMS norms have one segment per group (a sample's
+ * trailing dims) and per-element affine parameters, batch norm has N
+ * segments (the (H, W) planes) per channel and per-group ones.
+ */
+typedef struct NormGeometry {
+    size_t outer, groups, inner;
+    bool per_group;
+    int affine_ndim;
+    const size_t *affine_shape; // borrowed from the input
+} NormGeometry;
+
+static NormGeometry _norm_geometry(const ndArray *input,
+                                   const NormParams *params) {
+    int ndim = get_ndim(input);
+    const size_t *shape = get_shape(input);
+
+    DType dtype = get_dtype(input);
+    if (dtype != DTYPE_FLOAT && dtype != DTYPE_DOUBLE)
+        RUNTIME_ERRORF(INVALID_DTYPE,
+                       "Normalization needs DTYPE_FLOAT or DTYPE_DOUBLE, got "
+                       "`%s`",
+                       DTypeNames[dtype]);
+
+    NormGeometry g = {.outer = 1, .groups = 1, .inner = 1};
+    int split;
+    if (params->kind == NORM_BATCH) {
+        if (ndim < 2)
+            RUNTIME_ERRORF(SHAPE_MISMATCH,
+                           "Batch norm expects an (N, C, *) input, got %d-d",
+                           ndim);
+        g.outer = shape[0];
+        g.groups = shape[1];
+        g.per_group = true;
+        g.affine_ndim = 1;
+        g.affine_shape = shape + 1;
+        split = 2;
+    } else {
+        int k = params->normalized_ndim;
+        if (k < 1 || k > ndim)
+            RUNTIME_ERRORF(INVALID_DIM,
+                           "Cannot normalize %d trailing dims of a %d-d input",
+                           k, ndim);
+        split = ndim - k;
+        for (int d = 0; d < split; d++)
+            g.groups *= shape[d];
+        g.affine_ndim = k;
+        g.affine_shape = shape + split;
+    }
+    for (int d = split; d < ndim; d++)
+        g.inner *= shape[d];
+
+    if (g.outer * g.inner == 0)
+        RUNTIME_ERROR(SHAPE_MISMATCH, "Cannot normalize empty groups");
+
+    return g;
+}
+
+static void _check_affine(const ndArray *param, const NormGeometry *g,
+                          DType dtype, const char *name) {
+    if (!param)
+        return;
+
+    bool match = get_dtype(param) == dtype && get_ndim(param) == g->affine_ndim;
+    for (int d = 0; match && d < g->affine_ndim; d++)
+        match = get_shape(param)[d] == g->affine_shape[d];
+    if (!match)
+        RUNTIME_ERRORF(SHAPE_MISMATCH,
+                       "Normalization %s must be `%s` and of the normalized "
+                       "shape",
+                       name, DTypeNames[dtype]);
+}
+
+static void _check_like(const ndArray *array, const ndArray *input,
+                        const char *name) {
+    bool match = get_dtype(array) == get_dtype(input) &&
+                 get_ndim(array) == get_ndim(input);
+    for (int d = 0; match && d < get_ndim(input); d++)
+        match = get_shape(array)[d] == get_shape(input)[d];
+    if (!match)
+        RUNTIME_ERRORF(SHAPE_MISMATCH,
+                       "Normalization %s must match the input", name);
+}
+
+static void _check_running(const ndArray *running, const NormGeometry *g) {
+    DType dtype = get_dtype(running);
+    if (get_ndim(running) != 1 || get_shape(running)[0] != g->groups ||
+        !is_array_contiguous(running) ||
+        (dtype != DTYPE_FLOAT && dtype != DTYPE_DOUBLE))
+        RUNTIME_ERRORF(SHAPE_MISMATCH,
+                       "Running statistics must be contiguous (%zu,) "
+                       "DTYPE_FLOAT or DTYPE_DOUBLE arrays",
+                       g->groups);
+}
+
+/*
+ * `array`'s row-major buffer, copied into `*owned` when it is strided or,
+ * for a NULL array, filled with `fill` in the affine shape. The caller
+ * frees `*owned`.
+ */
+static const void *_operand(const ndArray *array, ndArray **owned,
+                            const NormGeometry *g, DType dtype,
+                            double fill) {
+    if (!array)
+        *owned = fill == 0.0 ? zeros(g->affine_ndim, g->affine_shape, dtype)
+                             : ones(g->affine_ndim, g->affine_shape, dtype);
+    else
+        *owned = array_align_contiguous(array);
+
+    return get_array_data(*owned ? *owned : array);
+}
+
+static void _release(ndArray **owned, size_t n) {
+    for (size_t i = 0; i < n; i++)
+        if (owned[i])
+            free_array(owned[i]);
+}
+
+/*
+ * Mean and centered sum of squares of every segment in one read: each
+ * block of NORM_BLOCK elements gets its own mean and M2 from two passes
+ * over L1 (both vectorize, unlike per-element Welford updates), and the
+ * blocks are folded with Chan's pairwise update. RMS norm only needs the
+ * plain sum of squares.
+ */
+#define _NORM_MOMENTS_KERNEL(NAME, T)                                          \
+    static void NAME(const T *x, double *mean, double *m2, bool rms,           \
+                     const NormGeometry *g) {                                  \
+        size_t segments = g->outer * g->groups, inner = g->inner;              \
+        _Pragma("omp parallel for if (segments * inner > NORM_PARALLEL_MIN)")  \
+        for (size_t s = 0; s < segments; s++) {                                \
+            const T *seg = x + s * inner;                                      \
+            double n = 0.0, m = 0.0, q = 0.0;                                  \
+            for (size_t b = 0; b < inner; b += NORM_BLOCK) {                   \
+                size_t len = inner - b < NORM_BLOCK ? inner - b : NORM_BLOCK;  \
+                const T *blk = seg + b;                                        \
+                double sum = 0.0, sq = 0.0;                                    \
+                if (rms) {                                                     \
+                    _Pragma("omp simd reduction(+ : sq)")                      \
+                    for (size_t i = 0; i < len; i++)                           \
+                        sq += (double)blk[i] * (double)blk[i];                 \
+                    q += sq;                                                   \
+                    continue;                                                  \
+                }                                                              \
+                _Pragma("omp simd reduction(+ : sum)")                         \
+                for (size_t i = 0; i < len; i++)                               \
+                    sum += blk[i];                                             \
+                double bm = sum / (double)len;                                 \
+                _Pragma("omp simd reduction(+ : sq)")                          \
+                for (size_t i = 0; i < len; i++) {                             \
+                    double d = blk[i] - bm;                                    \
+                    sq += d * d;                                               \
+                }                                                              \
+                double delta = bm - m, total = n + (double)len;                \
+                m += delta * (double)len / total;                              \
+                q += sq + delta * delta * n * (double)len / total;             \
+                n = total;                                                     \
+            }                                                                  \
+            mean[s] = m;                                                       \
+            m2[s] = q;                                                         \
+        }                                                                      \
+    }
+
+/*
+ * y = (x - mean) rstd gamma + beta. With per-group parameters that is one
+ * scale and shift per segment, which is also how batch norm's running
+ * statistics fold into the affine outside training.
+ */
+#define _NORM_APPLY_KERNEL(NAME, T)                                            \
+    static void NAME(const T *x, const T *gamma, const T *beta,                \
+                     const double *mean, const double *rstd, T *y,             \
+                     const NormGeometry *g) {                                  \
+        size_t segments = g->outer * g->groups, inner = g->inner;              \
+        _Pragma("omp parallel for if (segments * inner > NORM_PARALLEL_MIN)")  \
+        for (size_t s = 0; s < segments; s++) {                                \
+            size_t grp = s % g->groups;                                        \
+            const T *in = x + s * inner;                                       \
+            T *out = y + s * inner;                                            \
+            if (g->per_group) {                                                \
+                double scale = rstd[grp] * gamma[grp];                         \
+                T a = (T)scale, b = (T)(beta[grp] - mean[grp] * scale);        \
+                _Pragma("omp simd") for (size_t i = 0; i < inner; i++)         \
+                    out[i] = in[i] * a + b;                                    \
+            } else {                                                           \
+                T mu = (T)mean[grp], r = (T)rstd[grp];                         \
+                _Pragma("omp simd") for (size_t i = 0; i < inner; i++)         \
+                    out[i] = (in[i] - mu) * r * gamma[i] + beta[i];            \
+            }                                                                  \
+        }                                                                      \
+    }
+
+/*
+ * Per-segment sums a = sum(gamma v) and b = sum(gamma v xhat), gamma being
+ * per-element (NULL for none). `dgamma` and `dbeta` (NULL to skip) collect
+ * the per-element sums of v xhat and v over all segments in thread-local
+ * rows, in the same read.
+ */
+#define _NORM_SUMS_KERNEL(NAME, T)                                             \
+    static void NAME(const T *v, const T *x, const T *gamma,                   \
+                     const double *mean, const double *rstd, double *a,        \
+                     double *b, double *dgamma, double *dbeta,                 \
+                     const NormGeometry *g) {                                  \
+        size_t segments = g->outer * g->groups, inner = g->inner;              \
+        _Pragma("omp parallel if (segments * inner > NORM_PARALLEL_MIN)")      \
+        {                                                                      \
+            double *acc = NULL;                                                \
+            if (dgamma) {                                                      \
+                acc = calloc(2 * inner, sizeof(double));                       \
+                if (!acc)                                                      \
+                    RUNTIME_ERROR(ARRAY_INIT_FAILURE,                          \
+                                  "Failed to allocate norm accumulators");     \
+            }                                                                  \
+            _Pragma("omp for") for (size_t s = 0; s < segments; s++) {         \
+                size_t grp = s % g->groups;                                    \
+                const T *vs = v + s * inner, *xs = x + s * inner;              \
+                double mu = mean[grp], r = rstd[grp], sa = 0.0, sb = 0.0;      \
+                if (gamma) {                                                   \
+                    _Pragma("omp simd reduction(+ : sa, sb)")                  \
+                    for (size_t i = 0; i < inner; i++) {                       \
+                        double gv = (double)gamma[i] * vs[i];                  \
+                        sa += gv;                                              \
+                        sb += gv * (xs[i] - mu) * r;                           \
+                    }                                                          \
+                } else {                                                       \
+                    _Pragma("omp simd reduction(+ : sa, sb)")                  \
+                    for (size_t i = 0; i < inner; i++) {                       \
+                        sa += vs[i];                                           \
+                        sb += (double)vs[i] * (xs[i] - mu) * r;                \
+                    }                                                          \
+                }                                                              \
+                a[s] = sa;                                                     \
+                b[s] = sb;                                                     \
+                if (acc) {                                                     \
+                    _Pragma("omp simd") for (size_t i = 0; i < inner; i++) {   \
+                        acc[i] += (double)vs[i] * (xs[i] - mu) * r;            \
+                        acc[inner + i] += vs[i];                               \
+                    }                                                          \
+                }                                                              \
+            }                                                                  \
+            if (acc) {                                                         \
+                _Pragma("omp critical") for (size_t i = 0; i < inner; i++) {   \
+                    dgamma[i] += acc[i];                                       \
+                    dbeta[i] += acc[inner + i];                                \
+                }                                                              \
+                free(acc);                                                     \
+            }                                                                  \
+        }                                                                      \
+    }
+
+/*
+ * dx = rstd (gamma dy - c1 - xhat c2), c1 and c2 being the group means of
+ * gamma dy and gamma dy xhat (zero for constant statistics). Expanding
+ * xhat makes it one multiply-add chain per element.
+ */
+#define _NORM_GRAD_INPUT_KERNEL(NAME, T)                                       \
+    static void NAME(const T *dy, const T *x, const T *gamma,                  \
+                     const double *mean, const double *rstd, const double *c1, \
+                     const double *c2, T *dx, const NormGeometry *g) {         \
+        size_t segments = g->outer * g->groups, inner = g->inner;              \
+        _Pragma("omp parallel for if (segments * inner > NORM_PARALLEL_MIN)")  \
+        for (size_t s = 0; s < segments; s++) {                                \
+            size_t grp = s % g->groups;                                        \
+            const T *dys = dy + s * inner, *xs = x + s * inner;                \
+            T *dxs = dx + s * inner;                                           \
+            double r = rstd[grp];                                              \
+            T slope = (T)(-r * r * c2[grp]),                                   \
+              shift = (T)(r * (r * c2[grp] * mean[grp] - c1[grp]));            \
+            if (g->per_group || !gamma) {                                      \
+                T scale = (T)(r * (gamma ? gamma[grp] : (T)1));                \
+                _Pragma("omp simd") for (size_t i = 0; i < inner; i++)         \
+                    dxs[i] = scale * dys[i] + slope * xs[i] + shift;           \
+            } else {                                                           \
+                T rt = (T)r;                                                   \
+                _Pragma("omp simd") for (size_t i = 0; i < inner; i++)         \
+                    dxs[i] = rt * gamma[i] * dys[i] + slope * xs[i] + shift;   \
+            }                                                                  \
+        }                                                                      \
+    }
+
+/*
+ * The normalization's Jacobian is symmetric, so the tangent is the input
+ * gradient's projection applied to v before gamma rather than after:
+ * dy = gamma rstd (v - c1 - xhat c2) + dgamma xhat + dbeta.
+ */
+#define _NORM_JVP_KERNEL(NAME, T)                                              \
+    static void NAME(const T *v, const T *x, const T *gamma,                   \
+                     const T *dgamma, const T *dbeta, const double *mean,      \
+                     const double *rstd, const double *c1, const double *c2,   \
+                     T *dy, const NormGeometry *g) {                           \
+        size_t segments = g->outer * g->groups, inner = g->inner;              \
+        _Pragma("omp parallel for if (segments * inner > NORM_PARALLEL_MIN)")  \
+        for (size_t s = 0; s < segments; s++) {                                \
+            size_t grp = s % g->groups;                                        \
+            const T *vs = v + s * inner, *xs = x + s * inner;                  \
+            T *dys = dy + s * inner;                                           \
+            T mu = (T)mean[grp], r = (T)rstd[grp], k1 = (T)c1[grp],            \
+              k2 = (T)c2[grp];                                                 \
+            if (g->per_group) {                                                \
+                T gm = gamma[grp] * r, dg = dgamma[grp], db = dbeta[grp];      \
+                _Pragma("omp simd") for (size_t i = 0; i < inner; i++) {       \
+                    T xh = (xs[i] - mu) * r;                                   \
+                    dys[i] = gm * (vs[i] - k1 - xh * k2) + dg * xh + db;       \
+                }                                                              \
+            } else {                                                           \
+                _Pragma("omp simd") for (size_t i = 0; i < inner; i++) {       \
+                    T xh = (xs[i] - mu) * r;                                   \
+                    dys[i] = gamma[i] * r * (vs[i] - k1 - xh * k2) +           \
+                             dgamma[i] * xh + dbeta[i];                        \
+                }                                                              \
+            }                                                                  \
+        }                                                                      \
+    }
+
+#define _NORM_KERNELS(S, T)                                                    \
+    _NORM_MOMENTS_KERNEL(_norm_moments_##S, T)                                 \
+    _NORM_APPLY_KERNEL(_norm_apply_##S, T)                                     \
+    _NORM_SUMS_KERNEL(_norm_sums_##S, T)                                       \
+    _NORM_GRAD_INPUT_KERNEL(_norm_grad_input_##S, T)                           \
+    _NORM_JVP_KERNEL(_norm_jvp_##S, T)
+
+_NORM_KERNELS(F, float)
+_NORM_KERNELS(D, double)
+
+// Chan's pairwise update folds a group's segment moments into its variance
+static void _merge_moments(const double *seg_mean, const double *seg_m2,
+                           const NormGeometry *g, double *mean, double *var) {
+    size_t groups = g->groups;
+    double inner = (double)g->inner;
+    _Pragma("omp parallel for if (groups * g->outer > NORM_PARALLEL_MIN)")
+    for (size_t grp = 0; grp < groups; grp++) {
+        double n = 0.0, m = 0.0, q = 0.0;
+        for (size_t o = 0; o < g->outer; o++) {
+            size_t s = o * groups + grp;
+            double delta = seg_mean[s] - m, total = n + inner;
+            m += delta * inner / total;
+            q += seg_m2[s] + delta * delta * n * inner / total;
+            n = total;
+        }
+        mean[grp] = m;
+        var[grp] = q / n;
+    }
+}
+
+static double _value_at(const void *data, DType dtype, size_t i) {
+    return dtype == DTYPE_DOUBLE ? ((const double *)data)[i]
+                                 : (double)((const float *)data)[i];
+}
+
+static void _read_running(const ndArray *running, double *out) {
+    const void *data = get_array_data(running);
+    for (size_t i = 0; i < get_total_size(running); i++)
+        out[i] = _value_at(data, get_dtype(running), i);
+}
+
+static void _update_running(ndArray *running, const double *batch,
+                            double momentum, double correction) {
+    void *data = get_array_data(running);
+    for (size_t i = 0; i < get_total_size(running); i++) {
+        double value = (1.0 - momentum) *
+                           _value_at(data, get_dtype(running), i) +
+                       momentum * batch[i] * correction;
+        if (get_dtype(running) == DTYPE_DOUBLE)
+            ((double *)data)[i] = value;
+        else
+            ((float *)data)[i] = (float)value;
+    }
+}
+
+/*
+ * Fills stats = [mean; rstd]: from the running statistics for batch norm
+ * outside training, from one moments pass over `x` otherwise, updating the
+ * running statistics in training.
+ */
+static void _norm_stats(const void *x, DType dtype, const NormGeometry *g,
+                        const NormParams *params, ndArray *running_mean,
+                        ndArray *running_var, double *stats) {
+    double *mean = stats, *rstd = stats + g->groups;
+    bool batch = params->kind == NORM_BATCH;
+
+    if (batch && !params->training) {
+        if (!running_mean || !running_var)
+            RUNTIME_ERROR(INVALID_ARRAY,
+                          "Batch norm outside training needs running "
+                          "statistics");
+        _read_running(running_mean, mean);
+        _read_running(running_var, rstd);
+    } else {
+        size_t count = g->outer * g->inner, segments = g->outer * g->groups;
+        if (batch && count < 2)
+            RUNTIME_ERRORF(SHAPE_MISMATCH,
+                           "Batch norm needs more than one value per channel "
+                           "in training, got %zu",
+                           count);
+
+        double *seg = malloc(2 * segments * sizeof(double));
+        if (!seg)
+            RUNTIME_ERROR(ARRAY_INIT_FAILURE,
+                          "Failed to allocate norm moments");
+
+        bool rms = params->kind == NORM_RMS;
+        if (dtype == DTYPE_DOUBLE)
+            _norm_moments_D(x, seg, seg + segments, rms, g);
+        else
+            _norm_moments_F(x, seg, seg + segments, rms, g);
+        _merge_moments(seg, seg + segments, g, mean, rstd);
+        free(seg);
+
+        if (batch && running_mean)
+            _update_running(running_mean, mean, params->momentum, 1.0);
+        if (batch && running_var)
+            _update_running(running_var, rstd, params->momentum,
+                            (double)count / (double)(count - 1));
+    }
+
+    for (size_t grp = 0; grp < g->groups; grp++)
+        rstd[grp] = 1.0 / sqrt(rstd[grp] + params->eps);
+}
+
+ndArray *array_norm(const ndArray *input, const ndArray *weight,
+                    const ndArray *bias, ndArray *running_mean,
+                    ndArray *running_var, const NormParams *params,
+                    ndArray **stats) {
+    NormGeometry g = _norm_geometry(input, params);
+    DType dtype = get_dtype(input);
+    _check_affine(weight, &g, dtype, "weight");
+    _check_affine(bias, &g, dtype, "bias");
+    if (params->kind == NORM_BATCH && running_mean)
+        _check_running(running_mean, &g);
+    if (params->kind == NORM_BATCH && running_var)
+        _check_running(running_var, &g);
+
+    ndArray *owned[3];
+    owned[0] = array_align_contiguous(input);
+    const void *x = get_array_data(owned[0] ? owned[0] : input);
+    const void *gamma = _operand(weight, &owned[1], &g, dtype, 1.0),
+               *beta = _operand(bias, &owned[2], &g, dtype, 0.0);
+
+    ndArray *stats_array =
+        array_init(2, (const size_t[]){2, g.groups}, DTYPE_DOUBLE);
+    double *mean = get_array_data(stats_array), *rstd = mean + g.groups;
+    _norm_stats(x, dtype, &g, params, running_mean, running_var, mean);
+
+    ndArray *result = array_init(get_ndim(input), get_shape(input), dtype);
+    if (dtype == DTYPE_DOUBLE)
+        _norm_apply_D(x, gamma, beta, mean, rstd, get_array_data(result), &g);
+    else
+        _norm_apply_F(x, gamma, beta, mean, rstd, get_array_data(result), &g);
+
+    _release(owned, 3);
+    if (stats)
+        *stats = stats_array;
+    else
+        free_array(stats_array);
+
+    return result;
+}
+
+// the affine parameters' gradient or tangent in their own shape and dtype
+static ndArray *_affine_array(const double *values, const NormGeometry *g,
+                              DType dtype) {
+    ndArray *result = array_init(g->affine_ndim, g->affine_shape, dtype);
+    void *data = get_array_data(result);
+    for (size_t i = 0; i < get_total_size(result); i++) {
+        if (dtype == DTYPE_DOUBLE)
+            ((double *)data)[i] = values[i];
+        else
+            ((float *)data)[i] = (float)values[i];
+    }
+
+    return result;
+}
+
+/*
+ * Per-group means c1 = mean(gamma v) and c2 = mean(gamma v xhat) from the
+ * segment sums, `gamma` being per-group (NULL for none). Layer and batch
+ * norms in training center (c1), RMS norm does not, and batch norm outside
+ * training normalizes by constants, so it projects nothing.
+ */
+static void _projection(const double *a, const double *b, const void *gamma,
+                        DType dtype, const NormGeometry *g,
+                        const NormParams *params, double *c1, double *c2) {
+    bool project = params->kind != NORM_BATCH || params->training;
+    bool center = project && params->kind != NORM_RMS;
+    double count = (double)(g->outer * g->inner);
+
+    for (size_t grp = 0; grp < g->groups; grp++) {
+        double sa = 0.0, sb = 0.0;
+        for (size_t o = 0; o < g->outer; o++) {
+            sa += a[o * g->groups + grp];
+            sb += b[o * g->groups + grp];
+        }
+        double gm = gamma ? _value_at(gamma, dtype, grp) : 1.0;
+        c1[grp] = center ? gm * sa / count : 0.0;
+        c2[grp] = project ? gm * sb / count : 0.0;
+    }
+}
+
+/*
+ * Two reads of the upstream gradient: one for the segment sums (and the
+ * per-element affine gradients), one writing the input gradient.
+ */
+void array_norm_grad(const ndArray *grad, const ndArray *input,
+                     const ndArray *weight, const ndArray *stats,
+                     const NormParams *params, ndArray **input_grad,
+                     ndArray **weight_grad, ndArray **bias_grad) {
+    NormGeometry g = _norm_geometry(input, params);
+    DType dtype = get_dtype(input);
+    _check_like(grad, input, "gradient");
+    _check_affine(weight, &g, dtype, "weight");
+
+    ndArray *owned[3] = {array_align_contiguous(grad),
+                         array_align_contiguous(input),
+                         weight ? array_align_contiguous(weight) : NULL};
+    const void *dy = get_array_data(owned[0] ? owned[0] : grad),
+               *x = get_array_data(owned[1] ? owned[1] : input),
+               *gamma = weight ? get_array_data(owned[2] ? owned[2] : weight)
+                               : NULL;
+    const double *mean = get_array_data(stats), *rstd = mean + g.groups;
+
+    size_t segments = g.outer * g.groups, affine_size = g.inner;
+    if (g.per_group)
+        affine_size = g.groups;
+
+    bool want_affine = weight_grad || bias_grad;
+    double *buffer = calloc(2 * segments + 2 * g.groups + 2 * affine_size,
+                            sizeof(double));
+    if (!buffer)
+        RUNTIME_ERROR(ARRAY_INIT_FAILURE, "Failed to allocate norm sums");
+    double *a = buffer, *b = a + segments, *c1 = b + segments,
+           *c2 = c1 + g.groups, *dgamma = c2 + g.groups,
+           *dbeta = dgamma + affine_size;
+
+    // per-group parameters scale the group sums afterwards
+    const void *sums_gamma = g.per_group ? NULL : gamma;
+    double *acc_gamma = want_affine && !g.per_group ? dgamma : NULL,
+           *acc_beta = want_affine && !g.per_group ? dbeta : NULL;
+    if (dtype == DTYPE_DOUBLE)
+        _norm_sums_D(dy, x, sums_gamma, mean, rstd, a, b, acc_gamma, acc_beta,
+                     &g);
+    else
+        _norm_sums_F(dy, x, sums_gamma, mean, rstd, a, b, acc_gamma, acc_beta,
+                     &g);
+
+    if (want_affine && g.per_group) {
+        for (size_t s = 0; s < segments; s++) {
+            dgamma[s % g.groups] += b[s];
+            dbeta[s % g.groups] += a[s];
+        }
+    }
+    _projection(a, b, g.per_group ? gamma : NULL, dtype, &g, params, c1, c2);
+
+    if (input_grad) {
+        *input_grad = array_init(get_ndim(input), get_shape(input), dtype);
+        void *dx = get_array_data(*input_grad);
+        if (dtype == DTYPE_DOUBLE)
+            _norm_grad_input_D(dy, x, gamma, mean, rstd, c1, c2, dx, &g);
+        else
+            _norm_grad_input_F(dy, x, gamma, mean, rstd, c1, c2, dx, &g);
+    }
+    if (weight_grad)
+        *weight_grad = _affine_array(dgamma, &g, dtype);
+    if (bias_grad)
+        *bias_grad = _affine_array(dbeta, &g, dtype);
+
+    free(buffer);
+    _release(owned, 3);
+}
+
+ndArray *array_norm_jvp(const ndArray *input, const ndArray *weight,
+                        const ndArray *stats, const NormParams *params,
+                        const ndArray *tangent, const ndArray *weight_tangent,
+                        const ndArray *bias_tangent) {
+    NormGeometry g = _norm_geometry(input, params);
+    DType dtype = get_dtype(input);
+    if (tangent)
+        _check_like(tangent, input, "tangent");
+    _check_affine(weight, &g, dtype, "weight");
+    _check_affine(weight_tangent, &g, dtype, "weight tangent");
+    _check_affine(bias_tangent, &g, dtype, "bias tangent");
+
+    ndArray *owned[5];
+    owned[0] = array_align_contiguous(input);
+    owned[1] = tangent ? array_align_contiguous(tangent)
+                       : zeros(get_ndim(input), get_shape(input), dtype);
+    const void *x = get_array_data(owned[0] ? owned[0] : input),
+               *v = get_array_data(owned[1] ? owned[1] : tangent);
+    const void *gamma = _operand(weight, &owned[2], &g, dtype, 1.0),
+               *dgamma = _operand(weight_tangent, &owned[3], &g, dtype, 0.0),
+               *dbeta = _operand(bias_tangent, &owned[4], &g, dtype, 0.0);
+    const double *mean = get_array_data(stats), *rstd = mean + g.groups;
+
+    size_t segments = g.outer * g.groups;
+    double *buffer = calloc(2 * segments + 2 * g.groups, sizeof(double));
+    if (!buffer)
+        RUNTIME_ERROR(ARRAY_INIT_FAILURE, "Failed to allocate norm sums");
+    double *a = buffer, *b = a + segments, *c1 = b + segments,
+           *c2 = c1 + g.groups;
+
+    if (tangent) {
+        if (dtype == DTYPE_DOUBLE)
+            _norm_sums_D(v, x, NULL, mean, rstd, a, b, NULL, NULL, &g);
+        else
+            _norm_sums_F(v, x, NULL, mean, rstd, a, b, NULL, NULL, &g);
+        _projection(a, b, NULL, dtype, &g, params, c1, c2);
+    }
+
+    ndArray *result = array_init(get_ndim(input), get_shape(input), dtype);
+    if (dtype == DTYPE_DOUBLE)
+        _norm_jvp_D(v, x, gamma, dgamma, dbeta, mean, rstd, c1, c2,
+                    get_array_data(result), &g);
+    else
+        _norm_jvp_F(v, x, gamma, dgamma, dbeta, mean, rstd, c1, c2,
+                    get_array_data(result), &g);
+
+    free(buffer);
+    _release(owned, 5);
+
+    return result;
+}
@@ -0,0 +1,398 @@
+#include "array.h"
+#include "error_codes.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// plane loops fork only past this many output elements
+#define POOL_PARALLEL_MIN 4096
+
+/*
+ * Every output position o along a dim reads the input span [lo[o], hi[o]),
+ * already clipped to the input. `count[o]` is the span's share of an
+ * average's divisor: the full kernel size for fixed windows, whose padding
+ * counts as zeros, and the clipped span itself for adaptive ones.
+ */
+typedef struct PoolWindows {
+    size_t in, out;
+    size_t *lo, *hi, *count;
+} PoolWindows;
+
+typedef struct PoolGeometry {
+    size_t planes; // N * C
+    PoolWindows rows, cols;
+} PoolGeometry;
+
+static PoolWindows _pool_windows(size_t in, size_t k, size_t s, size_t p,
+                                 size_t adaptive_out) {
+    PoolWindows w = {.in = in};
+    if (adaptive_out) {
+        w.out = adaptive_out;
+    } else {
+        if (k == 0 || s == 0 || 2 * p > k)
+            RUNTIME_ERRORF(INVALID_ARRAY,
+                           "Invalid pooling window (kernel %zu, stride %zu, "
+                           "padding %zu)",
+                           k, s, p);
+        if (in + 2 * p < k)
+            RUNTIME_ERRORF(SHAPE_MISMATCH,
+                           "Pooling kernel %zu larger than the padded input "
+                           "(%zu)",
+                           k, in + 2 * p);
+        w.out = (in + 2 * p - k) / s + 1;
+    }
+
+    w.lo = malloc(3 * w.out * sizeof(size_t));
+    if (!w.lo)
+        RUNTIME_ERROR(ARRAY_INIT_FAILURE, "Failed to allocate pooling windows");
+    w.hi = w.lo + w.out;
+    w.count = w.hi + w.out;
+
+    for (size_t o = 0; o < w.out; o++) {
+        if (adaptive_out) {
+            w.lo[o] = o * in / w.out;
+            w.hi[o] = ((o + 1) * in + w.out - 1) / w.out;
+            w.count[o] = w.hi[o] - w.lo[o];
+        } else {
+            size_t start = o * s, end = start + k;
+            w.lo[o] = start > p ? start - p : 0;
+            w.hi[o] = end - p < in ? end - p : in;
+            w.count[o] = k;
+        }
+    }
+
+    return w;
+}
+
+static PoolGeometry _pool_geometry(const size_t *input_shape,
+                                   const PoolParams *params) {
+    int sd = params->ndim;
+    if (sd != 1 && sd != 2)
+        RUNTIME_ERRORF(INVALID_DIM,
+                       "Pooling has 1 or 2 spatial dims, got %d", sd);
+
+    bool adaptive = params->kind == POOL_ADAPTIVE_AVG;
+    size_t H = sd == 2 ? input_shape[2] : 1, W = input_shape[sd + 1];
+
+    PoolGeometry g = {.planes = input_shape[0] * input_shape[1]};
+    if (sd == 2)
+        g.rows = _pool_windows(H, params->kernel_size[0], params->stride[0],
+                               params->padding[0],
+                               adaptive ? params->output_size[0] : 0);
+    else
+        g.rows = _pool_windows(1, 1, 1, 0, 0);
+
+    g.cols = _pool_windows(W, params->kernel_size[sd - 1],
+                           params->stride[sd - 1], params->padding[sd - 1],
+                           adaptive ? params->output_size[sd - 1] : 0);
+    if (adaptive && (g.rows.out == 0 || g.cols.out == 0))
+        RUNTIME_ERROR(INVALID_ARRAY, "Adaptive pooling needs output sizes");
+
+    return g;
+}
+
+static void _free_pool_geometry(PoolGeometry *g) {
+    free(g->rows.lo);
+    free(g->cols.lo);
+}
+
+void pool_output_shape(const size_t *input_shape, const PoolParams *params,
+                       size_t *shape) {
+    PoolGeometry g = _pool_geometry(input_shape, params);
+
+    shape[0] = input_shape[0];
+    shape[1] = input_shape[1];
+    if (params->ndim == 2)
+        shape[2] = g.rows.out;
+    shape[params->ndim + 1] = g.cols.out;
+
+    _free_pool_geometry(&g);
+}
+
+// bit tests, `-ffast-math` lets the compiler assume isnan is always false
+static inline bool _is_nan_F(float x) {
+    uint32_t bits;
+    memcpy(&bits, &x, sizeof(bits));
+    return (bits & 0x7fffffffu) > 0x7f800000u;
+}
+
+static inline bool _is_nan_D(double x) {
+    uint64_t bits;
+    memcpy(&bits, &x, sizeof(bits));
+    return (bits & 0x7fffffffffffffffull) > 0x7ff0000000000000ull;
+}
+
+/*
+ * One (N, C) plane per work item. Max pooling records the argmax of every
+ * window as an int32 offset into its input plane, so backward scatters one
+ * gradient per output instead of searching the windows again. A NaN wins
+ * its window, the first one is kept. A window lying entirely in the
+ * padding has no argmax, it is recorded as -1 and yields -inf.
+ */
+#define _MAX_POOL_KERNEL(NAME, T, IS_NAN)                                      \
+    static void NAME(const T *x, T *y, int32_t *idx, const PoolGeometry *g) {  \
+        size_t planes = g->planes, W = g->cols.in;                             \
+        size_t in_size = g->rows.in * W, out_size = g->rows.out * g->cols.out; \
+        _Pragma("omp parallel for if (planes * out_size > POOL_PARALLEL_MIN)") \
+        for (size_t plane = 0; plane < planes; plane++) {                      \
+            const T *in = x + plane * in_size;                                 \
+            T *out = y + plane * out_size;                                     \
+            int32_t *arg = idx + plane * out_size;                             \
+            for (size_t oh = 0; oh < g->rows.out; oh++) {                      \
+                for (size_t ow = 0; ow < g->cols.out; ow++) {                  \
+                    T best = -(T)INFINITY;                                     \
+                    int32_t best_i = -1;                                       \
+                    bool nan = false;                                          \
+                    for (size_t ih = g->rows.lo[oh];                           \
+                         !nan && ih < g->rows.hi[oh]; ih++) {                  \
+                        const T *row = in + ih * W;                            \
+                        for (size_t iw = g->cols.lo[ow]; iw < g->cols.hi[ow];  \
+                             iw++) {                                           \
+                            nan = IS_NAN(row[iw]);                             \
+                            if (nan || row[iw] > best || best_i < 0) {         \
+                                best = row[iw];                                \
+                                best_i = (int32_t)(ih * W + iw);               \
+                            }                                                  \
+                            if (nan)                                           \
+                                break;                                         \
+                        }                                                      \
+                    }                                                          \
+                    out[oh * g->cols.out + ow] = best;                         \
+                    arg[oh * g->cols.out + ow] = best_i;                       \
+                }                                                              \
+            }                                                                  \
+        }                                                                      \
+    }
+
+#define _AVG_POOL_KERNEL(NAME, T)                                              \
+    static void NAME(const T *x, T *y, const PoolGeometry *g) {                \
+        size_t planes = g->planes, W = g->cols.in;                             \
+        size_t in_size = g->rows.in * W, out_size = g->rows.out * g->cols.out; \
+        _Pragma("omp parallel for if (planes * out_size > POOL_PARALLEL_MIN)") \
+        for (size_t plane = 0; plane < planes; plane++) {                      \
+            const T *in = x + plane * in_size;                                 \
+            T *out = y + plane * out_size;                                     \
+            for (size_t oh = 0; oh < g->rows.out; oh++) {                      \
+                for (size_t ow = 0; ow < g->cols.out; ow++) {                  \
+                    T acc = 0;                                                 \
+                    for (size_t ih = g->rows.lo[oh]; ih < g->rows.hi[oh];      \
+                         ih++) {                                               \
+                        const T *row = in + ih * W;                            \
+                        _Pragma("omp simd reduction(+ : acc)") for (           \
+                            size_t iw = g->cols.lo[ow]; iw < g->cols.hi[ow];   \
+                            iw++) acc += row[iw];                              \
+                    }                                                          \
+                    size_t count = g->rows.count[oh] * g->cols.count[ow];      \
+                    out[oh * g->cols.out + ow] = acc / (T)count;               \
+                }                                                              \
+            }                                                                  \
+        }                                                                      \
+    }
+
+// O(output): each gradient lands on its window's recorded argmax
+#define _MAX_POOL_GRAD_KERNEL(NAME, T)                                         \
+    static void NAME(const T *dy, const int32_t *idx, T *dx,                   \
+                     const PoolGeometry *g) {                                  \
+        size_t planes = g->planes;                                             \
+        size_t in_size = g->rows.in * g->cols.in,                              \
+               out_size = g->rows.out * g->cols.out;                           \
+        _Pragma("omp parallel for if (planes * out_size > POOL_PARALLEL_MIN)") \
+        for (size_t plane = 0; plane < planes; plane++) {                      \
+            const T *out = dy + plane * out_size;                              \
+            const int32_t *arg = idx + plane * out_size;                       \
+            T *in = dx + plane * in_size;                                      \
+            for (size_t o = 0; o < out_size; o++)                              \
+                if (arg[o] >= 0)                                               \
+                    in[arg[o]] += out[o];                                      \
+        }                                                                      \
+    }
+
+#define _AVG_POOL_GRAD_KERNEL(NAME, T)                                         \
+    static void NAME(const T *dy, T *dx, const PoolGeometry *g) {              \
+        size_t planes = g->planes, W = g->cols.in;                             \
+        size_t in_size = g->rows.in * W, out_size = g->rows.out * g->cols.out; \
+        _Pragma("omp parallel for if (planes * out_size > POOL_PARALLEL_MIN)") \
+        for (size_t plane = 0; plane < planes; plane++) {                      \
+            const T *out = dy + plane * out_size;                              \
+            T *in = dx + plane * in_size;                                      \
+            for (size_t oh = 0; oh < g->rows.out; oh++) {                      \
+                for (size_t ow = 0; ow < g->cols.out; ow++) {                  \
+                    size_t count = g->rows.count[oh] * g->cols.count[ow];      \
+                    T share = out[oh * g->cols.out + ow] / (T)count;           \
+                    for (size_t ih = g->rows.lo[oh]; ih < g->rows.hi[oh];      \
+                         ih++) {                                               \
+                        T *row = in + ih * W;                                  \
+                        _Pragma("omp simd") for (size_t iw = g->cols.lo[ow];   \
+                                                 iw < g->cols.hi[ow]; iw++)    \
+                            row[iw] += share;                                  \
+                    }                                                          \
+                }                                                              \
+            }                                                                  \
+        }                                                                      \
+    }
+
+// the gathered tangent of a max pool, the argmax's own
+#define _MAX_POOL_GATHER_KERNEL(NAME, T)                                       \
+    static void NAME(const T *dx, const int32_t *idx, T *dy,                   \
+                     const PoolGeometry *g) {                                  \
+        size_t planes = g->planes;                                             \
+        size_t in_size = g->rows.in * g->cols.in,                              \
+               out_size = g->rows.out * g->cols.out;                           \
+        _Pragma("omp parallel for if (planes * out_size > POOL_PARALLEL_MIN)") \
+        for (size_t plane = 0; plane < planes; plane++) {                      \
+            const T *in = dx + plane * in_size;                                \
+            const int32_t *arg = idx + plane * out_size;                       \
+            T *out = dy + plane * out_size;                                    \
+            for (size_t o = 0; o < out_size; o++)                              \
+                out[o] = arg[o] >= 0 ? in[arg[o]] : (T)0;                      \
+        }                                                                      \
+    }
+
+#define _POOL_KERNELS(S, T)                                                    \
+    _MAX_POOL_KERNEL(_max_pool_##S, T, _is_nan_##S)                            \
+    _AVG_POOL_KERNEL(_avg_pool_##S, T)                                         \
+    _MAX_POOL_GRAD_KERNEL(_max_pool_grad_##S, T)                               \
+    _AVG_POOL_GRAD_KERNEL(_avg_pool_grad_##S, T)                               \
+    _MAX_POOL_GATHER_KERNEL(_max_pool_gather_##S, T)
+
+_POOL_KERNELS(F, float)
+_POOL_KERNELS(D, double)
+
+static void _check_pool_input(const ndArray *input, const PoolParams *params) {
+    if (get_ndim(input) != params->ndim + 2)
+        RUNTIME_ERRORF(SHAPE_MISMATCH,
+                       "%dd pooling expects a %d-d input, got %d-d",
+                       params->ndim, params->ndim + 2, get_ndim(input));
+
+    DType dtype = get_dtype(input);
+    if (dtype != DTYPE_FLOAT && dtype != DTYPE_DOUBLE)
+        RUNTIME_ERRORF(INVALID_DTYPE,
+                       "Pooling needs DTYPE_FLOAT or DTYPE_DOUBLE, got `%s`",
+                       DTypeNames[dtype]);
+
+    size_t plane = get_shape(input)[2];
+    if (params->ndim == 2)
+        plane *= get_shape(input)[3];
+    if (params->kind == POOL_MAX && plane > INT32_MAX)
+        RUNTIME_ERROR(SHAPE_MISMATCH,
+                      "Max pooling planes must be indexable by int32");
+}
+
+ndArray *array_pool(const ndArray *input, const PoolParams *params,
+                    ndArray **indices) {
+    _check_pool_input(input, params);
+    PoolGeometry g = _pool_geometry(get_shape(input), params);
+
+    int ndim = params->ndim + 2;
+    size_t shape[ndim];
+    pool_output_shape(get_shape(input), params, shape);
+    ndArray *result = array_init(ndim, shape, get_dtype(input));
+
+    ndArray *x_copy = array_align_contiguous(input);
+    const void *x = get_array_data(x_copy ? x_copy : input);
+    void *y = get_array_data(result);
+    bool is_double = get_dtype(input) == DTYPE_DOUBLE;
+
+    if (params->kind == POOL_MAX) {
+        ndArray *argmax = array_init(ndim, shape, DTYPE_INT);
+        int32_t *idx = get_array_data(argmax);
+        if (is_double)
+            _max_pool_D(x, y, idx, &g);
+        else
+            _max_pool_F(x, y, idx, &g);
+
+        if (indices)
+            *indices = argmax;
+        else
+            free_array(argmax);
+    } else {
+        if (is_double)
+            _avg_pool_D(x, y, &g);
+        else
+            _avg_pool_F(x, y, &g);
+
+        if (indices)
+            *indices = NULL;
+    }
+
+    if (x_copy)
+        free_array(x_copy);
+    _free_pool_geometry(&g);
+
+    return result;
+}
+
+static ndArray *_pool_backward(const ndArray *array, const ndArray *indices,
+                               const size_t *shape, const PoolParams *params,
+                               bool gather) {
+    if (params->kind == POOL_MAX && !indices)
+        RUNTIME_ERROR(INVALID_BACKWARD_PASS,
+                      "Max pooling gradients need the argmax indices");
+
+    const size_t *input_shape = gather ? get_shape(array) : shape;
+    PoolGeometry g = _pool_geometry(input_shape, params);
+
+    int ndim = params->ndim + 2;
+    size_t out_shape[ndim];
+    pool_output_shape(input_shape, params, out_shape);
+
+    bool valid = get_ndim(array) == ndim;
+    for (int d = 0; valid && !gather && d < ndim; d++)
+        valid = get_shape(array)[d] == out_shape[d];
+    if (!valid)
+        RUNTIME_ERROR(SHAPE_MISMATCH,
+                      "Gradient does not match the pooling output");
+
+    ndArray *copy = array_align_contiguous(array);
+    const void *src = get_array_data(copy ? copy : array);
+    bool is_double = get_dtype(array) == DTYPE_DOUBLE;
+    const int32_t *idx = indices ? get_array_data(indices) : NULL;
+
+    ndArray *result;
+    if (gather) {
+        result = array_init(ndim, out_shape, get_dtype(array));
+        void *dst = get_array_data(result);
+        if (is_double)
+            _max_pool_gather_D(src, idx, dst, &g);
+        else
+            _max_pool_gather_F(src, idx, dst, &g);
+    } else {
+        result = zeros(ndim, input_shape, get_dtype(array));
+        void *dst = get_array_data(result);
+        if (params->kind == POOL_MAX) {
+            if (is_double)
+                _max_pool_grad_D(src, idx, dst, &g);
+            else
+                _max_pool_grad_F(src, idx, dst, &g);
+        } else {
+            if (is_double)
+                _avg_pool_grad_D(src, dst, &g);
+            else
+                _avg_pool_grad_F(src, dst, &g);
+        }
+    }
+
+    if (copy)
+        free_array(copy);
+    _free_pool_geometry(&g);
+
+    return result;
+}
+
+ndArray *array_pool_grad(const ndArray *grad, const ndArray *indices,
+                         const size_t *input_shape, const PoolParams *params) {
+    return _pool_backward(grad, indices, input_shape, params, false);
+}
+
+ndArray *array_pool_jvp(const ndArray *tangent, const ndArray *indices,
+                        const PoolParams *params) {
+    if (params->kind != POOL_MAX)
+        return array_pool(tangent, params, NULL);
+
+    return _pool_backward(tangent, indices, NULL, params, true);
+}
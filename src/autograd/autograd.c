@@ -1,7 +1,9 @@
 #include "autograd.h"
 #include "error_codes.h"
+#include "private/callable_grads.h"
 #include "tensor.h"
 
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -17,8 +19,13 @@ struct BackwardFn {
 
     Ctx ctx_kind;
     void *ctx;
+    SavedKind saved;
 
     char *name;
+
+    // the tensor that produced the node and every edge in `next_functions`
+    size_t refcount;
+    bool released;
 };
 
 BackwardFn *backward_fn_init(CallableGradFn grad_fn, Tensor **input_tensors,
@@ -48,6 +55,10 @@ BackwardFn *backward_fn_init(CallableGradFn grad_fn, Tensor **input_tensors,
 
     backward_fn->ctx_kind = NULL_CTX;
     backward_fn->ctx = NULL;
+    backward_fn->saved = SAVE_SHAPES;
+
+    backward_fn->refcount = 1;
+    backward_fn->released = false;
 
     return backward_fn;
 }
@@ -70,24 +81,89 @@ BackwardFn **create_next_fns(Tensor **output_tensors, size_t num_outputs) {
             set_backward_fn(output_tensors[i], backward_fn);
         }
         next_functions[i] = backward_fn;
+        __atomic_add_fetch(&backward_fn->refcount, 1, __ATOMIC_RELAXED);
     }
 
     return next_functions;
 }
 
-void free_backward_fn(BackwardFn *backward_fn) {
-    if (!backward_fn)
+// drops the references the node holds on its next functions
+static void _drop_next_functions(BackwardFn *backward_fn, BackwardFn ***stack,
+                                 size_t *stack_size, size_t *capacity) {
+    BackwardFn **next_functions = backward_fn->next_functions;
+    if (!next_functions)
         return;
 
-    free(backward_fn->input_tensors);
-    free(backward_fn->output_tensors);
-    free(backward_fn->next_functions);
-    free(backward_fn->name);
+    for (size_t i = 0; i < backward_fn->num_outputs; i++) {
+        if (!next_functions[i])
+            continue;
+
+        if (*stack_size == *capacity) {
+            *capacity = *capacity ? 2 * *capacity : 16;
+            *stack = realloc(*stack, *capacity * sizeof(BackwardFn *));
+            if (!*stack)
+                RUNTIME_ERROR(BACKWARD_FN_INIT_FAILURE,
+                              "Failure to free next functions");
+        }
+        (*stack)[(*stack_size)++] = next_functions[i];
+    }
+
+    free(next_functions);
+    backward_fn->next_functions = NULL;
+}
+
+/*
+ * Drops one reference. A node goes with its last reference and drops its own
+ * references on its next functions, walked iteratively since graphs can be
+ * deep chains.
+ */
+void free_backward_fn(BackwardFn *backward_fn) {
+    BackwardFn **stack = NULL;
+    size_t stack_size = 0, capacity = 0;
+
+    while (backward_fn) {
+        if (__atomic_sub_fetch(&backward_fn->refcount, 1, __ATOMIC_ACQ_REL) ==
+            0) {
+            _drop_next_functions(backward_fn, &stack, &stack_size, &capacity);
+
+            free(backward_fn->input_tensors);
+            free(backward_fn->output_tensors);
+            free(backward_fn->name);
+            if (backward_fn->ctx)
+                free_ctx(backward_fn->ctx, backward_fn->ctx_kind);
+
+            free(backward_fn);
+        }
+
+        backward_fn = stack_size ? stack[--stack_size] : NULL;
+    }
+
+    free(stack);
+}
+
+/*
+ * Frees everything the node needs for its backward and drops its edges,
+ * keeping a stub for the other graphs that still point at it. Reaching a
+ * released node is an invalid backward pass.
+ */
+void release_backward_fn(BackwardFn *backward_fn) {
+    BackwardFn **next_functions = backward_fn->next_functions;
+    backward_fn->next_functions = NULL;
+    if (next_functions)
+        for (size_t i = 0; i < backward_fn->num_outputs; i++)
+            free_backward_fn(next_functions[i]);
+    free(next_functions);
 
     if (backward_fn->ctx)
         free_ctx(backward_fn->ctx, backward_fn->ctx_kind);
+    backward_fn->ctx = NULL;
+    backward_fn->ctx_kind = NULL_CTX;
+    backward_fn->num_outputs = 0;
+    backward_fn->released = true;
+}
 
-    free(backward_fn);
+bool is_backward_fn_released(const BackwardFn *backward_fn) {
+    return backward_fn->released;
 }
 
 BackwardFn **get_next_functions(const BackwardFn *backward_fn) {
@@ -114,21 +190,50 @@ Tensor **get_backward_fn_op_tensors(const BackwardFn *backward_fn) {
     return backward_fn->output_tensors;
 }
 
+size_t get_backward_refcount(const BackwardFn *backward_fn) {
+    return __atomic_load_n(&backward_fn->refcount, __ATOMIC_ACQUIRE);
+}
+
 CallableGradFn get_grad_fn(const BackwardFn *backward_fn) {
     return backward_fn->grad_fn;
 }
 
+bool is_leaf_tensor(const Tensor *tensor) {
+    const BackwardFn *backward_fn = get_backward_fn(tensor);
+    return !backward_fn || backward_fn->grad_fn == _accumulate_grad_fn;
+}
+
 void *get_ctx(const BackwardFn *backward_fn) { return backward_fn->ctx; }
 
 Ctx get_ctx_kind(const BackwardFn *backward_fn) {
     return backward_fn->ctx_kind;
 }
 
-void set_ctx(BackwardFn *backward_fn, void *ctx, Ctx ctx_kind) {
-    backward_fn->ctx = deep_copy_ctx(ctx, ctx_kind);
+SavedKind get_saved(const BackwardFn *backward_fn) {
+    return backward_fn->saved;
+}
+
+static void _replace_ctx(BackwardFn *backward_fn, void *ctx, Ctx ctx_kind) {
+    if (backward_fn->ctx)
+        free_ctx(backward_fn->ctx, backward_fn->ctx_kind);
+
+    backward_fn->ctx = ctx;
     backward_fn->ctx_kind = ctx_kind;
 }
 
+// a replayed graph refreshes the context of the nodes it reruns
+void set_ctx(BackwardFn *backward_fn, void *ctx, Ctx ctx_kind) {
+    _replace_ctx(backward_fn, deep_copy_ctx(ctx, ctx_kind), ctx_kind);
+}
+
+void move_ctx(BackwardFn *backward_fn, void *ctx, Ctx ctx_kind) {
+    _replace_ctx(backward_fn, shallow_copy_ctx(ctx, ctx_kind), ctx_kind);
+}
+
+void set_saved(BackwardFn *backward_fn, SavedKind saved) {
+    backward_fn->saved = saved;
+}
+
 void set_next_functions(BackwardFn *backward_fn, BackwardFn **next_functions) {
     backward_fn->next_functions = next_functions;
 }
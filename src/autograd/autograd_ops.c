@@ -13,13 +13,28 @@ BackwardFn *AccumulateGrad(Tensor *tensor) {
     return backward_fn;
 }
 
-#define DEFINE_BACKWARD_FN(NAME, _grad_fn)                                     \
+// the tensors a node reads during backward keep their buffers
+static void _save_tensors(BackwardFn *backward_fn, Tensor **input_tensors,
+                          Tensor **output_tensors, size_t num_inputs,
+                          size_t num_outputs, SavedKind saved) {
+    set_saved(backward_fn, saved);
+    if (saved == SAVE_INPUTS)
+        for (size_t i = 0; i < num_outputs; i++)
+            mark_tensor_saved(output_tensors[i]);
+    if (saved == SAVE_OUTPUT)
+        for (size_t i = 0; i < num_inputs; i++)
+            mark_tensor_saved(input_tensors[i]);
+}
+
+#define DEFINE_BACKWARD_FN(NAME, _grad_fn, SAVED)                              \
     BackwardFn *NAME(Tensor **input_tensors, Tensor **output_tensors,          \
                      size_t num_inputs, size_t num_outputs) {                  \
         CallableGradFn grad_fn = _grad_fn;                                     \
         BackwardFn *backward_fn =                                              \
             backward_fn_init(grad_fn, input_tensors, output_tensors,           \
                              num_inputs, num_outputs, #NAME);                  \
+        _save_tensors(backward_fn, input_tensors, output_tensors, num_inputs,  \
+                      num_outputs, SAVED);                                     \
                                                                                \
         BackwardFn **next_functions =                                          \
             create_next_fns(output_tensors, num_outputs);                      \
@@ -27,14 +42,39 @@ BackwardFn *AccumulateGrad(Tensor *tensor) {
         return backward_fn;                                                    \
     }
 
-DEFINE_BACKWARD_FN(AddBackward, _add_grad_fn)
-DEFINE_BACKWARD_FN(MulBackward, _mul_grad_fn)
-DEFINE_BACKWARD_FN(NegBackward, _neg_grad_fn)
-DEFINE_BACKWARD_FN(InvBackward, _inv_grad_fn)
+DEFINE_BACKWARD_FN(AddBackward, _add_grad_fn, SAVE_SHAPES)
+DEFINE_BACKWARD_FN(SubBackward, _sub_grad_fn, SAVE_SHAPES)
+DEFINE_BACKWARD_FN(MulBackward, _mul_grad_fn, SAVE_INPUTS)
+DEFINE_BACKWARD_FN(DivBackward, _div_grad_fn, SAVE_INPUTS)
+DEFINE_BACKWARD_FN(NegBackward, _neg_grad_fn, SAVE_SHAPES)
+DEFINE_BACKWARD_FN(InvBackward, _inv_grad_fn, SAVE_OUTPUT)
+
+DEFINE_BACKWARD_FN(MaxBackward, _select_grad_fn, SAVE_MASK)
+DEFINE_BACKWARD_FN(MinBackward, _select_grad_fn, SAVE_MASK)
+
+DEFINE_BACKWARD_FN(TransposeBackward, _transpose_grad_fn, SAVE_SHAPES)
+DEFINE_BACKWARD_FN(MatMulBackward, _matmul_grad_fn, SAVE_INPUTS)
+DEFINE_BACKWARD_FN(SumBackward, _sum_grad_fn, SAVE_SHAPES)
+DEFINE_BACKWARD_FN(SpMMBackward, _spmm_grad_fn, SAVE_SHAPES)
+DEFINE_BACKWARD_FN(CastBackward, _cast_grad_fn, SAVE_SHAPES)
+DEFINE_BACKWARD_FN(CheckpointBackward, _checkpoint_grad_fn, SAVE_INPUTS)
+DEFINE_BACKWARD_FN(FusedBackward, _fused_grad_fn, SAVE_INPUTS)
+DEFINE_BACKWARD_FN(ReluBackward, _relu_grad_fn, SAVE_OUTPUT)
+
+DEFINE_BACKWARD_FN(GeluBackward, _activation_grad_fn, SAVE_INPUTS)
+DEFINE_BACKWARD_FN(SiluBackward, _activation_grad_fn, SAVE_INPUTS)
+DEFINE_BACKWARD_FN(TanhBackward, _activation_grad_fn, SAVE_OUTPUT)
+DEFINE_BACKWARD_FN(SigmoidBackward, _activation_grad_fn, SAVE_OUTPUT)
+DEFINE_BACKWARD_FN(SoftmaxBackward, _softmax_grad_fn, SAVE_OUTPUT)
+DEFINE_BACKWARD_FN(LogSoftmaxBackward, _softmax_grad_fn, SAVE_OUTPUT)
 
-DEFINE_BACKWARD_FN(MaxBackward, _max_grad_fn)
-DEFINE_BACKWARD_FN(MinBackward, _min_grad_fn)
+DEFINE_BACKWARD_FN(NllLossBackward, _nll_loss_grad_fn, SAVE_INPUTS)
+DEFINE_BACKWARD_FN(CrossEntropyBackward, _nll_loss_grad_fn, SAVE_INPUTS)
+DEFINE_BACKWARD_FN(MseLossBackward, _pointwise_loss_grad_fn, SAVE_INPUTS)
+DEFINE_BACKWARD_FN(BceWithLogitsBackward, _pointwise_loss_grad_fn,
+                   SAVE_INPUTS)
 
-DEFINE_BACKWARD_FN(TransposeBackward, _transpose_grad_fn)
-DEFINE_BACKWARD_FN(MatMulBackward, _matmul_grad_fn)
-DEFINE_BACKWARD_FN(SumBackward, _sum_grad_fn)
+DEFINE_BACKWARD_FN(ConvBackward, _conv_grad_fn, SAVE_INPUTS)
+DEFINE_BACKWARD_FN(MaxPoolBackward, _pool_grad_fn, SAVE_SHAPES)
+DEFINE_BACKWARD_FN(AvgPoolBackward, _pool_grad_fn, SAVE_SHAPES)
+DEFINE_BACKWARD_FN(NormBackward, _norm_grad_fn, SAVE_INPUTS)
@@ -1,5 +1,10 @@
+#include "array.h"
 #include "autograd.h"
 #include "error_codes.h"
+#include "sparse.h"
+
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -24,11 +29,166 @@ void *deep_copy_ctx(void *ctx, Ctx ctx_kind) {
 
         return ctx_copy;
     }
+    case SPMM_CTX: {
+        SpMMCtx *ctx_copy = malloc(sizeof(SpMMCtx));
+        if (!ctx_copy)
+            RUNTIME_ERROR(ARRAY_INIT_FAILURE, "Failure to allocate Context");
+
+        ctx_copy->sparse = copy_sparse(((SpMMCtx *)ctx)->sparse);
+        ctx_copy->sparse_grad = ((SpMMCtx *)ctx)->sparse_grad;
+
+        return ctx_copy;
+    }
+    case CHECKPOINT_CTX: {
+        CheckpointCtx *ctx_copy = malloc(sizeof(CheckpointCtx));
+        if (!ctx_copy)
+            RUNTIME_ERROR(ARRAY_INIT_FAILURE, "Failure to allocate Context");
+
+        *ctx_copy = *(CheckpointCtx *)ctx;
+        return ctx_copy;
+    }
+    case FUSED_CTX: {
+        FusedCtx *ctx_copy = malloc(sizeof(FusedCtx));
+        if (!ctx_copy)
+            RUNTIME_ERROR(ARRAY_INIT_FAILURE, "Failure to allocate Context");
+
+        ctx_copy->num_instrs = ((FusedCtx *)ctx)->num_instrs;
+        ctx_copy->instrs = malloc(ctx_copy->num_instrs * sizeof(FusedInstr));
+        if (!ctx_copy->instrs)
+            RUNTIME_ERROR(ARRAY_INIT_FAILURE,
+                          "Failure to allocate Context instructions");
+        memcpy(ctx_copy->instrs, ((FusedCtx *)ctx)->instrs,
+               ctx_copy->num_instrs * sizeof(FusedInstr));
+
+        return ctx_copy;
+    }
+    case MASK_CTX: {
+        MaskCtx *ctx_copy = malloc(sizeof(MaskCtx));
+        if (!ctx_copy)
+            RUNTIME_ERROR(ARRAY_INIT_FAILURE, "Failure to allocate Context");
+
+        size_t num_bytes = (((MaskCtx *)ctx)->size + 7) / 8;
+        ctx_copy->size = ((MaskCtx *)ctx)->size;
+        ctx_copy->bits = malloc(num_bytes ? num_bytes : 1);
+        if (!ctx_copy->bits)
+            RUNTIME_ERROR(ARRAY_INIT_FAILURE,
+                          "Failure to allocate Context mask");
+        memcpy(ctx_copy->bits, ((MaskCtx *)ctx)->bits, num_bytes);
+
+        return ctx_copy;
+    }
+    case RELU_CTX: {
+        ReluCtx *ctx_copy = malloc(sizeof(ReluCtx));
+        if (!ctx_copy)
+            RUNTIME_ERROR(ARRAY_INIT_FAILURE, "Failure to allocate Context");
+
+        *ctx_copy = *(ReluCtx *)ctx;
+        return ctx_copy;
+    }
+    case ACTIVATION_CTX: {
+        ActivationCtx *ctx_copy = malloc(sizeof(ActivationCtx));
+        if (!ctx_copy)
+            RUNTIME_ERROR(ARRAY_INIT_FAILURE, "Failure to allocate Context");
+
+        *ctx_copy = *(ActivationCtx *)ctx;
+        return ctx_copy;
+    }
+    case SOFTMAX_CTX: {
+        SoftmaxCtx *ctx_copy = malloc(sizeof(SoftmaxCtx));
+        if (!ctx_copy)
+            RUNTIME_ERROR(ARRAY_INIT_FAILURE, "Failure to allocate Context");
+
+        *ctx_copy = *(SoftmaxCtx *)ctx;
+        return ctx_copy;
+    }
+    case LOSS_CTX: {
+        LossCtx *ctx_copy = malloc(sizeof(LossCtx));
+        if (!ctx_copy)
+            RUNTIME_ERROR(ARRAY_INIT_FAILURE, "Failure to allocate Context");
+
+        *ctx_copy = *(LossCtx *)ctx;
+        if (ctx_copy->lse)
+            ctx_copy->lse = copy_array(ctx_copy->lse);
+
+        return ctx_copy;
+    }
+    case POOL_CTX: {
+        PoolCtx *ctx_copy = malloc(sizeof(PoolCtx));
+        if (!ctx_copy)
+            RUNTIME_ERROR(ARRAY_INIT_FAILURE, "Failure to allocate Context");
+
+        *ctx_copy = *(PoolCtx *)ctx;
+        if (ctx_copy->indices)
+            ctx_copy->indices = copy_array(ctx_copy->indices);
+
+        return ctx_copy;
+    }
+    case CONV_CTX: {
+        ConvCtx *ctx_copy = malloc(sizeof(ConvCtx));
+        if (!ctx_copy)
+            RUNTIME_ERROR(ARRAY_INIT_FAILURE, "Failure to allocate Context");
+
+        *ctx_copy = *(ConvCtx *)ctx;
+        return ctx_copy;
+    }
+    case NORM_CTX: {
+        NormCtx *ctx_copy = malloc(sizeof(NormCtx));
+        if (!ctx_copy)
+            RUNTIME_ERROR(ARRAY_INIT_FAILURE, "Failure to allocate Context");
+
+        *ctx_copy = *(NormCtx *)ctx;
+        ctx_copy->stats = copy_array(ctx_copy->stats);
+        return ctx_copy;
+    }
     }
 
     return NULL;
 }
 
+static size_t _ctx_size(Ctx ctx_kind) {
+    switch (ctx_kind) {
+    case NULL_CTX:
+        break;
+    case TRANSPOSE_CTX:
+        return sizeof(TransposeCtx);
+    case SPMM_CTX:
+        return sizeof(SpMMCtx);
+    case CHECKPOINT_CTX:
+        return sizeof(CheckpointCtx);
+    case FUSED_CTX:
+        return sizeof(FusedCtx);
+    case MASK_CTX:
+        return sizeof(MaskCtx);
+    case RELU_CTX:
+        return sizeof(ReluCtx);
+    case ACTIVATION_CTX:
+        return sizeof(ActivationCtx);
+    case SOFTMAX_CTX:
+        return sizeof(SoftmaxCtx);
+    case LOSS_CTX:
+        return sizeof(LossCtx);
+    case CONV_CTX:
+        return sizeof(ConvCtx);
+    case POOL_CTX:
+        return sizeof(PoolCtx);
+    case NORM_CTX:
+        return sizeof(NormCtx);
+    }
+
+    RUNTIME_ERROR(INVALID_BACKWARD_PASS, "Invalid Context Kind in Move");
+    return 0;
+}
+
+void *shallow_copy_ctx(void *ctx, Ctx ctx_kind) {
+    size_t size = _ctx_size(ctx_kind);
+    void *ctx_copy = malloc(size);
+    if (!ctx_copy)
+        RUNTIME_ERROR(ARRAY_INIT_FAILURE, "Failure to allocate Context");
+
+    memcpy(ctx_copy, ctx, size);
+    return ctx_copy;
+}
+
 void free_ctx(void *ctx, Ctx ctx_kind) {
     switch (ctx_kind) {
     case NULL_CTX:
@@ -38,6 +198,87 @@ void free_ctx(void *ctx, Ctx ctx_kind) {
     case TRANSPOSE_CTX: {
         free(((TransposeCtx *)ctx)->dims);
         free(ctx);
+    } break;
+    case SPMM_CTX: {
+        free_sparse(((SpMMCtx *)ctx)->sparse);
+        free(ctx);
+    } break;
+    case CHECKPOINT_CTX: {
+        free(ctx);
+    } break;
+    case FUSED_CTX: {
+        free(((FusedCtx *)ctx)->instrs);
+        free(ctx);
+    } break;
+    case MASK_CTX: {
+        free(((MaskCtx *)ctx)->bits);
+        free(ctx);
+    } break;
+    case RELU_CTX:
+    case ACTIVATION_CTX:
+    case SOFTMAX_CTX:
+    case CONV_CTX: {
+        free(ctx);
+    } break;
+    case LOSS_CTX: {
+        if (((LossCtx *)ctx)->lse)
+            free_array(((LossCtx *)ctx)->lse);
+        free(ctx);
+    } break;
+    case POOL_CTX: {
+        if (((PoolCtx *)ctx)->indices)
+            free_array(((PoolCtx *)ctx)->indices);
+        free(ctx);
+    } break;
+    case NORM_CTX: {
+        free_array(((NormCtx *)ctx)->stats);
+        free(ctx);
+    } break;
     }
+}
+
+/*
+ * One bit per element instead of a 0/1 array in the operands' dtype.
+ * Comparison results are freshly allocated, so their buffer is in row-major
+ * order of the output.
+ */
+void set_select_mask(BackwardFn *backward_fn, ndArray *data1, ndArray *data2,
+                     bool max) {
+    ndArray *selected = max ? array_ge(data1, data2) : array_le(data1, data2);
+    ndArray *flags = array_cast(selected, DTYPE_INT);
+    free_array(selected);
+
+    size_t size = get_total_size(flags);
+    unsigned char *bits = calloc((size + 7) / 8 + 1, 1);
+    if (!bits)
+        RUNTIME_ERROR(ARRAY_INIT_FAILURE, "Failure to allocate Context mask");
+
+    const int *values = get_array_data(flags);
+    for (size_t i = 0; i < size; i++)
+        if (values[i])
+            bits[i / 8] |= (unsigned char)(1u << (i % 8));
+    free_array(flags);
+
+    MaskCtx ctx = {.size = size, .bits = bits};
+    set_ctx(backward_fn, &ctx, MASK_CTX);
+    free(bits);
+}
+
+ndArray *mask_ctx_array(const MaskCtx *ctx, int ndim, const size_t *shape,
+                        DType dtype, bool complement) {
+    ndArray *flags = array_init(ndim, shape, DTYPE_INT);
+    if (get_total_size(flags) != ctx->size)
+        RUNTIME_ERROR(SHAPE_MISMATCH,
+                      "Gradient does not match the saved selection mask");
+
+    int *values = get_array_data(flags);
+    for (size_t i = 0; i < ctx->size; i++) {
+        bool bit = (ctx->bits[i / 8] >> (i % 8)) & 1u;
+        values[i] = bit != complement;
     }
+
+    ndArray *mask = array_cast(flags, dtype);
+    free_array(flags);
+
+    return mask;
 }
@@ -0,0 +1,369 @@
+#include "array.h"
+#include "autograd.h"
+#include "error_codes.h"
+#include "sparse.h"
+#include "tensor.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+// tangents follow their tensor's dtype, promoted ops hand them over
+static void _set_tangent(Tensor *out, ndArray *tangent) {
+    DType dtype = get_tensor_dtype(out);
+    if (get_dtype(tangent) != dtype) {
+        ndArray *cast = array_cast(tangent, dtype);
+        free_array(tangent);
+        tangent = cast;
+    }
+
+    set_tensor_tangent(out, tangent);
+}
+
+static bool _same_shape(const ndArray *array, const Tensor *tensor) {
+    int ndim = get_ndim(array);
+    if (ndim != get_tensor_ndim(tensor))
+        return false;
+
+    for (int d = 0; d < ndim; d++)
+        if (get_shape(array)[d] != get_tensor_shape(tensor)[d])
+            return false;
+
+    return true;
+}
+
+// a lone tangent of a broadcast operand is expanded to the output's shape
+static ndArray *_expand_tangent(const ndArray *tangent, const Tensor *out) {
+    if (_same_shape(tangent, out))
+        return array_cast(tangent, get_dtype(tangent));
+
+    ndArray *zero = zeros(get_tensor_ndim(out), get_tensor_shape(out),
+                          get_dtype(tangent));
+    ndArray *expanded = array_add(zero, (ndArray *)tangent);
+    free_array(zero);
+
+    return expanded;
+}
+
+static ndArray *_sum_tangents(ndArray *tangent1, ndArray *tangent2,
+                              const Tensor *out) {
+    if (!tangent1 || !tangent2) {
+        ndArray *tangent = tangent1 ? tangent1 : tangent2;
+        if (_same_shape(tangent, out))
+            return tangent;
+
+        ndArray *expanded = _expand_tangent(tangent, out);
+        free_array(tangent);
+
+        return expanded;
+    }
+
+    ndArray *tangent = array_add(tangent1, tangent2);
+    free_array(tangent1);
+    free_array(tangent2);
+
+    return tangent;
+}
+
+void tangent_add(Tensor *out, Tensor *t1, Tensor *t2) {
+    ndArray *dt1 = get_tensor_tangent(t1), *dt2 = get_tensor_tangent(t2);
+    if (!dt1 && !dt2)
+        return;
+
+    ndArray *tangent = (dt1 && dt2) ? array_add(dt1, dt2)
+                                    : _expand_tangent(dt1 ? dt1 : dt2, out);
+    _set_tangent(out, tangent);
+}
+
+void tangent_sub(Tensor *out, Tensor *t1, Tensor *t2) {
+    ndArray *dt1 = get_tensor_tangent(t1), *dt2 = get_tensor_tangent(t2);
+    if (!dt1 && !dt2)
+        return;
+
+    ndArray *term1 = dt1 ? copy_array(dt1) : NULL;
+    ndArray *term2 = dt2 ? negative(dt2) : NULL;
+    _set_tangent(out, _sum_tangents(term1, term2, out));
+}
+
+void tangent_mul(Tensor *out, Tensor *t1, Tensor *t2) {
+    ndArray *dt1 = get_tensor_tangent(t1), *dt2 = get_tensor_tangent(t2);
+    if (!dt1 && !dt2)
+        return;
+
+    ndArray *term1 = dt1 ? array_mul(dt1, get_tensor_data(t2)) : NULL;
+    ndArray *term2 = dt2 ? array_mul(get_tensor_data(t1), dt2) : NULL;
+    _set_tangent(out, _sum_tangents(term1, term2, out));
+}
+
+// d(a / b) = da / b - out * db / b
+void tangent_div(Tensor *out, Tensor *t1, Tensor *t2) {
+    ndArray *dt1 = get_tensor_tangent(t1), *dt2 = get_tensor_tangent(t2);
+    if (!dt1 && !dt2)
+        return;
+
+    ndArray *data2 = get_tensor_data(t2);
+    ndArray *term1 = dt1 ? array_div(dt1, data2) : NULL;
+    ndArray *term2 = NULL;
+    if (dt2) {
+        term2 = array_mul(get_tensor_data(out), dt2);
+        array_divi(&term2, data2);
+        negativei(&term2);
+    }
+    _set_tangent(out, _sum_tangents(term1, term2, out));
+}
+
+/*
+ * The tangent follows the operand the op selects, ties go to `t1` to match
+ * MaxBackward and MinBackward.
+ */
+static void _tangent_select(Tensor *out, Tensor *t1, Tensor *t2, bool max) {
+    ndArray *dt1 = get_tensor_tangent(t1), *dt2 = get_tensor_tangent(t2);
+    if (!dt1 && !dt2)
+        return;
+
+    ndArray *data1 = get_tensor_data(t1), *data2 = get_tensor_data(t2);
+    ndArray *term1 = NULL, *term2 = NULL;
+    if (dt1) {
+        ndArray *mask = max ? array_ge(data1, data2) : array_le(data1, data2);
+        term1 = array_mul(dt1, mask);
+        free_array(mask);
+    }
+    if (dt2) {
+        ndArray *mask = max ? array_gt(data2, data1) : array_lt(data2, data1);
+        term2 = array_mul(dt2, mask);
+        free_array(mask);
+    }
+
+    _set_tangent(out, _sum_tangents(term1, term2, out));
+}
+
+void tangent_max(Tensor *out, Tensor *t1, Tensor *t2) {
+    _tangent_select(out, t1, t2, true);
+}
+
+void tangent_min(Tensor *out, Tensor *t1, Tensor *t2) {
+    _tangent_select(out, t1, t2, false);
+}
+
+void tangent_neg(Tensor *out, Tensor *tensor) {
+    ndArray *dt = get_tensor_tangent(tensor);
+    if (dt)
+        _set_tangent(out, negative(dt));
+}
+
+// d(1/x) = -dx / x^2 = -dx * out^2
+void tangent_inv(Tensor *out, Tensor *tensor) {
+    ndArray *dt = get_tensor_tangent(tensor);
+    if (!dt)
+        return;
+
+    ndArray *out_data = get_tensor_data(out);
+    ndArray *tangent = array_mul(out_data, out_data);
+    array_muli(&tangent, dt);
+
+    ndArray *neg = negative(tangent);
+    free_array(tangent);
+    _set_tangent(out, neg);
+}
+
+void tangent_transpose(Tensor *out, Tensor *tensor, const int *dims) {
+    ndArray *dt = get_tensor_tangent(tensor);
+    if (dt)
+        _set_tangent(out, transpose(dt, dims));
+}
+
+void tangent_matmul(Tensor *out, Tensor *t1, Tensor *t2) {
+    ndArray *dt1 = get_tensor_tangent(t1), *dt2 = get_tensor_tangent(t2);
+    if (!dt1 && !dt2)
+        return;
+
+    ndArray *term1 = dt1 ? matmul(dt1, get_tensor_data(t2)) : NULL;
+    ndArray *term2 = dt2 ? matmul(get_tensor_data(t1), dt2) : NULL;
+    _set_tangent(out, _sum_tangents(term1, term2, out));
+}
+
+void tangent_sum(Tensor *out, Tensor *tensor) {
+    ndArray *dt = get_tensor_tangent(tensor);
+    if (dt)
+        _set_tangent(out, array_sum(dt));
+}
+
+// casts to integer dtypes are detached, they carry no tangent either
+void tangent_cast(Tensor *out, Tensor *tensor) {
+    ndArray *dt = get_tensor_tangent(tensor);
+    DType dtype = get_tensor_dtype(out);
+    if (dt && dtype != DTYPE_INT && dtype != DTYPE_LONG)
+        _set_tangent(out, array_cast(dt, dtype));
+}
+
+void tangent_spmm(Tensor *out, const SparseArray *sparse, Tensor *dense) {
+    ndArray *dt = get_tensor_tangent(dense);
+    if (dt)
+        _set_tangent(out, spmm(sparse, dt));
+}
+
+// the rectifier's derivative is read off its output, like in backward
+void tangent_relu(Tensor *out, Tensor *tensor, double negative_slope,
+                  double cap) {
+    ndArray *dt = get_tensor_tangent(tensor);
+    if (!dt)
+        return;
+
+    ndArray *aligned = array_cast(dt, get_tensor_dtype(out));
+    _set_tangent(out, array_relu_grad(aligned, get_tensor_data(out),
+                                      negative_slope, cap));
+    free_array(aligned);
+}
+
+void tangent_activation(Tensor *out, Tensor *tensor, ActivationKind kind) {
+    ndArray *dt = get_tensor_tangent(tensor);
+    if (!dt)
+        return;
+
+    Tensor *saved = activation_reads_output(kind) ? out : tensor;
+    ndArray *aligned = array_cast(dt, get_tensor_dtype(out));
+    _set_tangent(out, array_activation_grad(aligned, get_tensor_data(saved),
+                                            kind));
+    free_array(aligned);
+}
+
+void tangent_softmax(Tensor *out, Tensor *tensor, int dim, bool log_space) {
+    ndArray *dt = get_tensor_tangent(tensor);
+    if (!dt)
+        return;
+
+    ndArray *aligned = array_cast(dt, get_tensor_dtype(out));
+    _set_tangent(out, array_softmax_jvp(aligned, get_tensor_data(out), dim,
+                                        log_space));
+    free_array(aligned);
+}
+
+/*
+ * The loss is a sum over each sample's row (or element), so its tangent is
+ * the gradient for a unit upstream gradient times the input tangent,
+ * reduced the same way.
+ */
+static ndArray *_loss_directional(Tensor *out, Tensor *input, Tensor *target,
+                                  LossKind kind, Reduction reduction,
+                                  const ndArray *lse, bool wrt_target) {
+    ndArray *dt = get_tensor_tangent(wrt_target ? target : input);
+    if (!dt)
+        return NULL;
+
+    ndArray *out_data = get_tensor_data(out);
+    ndArray *unit = ones(get_ndim(out_data), get_shape(out_data),
+                         get_dtype(out_data));
+    ndArray *x = get_tensor_data(input), *t = get_tensor_data(target), *grad;
+    if (kind == LOSS_NLL || kind == LOSS_CROSS_ENTROPY)
+        grad = array_nll_loss_grad(unit, x, t, lse, reduction);
+    else
+        grad = array_pointwise_loss_grad(unit, x, t, kind, reduction,
+                                         wrt_target);
+    free_array(unit);
+
+    ndArray *aligned = array_cast(dt, get_dtype(grad));
+    ndArray *product = array_mul(grad, aligned);
+    free_array(grad);
+    free_array(aligned);
+
+    ndArray *result = product;
+    if (reduction != REDUCTION_NONE)
+        result = array_sum(product);
+    else if (kind == LOSS_NLL || kind == LOSS_CROSS_ENTROPY)
+        result = array_sum_dim(product, 1, false);
+    if (result != product)
+        free_array(product);
+
+    return result;
+}
+
+void tangent_loss(Tensor *out, Tensor *input, Tensor *target, LossKind kind,
+                  Reduction reduction, const ndArray *lse) {
+    ndArray *dx = _loss_directional(out, input, target, kind, reduction, lse,
+                                    false);
+    ndArray *dy = NULL;
+    if (kind == LOSS_MSE || kind == LOSS_BCE_WITH_LOGITS)
+        dy = _loss_directional(out, input, target, kind, reduction, lse, true);
+
+    if (dx && dy) {
+        ndArray *sum = array_add(dx, dy);
+        free_array(dx);
+        free_array(dy);
+        dx = sum;
+    }
+
+    if (dx || dy)
+        _set_tangent(out, dx ? dx : dy);
+}
+
+Tensor *jvp(JvpFn fn, void *ctx, size_t num_inputs, Tensor **inputs,
+            ndArray **tangents, ndArray **output_tangent) {
+    for (size_t i = 0; i < num_inputs; i++) {
+        if (get_tensor_tangent(inputs[i]))
+            RUNTIME_ERRORF(INVALID_BACKWARD_PASS,
+                           "Input tensor at index `%zu` already has a tangent",
+                           i);
+
+        ndArray *tangent = tangents[i];
+        if (tangent)
+            set_tensor_tangent(inputs[i],
+                               array_cast(tangent, get_dtype(tangent)));
+    }
+
+    Tensor *output = fn(ctx, inputs);
+
+    ndArray *tangent = get_tensor_tangent(output);
+    *output_tangent = tangent ? array_cast(tangent, get_dtype(tangent))
+                              : zeros(get_tensor_ndim(output),
+                                      get_tensor_shape(output),
+                                      get_tensor_dtype(output));
+
+    for (size_t i = 0; i < num_inputs; i++)
+        set_tensor_tangent(inputs[i], NULL);
+
+    return output;
+}
+
+// linear in each operand, the bias tangent rides along with the first term
+void tangent_conv(Tensor *out, Tensor *input, Tensor *weight, Tensor *bias,
+                  const ConvParams *params) {
+    ndArray *dx = get_tensor_tangent(input), *dw = get_tensor_tangent(weight),
+            *db = bias ? get_tensor_tangent(bias) : NULL;
+    if (!dx && !dw && !db)
+        return;
+
+    ndArray *x = get_tensor_data(input), *w = get_tensor_data(weight);
+    ndArray *term1 = NULL, *term2 = NULL;
+    if (dx)
+        term1 = array_conv(dx, w, db, params);
+    if (dw || (!dx && db)) {
+        ndArray *zero = dw ? NULL : zeros(get_ndim(w), get_shape(w),
+                                          get_dtype(w));
+        term2 = array_conv(x, dw ? dw : zero, dx ? NULL : db, params);
+        if (zero)
+            free_array(zero);
+    }
+
+    _set_tangent(out, _sum_tangents(term1, term2, out));
+}
+
+void tangent_pool(Tensor *out, Tensor *tensor, const PoolParams *params,
+                  const ndArray *indices) {
+    ndArray *dt = get_tensor_tangent(tensor);
+    if (dt)
+        _set_tangent(out, array_pool_jvp(dt, indices, params));
+}
+
+// one fused kernel covers the input, weight and bias tangents together
+void tangent_norm(Tensor *out, Tensor *input, Tensor *weight, Tensor *bias,
+                  const NormParams *params, const ndArray *stats) {
+    ndArray *dx = get_tensor_tangent(input),
+            *dw = weight ? get_tensor_tangent(weight) : NULL,
+            *db = bias ? get_tensor_tangent(bias) : NULL;
+    if (!dx && !dw && !db)
+        return;
+
+    _set_tangent(out, array_norm_jvp(get_tensor_data(input),
+                                     weight ? get_tensor_data(weight) : NULL,
+                                     stats, params, dx, dw, db));
+}
@@ -0,0 +1,45 @@
+#include "autograd.h"
+#include "error_codes.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+
+static _Thread_local int no_grad_depth = 0;
+static _Thread_local int inference_depth = 0;
+static _Thread_local int recompute_depth = 0;
+
+int ctorch_no_grad_enter() { return ++no_grad_depth; }
+
+void ctorch_no_grad_exit() {
+    if (no_grad_depth == 0)
+        RUNTIME_ERROR(INVALID_GRAD_MODE,
+                      "ctorch_no_grad_exit called outside of a no_grad region");
+
+    no_grad_depth--;
+}
+
+int ctorch_inference_mode_enter() { return ++inference_depth; }
+
+void ctorch_inference_mode_exit() {
+    if (inference_depth == 0)
+        RUNTIME_ERROR(INVALID_GRAD_MODE,
+                      "ctorch_inference_mode_exit called outside of an "
+                      "inference region");
+
+    inference_depth--;
+}
+
+int ctorch_recompute_enter() { return ++recompute_depth; }
+
+void ctorch_recompute_exit() {
+    if (recompute_depth == 0)
+        RUNTIME_ERROR(INVALID_GRAD_MODE,
+                      "ctorch_recompute_exit called outside of a recompute "
+                      "region");
+
+    recompute_depth--;
+}
+
+bool is_grad_enabled() { return no_grad_depth == 0 && inference_depth == 0; }
+bool is_inference_mode() { return inference_depth > 0; }
+bool is_recomputing() { return recompute_depth > 0; }
@@ -0,0 +1,250 @@
+#include "array.h"
+#include "autograd.h"
+#include "error_codes.h"
+#include "tensor.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// copies `src` in row-major order into a dense buffer, whatever its strides
+static void _copy_dense(char *dst, const ndArray *src) {
+    int ndim = get_ndim(src);
+    const size_t *shape = get_shape(src), *strides = get_strides(src);
+    size_t itemsize = get_itemsize(src), total_size = get_total_size(src);
+    const char *data = get_array_data(src);
+
+    if (is_array_contiguous(src)) {
+        memcpy(dst, data, total_size * itemsize);
+        return;
+    }
+
+    for (size_t i = 0; i < total_size; i++) {
+        size_t tmp = i, offset = 0;
+        for (int d = ndim - 1; d >= 0; d--) {
+            offset += (tmp % shape[d]) * strides[d];
+            tmp /= shape[d];
+        }
+        memcpy(dst + i * itemsize, data + offset, itemsize);
+    }
+}
+
+// `stacked` has one leading dimension over `like`'s shape
+static ndArray *_stacked_zeros(size_t num, const Tensor *like) {
+    int ndim = get_tensor_ndim(like);
+    size_t shape[ndim + 1];
+    shape[0] = num;
+    memcpy(shape + 1, get_tensor_shape(like), ndim * sizeof(size_t));
+
+    return zeros(ndim + 1, shape, get_tensor_dtype(like));
+}
+
+static void _store_slice(ndArray *stacked, size_t index, const ndArray *src) {
+    size_t size = get_total_size(src) * get_itemsize(src);
+    _copy_dense((char *)get_array_data(stacked) + index * size, src);
+}
+
+static ndArray *_load_slice(const ndArray *stacked, size_t index,
+                            const Tensor *like) {
+    ndArray *slice = array_init(get_tensor_ndim(like), get_tensor_shape(like),
+                                get_dtype(stacked));
+    size_t size = get_total_size(slice) * get_itemsize(slice);
+    memcpy(get_array_data(slice),
+           (const char *)get_array_data(stacked) + index * size, size);
+
+    return slice;
+}
+
+static void _check_stacked(const ndArray *stacked, size_t num,
+                           const Tensor *like) {
+    int ndim = get_tensor_ndim(like);
+    bool valid = get_ndim(stacked) == ndim + 1 &&
+                 get_shape(stacked)[0] == num &&
+                 get_dtype(stacked) == get_tensor_dtype(like) &&
+                 is_array_contiguous(stacked);
+    for (int d = 0; valid && d < ndim; d++)
+        valid = get_shape(stacked)[d + 1] == get_tensor_shape(like)[d];
+
+    if (!valid)
+        RUNTIME_ERROR(SHAPE_MISMATCH,
+                      "Stacked vectors must be contiguous with shape "
+                      "(num_vectors, *input shape) and the input's dtype");
+}
+
+typedef struct HvpCtx {
+    JvpFn fn;
+    void *ctx;
+    size_t num_inputs;
+    Tensor **grads;
+} HvpCtx;
+
+/*
+ * The gradient is built with a graph, its ops carry the inputs' tangents
+ * forward, so each gradient's tangent is the Hessian-vector product.
+ */
+static Tensor *_hvp_fn(void *ctx, Tensor **inputs) {
+    HvpCtx *hvp_ctx = ctx;
+    Tensor *output = hvp_ctx->fn(hvp_ctx->ctx, inputs);
+    if (get_tensor_ndim(output) != 0 || !get_requires_grad(output))
+        RUNTIME_ERROR(INVALID_BACKWARD_PASS,
+                      "hvp expects a scalar output that requires grad");
+
+    for (size_t i = 0; i < hvp_ctx->num_inputs; i++)
+        hvp_ctx->grads[i] = NULL;
+
+    Tensor *seed = ones_like(output, NO_GRAD, get_tensor_environ(output));
+    gradient(hvp_ctx->grads, hvp_ctx->num_inputs, inputs, 1,
+             (Tensor *[]){output}, (Tensor *[]){seed}, CREATE_GRAPH);
+
+    return output;
+}
+
+void hvp(JvpFn fn, void *ctx, size_t num_inputs, Tensor **inputs,
+         ndArray **vectors, ndArray **hvps) {
+    size_t num_vectors = get_shape(vectors[0])[0];
+    for (size_t i = 0; i < num_inputs; i++) {
+        _check_stacked(vectors[i], num_vectors, inputs[i]);
+        hvps[i] = _stacked_zeros(num_vectors, inputs[i]);
+    }
+
+    Tensor *grads[num_inputs];
+    HvpCtx hvp_ctx = {fn, ctx, num_inputs, grads};
+    for (size_t v = 0; v < num_vectors; v++) {
+        ndArray *tangents[num_inputs], *output_tangent;
+        for (size_t i = 0; i < num_inputs; i++)
+            tangents[i] = _load_slice(vectors[i], v, inputs[i]);
+
+        size_t mark = env_scratch_begin();
+        jvp(_hvp_fn, &hvp_ctx, num_inputs, inputs, tangents, &output_tangent);
+
+        // gradients that are constant in the inputs have no tangent
+        for (size_t i = 0; i < num_inputs; i++) {
+            ndArray *product = grads[i] ? get_tensor_tangent(grads[i]) : NULL;
+            if (product)
+                _store_slice(hvps[i], v, product);
+            free_array(tangents[i]);
+        }
+
+        free_array(output_tangent);
+        env_scratch_end(mark);
+    }
+}
+
+// one reverse pass per output element, the rows of every Jacobian
+static void _jacobian_rows(Tensor *output, size_t num_inputs, Tensor **inputs,
+                           ndArray **jacobians) {
+    int ndim = get_tensor_ndim(output);
+    const size_t *shape = get_tensor_shape(output);
+    size_t num_rows = get_total_size(get_tensor_data(output));
+    DType dtype = get_tensor_dtype(output);
+    Environment *env = get_tensor_environ(output);
+
+    for (size_t r = 0; r < num_rows; r++) {
+        size_t idx[ndim > 0 ? ndim : 1], tmp = r;
+        for (int d = ndim - 1; d >= 0; d--) {
+            idx[d] = tmp % shape[d];
+            tmp /= shape[d];
+        }
+
+        size_t mark = env_scratch_begin();
+        ndArray *one_hot = zeros(ndim, shape, dtype);
+        set_value(one_hot, idx, array_val_one(dtype));
+        Tensor *seed = tensor_init(one_hot, NO_GRAD, env);
+
+        Tensor *grads[num_inputs];
+        for (size_t i = 0; i < num_inputs; i++)
+            grads[i] = NULL;
+
+        gradient(grads, num_inputs, inputs, 1, (Tensor *[]){output},
+                 (Tensor *[]){seed}, NO_GRAPH);
+
+        for (size_t i = 0; i < num_inputs; i++)
+            if (grads[i])
+                _store_slice(jacobians[i], r, get_tensor_data(grads[i]));
+        env_scratch_end(mark);
+    }
+}
+
+// one forward pass per input element, the columns of `jacobians[i]`
+static void _jacobian_columns(JvpFn fn, void *ctx, size_t num_inputs,
+                              Tensor **inputs, size_t i, ndArray *jacobian) {
+    size_t num_cols = get_total_size(get_tensor_data(inputs[i]));
+    size_t num_rows = get_total_size(jacobian) / num_cols;
+    size_t itemsize = get_itemsize(jacobian);
+    char *dst = get_array_data(jacobian);
+    char *column = malloc(num_rows * itemsize);
+    if (!column)
+        RUNTIME_ERROR(ARRAY_INIT_FAILURE,
+                      "Failure to allocate a Jacobian column");
+
+    DType dtype = get_tensor_dtype(inputs[i]);
+    ndArray *tangents[num_inputs];
+    for (size_t j = 0; j < num_inputs; j++)
+        tangents[j] = NULL;
+
+    for (size_t c = 0; c < num_cols; c++) {
+        ndArray *one_hot = zeros(get_tensor_ndim(inputs[i]),
+                                 get_tensor_shape(inputs[i]), dtype);
+        array_val_store((char *)get_array_data(one_hot) + c * itemsize,
+                        array_val_one(dtype), dtype);
+        tangents[i] = one_hot;
+
+        ndArray *output_tangent;
+        size_t mark = env_scratch_begin();
+        jvp(fn, ctx, num_inputs, inputs, tangents, &output_tangent);
+        env_scratch_end(mark);
+        free_array(one_hot);
+
+        ndArray *cast = array_cast(output_tangent, get_dtype(jacobian));
+        _copy_dense(column, cast);
+        for (size_t r = 0; r < num_rows; r++)
+            memcpy(dst + (r * num_cols + c) * itemsize, column + r * itemsize,
+                   itemsize);
+
+        free_array(output_tangent);
+        free_array(cast);
+    }
+
+    free(column);
+}
+
+/*
+ * Reverse mode costs a pass per output element, forward mode one per input
+ * element, the cheaper of the two runs.
+ */
+void jacobian(JvpFn fn, void *ctx, size_t num_inputs, Tensor **inputs,
+              ndArray **jacobians) {
+    size_t mark = env_scratch_begin();
+    Tensor *output = fn(ctx, inputs);
+
+    int ndim = get_tensor_ndim(output);
+    const size_t *shape = get_tensor_shape(output);
+    size_t num_rows = get_total_size(get_tensor_data(output)), num_cols = 0;
+    for (size_t i = 0; i < num_inputs; i++) {
+        int in_ndim = get_tensor_ndim(inputs[i]);
+        size_t jac_shape[ndim + in_ndim];
+        memcpy(jac_shape, shape, ndim * sizeof(size_t));
+        memcpy(jac_shape + ndim, get_tensor_shape(inputs[i]),
+               in_ndim * sizeof(size_t));
+
+        jacobians[i] =
+            zeros(ndim + in_ndim, jac_shape, get_tensor_dtype(inputs[i]));
+        num_cols += get_total_size(get_tensor_data(inputs[i]));
+    }
+
+    if (num_rows <= num_cols) {
+        if (!get_requires_grad(output))
+            RUNTIME_ERROR(INVALID_BACKWARD_PASS,
+                          "jacobian expects an output that requires grad");
+
+        _jacobian_rows(output, num_inputs, inputs, jacobians);
+        env_scratch_end(mark);
+        return;
+    }
+
+    env_scratch_end(mark);
+    for (size_t i = 0; i < num_inputs; i++)
+        _jacobian_columns(fn, ctx, num_inputs, inputs, i, jacobians[i]);
+}
@@ -2,6 +2,7 @@
 #include "array.h"
 #include "autograd.h"
 #include "error_codes.h"
+#include "sparse.h"
 #include "tensor.h"
 
 #include <stdbool.h>
@@ -31,20 +32,67 @@ _DEFINE_GRAD_FN(_accumulate_grad_fn, 1, 0, {
     Tensor *tensor = inputs[0], *grad = input_grads[0];
     Environment *env = get_tensor_environ(tensor);
 
+    // rows of the leaf gradient not hit by any non-zero stay untouched
+    SparseArray *sparse = get_sparse_grad_factor(grad);
+    if (sparse) {
+        Tensor *tensor_grad = get_tensor_grad(tensor);
+        if (!tensor_grad) {
+            zero_grad(tensor);
+            tensor_grad = get_tensor_grad(tensor);
+        }
+
+        ndArray *acc = get_tensor_data(tensor_grad);
+        if (is_array_contiguous(acc) &&
+            get_dtype(acc) == get_tensor_dtype(grad)) {
+            spmm_t_accumulate(sparse, get_tensor_data(grad), acc);
+            return;
+        }
+        sparse_grad_densify(grad);
+    }
+
+    ndArray *value = get_tensor_data(tensor), *data = get_tensor_data(grad);
+    bool same_shape = get_ndim(value) == get_ndim(data);
+    for (int d = 0; same_shape && d < get_ndim(value); d++)
+        same_shape = get_shape(value)[d] == get_shape(data)[d];
+
+    // the first gradient is copied rather than added to zeros
     Tensor *tensor_grad = get_tensor_grad(tensor);
+    if (!tensor_grad && same_shape && is_array_contiguous(data)) {
+        set_tensor_grad(tensor, tensor_init(array_cast(data, get_dtype(value)),
+                                            NO_GRAD, NULL));
+        return;
+    }
     if (!tensor_grad) {
         zero_grad(tensor);
         tensor_grad = get_tensor_grad(tensor);
     }
 
-    ndArray *sum =
-        array_add(get_tensor_data(tensor_grad), get_tensor_data(grad));
+    // accumulate in place when the shapes agree, the buffer may be a view
+    ndArray *acc = get_tensor_data(tensor_grad);
+    bool in_place = get_dtype(acc) == get_dtype(data) && same_shape;
 
-    replace_tensor_data(tensor_grad, sum);
+    if (in_place)
+        array_add_out(acc, data, acc);
+    else
+        replace_tensor_data(tensor_grad, array_add(acc, data));
 })
 
 #define BLOCK(...) {__VA_ARGS__}
 
+// promoted binary ops hand back gradients in the operand's own dtype
+static inline Tensor *_grad_like(Tensor *grad, const Tensor *tensor,
+                                 bool create_graph) {
+    DType dtype = get_tensor_dtype(tensor);
+    if (!grad || get_tensor_dtype(grad) == dtype)
+        return grad;
+
+    if (create_graph)
+        return tensor_to(grad, dtype);
+
+    replace_tensor_data(grad, array_cast(get_tensor_data(grad), dtype));
+    return grad;
+}
+
 #define _ONE_IP_TWO_OP_GRAD_FN(name, CG_T1_BLOCK, CG_T2_BLOCK, NG_T1_BLOCK,    \
                                NG_T2_BLOCK)                                    \
     _DEFINE_GRAD_FN(name, 1, 2, {                                              \
@@ -73,8 +121,8 @@ _DEFINE_GRAD_FN(_accumulate_grad_fn, 1, 0, {
             if (t2_requires_grad)                                              \
                 NG_T2_BLOCK                                                    \
         }                                                                      \
-        output_grads[0] = t1_grad;                                             \
-        output_grads[1] = t2_grad;                                             \
+        output_grads[0] = _grad_like(t1_grad, t1, create_graph);               \
+        output_grads[1] = _grad_like(t2_grad, t2, create_graph);               \
     })
 
 _ONE_IP_TWO_OP_GRAD_FN(
@@ -93,6 +141,24 @@ _ONE_IP_TWO_OP_GRAD_FN(
         t2_grad = tensor_init(data2_grad, NO_GRAD, env);
     }))
 
+_ONE_IP_TWO_OP_GRAD_FN(
+    _sub_grad_fn,
+    BLOCK({ t1_grad = broadcast_tensor_grad(grad, t1_ndim, t1_shape); }),
+    BLOCK({
+        t2_grad = broadcast_tensor_grad(tensor_neg(grad), t2_ndim, t2_shape);
+    }),
+
+    BLOCK({
+        ndArray *data1_grad = copy_array(grad_data);
+        data1_grad = broadcast_grad_data(data1_grad, t1_ndim, t1_shape);
+        t1_grad = tensor_init(data1_grad, NO_GRAD, env);
+    }),
+    BLOCK({
+        ndArray *data2_grad = negative(grad_data);
+        data2_grad = broadcast_grad_data(data2_grad, t2_ndim, t2_shape);
+        t2_grad = tensor_init(data2_grad, NO_GRAD, env);
+    }))
+
 _ONE_IP_TWO_OP_GRAD_FN(
     _mul_grad_fn, BLOCK({
         t1_grad = tensor_mul(t2, grad);
@@ -114,6 +180,63 @@ _ONE_IP_TWO_OP_GRAD_FN(
         t2_grad = tensor_init(data2_grad, NO_GRAD, env);
     }))
 
+// fused expressions read float or double tensors of a single dtype
+static bool _fusable(Tensor **tensors, size_t num_tensors) {
+    DType dtype = get_tensor_dtype(tensors[0]);
+    if (dtype != DTYPE_FLOAT && dtype != DTYPE_DOUBLE)
+        return false;
+
+    for (size_t i = 1; i < num_tensors; i++)
+        if (get_tensor_dtype(tensors[i]) != dtype)
+            return false;
+
+    return true;
+}
+
+// d(a / b)/db = -grad * a / b^2, one fused pass instead of four ops
+static Tensor *_div_rhs_grad_create_graph(Tensor *grad, Tensor *t1,
+                                          Tensor *t2) {
+    if (!_fusable((Tensor *[]){grad, t1, t2}, 3))
+        return tensor_neg(
+            tensor_div(tensor_mul(grad, t1), tensor_mul(t2, t2)));
+
+    FusedExpr *expr = fused_expr_init();
+    int g = fused_input(expr, grad), a = fused_input(expr, t1),
+        b = fused_input(expr, t2);
+    int root = fused_neg(expr, fused_div(expr, fused_mul(expr, g, a),
+                                         fused_mul(expr, b, b)));
+
+    Tensor *result = fused_eval(expr, root);
+    free_fused_expr(expr);
+    return result;
+}
+
+_ONE_IP_TWO_OP_GRAD_FN(
+    _div_grad_fn, BLOCK({
+        t1_grad = tensor_div(grad, t2);
+        t1_grad = broadcast_tensor_grad(t1_grad, t1_ndim, t1_shape);
+    }),
+    BLOCK({
+        t2_grad = _div_rhs_grad_create_graph(grad, t1, t2);
+        t2_grad = broadcast_tensor_grad(t2_grad, t2_ndim, t2_shape);
+    }),
+
+    BLOCK({
+        ndArray *data1_grad = array_div(grad_data, data2);
+        data1_grad = broadcast_grad_data(data1_grad, t1_ndim, t1_shape);
+        t1_grad = tensor_init(data1_grad, NO_GRAD, env);
+    }),
+    BLOCK({
+        ndArray *data2_grad = array_mul(grad_data, data1);
+        ndArray *square = array_mul(data2, data2);
+        array_divi(&data2_grad, square);
+        negativei(&data2_grad);
+        free_array(square);
+
+        data2_grad = broadcast_grad_data(data2_grad, t2_ndim, t2_shape);
+        t2_grad = tensor_init(data2_grad, NO_GRAD, env);
+    }))
+
 _DEFINE_GRAD_FN(_neg_grad_fn, 1, 1, {
     Tensor *new_tensor = inputs[0], *grad = input_grads[0];
 
@@ -130,7 +253,14 @@ _DEFINE_GRAD_FN(_inv_grad_fn, 1, 1, {
     Tensor *new_tensor = inputs[0], *grad = input_grads[0];
 
     Environment *env = get_tensor_environ(new_tensor);
-    if (create_graph) {
+    if (create_graph && _fusable((Tensor *[]){new_tensor, grad}, 2)) {
+        FusedExpr *expr = fused_expr_init();
+        int y = fused_input(expr, new_tensor), g = fused_input(expr, grad);
+        int root = fused_neg(expr, fused_mul(expr, fused_mul(expr, y, y), g));
+
+        output_grads[0] = fused_eval(expr, root);
+        free_fused_expr(expr);
+    } else if (create_graph) {
         Tensor *tensor_grad = tensor_mul(new_tensor, new_tensor);
         tensor_grad = tensor_mul(tensor_grad, grad);
         output_grads[0] = tensor_neg(tensor_grad);
@@ -166,6 +296,295 @@ _DEFINE_GRAD_FN(_transpose_grad_fn, 1, 1, {
     }
 })
 
+/*
+ * One pass over the gradient and the saved output. The derivative is
+ * piecewise constant, so with `create_graph` it multiplies the gradient as
+ * a constant mask.
+ */
+_DEFINE_GRAD_FN(_relu_grad_fn, 1, 1, {
+    Tensor *new_tensor = inputs[0], *grad = input_grads[0];
+
+    BackwardFn *backward_fn = get_backward_fn(new_tensor);
+    Ctx ctx_kind = get_ctx_kind(backward_fn);
+    if (ctx_kind != RELU_CTX) {
+        RUNTIME_ERRORF(INVALID_BACKWARD_PASS, "Invalid context kind for `%s`",
+                       __func__);
+    }
+    ReluCtx *ctx = (ReluCtx *)get_ctx(backward_fn);
+    ndArray *new_data = get_tensor_data(new_tensor);
+
+    Environment *env = get_tensor_environ(new_tensor);
+    if (create_graph) {
+        ndArray *ones_arr = ones(get_ndim(new_data), get_shape(new_data),
+                                 get_dtype(new_data));
+        ndArray *mask = array_relu_grad(ones_arr, new_data,
+                                        ctx->negative_slope, ctx->cap);
+        free_array(ones_arr);
+
+        output_grads[0] = tensor_mul(grad, tensor_init(mask, NO_GRAD, env));
+    } else {
+        ndArray *data_grad = array_relu_grad(
+            get_tensor_data(grad), new_data, ctx->negative_slope, ctx->cap);
+        output_grads[0] = tensor_init(data_grad, NO_GRAD, env);
+    }
+})
+
+/*
+ * With `create_graph` the derivative is rebuilt as a fused expression over
+ * the saved tensors (and tanh/sigmoid nodes for GELU and SiLU), so it can
+ * be differentiated again.
+ */
+static Tensor *_activation_grad_create_graph(ActivationKind kind, Tensor *grad,
+                                             Tensor *input, Tensor *output) {
+    FusedExpr *expr = fused_expr_init();
+    int g = fused_input(expr, grad), one = fused_scalar(expr, 1.0), root = -1;
+
+    switch (kind) {
+    case ACTIVATION_TANH: {
+        int y = fused_input(expr, output);
+        root = fused_mul(expr, g, fused_sub(expr, one, fused_mul(expr, y, y)));
+    } break;
+    case ACTIVATION_SIGMOID: {
+        int y = fused_input(expr, output);
+        int dy = fused_mul(expr, y, fused_sub(expr, one, y));
+        root = fused_mul(expr, g, dy);
+    } break;
+    case ACTIVATION_SILU: {
+        int x = fused_input(expr, input);
+        int s = fused_input(expr, tensor_sigmoid(input));
+        int dx = fused_add(expr, one,
+                           fused_mul(expr, x, fused_sub(expr, one, s)));
+        root = fused_mul(expr, g, fused_mul(expr, s, dx));
+    } break;
+    case ACTIVATION_GELU: {
+        // u = k (x + c x^3), t = tanh(u), dx = (1 + t + x (1 - t^2) u') / 2
+        FusedExpr *arg = fused_expr_init();
+        int ax = fused_input(arg, input);
+        int cube = fused_mul(arg, fused_scalar(arg, GELU_C),
+                             fused_mul(arg, ax, fused_mul(arg, ax, ax)));
+        int u = fused_mul(arg, fused_scalar(arg, GELU_K),
+                          fused_add(arg, ax, cube));
+        Tensor *t_tensor = tensor_tanh(fused_eval(arg, u));
+        free_fused_expr(arg);
+
+        int x = fused_input(expr, input), t = fused_input(expr, t_tensor);
+        int x2 = fused_mul(expr, x, x);
+        int du = fused_mul(
+            expr, fused_scalar(expr, GELU_K),
+            fused_add(expr, one,
+                      fused_mul(expr, fused_scalar(expr, 3 * GELU_C), x2)));
+        int dt = fused_mul(expr, fused_sub(expr, one, fused_mul(expr, t, t)),
+                           fused_mul(expr, x, du));
+        int dx = fused_mul(expr, fused_scalar(expr, 0.5),
+                           fused_add(expr, fused_add(expr, one, t), dt));
+        root = fused_mul(expr, g, dx);
+    } break;
+    default:
+        RUNTIME_ERRORF(INVALID_BACKWARD_PASS,
+                       "Unsupported activation kind %d in `%s`", (int)kind,
+                       __func__);
+    }
+
+    Tensor *result = fused_eval(expr, root);
+    free_fused_expr(expr);
+    return result;
+}
+
+_DEFINE_GRAD_FN(_activation_grad_fn, 1, 1, {
+    Tensor *new_tensor = inputs[0], *tensor = outputs[0],
+           *grad = input_grads[0];
+
+    BackwardFn *backward_fn = get_backward_fn(new_tensor);
+    if (get_ctx_kind(backward_fn) != ACTIVATION_CTX) {
+        RUNTIME_ERRORF(INVALID_BACKWARD_PASS, "Invalid context kind for `%s`",
+                       __func__);
+    }
+    ActivationKind kind = ((ActivationCtx *)get_ctx(backward_fn))->kind;
+
+    if (create_graph) {
+        output_grads[0] =
+            _activation_grad_create_graph(kind, grad, tensor, new_tensor);
+        return;
+    }
+
+    Tensor *saved = activation_reads_output(kind) ? new_tensor : tensor;
+    ndArray *data_grad = array_activation_grad(
+        get_tensor_data(grad), get_tensor_data(saved), kind);
+    output_grads[0] =
+        tensor_init(data_grad, NO_GRAD, get_tensor_environ(new_tensor));
+})
+
+_DEFINE_GRAD_FN(_softmax_grad_fn, 1, 1, {
+    Tensor *new_tensor = inputs[0], *grad = input_grads[0];
+
+    BackwardFn *backward_fn = get_backward_fn(new_tensor);
+    if (get_ctx_kind(backward_fn) != SOFTMAX_CTX) {
+        RUNTIME_ERRORF(INVALID_BACKWARD_PASS, "Invalid context kind for `%s`",
+                       __func__);
+    }
+    if (create_graph)
+        RUNTIME_ERROR(INVALID_BACKWARD_PASS,
+                      "Softmax does not support `create_graph`");
+
+    SoftmaxCtx *ctx = (SoftmaxCtx *)get_ctx(backward_fn);
+    ndArray *data_grad =
+        array_softmax_grad(get_tensor_data(grad), get_tensor_data(new_tensor),
+                           ctx->dim, ctx->log_space);
+    output_grads[0] =
+        tensor_init(data_grad, NO_GRAD, get_tensor_environ(new_tensor));
+})
+
+static LossCtx *_loss_ctx(Tensor *loss, const char *name) {
+    BackwardFn *backward_fn = get_backward_fn(loss);
+    if (get_ctx_kind(backward_fn) != LOSS_CTX) {
+        RUNTIME_ERRORF(INVALID_BACKWARD_PASS, "Invalid context kind for `%s`",
+                       name);
+    }
+
+    return (LossCtx *)get_ctx(backward_fn);
+}
+
+// class targets are integers, only the input gets a gradient
+_DEFINE_GRAD_FN(_nll_loss_grad_fn, 1, 2, {
+    Tensor *loss = inputs[0], *input = outputs[0], *target = outputs[1],
+           *grad = input_grads[0];
+
+    LossCtx *ctx = _loss_ctx(loss, __func__);
+    if (create_graph)
+        RUNTIME_ERROR(INVALID_BACKWARD_PASS,
+                      "Class losses do not support `create_graph`");
+
+    output_grads[0] = output_grads[1] = NULL;
+    if (!get_requires_grad(input))
+        return;
+
+    ndArray *data_grad = array_nll_loss_grad(
+        get_tensor_data(grad), get_tensor_data(input),
+        get_tensor_data(target), ctx->lse, ctx->reduction);
+    output_grads[0] = tensor_init(data_grad, NO_GRAD, get_tensor_environ(loss));
+})
+
+static Tensor *_pointwise_loss_grad_create_graph(const LossCtx *ctx,
+                                                 Tensor *grad, Tensor *input,
+                                                 Tensor *target,
+                                                 bool wrt_target) {
+    double scale = 1.0;
+    if (ctx->reduction == REDUCTION_MEAN)
+        scale /= (double)get_total_size(get_tensor_data(input));
+
+    FusedExpr *expr = fused_expr_init();
+    int g = fused_mul(expr, fused_input(expr, grad), fused_scalar(expr, scale));
+    int x = fused_input(expr, input), d;
+
+    if (ctx->kind == LOSS_MSE) {
+        int diff = fused_sub(expr, x, fused_input(expr, target));
+        d = fused_mul(expr, fused_scalar(expr, wrt_target ? -2.0 : 2.0), diff);
+    } else if (wrt_target) {
+        d = fused_neg(expr, x);
+    } else {
+        d = fused_sub(expr, fused_input(expr, tensor_sigmoid(input)),
+                      fused_input(expr, target));
+    }
+
+    Tensor *result = fused_eval(expr, fused_mul(expr, g, d));
+    free_fused_expr(expr);
+    return result;
+}
+
+_DEFINE_GRAD_FN(_pointwise_loss_grad_fn, 1, 2, {
+    Tensor *loss = inputs[0], *grad = input_grads[0];
+    LossCtx *ctx = _loss_ctx(loss, __func__);
+
+    for (size_t k = 0; k < 2; k++) {
+        output_grads[k] = NULL;
+        if (!get_requires_grad(outputs[k]))
+            continue;
+
+        bool wrt_target = k == 1;
+        if (create_graph) {
+            output_grads[k] = _pointwise_loss_grad_create_graph(
+                ctx, grad, outputs[0], outputs[1], wrt_target);
+            continue;
+        }
+
+        ndArray *data_grad = array_pointwise_loss_grad(
+            get_tensor_data(grad), get_tensor_data(outputs[0]),
+            get_tensor_data(outputs[1]), ctx->kind, ctx->reduction,
+            wrt_target);
+        output_grads[k] =
+            tensor_init(data_grad, NO_GRAD, get_tensor_environ(loss));
+    }
+})
+
+// the bias is optional, so the node has two or three operands
+void _conv_grad_fn(Tensor **output_grads, Tensor **inputs, Tensor **outputs,
+                   Tensor **input_grads, size_t num_inputs, size_t num_outputs,
+                   bool create_graph) {
+    if (num_inputs != 1 || num_outputs < 2 || num_outputs > 3) {
+        RUNTIME_ERRORF(INVALID_NUM_INPUTS_OUTPUTS,
+                       "Invalid number of inputs (%zu, expected 1) or "
+                       "outputs (%zu, expected 2 or 3) in function `%s`",
+                       num_inputs, num_outputs, __func__);
+    }
+
+    Tensor *new_tensor = inputs[0], *grad = input_grads[0];
+    Tensor *input = outputs[0], *weight = outputs[1];
+
+    BackwardFn *backward_fn = get_backward_fn(new_tensor);
+    if (get_ctx_kind(backward_fn) != CONV_CTX) {
+        RUNTIME_ERRORF(INVALID_BACKWARD_PASS, "Invalid context kind for `%s`",
+                       __func__);
+    }
+    const ConvParams *params = &((ConvCtx *)get_ctx(backward_fn))->params;
+
+    if (create_graph)
+        RUNTIME_ERROR(INVALID_BACKWARD_PASS,
+                      "Convolutions do not support `create_graph`");
+
+    Environment *env = get_tensor_environ(new_tensor);
+    ndArray *grad_data = get_tensor_data(grad);
+    for (size_t i = 0; i < num_outputs; i++)
+        output_grads[i] = NULL;
+
+    if (get_requires_grad(input)) {
+        ndArray *data_grad = array_conv_grad_input(
+            grad_data, get_tensor_data(weight), get_tensor_shape(input),
+            params);
+        output_grads[0] = tensor_init(data_grad, NO_GRAD, env);
+    }
+    if (get_requires_grad(weight)) {
+        ndArray *data_grad = array_conv_grad_weight(
+            grad_data, get_tensor_data(input), get_tensor_shape(weight),
+            params);
+        output_grads[1] = tensor_init(data_grad, NO_GRAD, env);
+    }
+    if (num_outputs == 3 && get_requires_grad(outputs[2]))
+        output_grads[2] =
+            tensor_init(array_conv_grad_bias(grad_data), NO_GRAD, env);
+}
+
+_DEFINE_GRAD_FN(_pool_grad_fn, 1, 1, {
+    Tensor *new_tensor = inputs[0], *grad = input_grads[0];
+    Tensor *tensor = outputs[0];
+
+    BackwardFn *backward_fn = get_backward_fn(new_tensor);
+    if (get_ctx_kind(backward_fn) != POOL_CTX) {
+        RUNTIME_ERRORF(INVALID_BACKWARD_PASS, "Invalid context kind for `%s`",
+                       __func__);
+    }
+    PoolCtx *ctx = (PoolCtx *)get_ctx(backward_fn);
+
+    if (create_graph)
+        RUNTIME_ERROR(INVALID_BACKWARD_PASS,
+                      "Pooling does not support `create_graph`");
+
+    ndArray *data_grad =
+        array_pool_grad(get_tensor_data(grad), ctx->indices,
+                        get_tensor_shape(tensor), &ctx->params);
+    output_grads[0] =
+        tensor_init(data_grad, NO_GRAD, get_tensor_environ(new_tensor));
+})
+
 static void inline _get_dims_for_matmul_grad(Tensor *t, int *dims) {
     int ndim = get_tensor_ndim(t);
     for (int d = 0; d < ndim; d++)
@@ -233,58 +652,334 @@ _DEFINE_GRAD_FN(_sum_grad_fn, 1, 1, {
     }
 })
 
-_ONE_IP_TWO_OP_GRAD_FN(
-    _max_grad_fn, BLOCK({
-        Tensor *t1_ge_t2 = tensor_ge(t1, t2);
-        t1_grad = tensor_mul(grad, t1_ge_t2);
-        t1_grad = broadcast_tensor_grad(t1_grad, t1_ndim, t1_shape);
-    }),
-    BLOCK({
-        Tensor *t2_gt_t1 = tensor_gt(t2, t1);
-        t2_grad = tensor_mul(grad, t2_gt_t1);
-        t2_grad = broadcast_tensor_grad(t2_grad, t2_ndim, t2_shape);
-    }),
-    BLOCK({
-        ndArray *data1_ge_data2 = array_ge(data1, data2);
-        ndArray *data1_grad = array_mul(grad_data, data1_ge_data2);
-        data1_grad = broadcast_grad_data(data1_grad, t1_ndim, t1_shape);
+_DEFINE_GRAD_FN(_spmm_grad_fn, 1, 1, {
+    Tensor *new_tensor = inputs[0], *grad = input_grads[0];
 
-        t1_grad = tensor_init(data1_grad, NO_GRAD, env);
-        free_array(data1_ge_data2);
-    }),
-    BLOCK({
-        ndArray *data2_gt_data1 = array_gt(data2, data1);
-        ndArray *data2_grad = array_mul(grad_data, data2_gt_data1);
-        data2_grad = broadcast_grad_data(data2_grad, t2_ndim, t2_shape);
+    BackwardFn *backward_fn = get_backward_fn(new_tensor);
+    Ctx ctx_kind = get_ctx_kind(backward_fn);
+    if (ctx_kind != SPMM_CTX) {
+        RUNTIME_ERRORF(INVALID_BACKWARD_PASS, "Invalid context kind for `%s`",
+                       __func__);
+    }
+    SpMMCtx *ctx = (SpMMCtx *)get_ctx(backward_fn);
 
-        t2_grad = tensor_init(data2_grad, NO_GRAD, env);
-        free_array(data2_gt_data1);
-    }))
+    Environment *env = get_tensor_environ(new_tensor);
+    if (create_graph) {
+        SparseArray *transposed = sparse_transpose(ctx->sparse);
+        output_grads[0] = tensor_spmm(transposed, grad, DENSE_GRAD, env);
+        free_sparse(transposed);
+    } else if (ctx->sparse_grad) {
+        // the node may be freed before the leaf's AccumulateGrad runs
+        ndArray *grad_data = get_tensor_data(grad);
+        output_grads[0] = sparse_grad_init(copy_sparse(ctx->sparse),
+                                           copy_array(grad_data), env);
+    } else {
+        ndArray *data_grad = spmm_t(ctx->sparse, get_tensor_data(grad));
+        output_grads[0] = tensor_init(data_grad, NO_GRAD, env);
+    }
+})
+
+_DEFINE_GRAD_FN(_cast_grad_fn, 1, 1, {
+    Tensor *new_tensor = inputs[0], *grad = input_grads[0];
+    DType dtype = get_tensor_dtype(outputs[0]);
 
+    Environment *env = get_tensor_environ(new_tensor);
+    if (create_graph) {
+        output_grads[0] = tensor_to_env(grad, dtype, env);
+    } else {
+        ndArray *data_grad = array_cast(get_tensor_data(grad), dtype);
+        output_grads[0] = tensor_init(data_grad, NO_GRAD, env);
+    }
+})
+
+/*
+ * Re-runs the checkpointed forward on a detached copy of its input with the
+ * graph recorded, inside a recompute region (see `is_recomputing`), then
+ * takes the gradients of the recomputed segment with respect to that copy
+ * and the segment's parameters. The node's outputs are the input followed by
+ * the parameters, so the caller's pass hands each gradient on: nothing
+ * accumulates into a leaf here. The recomputed activations live in a
+ * scratch environment that is freed right after.
+ */
+void _checkpoint_grad_fn(Tensor **output_grads, Tensor **inputs,
+                         Tensor **outputs, Tensor **input_grads,
+                         size_t num_inputs, size_t num_outputs,
+                         bool create_graph) {
+    if (num_inputs != 1 || num_outputs < 1) {
+        RUNTIME_ERRORF(INVALID_NUM_INPUTS_OUTPUTS,
+                       "Invalid number of inputs (%zu, expected 1) or "
+                       "outputs (%zu, expected at least 1) in function `%s`",
+                       num_inputs, num_outputs, __func__);
+    }
+
+    Tensor *output = inputs[0], *grad = input_grads[0];
+    Tensor *input = outputs[0];
+
+    if (create_graph)
+        RUNTIME_ERROR(INVALID_BACKWARD_PASS,
+                      "Checkpointed segments do not support `create_graph`");
+
+    BackwardFn *backward_fn = get_backward_fn(output);
+    Ctx ctx_kind = get_ctx_kind(backward_fn);
+    if (ctx_kind != CHECKPOINT_CTX) {
+        RUNTIME_ERRORF(INVALID_BACKWARD_PASS, "Invalid context kind for `%s`",
+                       __func__);
+    }
+    CheckpointCtx *ctx = (CheckpointCtx *)get_ctx(backward_fn);
+
+    Environment *scratch = env_init();
+    Tensor *detached = tensor_init(copy_array(get_tensor_data(input)),
+                                   get_requires_grad(input), scratch);
+
+    ctorch_recompute_enter();
+    Tensor *recomputed = ctx->forward(ctx->module, detached);
+    ctorch_recompute_exit();
+
+    // the detached input stands in for the node's first output
+    Tensor *wrt[num_outputs], *grads[num_outputs];
+    size_t slots[num_outputs], num_wrt = 0;
+    for (size_t i = 0; i < num_outputs; i++) {
+        output_grads[i] = NULL;
+        Tensor *tensor = (i == 0) ? detached : outputs[i];
+        if (!get_requires_grad(tensor))
+            continue;
+
+        wrt[num_wrt] = tensor;
+        grads[num_wrt] = NULL;
+        slots[num_wrt++] = i;
+    }
+
+    if (num_wrt && get_requires_grad(recomputed))
+        gradient(grads, num_wrt, wrt, 1, (Tensor *[]){recomputed},
+                 (Tensor *[]){grad}, NO_GRAPH);
+
+    Environment *env = get_tensor_environ(output);
+    for (size_t i = 0; i < num_wrt; i++) {
+        if (!grads[i])
+            continue;
+
+        // gradients outside the scratch environment are handed on as is
+        output_grads[slots[i]] = grads[i];
+        if (get_tensor_environ(grads[i]) == scratch) {
+            sparse_grad_densify(grads[i]);
+            output_grads[slots[i]] = tensor_init(
+                copy_array(get_tensor_data(grads[i])), NO_GRAD, env);
+        }
+    }
+
+    free_env(scratch);
+}
+
+static inline void _accumulate_adjoint(Tensor **adjoint, Tensor *grad) {
+    *adjoint = *adjoint ? tensor_add(*adjoint, grad) : grad;
+}
+
+// reruns the program as tensor ops so the gradients are differentiable
+static void _fused_grad_create_graph(const FusedCtx *ctx, Tensor *grad,
+                                     Tensor **tensors, Tensor **adjoints,
+                                     Environment *env) {
+    int root = (int)ctx->num_instrs - 1;
+    Tensor *values[root + 1];
+    fused_replay(ctx->instrs, root, tensors, get_tensor_dtype(grad), env,
+                 values);
+
+    Tensor *adj[root + 1];
+    for (int i = 0; i <= root; i++)
+        adj[i] = NULL;
+    adj[root] = grad;
+
+    for (int i = root; i >= 0; i--) {
+        const FusedInstr *instr = &ctx->instrs[i];
+        Tensor *g = adj[i];
+        if (!g || instr->op == FUSED_SCALAR)
+            continue;
+
+        if (instr->op == FUSED_INPUT) {
+            _accumulate_adjoint(&adjoints[instr->a], g);
+            continue;
+        }
+
+        Tensor *x = values[instr->a];
+        Tensor *y = (instr->op == FUSED_NEG) ? NULL : values[instr->b];
+        Tensor **ga = &adj[instr->a], **gb = y ? &adj[instr->b] : NULL;
+        switch (instr->op) {
+        case FUSED_ADD:
+            _accumulate_adjoint(ga, g);
+            _accumulate_adjoint(gb, g);
+            break;
+        case FUSED_SUB:
+            _accumulate_adjoint(ga, g);
+            _accumulate_adjoint(gb, tensor_neg(g));
+            break;
+        case FUSED_MUL:
+            _accumulate_adjoint(ga, tensor_mul(g, y));
+            _accumulate_adjoint(gb, tensor_mul(g, x));
+            break;
+        case FUSED_DIV:
+            _accumulate_adjoint(ga, tensor_div(g, y));
+            _accumulate_adjoint(gb, _div_rhs_grad_create_graph(g, x, y));
+            break;
+        case FUSED_MAX:
+            _accumulate_adjoint(ga, tensor_mul(g, tensor_ge(x, y)));
+            _accumulate_adjoint(gb, tensor_mul(g, tensor_gt(y, x)));
+            break;
+        case FUSED_MIN:
+            _accumulate_adjoint(ga, tensor_mul(g, tensor_le(x, y)));
+            _accumulate_adjoint(gb, tensor_mul(g, tensor_lt(y, x)));
+            break;
+        case FUSED_NEG:
+            _accumulate_adjoint(ga, tensor_neg(g));
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+void _fused_grad_fn(Tensor **output_grads, Tensor **inputs, Tensor **outputs,
+                    Tensor **input_grads, size_t num_inputs,
+                    size_t num_outputs, bool create_graph) {
+    if (num_inputs != 1)
+        RUNTIME_ERRORF(INVALID_NUM_INPUTS_OUTPUTS,
+                       "Invalid number of inputs (%zu, expected 1) in "
+                       "function `%s`",
+                       num_inputs, __func__);
+
+    Tensor *fused = inputs[0], *grad = input_grads[0];
+    BackwardFn *backward_fn = get_backward_fn(fused);
+    if (get_ctx_kind(backward_fn) != FUSED_CTX) {
+        RUNTIME_ERRORF(INVALID_BACKWARD_PASS, "Invalid context kind for `%s`",
+                       __func__);
+    }
+    FusedCtx *ctx = (FusedCtx *)get_ctx(backward_fn);
+    Environment *env = get_tensor_environ(fused);
+
+    Tensor *adjoints[num_outputs];
+    if (create_graph) {
+        for (size_t k = 0; k < num_outputs; k++)
+            adjoints[k] = NULL;
+        _fused_grad_create_graph(ctx, grad, outputs, adjoints, env);
+
+        for (size_t k = 0; k < num_outputs; k++) {
+            Tensor *tensor = outputs[k];
+            output_grads[k] = NULL;
+            if (get_requires_grad(tensor) && adjoints[k])
+                output_grads[k] =
+                    broadcast_tensor_grad(adjoints[k], get_tensor_ndim(tensor),
+                                          get_tensor_shape(tensor));
+        }
+        return;
+    }
+
+    ndArray *datas[num_outputs], *adjoint_datas[num_outputs];
+    bool requires_grad[num_outputs];
+    for (size_t k = 0; k < num_outputs; k++) {
+        datas[k] = get_tensor_data(outputs[k]);
+        requires_grad[k] = get_requires_grad(outputs[k]);
+    }
+
+    array_fused_grad(ctx->instrs, (int)ctx->num_instrs - 1, datas,
+                     num_outputs, get_tensor_data(grad), requires_grad,
+                     adjoint_datas);
+
+    for (size_t k = 0; k < num_outputs; k++) {
+        output_grads[k] = NULL;
+        if (!adjoint_datas[k])
+            continue;
+
+        Tensor *tensor = outputs[k];
+        ndArray *data_grad =
+            broadcast_grad_data(adjoint_datas[k], get_tensor_ndim(tensor),
+                                get_tensor_shape(tensor));
+        output_grads[k] = tensor_init(data_grad, NO_GRAD, env);
+    }
+}
+
+// 1 where a max/min picked the first operand, inverted by `complement`
+static ndArray *_select_mask(Tensor *tensor, Tensor *grad, bool complement) {
+    BackwardFn *backward_fn = get_backward_fn(tensor);
+    if (get_ctx_kind(backward_fn) != MASK_CTX) {
+        RUNTIME_ERRORF(INVALID_BACKWARD_PASS, "Invalid context kind for `%s`",
+                       __func__);
+    }
+    MaskCtx *ctx = (MaskCtx *)get_ctx(backward_fn);
+
+    return mask_ctx_array(ctx, get_tensor_ndim(grad), get_tensor_shape(grad),
+                          get_tensor_dtype(grad), complement);
+}
+
+// MaxBackward and MinBackward share the mask, ties go to the first operand
 _ONE_IP_TWO_OP_GRAD_FN(
-    _min_grad_fn, BLOCK({
-        Tensor *t1_le_t2 = tensor_le(t1, t2);
-        t1_grad = tensor_mul(grad, t1_le_t2);
+    _select_grad_fn, BLOCK({
+        ndArray *mask = _select_mask(tensor, grad, false);
+        t1_grad = tensor_mul(grad, tensor_init(mask, NO_GRAD, env));
         t1_grad = broadcast_tensor_grad(t1_grad, t1_ndim, t1_shape);
     }),
     BLOCK({
-        Tensor *t2_lt_t1 = tensor_lt(t2, t1);
-        t2_grad = tensor_mul(grad, t2_lt_t1);
+        ndArray *mask = _select_mask(tensor, grad, true);
+        t2_grad = tensor_mul(grad, tensor_init(mask, NO_GRAD, env));
         t2_grad = broadcast_tensor_grad(t2_grad, t2_ndim, t2_shape);
     }),
     BLOCK({
-        ndArray *data1_le_data2 = array_le(data1, data2);
-        ndArray *data1_grad = array_mul(grad_data, data1_le_data2);
+        ndArray *mask = _select_mask(tensor, grad, false);
+        ndArray *data1_grad = array_mul(grad_data, mask);
         data1_grad = broadcast_grad_data(data1_grad, t1_ndim, t1_shape);
 
         t1_grad = tensor_init(data1_grad, NO_GRAD, env);
-        free_array(data1_le_data2);
+        free_array(mask);
     }),
     BLOCK({
-        ndArray *data2_lt_data1 = array_lt(data2, data1);
-        ndArray *data2_grad = array_mul(grad_data, data2_lt_data1);
+        ndArray *mask = _select_mask(tensor, grad, true);
+        ndArray *data2_grad = array_mul(grad_data, mask);
         data2_grad = broadcast_grad_data(data2_grad, t2_ndim, t2_shape);
 
         t2_grad = tensor_init(data2_grad, NO_GRAD, env);
-        free_array(data2_lt_data1);
+        free_array(mask);
     }))
+
+// weight and bias are optional, the node's operands say which it has
+void _norm_grad_fn(Tensor **output_grads, Tensor **inputs, Tensor **outputs,
+                   Tensor **input_grads, size_t num_inputs, size_t num_outputs,
+                   bool create_graph) {
+    if (num_inputs != 1 || num_outputs < 1 || num_outputs > 3) {
+        RUNTIME_ERRORF(INVALID_NUM_INPUTS_OUTPUTS,
+                       "Invalid number of inputs (%zu, expected 1) or "
+                       "outputs (%zu, expected 1 to 3) in function `%s`",
+                       num_inputs, num_outputs, __func__);
+    }
+
+    Tensor *new_tensor = inputs[0], *grad = input_grads[0];
+    Tensor *input = outputs[0];
+
+    BackwardFn *backward_fn = get_backward_fn(new_tensor);
+    if (get_ctx_kind(backward_fn) != NORM_CTX) {
+        RUNTIME_ERRORF(INVALID_BACKWARD_PASS, "Invalid context kind for `%s`",
+                       __func__);
+    }
+    NormCtx *ctx = (NormCtx *)get_ctx(backward_fn);
+
+    if (create_graph)
+        RUNTIME_ERROR(INVALID_BACKWARD_PASS,
+                      "Normalization does not support `create_graph`");
+
+    Tensor *weight = ctx->has_weight ? outputs[1] : NULL,
+           *bias = ctx->has_bias ? outputs[num_outputs - 1] : NULL;
+    for (size_t i = 0; i < num_outputs; i++)
+        output_grads[i] = NULL;
+
+    ndArray *input_grad = NULL, *weight_grad = NULL, *bias_grad = NULL;
+    array_norm_grad(get_tensor_data(grad), get_tensor_data(input),
+                    weight ? get_tensor_data(weight) : NULL, ctx->stats,
+                    &ctx->params,
+                    get_requires_grad(input) ? &input_grad : NULL,
+                    weight && get_requires_grad(weight) ? &weight_grad : NULL,
+                    bias && get_requires_grad(bias) ? &bias_grad : NULL);
+
+    Environment *env = get_tensor_environ(new_tensor);
+    if (input_grad)
+        output_grads[0] = tensor_init(input_grad, NO_GRAD, env);
+    if (weight_grad)
+        output_grads[1] = tensor_init(weight_grad, NO_GRAD, env);
+    if (bias_grad)
+        output_grads[num_outputs - 1] = tensor_init(bias_grad, NO_GRAD, env);
+}
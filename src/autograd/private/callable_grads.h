@@ -16,15 +16,28 @@ Tensor *broadcast_tensor_grad(Tensor *data, int ndim, const size_t *shape);
 
 _DECLARE_GRAD_FN(_accumulate_grad_fn)
 _DECLARE_GRAD_FN(_add_grad_fn)
+_DECLARE_GRAD_FN(_sub_grad_fn)
 _DECLARE_GRAD_FN(_mul_grad_fn)
+_DECLARE_GRAD_FN(_div_grad_fn)
 _DECLARE_GRAD_FN(_neg_grad_fn)
 _DECLARE_GRAD_FN(_inv_grad_fn)
 
 _DECLARE_GRAD_FN(_transpose_grad_fn)
 _DECLARE_GRAD_FN(_matmul_grad_fn)
 _DECLARE_GRAD_FN(_sum_grad_fn)
-
-_DECLARE_GRAD_FN(_max_grad_fn)
-_DECLARE_GRAD_FN(_min_grad_fn)
+_DECLARE_GRAD_FN(_spmm_grad_fn)
+_DECLARE_GRAD_FN(_cast_grad_fn)
+_DECLARE_GRAD_FN(_checkpoint_grad_fn)
+_DECLARE_GRAD_FN(_fused_grad_fn)
+_DECLARE_GRAD_FN(_relu_grad_fn)
+_DECLARE_GRAD_FN(_activation_grad_fn)
+_DECLARE_GRAD_FN(_softmax_grad_fn)
+_DECLARE_GRAD_FN(_nll_loss_grad_fn)
+_DECLARE_GRAD_FN(_pointwise_loss_grad_fn)
+_DECLARE_GRAD_FN(_conv_grad_fn)
+_DECLARE_GRAD_FN(_pool_grad_fn)
+_DECLARE_GRAD_FN(_norm_grad_fn)
+
+_DECLARE_GRAD_FN(_select_grad_fn)
 
 #endif // !CALLABLE_GRADS_H
@@ -72,7 +72,7 @@ static inline BackwardFn *BroadcastBackward(Tensor **inputs, Tensor **outputs,
 Tensor *broadcast_tensor_grad(Tensor *tensor, int ndim, const size_t *shape) {
     ndArray *data =
         broadcast_grad_data(copy_array(get_tensor_data(tensor)), ndim, shape);
-    bool requires_grad = get_requires_grad(tensor);
+    bool requires_grad = is_grad_enabled() && get_requires_grad(tensor);
     Environment *env = get_tensor_environ(tensor);
 
     Tensor *t = tensor_init(data, requires_grad, env);
@@ -82,5 +82,10 @@ Tensor *broadcast_tensor_grad(Tensor *tensor, int ndim, const size_t *shape) {
         set_backward_fn(t, backward_fn);
     }
 
+    ndArray *tangent = get_tensor_tangent(tensor);
+    if (tangent)
+        set_tensor_tangent(t, broadcast_grad_data(copy_array(tangent), ndim,
+                                                  shape));
+
     return t;
 }
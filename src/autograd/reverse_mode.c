@@ -1,10 +1,14 @@
 #include "array.h"
 #include "autograd.h"
 #include "error_codes.h"
+#include "private/callable_grads.h"
+#include "sparse.h"
 #include "tensor.h"
 
+#include <omp.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -16,6 +20,16 @@ static inline ssize_t find_input(const Tensor *t, Tensor **inputs,
     return -1;
 }
 
+// a node shared with a graph that was already run and freed
+static inline void _check_not_released(const BackwardFn *fn) {
+    if (is_backward_fn_released(fn))
+        RUNTIME_ERRORF(INVALID_BACKWARD_PASS,
+                       "Invalid backward pass through `%s`, it was freed by a "
+                       "previous backward pass, use `retain_graph` to "
+                       "backward through it again",
+                       get_backward_name(fn));
+}
+
 static void _gradient_backward(Tensor **inputs, Tensor **grads,
                                size_t num_inputs, Tensor **cur_inputs,
                                Tensor **cur_grads, BackwardFn *backward_fn,
@@ -29,15 +43,20 @@ static void _gradient_backward(Tensor **inputs, Tensor **grads,
     CallableGradFn grad_fn = get_grad_fn(backward_fn);
 
     Tensor *op_grads[num_fn_outputs];
+    unpack_saved_tensors(backward_fn);
     grad_fn(op_grads, cur_inputs, outputs, cur_grads, num_fn_inputs,
             num_fn_outputs, create_graph);
+    repack_saved_tensors(backward_fn);
 
     for (size_t i = 0; i < num_fn_outputs; i++) {
         const Tensor *out = outputs[i];
         Tensor *g = op_grads[i];
+        if (!g)
+            continue;
 
         ssize_t idx = find_input(out, inputs, num_inputs);
         if (idx >= 0) {
+            sparse_grad_densify(g);
             grads[idx] = grads[idx] ? tensor_add(grads[idx], g) : g;
             continue;
         }
@@ -45,6 +64,7 @@ static void _gradient_backward(Tensor **inputs, Tensor **grads,
         BackwardFn *next_fn = next_fns[i];
         if (!next_fn)
             continue;
+        _check_not_released(next_fn);
 
         Tensor **next_inputs = get_backward_fn_ip_tensors(next_fn);
         size_t next_n = get_backward_inputs(next_fn);
@@ -76,6 +96,10 @@ void gradient(Tensor **grads, size_t num_inputs, Tensor **inputs,
                 "Output tensor at index `%zu` does not requires_grad", i);
     }
 
+    // mixed dtypes in the graph can only come from promoted forward ops
+    bool promotion = get_dtype_promotion();
+    set_dtype_promotion(true);
+
     for (size_t i = 0; i < num_outputs; i++) {
         BackwardFn *fn = get_backward_fn(outputs[i]);
         if (!fn)
@@ -84,45 +108,335 @@ void gradient(Tensor **grads, size_t num_inputs, Tensor **inputs,
         _gradient_backward(inputs, grads, num_inputs, (Tensor *[]){outputs[i]},
                            (Tensor *[]){grad_outputs[i]}, fn, create_graph);
     }
+
+    set_dtype_promotion(promotion);
 }
 
-static inline void _backward(Tensor **inputs, Tensor **grads,
-                             BackwardFn *backward_fn) {
-    size_t num_inputs = get_backward_inputs(backward_fn),
-           num_outputs = get_backward_outputs(backward_fn);
+static bool parallel_backward = true;
 
-    Tensor **outputs = get_backward_fn_op_tensors(backward_fn);
-    BackwardFn **next_fns = get_next_functions(backward_fn);
+void set_parallel_backward(bool enabled) { parallel_backward = enabled; }
+bool get_parallel_backward() { return parallel_backward; }
 
-    CallableGradFn grad_fn = get_grad_fn(backward_fn);
-    Tensor *op_grads[num_outputs];
-    grad_fn(op_grads, inputs, outputs, grads, num_inputs, num_outputs, false);
+/*
+ * Nodes reached by a single backward pass, kept in an open addressing table
+ * keyed by their BackwardFn. `grads` sums the gradients flowing into the
+ * node's inputs and `dependencies` counts the edges not yet processed, a node
+ * runs exactly once, after every consumer of its inputs has run.
+ */
+typedef struct GraphNode {
+    BackwardFn *fn;
+    size_t dependencies;
+    Tensor **grads;
+    bool internal; // every reference to `fn` comes from this pass
+} GraphNode;
+
+typedef struct GraphTask {
+    GraphNode *nodes;
+    size_t capacity; // power of two
+    size_t num_nodes;
+
+    // ready nodes when sequential, deferred AccumulateGrad nodes otherwise
+    BackwardFn **stack;
+    size_t stack_size;
+
+    size_t num_branches; // nodes feeding two or more non-leaf nodes
+    bool parallel;
+    bool retain_graph;
+} GraphTask;
+
+static inline size_t _node_slot(const BackwardFn *fn, size_t capacity) {
+    uint64_t key = (uint64_t)(uintptr_t)fn >> 4;
+    return (size_t)(key * 11400714819323198485ULL) & (capacity - 1);
+}
+
+static GraphNode *_find_node(const GraphTask *task, const BackwardFn *fn) {
+    size_t i = _node_slot(fn, task->capacity);
+    while (task->nodes[i].fn && task->nodes[i].fn != fn)
+        i = (i + 1) & (task->capacity - 1);
+
+    return &task->nodes[i];
+}
+
+static GraphNode *_alloc_nodes(size_t capacity) {
+    GraphNode *nodes = calloc(capacity, sizeof(GraphNode));
+    if (!nodes)
+        RUNTIME_ERROR(GRAPH_TASK_INIT_FAILURE,
+                      "Failure to allocate backward graph nodes");
+
+    return nodes;
+}
+
+static void _grow_task(GraphTask *task) {
+    GraphNode *old_nodes = task->nodes;
+    size_t old_capacity = task->capacity;
+
+    task->capacity *= 2;
+    task->nodes = _alloc_nodes(task->capacity);
+    for (size_t i = 0; i < old_capacity; i++)
+        if (old_nodes[i].fn)
+            *_find_node(task, old_nodes[i].fn) = old_nodes[i];
+
+    free(old_nodes);
+    task->stack = realloc(task->stack, task->capacity * sizeof(BackwardFn *));
+    if (!task->stack)
+        RUNTIME_ERROR(GRAPH_TASK_INIT_FAILURE,
+                      "Failure to allocate backward graph stack");
+}
+
+// returns true when `fn` was not part of the task yet
+static bool _insert_node(GraphTask *task, BackwardFn *fn) {
+    if (2 * (task->num_nodes + 1) > task->capacity)
+        _grow_task(task);
+
+    GraphNode *node = _find_node(task, fn);
+    if (node->fn)
+        return false;
+
+    node->fn = fn;
+    node->dependencies = 0;
+    node->grads = calloc(get_backward_inputs(fn), sizeof(Tensor *));
+    if (!node->grads)
+        RUNTIME_ERROR(GRAPH_TASK_INIT_FAILURE,
+                      "Failure to allocate backward graph gradients");
+
+    task->num_nodes++;
+    return true;
+}
+
+static inline bool _is_accumulate_node(const BackwardFn *fn) {
+    return get_grad_fn(fn) == _accumulate_grad_fn;
+}
+
+static inline size_t _num_owners(BackwardFn *fn) {
+    size_t num_owners = 0;
+    Tensor **inputs = get_backward_fn_ip_tensors(fn);
+    for (size_t i = 0; i < get_backward_inputs(fn); i++)
+        num_owners += get_backward_fn(inputs[i]) == fn;
+
+    return num_owners;
+}
+
+static GraphTask *_graph_task_init(BackwardFn *root, bool retain_graph) {
+    GraphTask *task = malloc(sizeof(GraphTask));
+    if (!task)
+        RUNTIME_ERROR(GRAPH_TASK_INIT_FAILURE,
+                      "Failure to allocate backward graph task");
+
+    task->capacity = 16;
+    task->num_nodes = 0;
+    task->nodes = _alloc_nodes(task->capacity);
+    task->stack = malloc(task->capacity * sizeof(BackwardFn *));
+    task->stack_size = 0;
+    task->num_branches = 0;
+    task->retain_graph = retain_graph;
+    if (!task->stack)
+        RUNTIME_ERROR(GRAPH_TASK_INIT_FAILURE,
+                      "Failure to allocate backward graph stack");
+
+    // depth first walk counting the incoming edges of every reachable node
+    _insert_node(task, root);
+    task->stack[task->stack_size++] = root;
+    while (task->stack_size) {
+        BackwardFn *fn = task->stack[--task->stack_size];
+        BackwardFn **next_fns = get_next_functions(fn);
+
+        size_t num_children = 0;
+        for (size_t i = 0; i < get_backward_outputs(fn); i++) {
+            BackwardFn *next_fn = next_fns[i];
+            if (!next_fn)
+                continue;
+            _check_not_released(next_fn);
+
+            if (_insert_node(task, next_fn))
+                task->stack[task->stack_size++] = next_fn;
+            _find_node(task, next_fn)->dependencies++;
+            num_children += !_is_accumulate_node(next_fn);
+        }
+
+        task->num_branches += num_children > 1;
+    }
+
+    // a node referenced from outside keeps its tensors for the other graphs
+    for (size_t i = 0; i < task->capacity; i++) {
+        GraphNode *node = &task->nodes[i];
+        if (node->fn)
+            node->internal = get_backward_refcount(node->fn) ==
+                             _num_owners(node->fn) + node->dependencies;
+    }
+    // a chain gains nothing from tasks and would lose intra-op threads
+    task->parallel = parallel_backward && task->num_branches > 0 &&
+                     omp_get_max_threads() > 1 && !omp_in_parallel();
+
+    return task;
+}
+
+static void _free_graph_task(GraphTask *task) {
+    for (size_t i = 0; i < task->capacity; i++)
+        free(task->nodes[i].grads);
+
+    free(task->nodes);
+    free(task->stack);
+    free(task);
+}
+
+// gradients produced during the pass are temporaries of the scheduler
+static inline void _free_grad(Tensor *grad) {
+    Environment *env = get_tensor_environ(grad);
+    if (!env || !env_remove_and_free(env, grad))
+        free_tensor(grad);
+}
 
-    size_t i = 0;
-    while (i < num_outputs) {
+/*
+ * Lock-free: publish `grad` into an empty slot, otherwise take the slot's
+ * partial sum out, fold it in and retry. Producers decrement the node's
+ * dependencies only after publishing, so the last one sees the full sum.
+ */
+static void _accumulate_node_grad(GraphNode *node, const Tensor *tensor,
+                                  Tensor *grad) {
+    Tensor **inputs = get_backward_fn_ip_tensors(node->fn);
+    size_t slot = 0;
+    while (inputs[slot] != tensor)
+        slot++;
+
+    Tensor **acc = &node->grads[slot];
+    for (;;) {
+        Tensor *expected = NULL;
+        if (__atomic_compare_exchange_n(acc, &expected, grad, false,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+            return;
+
+        Tensor *partial = __atomic_exchange_n(acc, NULL, __ATOMIC_ACQ_REL);
+        if (!partial)
+            continue;
+
+        // deferred sparse gradients only reach AccumulateGrad on their own
+        sparse_grad_densify(partial);
+        sparse_grad_densify(grad);
+        ndArray *sum =
+            array_add(get_tensor_data(partial), get_tensor_data(grad));
+        replace_tensor_data(grad, sum);
+        _free_grad(partial);
+    }
+}
+
+/*
+ * Detaches a processed node from the tensors it produced and releases it
+ * along with its context. Every consumer of those tensors has run by now, so
+ * the temporaries among them (see `tensor_release`) are freed too unless
+ * another graph still points at the node. Other graphs keep a stub that goes
+ * with their last reference. AccumulateGrad nodes belong to leaves and are
+ * reused by every step, so they are kept.
+ */
+static void _release_node(GraphNode *node) {
+    BackwardFn *fn = node->fn;
+    if (_is_accumulate_node(fn))
+        return;
+
+    size_t num_inputs = get_backward_inputs(fn), num_owners = 0;
+    Tensor **inputs = get_backward_fn_ip_tensors(fn);
+    Tensor *owned[num_inputs + 1];
+    for (size_t i = 0; i < num_inputs; i++) {
+        if (get_backward_fn(inputs[i]) == fn) {
+            set_backward_fn(inputs[i], NULL);
+            owned[num_owners++] = inputs[i];
+        }
+    }
+
+    release_backward_fn(fn);
+    for (size_t i = 0; i < num_owners; i++)
+        free_backward_fn(fn);
+
+    if (!node->internal)
+        return;
+
+    for (size_t i = 0; i < num_owners; i++)
+        if (is_tensor_released(owned[i]))
+            env_remove_and_free(get_tensor_environ(owned[i]), owned[i]);
+}
+
+static void _run_node(GraphTask *task, BackwardFn *fn, bool owns_grads);
+
+static void _schedule_node(GraphTask *task, BackwardFn *fn) {
+    if (!task->parallel) {
+        task->stack[task->stack_size++] = fn;
+        return;
+    }
+
+    // leaf gradients may allocate in locked module environments, those
+    // accumulations run on the calling thread once the tasks are done
+    if (_is_accumulate_node(fn)) {
+        size_t idx = __atomic_fetch_add(&task->stack_size, 1, __ATOMIC_RELAXED);
+        task->stack[idx] = fn;
+        return;
+    }
+
+    _Pragma("omp task firstprivate(task, fn)") _run_node(task, fn, true);
+}
+
+static void _run_node(GraphTask *task, BackwardFn *fn, bool owns_grads) {
+    GraphNode *node = _find_node(task, fn);
+    size_t num_inputs = get_backward_inputs(fn),
+           num_outputs = get_backward_outputs(fn);
+
+    Tensor **inputs = get_backward_fn_ip_tensors(fn);
+    Tensor **outputs = get_backward_fn_op_tensors(fn);
+    BackwardFn **next_fns = get_next_functions(fn);
+
+    bool has_grads = true;
+    for (size_t i = 0; i < num_inputs; i++)
+        has_grads = has_grads && node->grads[i];
+
+    Tensor *op_grads[num_outputs + 1];
+    for (size_t i = 0; i < num_outputs; i++)
+        op_grads[i] = NULL;
+
+    if (has_grads) {
+        CallableGradFn grad_fn = get_grad_fn(fn);
+        unpack_saved_tensors(fn);
+        grad_fn(op_grads, inputs, outputs, node->grads, num_inputs,
+                num_outputs, false);
+        repack_saved_tensors(fn);
+    }
+
+    if (owns_grads)
+        for (size_t i = 0; i < num_inputs; i++)
+            if (node->grads[i])
+                _free_grad(node->grads[i]);
+
+    for (size_t i = 0; i < num_outputs; i++) {
         BackwardFn *next_fn = next_fns[i];
         if (!next_fn) {
-            i++;
+            if (op_grads[i])
+                _free_grad(op_grads[i]);
             continue;
         }
 
-        Tensor **next_fn_inputs = get_backward_fn_ip_tensors(next_fn);
-        size_t next_fn_num_ips = get_backward_inputs(next_fn);
+        GraphNode *next = _find_node(task, next_fn);
+        if (op_grads[i])
+            _accumulate_node_grad(next, outputs[i], op_grads[i]);
 
-        Tensor *next_fn_ip_grads[next_fn_num_ips];
-        for (size_t j = 0; j < next_fn_num_ips; j++)
-            next_fn_ip_grads[j] = op_grads[i++];
-
-        _backward(next_fn_inputs, next_fn_ip_grads, next_fn);
+        if (__atomic_sub_fetch(&next->dependencies, 1, __ATOMIC_ACQ_REL) == 0)
+            _schedule_node(task, next_fn);
     }
+
+    if (!task->retain_graph)
+        _release_node(node);
 }
 
-void backward(Tensor *tensor, Tensor *grad) {
+void run_backward(Tensor *tensor, Tensor *grad, bool retain_graph) {
     bool requires_grad = get_requires_grad(tensor);
     if (!requires_grad)
         RUNTIME_ERROR(INVALID_BACKWARD_PASS,
                       "Invalid backward pass on non-requires_grad tensor");
 
+    BackwardFn *backward_fn = get_backward_fn(tensor);
+    if (!backward_fn)
+        RUNTIME_ERROR(INVALID_BACKWARD_PASS,
+                      "Invalid backward pass on tensor without a graph, it "
+                      "may have been freed by a previous backward pass, use "
+                      "`retain_graph` to backward through it again");
+
+    Tensor *root_grad = grad;
     if (!grad) {
         size_t ndim = get_tensor_ndim(tensor);
         size_t *shape = get_tensor_shape(tensor);
@@ -132,13 +446,42 @@ void backward(Tensor *tensor, Tensor *grad) {
             RUNTIME_ERROR(GRAD_INIT_FAILURE,
                           "Invalid backward gradient for non-zero dim tensor");
 
-        grad = ones_tensor(ndim, shape, dtype, false, NULL);
+        root_grad = ones_tensor(ndim, shape, dtype, false, NULL);
     }
 
-    BackwardFn *backward_fn = get_backward_fn(tensor);
-    _backward((Tensor *[]){tensor}, (Tensor *[]){grad}, backward_fn);
+    bool promotion = get_dtype_promotion();
+    set_dtype_promotion(true);
 
-    const Environment *env = get_tensor_environ(grad);
-    if (!env)
-        free_tensor(grad);
+    GraphTask *task = _graph_task_init(backward_fn, retain_graph);
+    _accumulate_node_grad(_find_node(task, backward_fn), tensor, root_grad);
+
+    // the caller's gradient is never freed, everything else is a temporary
+    if (task->parallel) {
+        // promotion is thread-local, any thread of the team may run a node
+        _Pragma("omp parallel") {
+            bool thread_promotion = get_dtype_promotion();
+            set_dtype_promotion(true);
+            _Pragma("omp single") _run_node(task, backward_fn, false);
+            set_dtype_promotion(thread_promotion);
+        }
+
+        for (size_t i = 0; i < task->stack_size; i++)
+            _run_node(task, task->stack[i], true);
+    } else {
+        _run_node(task, backward_fn, false);
+        while (task->stack_size) {
+            BackwardFn *fn = task->stack[--task->stack_size];
+            _run_node(task, fn, true);
+        }
+    }
+
+    _free_graph_task(task);
+    set_dtype_promotion(promotion);
+
+    if (!grad)
+        free_tensor(root_grad);
+}
+
+void backward(Tensor *tensor, Tensor *grad) {
+    run_backward(tensor, grad, FREE_GRAPH);
 }
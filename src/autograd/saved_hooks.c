@@ -0,0 +1,295 @@
+#include "array.h"
+#include "autograd.h"
+#include "error_codes.h"
+#include "tensor.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#define MAX_HOOKS_DEPTH 16
+
+static _Thread_local const SavedTensorHooks *hooks_stack[MAX_HOOKS_DEPTH];
+static _Thread_local int hooks_depth = 0;
+
+int saved_tensor_hooks_enter(const SavedTensorHooks *hooks) {
+    if (hooks_depth == MAX_HOOKS_DEPTH)
+        RUNTIME_ERRORF(SAVED_TENSOR_HOOK_FAILURE,
+                       "Saved-tensor hooks nest at most %d deep",
+                       MAX_HOOKS_DEPTH);
+
+    hooks_stack[hooks_depth] = hooks;
+    return ++hooks_depth;
+}
+
+void saved_tensor_hooks_exit() {
+    if (hooks_depth == 0)
+        RUNTIME_ERROR(SAVED_TENSOR_HOOK_FAILURE,
+                      "saved_tensor_hooks_exit called outside of a hooks "
+                      "region");
+
+    hooks_depth--;
+}
+
+const SavedTensorHooks *get_saved_tensor_hooks() {
+    return hooks_depth ? hooks_stack[hooks_depth - 1] : NULL;
+}
+
+static void *_bf16_pack(void *ctx, const ndArray *data) {
+    DType dtype = get_dtype(data);
+    bool floating = dtype == DTYPE_FLOAT || dtype == DTYPE_DOUBLE;
+
+    return array_cast(data, floating ? DTYPE_BF16 : dtype);
+}
+
+// array_cast keeps the strides, the packed copy shares the saved layout
+static ndArray *_bf16_unpack(void *ctx, void *packed, const ndArray *like) {
+    return array_cast(packed, get_dtype(like));
+}
+
+static void _bf16_free(void *ctx, void *packed) { free_array(packed); }
+
+SavedTensorHooks bf16_saved_hooks() {
+    return (SavedTensorHooks){.pack = _bf16_pack,
+                              .unpack = _bf16_unpack,
+                              .free_packed = _bf16_free,
+                              .ctx = NULL};
+}
+
+/*
+ * All tensors packed with one set of disk hooks share a single scratch
+ * file: each is written at an offset and freed extents are reused first
+ * fit. Free extents are kept sorted by offset and merged with their
+ * neighbours, one reaching the end of the file shrinks it instead. The
+ * context goes away once it is closed and nothing packed with it is alive.
+ */
+typedef struct DiskExtent {
+    off_t offset;
+    size_t size;
+} DiskExtent;
+
+typedef struct DiskSpill {
+    FILE *file;
+    off_t end;
+    size_t num_live;
+    DiskExtent *free_extents;
+    size_t num_free, capacity;
+    bool closed;
+} DiskSpill;
+
+static void _disk_destroy(DiskSpill *spill) {
+    if (spill->file)
+        fclose(spill->file);
+    free(spill->free_extents);
+    free(spill);
+}
+
+static inline off_t _extent_end(const DiskExtent *extent) {
+    return extent->offset + (off_t)extent->size;
+}
+
+static void _remove_extent(DiskSpill *spill, size_t i) {
+    memmove(&spill->free_extents[i], &spill->free_extents[i + 1],
+            (spill->num_free - i - 1) * sizeof(DiskExtent));
+    spill->num_free--;
+}
+
+static off_t _disk_reserve(DiskSpill *spill, size_t size) {
+    for (size_t i = 0; i < spill->num_free; i++) {
+        DiskExtent *extent = &spill->free_extents[i];
+        if (extent->size < size)
+            continue;
+
+        off_t offset = extent->offset;
+        extent->offset += (off_t)size;
+        extent->size -= size;
+        if (extent->size == 0)
+            _remove_extent(spill, i);
+        return offset;
+    }
+
+    off_t offset = spill->end;
+    spill->end += (off_t)size;
+    return offset;
+}
+
+static void _disk_release(DiskSpill *spill, DiskExtent extent) {
+    if (--spill->num_live == 0) {
+        // nothing left in the file, start over from the beginning
+        spill->num_free = 0;
+        spill->end = 0;
+        return;
+    }
+
+    size_t i = 0;
+    while (i < spill->num_free && spill->free_extents[i].offset < extent.offset)
+        i++;
+
+    DiskExtent *prev = i > 0 ? &spill->free_extents[i - 1] : NULL;
+    DiskExtent *next = i < spill->num_free ? &spill->free_extents[i] : NULL;
+    if (prev && _extent_end(prev) == extent.offset) {
+        prev->size += extent.size;
+        if (next && _extent_end(prev) == next->offset) {
+            prev->size += next->size;
+            _remove_extent(spill, i);
+        }
+    } else if (next && _extent_end(&extent) == next->offset) {
+        next->offset = extent.offset;
+        next->size += extent.size;
+    } else {
+        if (spill->num_free == spill->capacity) {
+            spill->capacity = spill->capacity ? 2 * spill->capacity : 16;
+            spill->free_extents = realloc(
+                spill->free_extents, spill->capacity * sizeof(DiskExtent));
+            if (!spill->free_extents)
+                RUNTIME_ERROR(SAVED_TENSOR_HOOK_FAILURE,
+                              "Failure to track free spill file extents");
+        }
+
+        memmove(&spill->free_extents[i + 1], &spill->free_extents[i],
+                (spill->num_free - i) * sizeof(DiskExtent));
+        spill->free_extents[i] = extent;
+        spill->num_free++;
+    }
+
+    DiskExtent *last = &spill->free_extents[spill->num_free - 1];
+    if (_extent_end(last) == spill->end) {
+        spill->end = last->offset;
+        spill->num_free--;
+    }
+}
+
+static void *_disk_pack(void *ctx, const ndArray *data) {
+    DiskSpill *spill = ctx;
+    DiskExtent *packed = malloc(sizeof(DiskExtent));
+    if (!packed)
+        RUNTIME_ERROR(SAVED_TENSOR_HOOK_FAILURE,
+                      "Failure to allocate a spilled tensor record");
+
+    size_t total_size = get_total_size(data);
+    packed->size = total_size * get_itemsize(data);
+
+    bool failed = false;
+    _Pragma("omp critical(ctorch_disk_spill)") {
+        if (!spill->file)
+            spill->file = tmpfile();
+
+        if (!spill->file) {
+            failed = true;
+        } else {
+            packed->offset = _disk_reserve(spill, packed->size);
+            failed = fseeko(spill->file, packed->offset, SEEK_SET) != 0 ||
+                     fwrite(get_array_data(data), get_itemsize(data),
+                            total_size, spill->file) != total_size;
+            spill->num_live++;
+        }
+    }
+
+    if (failed)
+        RUNTIME_ERROR(SAVED_TENSOR_HOOK_FAILURE,
+                      "Failure to spill a saved tensor to disk");
+
+    return packed;
+}
+
+static ndArray *_disk_unpack(void *ctx, void *packed, const ndArray *like) {
+    DiskSpill *spill = ctx;
+    const DiskExtent *extent = packed;
+    ndArray *data = array_init(get_ndim(like), get_shape(like),
+                               get_dtype(like));
+    set_strides(data, get_strides(like));
+
+    size_t total_size = get_total_size(data);
+    bool failed;
+    _Pragma("omp critical(ctorch_disk_spill)") {
+        failed = fseeko(spill->file, extent->offset, SEEK_SET) != 0 ||
+                 fread(get_array_data(data), get_itemsize(data), total_size,
+                       spill->file) != total_size;
+    }
+
+    if (failed)
+        RUNTIME_ERROR(SAVED_TENSOR_HOOK_FAILURE,
+                      "Failure to read a saved tensor back from disk");
+
+    return data;
+}
+
+static void _disk_free(void *ctx, void *packed) {
+    DiskSpill *spill = ctx;
+    bool destroy;
+    _Pragma("omp critical(ctorch_disk_spill)") {
+        _disk_release(spill, *(DiskExtent *)packed);
+        destroy = spill->closed && spill->num_live == 0;
+    }
+
+    free(packed);
+    if (destroy)
+        _disk_destroy(spill);
+}
+
+SavedTensorHooks disk_saved_hooks() {
+    DiskSpill *spill = calloc(1, sizeof(DiskSpill));
+    if (!spill)
+        RUNTIME_ERROR(SAVED_TENSOR_HOOK_FAILURE,
+                      "Failure to allocate a spill file context");
+
+    return (SavedTensorHooks){.pack = _disk_pack,
+                              .unpack = _disk_unpack,
+                              .free_packed = _disk_free,
+                              .ctx = spill};
+}
+
+void free_disk_saved_hooks(SavedTensorHooks *hooks) {
+    DiskSpill *spill = hooks->ctx;
+    if (!spill)
+        return;
+
+    bool destroy;
+    _Pragma("omp critical(ctorch_disk_spill)") {
+        spill->closed = true;
+        destroy = spill->num_live == 0;
+    }
+
+    if (destroy)
+        _disk_destroy(spill);
+    hooks->ctx = NULL;
+}
+
+static void _saved_tensors(const BackwardFn *backward_fn, Tensor ***tensors,
+                           size_t *num_tensors) {
+    switch (get_saved(backward_fn)) {
+    case SAVE_INPUTS:
+        *tensors = get_backward_fn_op_tensors(backward_fn);
+        *num_tensors = get_backward_outputs(backward_fn);
+        break;
+    case SAVE_OUTPUT:
+        *tensors = get_backward_fn_ip_tensors(backward_fn);
+        *num_tensors = get_backward_inputs(backward_fn);
+        break;
+    default:
+        *tensors = NULL;
+        *num_tensors = 0;
+        break;
+    }
+}
+
+void unpack_saved_tensors(const BackwardFn *backward_fn) {
+    Tensor **tensors;
+    size_t num_tensors;
+    _saved_tensors(backward_fn, &tensors, &num_tensors);
+
+    for (size_t i = 0; i < num_tensors; i++)
+        tensor_unpack(tensors[i]);
+}
+
+void repack_saved_tensors(const BackwardFn *backward_fn) {
+    Tensor **tensors;
+    size_t num_tensors;
+    _saved_tensors(backward_fn, &tensors, &num_tensors);
+
+    for (size_t i = 0; i < num_tensors; i++)
+        tensor_repack(tensors[i]);
+}
@@ -0,0 +1,282 @@
+#include "capture.h"
+#include "private/captured_graph.h"
+#include "array.h"
+#include "autograd.h"
+#include "error_codes.h"
+#include "tensor.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static _Thread_local CapturedGraph *active_capture = NULL;
+
+void capture_begin() {
+    if (active_capture)
+        RUNTIME_ERROR(INVALID_CAPTURE_STATE,
+                      "capture_begin called inside an active capture");
+
+    CapturedGraph *graph = malloc(sizeof(CapturedGraph));
+    if (!graph)
+        RUNTIME_ERROR(INVALID_CAPTURE_STATE,
+                      "Failure to allocate captured graph");
+
+    graph->capacity = 16;
+    graph->num_nodes = 0;
+    graph->nodes = malloc(graph->capacity * sizeof(CapturedNode));
+    graph->output = NULL;
+    if (!graph->nodes)
+        RUNTIME_ERROR(INVALID_CAPTURE_STATE,
+                      "Failure to allocate captured graph nodes");
+
+    active_capture = graph;
+}
+
+CapturedGraph *capture_end(Tensor *output) {
+    if (!active_capture)
+        RUNTIME_ERROR(INVALID_CAPTURE_STATE,
+                      "capture_end called outside of a capture");
+
+    CapturedGraph *graph = active_capture;
+    active_capture = NULL;
+
+    graph->output = output;
+    capture_backward(graph);
+    return graph;
+}
+
+bool is_capturing() { return active_capture != NULL; }
+
+void capture_unsupported(const char *op) {
+    if (is_capturing())
+        RUNTIME_ERRORF(INVALID_CAPTURE_STATE, "%s cannot be captured", op);
+}
+
+static ndArray *_scalar_array(float value, DType dtype) {
+    ndArray *array = array_init(0, (const size_t[]){}, dtype);
+
+    ArrayVal val;
+    switch (dtype) {
+    case DTYPE_INT:
+        val.int_val = (int)value;
+        break;
+    case DTYPE_LONG:
+        val.long_val = (long int)value;
+        break;
+    case DTYPE_DOUBLE:
+        val.double_val = (double)value;
+        break;
+    default:
+        val.float_val = value;
+        break;
+    }
+
+    set_value(array, NULL, val);
+    return array;
+}
+
+static void _record(CapturedGraph *graph, CapturedNode node) {
+    // inference mode frees temporaries the tape would still point to
+    if (is_inference_mode())
+        RUNTIME_ERROR(INVALID_CAPTURE_STATE,
+                      "Cannot capture ops run in inference mode");
+
+    if (graph->num_nodes == graph->capacity) {
+        size_t new_capacity = 2 * graph->capacity;
+        CapturedNode *new_nodes =
+            realloc(graph->nodes, new_capacity * sizeof(CapturedNode));
+        if (!new_nodes)
+            RUNTIME_ERROR(INVALID_CAPTURE_STATE,
+                          "Failure to grow captured graph nodes");
+
+        graph->nodes = new_nodes;
+        graph->capacity = new_capacity;
+    }
+
+    graph->nodes[graph->num_nodes++] = node;
+}
+
+void capture_record(CaptureOp op, Tensor *t1, Tensor *t2, Tensor *out) {
+    CapturedGraph *graph = active_capture;
+    if (!graph)
+        return;
+
+    ndArray *constant = NULL;
+    if (op == CAPTURE_NEG || op == CAPTURE_INV)
+        constant = _scalar_array(op == CAPTURE_NEG ? 0.0f : 1.0f,
+                                 get_tensor_dtype(t1));
+
+    _record(graph, (CapturedNode){.op = op,
+                                  .t1 = t1,
+                                  .t2 = t2,
+                                  .out = out,
+                                  .constant = constant});
+}
+
+void capture_record_params(CaptureOp op, Tensor *t1, Tensor *t2, Tensor *out,
+                           double param1, double param2) {
+    CapturedGraph *graph = active_capture;
+    if (!graph)
+        return;
+
+    _record(graph, (CapturedNode){.op = op,
+                                  .t1 = t1,
+                                  .t2 = t2,
+                                  .out = out,
+                                  .params = {param1, param2}});
+}
+
+// max/min nodes save which operand won, not the operands themselves
+static void _refresh_mask(const CapturedNode *node, bool max) {
+    BackwardFn *backward_fn = get_backward_fn(node->out);
+    if (backward_fn && get_saved(backward_fn) == SAVE_MASK)
+        set_select_mask(backward_fn, get_tensor_data(node->t1),
+                        get_tensor_data(node->t2), max);
+}
+
+// cross-entropy's backward reads the row logsumexps of the new logits
+static void _replay_loss(const CapturedNode *node, ndArray *input,
+                         ndArray *target, ndArray *out) {
+    LossKind kind = (LossKind)node->params[0];
+    Reduction reduction = (Reduction)node->params[1];
+    if (kind == LOSS_MSE || kind == LOSS_BCE_WITH_LOGITS) {
+        array_pointwise_loss_out(input, target, kind, reduction, out);
+        return;
+    }
+
+    if (kind == LOSS_NLL) {
+        array_nll_loss_out(input, target, reduction, out);
+        return;
+    }
+
+    BackwardFn *backward_fn = get_backward_fn(node->out);
+    ndArray *lse = NULL, *tmp = NULL;
+    if (backward_fn && get_ctx_kind(backward_fn) == LOSS_CTX)
+        lse = ((LossCtx *)get_ctx(backward_fn))->lse;
+    if (!lse)
+        lse = tmp = array_init(1, (const size_t[]){get_shape(input)[0]},
+                               DTYPE_DOUBLE);
+
+    array_cross_entropy_out(input, target, reduction, lse, out);
+    if (tmp)
+        free_array(tmp);
+}
+
+static void _replay_node(const CapturedNode *node) {
+    ndArray *data1 = get_tensor_data(node->t1);
+    ndArray *data2 = node->t2 ? get_tensor_data(node->t2) : NULL;
+    ndArray *out = get_tensor_data(node->out);
+
+    switch (node->op) {
+    case CAPTURE_ADD:
+        array_add_out(data1, data2, out);
+        break;
+    case CAPTURE_SUB:
+        array_sub_out(data1, data2, out);
+        break;
+    case CAPTURE_MUL:
+        array_mul_out(data1, data2, out);
+        break;
+    case CAPTURE_DIV:
+        array_div_out(data1, data2, out);
+        break;
+    case CAPTURE_MAX:
+        array_max_out(data1, data2, out);
+        _refresh_mask(node, true);
+        break;
+    case CAPTURE_MIN:
+        array_min_out(data1, data2, out);
+        _refresh_mask(node, false);
+        break;
+    case CAPTURE_GT:
+        array_gt_out(data1, data2, out);
+        break;
+    case CAPTURE_GE:
+        array_ge_out(data1, data2, out);
+        break;
+    case CAPTURE_LT:
+        array_lt_out(data1, data2, out);
+        break;
+    case CAPTURE_LE:
+        array_le_out(data1, data2, out);
+        break;
+    case CAPTURE_EQ:
+        array_eq_out(data1, data2, out);
+        break;
+    case CAPTURE_NEG:
+        array_sub_out(node->constant, data1, out);
+        break;
+    case CAPTURE_INV:
+        array_div_out(node->constant, data1, out);
+        break;
+    case CAPTURE_TRANSPOSE:
+        // transposition copies the dense buffer and permutes strides only
+        if (get_total_size(data1) != get_total_size(out))
+            RUNTIME_ERROR(SHAPE_MISMATCH,
+                          "Replayed transpose input changed size");
+        memcpy(get_array_data(out), get_array_data(data1),
+               get_total_size(out) * get_itemsize(out));
+        break;
+    case CAPTURE_MATMUL:
+        matmul_out(data1, data2, out);
+        break;
+    case CAPTURE_SUM:
+        array_sum_out(data1, out);
+        break;
+    case CAPTURE_CAST:
+        array_cast_out(data1, out);
+        break;
+    case CAPTURE_RELU:
+        array_relu_out(data1, out, node->params[0], node->params[1]);
+        break;
+    case CAPTURE_ACTIVATION:
+        array_activation_out(data1, out, (ActivationKind)node->params[0]);
+        break;
+    case CAPTURE_SOFTMAX:
+        array_softmax_out(data1, out, (int)node->params[0],
+                          node->params[1] != 0);
+        break;
+    case CAPTURE_LOSS:
+        _replay_loss(node, data1, data2, out);
+        break;
+    }
+}
+
+void graph_replay(CapturedGraph *graph) {
+    if (graph == active_capture)
+        RUNTIME_ERROR(INVALID_CAPTURE_STATE,
+                      "Cannot replay a graph that is still being captured");
+
+    // promoted ops were recorded with promotion enabled
+    bool promotion = get_dtype_promotion();
+    set_dtype_promotion(true);
+
+    for (size_t i = 0; i < graph->num_nodes; i++)
+        _replay_node(&graph->nodes[i]);
+
+    set_dtype_promotion(promotion);
+    replay_backward(graph);
+}
+
+void free_captured_graph(CapturedGraph *graph) {
+    if (!graph)
+        return;
+
+    for (size_t i = 0; i < graph->num_nodes; i++)
+        if (graph->nodes[i].constant)
+            free_array(graph->nodes[i].constant);
+
+    free_captured_backward(graph);
+    free(graph->nodes);
+    free(graph);
+}
+
+size_t get_num_captured_ops(const CapturedGraph *graph) {
+    return graph->num_nodes;
+}
+
+Tensor *get_captured_output(const CapturedGraph *graph) {
+    return graph->output;
+}
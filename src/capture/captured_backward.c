@@ -0,0 +1,294 @@
+#include "private/captured_graph.h"
+#include "array.h"
+#include "autograd.h"
+#include "error_codes.h"
+#include "sparse.h"
+#include "tensor.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/types.h>
+
+ssize_t find_backward_step(const CapturedGraph *graph, const BackwardFn *fn) {
+    for (size_t i = 0; i < graph->num_steps; i++)
+        if (graph->steps[i].fn == fn)
+            return (ssize_t)i;
+
+    return -1;
+}
+
+static size_t _input_slot(const BackwardStep *step, const Tensor *tensor) {
+    Tensor **inputs = get_backward_fn_ip_tensors(step->fn);
+    size_t slot = 0;
+    while (inputs[slot] != tensor)
+        slot++;
+
+    return step->first_slot + slot;
+}
+
+// every node reachable from `root`, each with its number of incoming edges
+static void _collect_steps(CapturedGraph *graph, BackwardFn *root,
+                           size_t **dependencies) {
+    size_t capacity = 16;
+    graph->steps = malloc(capacity * sizeof(BackwardStep));
+    *dependencies = calloc(capacity, sizeof(size_t));
+    BackwardFn **stack = malloc(capacity * sizeof(BackwardFn *));
+    if (!graph->steps || !*dependencies || !stack)
+        RUNTIME_ERROR(INVALID_CAPTURE_STATE,
+                      "Failure to allocate captured backward steps");
+
+    graph->steps[0] = (BackwardStep){.fn = root};
+    graph->num_steps = 1;
+    size_t stack_size = 0;
+    stack[stack_size++] = root;
+
+    while (stack_size) {
+        BackwardFn *fn = stack[--stack_size];
+        BackwardFn **next_fns = get_next_functions(fn);
+
+        for (size_t i = 0; i < get_backward_outputs(fn); i++) {
+            BackwardFn *next_fn = next_fns[i];
+            if (!next_fn)
+                continue;
+            if (is_backward_fn_released(next_fn))
+                RUNTIME_ERRORF(INVALID_CAPTURE_STATE,
+                               "Cannot capture the backward through `%s`, it "
+                               "was freed by a previous backward pass",
+                               get_backward_name(next_fn));
+
+            ssize_t idx = find_backward_step(graph, next_fn);
+            if (idx < 0) {
+                if (graph->num_steps == capacity) {
+                    capacity *= 2;
+                    graph->steps =
+                        realloc(graph->steps, capacity * sizeof(BackwardStep));
+                    *dependencies =
+                        realloc(*dependencies, capacity * sizeof(size_t));
+                    stack = realloc(stack, capacity * sizeof(BackwardFn *));
+                    if (!graph->steps || !*dependencies || !stack)
+                        RUNTIME_ERROR(
+                            INVALID_CAPTURE_STATE,
+                            "Failure to grow captured backward steps");
+                }
+
+                idx = (ssize_t)graph->num_steps++;
+                graph->steps[idx] = (BackwardStep){.fn = next_fn};
+                (*dependencies)[idx] = 0;
+                stack[stack_size++] = next_fn;
+            }
+
+            (*dependencies)[idx]++;
+        }
+    }
+
+    free(stack);
+}
+
+// Kahn's algorithm, a node comes after every consumer of its inputs
+static void _order_steps(CapturedGraph *graph, size_t *dependencies) {
+    size_t n = graph->num_steps;
+    BackwardStep *ordered = malloc(n * sizeof(BackwardStep));
+    if (!ordered)
+        RUNTIME_ERROR(INVALID_CAPTURE_STATE,
+                      "Failure to allocate captured backward order");
+
+    size_t num_ordered = 0;
+    ordered[num_ordered++] = graph->steps[0];
+    for (size_t i = 0; i < num_ordered; i++) {
+        BackwardFn *fn = ordered[i].fn;
+        BackwardFn **next_fns = get_next_functions(fn);
+
+        for (size_t j = 0; j < get_backward_outputs(fn); j++) {
+            if (!next_fns[j])
+                continue;
+
+            ssize_t idx = find_backward_step(graph, next_fns[j]);
+            if (--dependencies[idx] == 0)
+                ordered[num_ordered++] = graph->steps[idx];
+        }
+    }
+
+    free(graph->steps);
+    graph->steps = ordered;
+}
+
+/*
+ * Walks the graph behind the captured output once and stores it as a tape:
+ * the nodes in a fixed topological order, the gradient slot of each node
+ * input and the slot each node output feeds. Replay then runs the tape
+ * without building a graph task, hashing nodes or counting dependencies,
+ * and seeds it with a gradient allocated here.
+ */
+void capture_backward(CapturedGraph *graph) {
+    graph->steps = NULL;
+    graph->num_steps = 0;
+    graph->slots = NULL;
+    graph->num_slots = 0;
+    graph->root_grad = NULL;
+    graph->planned_slots = NULL;
+
+    Tensor *output = graph->output;
+    if (!output || !get_requires_grad(output) || !get_backward_fn(output))
+        return;
+
+    if (get_tensor_ndim(output) != 0)
+        RUNTIME_ERROR(GRAD_INIT_FAILURE,
+                      "Invalid backward gradient for non-zero dim tensor");
+
+    size_t *dependencies;
+    _collect_steps(graph, get_backward_fn(output), &dependencies);
+    _order_steps(graph, dependencies);
+    free(dependencies);
+
+    for (size_t i = 0; i < graph->num_steps; i++) {
+        graph->steps[i].first_slot = graph->num_slots;
+        graph->num_slots += get_backward_inputs(graph->steps[i].fn);
+    }
+
+    graph->slots = calloc(graph->num_slots, sizeof(Tensor *));
+    if (graph->num_slots && !graph->slots)
+        RUNTIME_ERROR(INVALID_CAPTURE_STATE,
+                      "Failure to allocate captured backward slots");
+
+    for (size_t i = 0; i < graph->num_steps; i++) {
+        BackwardStep *step = &graph->steps[i];
+        size_t num_outputs = get_backward_outputs(step->fn);
+        Tensor **outputs = get_backward_fn_op_tensors(step->fn);
+        BackwardFn **next_fns = get_next_functions(step->fn);
+
+        step->targets = malloc((num_outputs + 1) * sizeof(ssize_t));
+        if (!step->targets)
+            RUNTIME_ERROR(INVALID_CAPTURE_STATE,
+                          "Failure to allocate captured backward targets");
+
+        for (size_t j = 0; j < num_outputs; j++) {
+            step->targets[j] = -1;
+            if (next_fns[j]) {
+                ssize_t idx = find_backward_step(graph, next_fns[j]);
+                step->targets[j] =
+                    (ssize_t)_input_slot(&graph->steps[idx], outputs[j]);
+            }
+        }
+    }
+
+    graph->root_slot = _input_slot(&graph->steps[0], output);
+    graph->root_grad = ones_tensor(0, get_tensor_shape(output),
+                                   get_tensor_dtype(output), false, NULL);
+}
+
+static inline void _free_grad(Tensor *grad) {
+    Environment *env = get_tensor_environ(grad);
+    if (!env || !env_remove_and_free(env, grad))
+        free_tensor(grad);
+}
+
+/*
+ * A slot fed by several outputs sums them in the first one's buffer. With a
+ * memory plan applied, the first gradient is copied into the slot's place
+ * in the slab instead, so it is freed as soon as its node returns.
+ */
+static void _fold_grad(Tensor **slot, Tensor *planned, Tensor *grad) {
+    if (!*slot && planned && !get_sparse_grad_factor(grad) &&
+        get_tensor_dtype(planned) == get_tensor_dtype(grad) &&
+        same_layout(get_tensor_data(planned), get_tensor_data(grad))) {
+        array_cast_out(get_tensor_data(grad), get_tensor_data(planned));
+        _free_grad(grad);
+        *slot = planned;
+        return;
+    }
+
+    if (!*slot) {
+        *slot = grad;
+        return;
+    }
+
+    sparse_grad_densify(*slot);
+    sparse_grad_densify(grad);
+    ndArray *acc = get_tensor_data(*slot), *data = get_tensor_data(grad);
+    if (get_dtype(acc) == get_dtype(data) && same_layout(acc, data))
+        array_add_out(acc, data, acc);
+    else
+        replace_tensor_data(*slot, array_add(acc, data));
+
+    _free_grad(grad);
+}
+
+static inline bool _is_planned(const CapturedGraph *graph, size_t slot,
+                               const Tensor *grad) {
+    return graph->planned_slots && graph->planned_slots[slot] == grad;
+}
+
+void replay_backward(CapturedGraph *graph) {
+    if (!graph->num_steps)
+        return;
+
+    bool promotion = get_dtype_promotion();
+    set_dtype_promotion(true);
+
+    graph->slots[graph->root_slot] = graph->root_grad;
+    for (size_t i = 0; i < graph->num_steps; i++) {
+        BackwardStep *step = &graph->steps[i];
+        BackwardFn *fn = step->fn;
+        size_t num_inputs = get_backward_inputs(fn),
+               num_outputs = get_backward_outputs(fn);
+        Tensor **grads = &graph->slots[step->first_slot];
+
+        bool has_grads = true;
+        for (size_t j = 0; j < num_inputs; j++)
+            has_grads = has_grads && grads[j];
+
+        Tensor *op_grads[num_outputs + 1];
+        for (size_t j = 0; j < num_outputs; j++)
+            op_grads[j] = NULL;
+
+        if (has_grads) {
+            CallableGradFn grad_fn = get_grad_fn(fn);
+            unpack_saved_tensors(fn);
+            grad_fn(op_grads, get_backward_fn_ip_tensors(fn),
+                    get_backward_fn_op_tensors(fn), grads, num_inputs,
+                    num_outputs, false);
+            repack_saved_tensors(fn);
+        }
+
+        for (size_t j = 0; j < num_inputs; j++) {
+            if (grads[j] && grads[j] != graph->root_grad &&
+                !_is_planned(graph, step->first_slot + j, grads[j]))
+                _free_grad(grads[j]);
+            grads[j] = NULL;
+        }
+
+        for (size_t j = 0; j < num_outputs; j++) {
+            if (!op_grads[j])
+                continue;
+
+            ssize_t target = step->targets[j];
+            if (target < 0)
+                _free_grad(op_grads[j]);
+            else
+                _fold_grad(&graph->slots[target],
+                           graph->planned_slots ? graph->planned_slots[target]
+                                                : NULL,
+                           op_grads[j]);
+        }
+    }
+
+    set_dtype_promotion(promotion);
+}
+
+void free_captured_backward(CapturedGraph *graph) {
+    for (size_t i = 0; i < graph->num_steps; i++)
+        free(graph->steps[i].targets);
+
+    if (graph->planned_slots)
+        for (size_t i = 0; i < graph->num_slots; i++)
+            if (graph->planned_slots[i])
+                free_tensor(graph->planned_slots[i]);
+
+    free(graph->steps);
+    free(graph->slots);
+    free(graph->planned_slots);
+    if (graph->root_grad)
+        free_tensor(graph->root_grad);
+}
@@ -0,0 +1,290 @@
+#include "capture.h"
+#include "private/captured_graph.h"
+#include "array.h"
+#include "autograd.h"
+#include "error_codes.h"
+#include "tensor.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/types.h>
+
+#define PLAN_ALIGNMENT 64
+
+/*
+ * Lifetimes are positions on one timeline: the forward nodes, then the steps
+ * of the backward tape. A gradient slot is planned like a forward tensor, it
+ * lives from the first step feeding it to the step reading it.
+ */
+typedef struct PlannedBuffer {
+    Tensor *tensor; // the forward tensor, or the one a slot is the grad of
+    ssize_t slot;   // backward tape slot, -1 for forward tensors
+    size_t size;    // bytes, rounded up to PLAN_ALIGNMENT
+    size_t first;   // position that produces the buffer
+    size_t last;    // last position reading it
+    size_t offset;
+} PlannedBuffer;
+
+struct MemoryPlan {
+    CapturedGraph *graph;
+    PlannedBuffer *buffers;
+    size_t num_buffers;
+
+    size_t peak;      // slab bytes
+    size_t unplanned; // bytes if every buffer is allocated separately
+    void *slab;
+};
+
+static size_t _aligned_size(const Tensor *tensor) {
+    ndArray *data = get_tensor_data(tensor);
+    size_t size = get_total_size(data) * get_itemsize(data);
+
+    return (size + PLAN_ALIGNMENT - 1) / PLAN_ALIGNMENT * PLAN_ALIGNMENT;
+}
+
+static PlannedBuffer *_find_buffer(MemoryPlan *plan, const Tensor *tensor) {
+    if (!tensor)
+        return NULL;
+
+    for (size_t i = 0; i < plan->num_buffers; i++)
+        if (plan->buffers[i].slot < 0 && plan->buffers[i].tensor == tensor)
+            return &plan->buffers[i];
+
+    return NULL;
+}
+
+static void _extend_lifetime(MemoryPlan *plan, const Tensor *tensor,
+                             size_t last) {
+    PlannedBuffer *buffer = _find_buffer(plan, tensor);
+    if (buffer && buffer->last < last)
+        buffer->last = last;
+}
+
+static SavedKind _saved_kind(const CapturedNode *node) {
+    BackwardFn *backward_fn = get_backward_fn(node->out);
+    return backward_fn ? get_saved(backward_fn) : SAVE_SHAPES;
+}
+
+// saved buffers live until the node's backward step, or the whole backward
+// when it is not on the tape
+static size_t _backward_read(const CapturedGraph *graph,
+                             const CapturedNode *node) {
+    size_t end = graph->num_nodes + graph->num_steps;
+    BackwardFn *backward_fn = get_backward_fn(node->out);
+    ssize_t step = backward_fn ? find_backward_step(graph, backward_fn) : -1;
+
+    return (step < 0) ? end : graph->num_nodes + (size_t)step;
+}
+
+static void _plan_slots(MemoryPlan *plan, const CapturedGraph *graph) {
+    if (!graph->num_slots)
+        return;
+
+    // the first step feeding each slot
+    size_t *producer = malloc(graph->num_slots * sizeof(size_t));
+    if (!producer)
+        RUNTIME_ERROR(MEMORY_PLAN_FAILURE,
+                      "Failure to allocate memory plan slot lifetimes");
+
+    for (size_t i = 0; i < graph->num_slots; i++)
+        producer[i] = SIZE_MAX;
+    for (size_t i = 0; i < graph->num_steps; i++) {
+        const BackwardStep *step = &graph->steps[i];
+        for (size_t j = 0; j < get_backward_outputs(step->fn); j++) {
+            ssize_t target = step->targets[j];
+            if (target >= 0 && producer[target] == SIZE_MAX)
+                producer[target] = i;
+        }
+    }
+
+    for (size_t i = 0; i < graph->num_steps; i++) {
+        const BackwardStep *step = &graph->steps[i];
+        Tensor **inputs = get_backward_fn_ip_tensors(step->fn);
+
+        for (size_t j = 0; j < get_backward_inputs(step->fn); j++) {
+            size_t slot = step->first_slot + j;
+            if (producer[slot] == SIZE_MAX)
+                continue;
+
+            size_t size = _aligned_size(inputs[j]);
+            plan->buffers[plan->num_buffers++] =
+                (PlannedBuffer){.tensor = inputs[j],
+                                .slot = (ssize_t)slot,
+                                .size = size,
+                                .first = graph->num_nodes + producer[slot],
+                                .last = graph->num_nodes + i,
+                                .offset = 0};
+            plan->unplanned += size;
+        }
+    }
+
+    free(producer);
+}
+
+static bool _overlaps(const PlannedBuffer *b1, const PlannedBuffer *b2) {
+    return b1->first <= b2->last && b2->first <= b1->last;
+}
+
+static int _compare_size_desc(const void *a, const void *b) {
+    const PlannedBuffer *b1 = *(PlannedBuffer *const *)a;
+    const PlannedBuffer *b2 = *(PlannedBuffer *const *)b;
+
+    if (b1->size != b2->size)
+        return (b1->size < b2->size) ? 1 : -1;
+
+    return (b1->first > b2->first) - (b1->first < b2->first);
+}
+
+/*
+ * Greedy-by-size interval coloring: larger buffers are placed first, each
+ * at the lowest offset that does not collide with an already placed buffer
+ * whose lifetime overlaps its own.
+ */
+static void _assign_offsets(MemoryPlan *plan) {
+    size_t n = plan->num_buffers;
+    PlannedBuffer **order = malloc(n * sizeof(PlannedBuffer *));
+    if (n && !order)
+        RUNTIME_ERROR(MEMORY_PLAN_FAILURE,
+                      "Failure to allocate memory plan ordering");
+
+    for (size_t i = 0; i < n; i++)
+        order[i] = &plan->buffers[i];
+    qsort(order, n, sizeof(PlannedBuffer *), _compare_size_desc);
+
+    plan->peak = 0;
+    for (size_t i = 0; i < n; i++) {
+        PlannedBuffer *buffer = order[i];
+        size_t offset = 0;
+
+        // placed buffers are revisited until a full pass finds no collision
+        bool moved = true;
+        while (moved) {
+            moved = false;
+            for (size_t j = 0; j < i; j++) {
+                PlannedBuffer *placed = order[j];
+                if (!_overlaps(buffer, placed))
+                    continue;
+
+                if (offset < placed->offset + placed->size &&
+                    placed->offset < offset + buffer->size) {
+                    offset = placed->offset + placed->size;
+                    moved = true;
+                }
+            }
+        }
+
+        buffer->offset = offset;
+        if (offset + buffer->size > plan->peak)
+            plan->peak = offset + buffer->size;
+    }
+
+    free(order);
+}
+
+MemoryPlan *plan_memory(CapturedGraph *graph) {
+    MemoryPlan *plan = malloc(sizeof(MemoryPlan));
+    if (!plan)
+        RUNTIME_ERROR(MEMORY_PLAN_FAILURE, "Failure to allocate memory plan");
+
+    size_t capacity = graph->num_nodes + graph->num_slots;
+    plan->buffers = malloc(capacity * sizeof(PlannedBuffer));
+    if (capacity && !plan->buffers)
+        RUNTIME_ERROR(MEMORY_PLAN_FAILURE,
+                      "Failure to allocate memory plan buffers");
+
+    plan->graph = graph;
+    plan->num_buffers = 0;
+    plan->unplanned = 0;
+    plan->slab = NULL;
+
+    for (size_t i = 0; i < graph->num_nodes; i++) {
+        const CapturedNode *node = &graph->nodes[i];
+        _extend_lifetime(plan, node->t1, i);
+        _extend_lifetime(plan, node->t2, i);
+
+        // buffers a backward node reads live until that node has run
+        SavedKind saved = _saved_kind(node);
+        size_t read = _backward_read(graph, node);
+        if (saved == SAVE_INPUTS) {
+            _extend_lifetime(plan, node->t1, read);
+            _extend_lifetime(plan, node->t2, read);
+        }
+
+        // the output is read by the caller, it keeps its own buffer
+        if (node->out == graph->output)
+            continue;
+
+        size_t size = _aligned_size(node->out);
+        size_t last = (saved == SAVE_OUTPUT) ? read : i;
+        plan->buffers[plan->num_buffers++] =
+            (PlannedBuffer){.tensor = node->out,
+                            .slot = -1,
+                            .size = size,
+                            .first = i,
+                            .last = last,
+                            .offset = 0};
+        plan->unplanned += size;
+    }
+
+    _plan_slots(plan, graph);
+    _assign_offsets(plan);
+    return plan;
+}
+
+void apply_memory_plan(MemoryPlan *plan) {
+    CapturedGraph *graph = plan->graph;
+    if (plan->slab || graph->planned_slots)
+        RUNTIME_ERROR(MEMORY_PLAN_FAILURE, "Memory plan was already applied");
+
+    plan->slab = aligned_alloc(PLAN_ALIGNMENT,
+                               plan->peak ? plan->peak : PLAN_ALIGNMENT);
+    if (!plan->slab)
+        RUNTIME_ERRORF(MEMORY_PLAN_FAILURE,
+                       "Failure to allocate memory plan slab of %zu bytes",
+                       plan->peak);
+
+    graph->planned_slots = calloc(graph->num_slots, sizeof(Tensor *));
+    if (graph->num_slots && !graph->planned_slots)
+        RUNTIME_ERROR(MEMORY_PLAN_FAILURE,
+                      "Failure to allocate memory plan slot gradients");
+
+    for (size_t i = 0; i < plan->num_buffers; i++) {
+        PlannedBuffer *buffer = &plan->buffers[i];
+        ndArray *data = get_tensor_data(buffer->tensor);
+
+        int ndim = get_ndim(data);
+        ndArray *placed =
+            array_from_buffer(ndim, get_shape(data), get_dtype(data),
+                              (char *)plan->slab + buffer->offset);
+
+        // slot gradients are dense, the graph owns them from here on
+        if (buffer->slot >= 0) {
+            graph->planned_slots[buffer->slot] =
+                tensor_init(placed, NO_GRAD, NULL);
+            continue;
+        }
+
+        set_strides(placed, get_strides(data));
+        replace_tensor_data(buffer->tensor, placed);
+    }
+}
+
+void free_memory_plan(MemoryPlan *plan) {
+    if (!plan)
+        return;
+
+    free(plan->buffers);
+    free(plan->slab);
+    free(plan);
+}
+
+size_t get_planned_peak(const MemoryPlan *plan) { return plan->peak; }
+
+size_t get_unplanned_bytes(const MemoryPlan *plan) { return plan->unplanned; }
+
+size_t get_num_planned_buffers(const MemoryPlan *plan) {
+    return plan->num_buffers;
+}
@@ -0,0 +1,47 @@
+#ifndef CAPTURED_GRAPH_H
+#define CAPTURED_GRAPH_H
+
+#include "array.h"
+#include "capture.h"
+#include "tensor.h"
+
+#include <stddef.h>
+#include <sys/types.h>
+
+typedef struct CapturedNode {
+    CaptureOp op;
+    Tensor *t1, *t2, *out;
+    ndArray *constant; // 0 for negation, 1 for inversion
+    double params[2];
+} CapturedNode;
+
+// a backward node of the captured output, run in a fixed topological order
+typedef struct BackwardStep {
+    BackwardFn *fn;
+    size_t first_slot; // gradients of fn's inputs occupy consecutive slots
+    ssize_t *targets;  // slot receiving each output's gradient, -1 if none
+} BackwardStep;
+
+struct CapturedGraph {
+    CapturedNode *nodes;
+    size_t num_nodes;
+    size_t capacity;
+
+    Tensor *output;
+
+    BackwardStep *steps;
+    size_t num_steps;
+    Tensor **slots;
+    size_t num_slots;
+    size_t root_slot;
+    Tensor *root_grad; // allocated once, seeds every replayed backward
+    Tensor **planned_slots; // slab buffers set by `apply_memory_plan`
+};
+
+void capture_backward(CapturedGraph *graph);
+// position of `fn` on the backward tape, -1 if it is not on it
+ssize_t find_backward_step(const CapturedGraph *graph, const BackwardFn *fn);
+void replay_backward(CapturedGraph *graph);
+void free_captured_backward(CapturedGraph *graph);
+
+#endif // !CAPTURED_GRAPH_H
@@ -1,4 +1,5 @@
 #include "ctorch.h"
+#include "autograd.h"
 #include "random.h"
 #include "tensor.h"
 
@@ -22,3 +23,7 @@ void auto_free_env(Environment **env) {
 
     free_env(*env);
 }
+
+void auto_no_grad_exit(int *depth) { ctorch_no_grad_exit(); }
+
+void auto_inference_mode_exit(int *depth) { ctorch_inference_mode_exit(); }
@@ -18,6 +18,8 @@ static const ErrorInfo error_table[] = {
     {INVALID_DTYPE, "INVALID_DTYPE"},
     {REPEATED_ARRAY_DIMS, "REPEATED_ARRAY_DIMS"},
     {INVALID_DIM, "INVALID_DIM"},
+    {SPARSE_INIT_FAILURE, "SPARSE_INIT_FAILURE"},
+    {INVALID_FUSED_EXPR, "INVALID_FUSED_EXPR"},
 
     /* tensor related error codes 20<x> */
     {TENSOR_INIT_FAILURE, "TENSOR_INIT_FAILURE"},
@@ -29,6 +31,8 @@ static const ErrorInfo error_table[] = {
     {FILE_READ_FAILURE, "FILE_READ_FAILURE"},
     {FILE_FORMAT_ERROR, "FILE_FORMAT_ERROR"},
     {ENV_RESOLVE_FAILURE, "ENV_RESOLVE_FAILURE"},
+    {INVALID_CAPTURE_STATE, "INVALID_CAPTURE_STATE"},
+    {MEMORY_PLAN_FAILURE, "MEMORY_PLAN_FAILURE"},
 
     /* autograd related error codes 30<x> */
     {BACKWARD_FN_INIT_FAILURE, "BACKWARD_FN_INIT_FAILURE"},
@@ -36,6 +40,11 @@ static const ErrorInfo error_table[] = {
     {GRAD_INIT_FAILURE, "GRAD_INIT_FAILURE"},
     {INVALID_BACKWARD_PASS, "INVALID_BACKWARD_PASS"},
     {INVALID_NUM_INPUTS_OUTPUTS, "INVALID_NUM_INPUTS_OUTPUTS"},
+    {INVALID_AUTOCAST_STATE, "INVALID_AUTOCAST_STATE"},
+    {GRAD_SCALER_INIT_FAILURE, "GRAD_SCALER_INIT_FAILURE"},
+    {INVALID_GRAD_MODE, "INVALID_GRAD_MODE"},
+    {GRAPH_TASK_INIT_FAILURE, "GRAPH_TASK_INIT_FAILURE"},
+    {SAVED_TENSOR_HOOK_FAILURE, "SAVED_TENSOR_HOOK_FAILURE"},
 
     /* random related error codes 40<x> */
     {PRNG_INIT_FAILURE, "PRNG_INIT_FAILURE"},
@@ -43,6 +52,7 @@ static const ErrorInfo error_table[] = {
 
     /* neural nets related error codes 50<x> */
     {MODULE_ALLOC_FAILURE, "MODULE_ALLOC_FAILURE"},
+    {OPTIM_INIT_FAILURE, "OPTIM_INIT_FAILURE"},
 };
 
 const char *error_code_to_string(ErrorCode code) {
@@ -0,0 +1,435 @@
+#include "array.h"
+#include "error_codes.h"
+#include "fusion.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// values of one tile stay in cache across the whole program
+#define FUSED_TILE 256
+
+typedef struct FusedLayout {
+    int ndim;
+    size_t shape[MAX_NDIM];
+    size_t total_size;
+
+    // element strides of each input over the output dims, 0 if broadcast
+    size_t (*strides)[MAX_NDIM];
+    bool *dense; // contiguous with the output's shape, read linearly
+} FusedLayout;
+
+static void _layout_strides(const ndArray *array, const FusedLayout *layout,
+                            size_t *strides, bool *dense) {
+    int ndim = get_ndim(array), offset = layout->ndim - ndim;
+    const size_t *shape = get_shape(array), *src_strides = get_strides(array);
+    size_t itemsize = get_itemsize(array);
+
+    *dense = is_array_contiguous(array) && ndim == layout->ndim;
+    for (int d = 0; d < layout->ndim; d++) {
+        int src_d = d - offset;
+        if (src_d < 0 || shape[src_d] == 1) {
+            strides[d] = 0;
+            *dense = *dense && layout->shape[d] == 1;
+            continue;
+        }
+
+        strides[d] = src_strides[src_d] / itemsize;
+        *dense = *dense && shape[src_d] == layout->shape[d];
+    }
+}
+
+static void _layout_init(FusedLayout *layout, ndArray **inputs,
+                         size_t num_inputs) {
+    layout->ndim = 0;
+    for (size_t k = 0; k < num_inputs; k++) {
+        int ndim = get_ndim(inputs[k]);
+        int out_ndim = (ndim > layout->ndim) ? ndim : layout->ndim;
+
+        size_t shape[MAX_NDIM];
+        broadcast_shape(layout->shape, get_shape(inputs[k]), shape,
+                        layout->ndim, ndim, out_ndim);
+        memcpy(layout->shape, shape, out_ndim * sizeof(size_t));
+        layout->ndim = out_ndim;
+    }
+
+    layout->total_size = 1;
+    for (int d = 0; d < layout->ndim; d++)
+        layout->total_size *= layout->shape[d];
+
+    layout->strides = malloc((num_inputs + 1) * sizeof(size_t[MAX_NDIM]));
+    layout->dense = malloc((num_inputs + 1) * sizeof(bool));
+    if (!layout->strides || !layout->dense)
+        RUNTIME_ERROR(ARRAY_INIT_FAILURE, "Failure to allocate fused layout");
+
+    for (size_t k = 0; k < num_inputs; k++)
+        _layout_strides(inputs[k], layout, layout->strides[k],
+                        &layout->dense[k]);
+}
+
+static void _free_layout(FusedLayout *layout) {
+    free(layout->strides);
+    free(layout->dense);
+}
+
+static bool _is_unary(FusedOpKind op) { return op == FUSED_NEG; }
+static bool _is_leaf(FusedOpKind op) {
+    return op == FUSED_INPUT || op == FUSED_SCALAR;
+}
+
+// operands must precede their instruction, the program is then acyclic
+static void _check_program(const FusedInstr *instrs, int root,
+                           size_t num_inputs) {
+    if (root < 0)
+        RUNTIME_ERROR(INVALID_FUSED_EXPR, "Fused expression has no root");
+
+    for (int i = 0; i <= root; i++) {
+        const FusedInstr *instr = &instrs[i];
+        if (instr->op == FUSED_INPUT) {
+            if (instr->a < 0 || (size_t)instr->a >= num_inputs)
+                RUNTIME_ERRORF(INVALID_FUSED_EXPR,
+                               "Fused instruction %d reads input %d of %zu", i,
+                               instr->a, num_inputs);
+            continue;
+        }
+        if (_is_leaf(instr->op))
+            continue;
+
+        bool valid = instr->a >= 0 && instr->a < i;
+        if (!_is_unary(instr->op))
+            valid = valid && instr->b >= 0 && instr->b < i;
+        if (!valid)
+            RUNTIME_ERRORF(INVALID_FUSED_EXPR,
+                           "Fused instruction %d reads an undefined value", i);
+    }
+}
+
+static void _live_mask(const FusedInstr *instrs, int root, bool *live) {
+    memset(live, 0, (root + 1) * sizeof(bool));
+    live[root] = true;
+
+    for (int i = root; i >= 0; i--) {
+        if (!live[i] || _is_leaf(instrs[i].op))
+            continue;
+
+        live[instrs[i].a] = true;
+        if (!_is_unary(instrs[i].op))
+            live[instrs[i].b] = true;
+    }
+}
+
+#define _REG(base, k) ((base) + (size_t)(k) * FUSED_TILE)
+
+#define _FUSED_KERNELS(S, T)                                                   \
+    static void _fused_load_##S(T *dst, const T *src, const size_t *strides,   \
+                                bool dense, const FusedLayout *layout,         \
+                                size_t start, size_t n) {                      \
+        if (dense) {                                                           \
+            memcpy(dst, src + start, n * sizeof(T));                           \
+            return;                                                            \
+        }                                                                      \
+                                                                               \
+        int ndim = layout->ndim;                                               \
+        size_t idx[MAX_NDIM], offset = 0, tmp = start;                         \
+        for (int d = ndim - 1; d >= 0; d--) {                                  \
+            idx[d] = tmp % layout->shape[d];                                   \
+            tmp /= layout->shape[d];                                           \
+            offset += idx[d] * strides[d];                                     \
+        }                                                                      \
+                                                                               \
+        for (size_t j = 0; j < n; j++) {                                       \
+            dst[j] = src[offset];                                              \
+            for (int d = ndim - 1; d >= 0; d--) {                              \
+                offset += strides[d];                                          \
+                if (++idx[d] < layout->shape[d])                               \
+                    break;                                                     \
+                                                                               \
+                offset -= idx[d] * strides[d];                                 \
+                idx[d] = 0;                                                    \
+            }                                                                  \
+        }                                                                      \
+    }                                                                          \
+                                                                               \
+    static void _fused_tile_##S(const FusedInstr *instrs, int root,            \
+                                const bool *live, T *regs, T *const *srcs,     \
+                                const FusedLayout *layout, size_t start,       \
+                                size_t n) {                                    \
+        for (int i = 0; i <= root; i++) {                                      \
+            if (!live[i])                                                      \
+                continue;                                                      \
+                                                                               \
+            const FusedInstr *instr = &instrs[i];                              \
+            T *r = _REG(regs, i);                                              \
+            if (instr->op == FUSED_INPUT) {                                    \
+                int k = instr->a;                                              \
+                _fused_load_##S(r, srcs[k], layout->strides[k],                \
+                                layout->dense[k], layout, start, n);           \
+                continue;                                                      \
+            }                                                                  \
+            if (instr->op == FUSED_SCALAR) {                                   \
+                for (size_t j = 0; j < n; j++)                                 \
+                    r[j] = (T)instr->value;                                    \
+                continue;                                                      \
+            }                                                                  \
+                                                                               \
+            const T *x = _REG(regs, instr->a);                                 \
+            const T *y = _is_unary(instr->op) ? x : _REG(regs, instr->b);      \
+            switch (instr->op) {                                               \
+            case FUSED_ADD:                                                    \
+                _Pragma("omp simd") for (size_t j = 0; j < n; j++) r[j] =      \
+                    x[j] + y[j];                                               \
+                break;                                                         \
+            case FUSED_SUB:                                                    \
+                _Pragma("omp simd") for (size_t j = 0; j < n; j++) r[j] =      \
+                    x[j] - y[j];                                               \
+                break;                                                         \
+            case FUSED_MUL:                                                    \
+                _Pragma("omp simd") for (size_t j = 0; j < n; j++) r[j] =      \
+                    x[j] * y[j];                                               \
+                break;                                                         \
+            case FUSED_DIV:                                                    \
+                _Pragma("omp simd") for (size_t j = 0; j < n; j++) r[j] =      \
+                    x[j] / y[j];                                               \
+                break;                                                         \
+            case FUSED_MAX:                                                    \
+                _Pragma("omp simd") for (size_t j = 0; j < n; j++) r[j] =      \
+                    (x[j] > y[j]) ? x[j] : y[j];                               \
+                break;                                                         \
+            case FUSED_MIN:                                                    \
+                _Pragma("omp simd") for (size_t j = 0; j < n; j++) r[j] =      \
+                    (x[j] < y[j]) ? x[j] : y[j];                               \
+                break;                                                         \
+            case FUSED_NEG:                                                    \
+                _Pragma("omp simd") for (size_t j = 0; j < n; j++) r[j] =      \
+                    -x[j];                                                     \
+                break;                                                         \
+            default:                                                           \
+                break;                                                         \
+            }                                                                  \
+        }                                                                      \
+    }                                                                          \
+                                                                               \
+    /* reverse sweep over a recomputed tile, adjoints are accumulated */       \
+    static void _fused_tile_grad_##S(const FusedInstr *instrs, int root,       \
+                                     const bool *live, const T *regs,          \
+                                     T *adj, T *const *adjoints,               \
+                                     size_t start, size_t n) {                 \
+        for (int i = root; i >= 0; i--) {                                      \
+            const FusedInstr *instr = &instrs[i];                              \
+            if (!live[i] || instr->op == FUSED_SCALAR)                         \
+                continue;                                                      \
+                                                                               \
+            const T *g = _REG(adj, i);                                         \
+            if (instr->op == FUSED_INPUT) {                                    \
+                T *dst = adjoints[instr->a];                                   \
+                if (dst)                                                       \
+                    for (size_t j = 0; j < n; j++)                             \
+                        dst[start + j] += g[j];                                \
+                continue;                                                      \
+            }                                                                  \
+                                                                               \
+            const T *x = _REG(regs, instr->a);                                 \
+            const T *y = _is_unary(instr->op) ? x : _REG(regs, instr->b);      \
+            T *ga = _REG(adj, instr->a);                                       \
+            T *gb = _is_unary(instr->op) ? ga : _REG(adj, instr->b);           \
+            switch (instr->op) {                                               \
+            case FUSED_ADD:                                                    \
+                for (size_t j = 0; j < n; j++)                                 \
+                    ga[j] += g[j];                                             \
+                for (size_t j = 0; j < n; j++)                                 \
+                    gb[j] += g[j];                                             \
+                break;                                                         \
+            case FUSED_SUB:                                                    \
+                for (size_t j = 0; j < n; j++)                                 \
+                    ga[j] += g[j];                                             \
+                for (size_t j = 0; j < n; j++)                                 \
+                    gb[j] -= g[j];                                             \
+                break;                                                         \
+            case FUSED_MUL:                                                    \
+                for (size_t j = 0; j < n; j++)                                 \
+                    ga[j] += g[j] * y[j];                                      \
+                for (size_t j = 0; j < n; j++)                                 \
+                    gb[j] += g[j] * x[j];                                      \
+                break;                                                         \
+            case FUSED_DIV:                                                    \
+                for (size_t j = 0; j < n; j++)                                 \
+                    ga[j] += g[j] / y[j];                                      \
+                for (size_t j = 0; j < n; j++)                                 \
+                    gb[j] -= g[j] * x[j] / (y[j] * y[j]);                      \
+                break;                                                         \
+            case FUSED_MAX:                                                    \
+                for (size_t j = 0; j < n; j++)                                 \
+                    ga[j] += (x[j] >= y[j]) ? g[j] : 0;                        \
+                for (size_t j = 0; j < n; j++)                                 \
+                    gb[j] += (y[j] > x[j]) ? g[j] : 0;                         \
+                break;                                                         \
+            case FUSED_MIN:                                                    \
+                for (size_t j = 0; j < n; j++)                                 \
+                    ga[j] += (x[j] <= y[j]) ? g[j] : 0;                        \
+                for (size_t j = 0; j < n; j++)                                 \
+                    gb[j] += (y[j] < x[j]) ? g[j] : 0;                         \
+                break;                                                         \
+            case FUSED_NEG:                                                    \
+                for (size_t j = 0; j < n; j++)                                 \
+                    ga[j] -= g[j];                                             \
+                break;                                                         \
+            default:                                                           \
+                break;                                                         \
+            }                                                                  \
+        }                                                                      \
+    }                                                                          \
+                                                                               \
+    static void _fused_eval_##S(const FusedInstr *instrs, int root,            \
+                                const bool *live, T *const *srcs,              \
+                                const FusedLayout *layout, T *out) {           \
+        size_t total_size = layout->total_size;                                \
+        size_t num_tiles = (total_size + FUSED_TILE - 1) / FUSED_TILE;         \
+                                                                               \
+        _Pragma("omp parallel") {                                              \
+            T *regs = malloc((size_t)(root + 1) * FUSED_TILE * sizeof(T));     \
+            if (!regs)                                                         \
+                RUNTIME_ERROR(ARRAY_INIT_FAILURE,                              \
+                              "Failure to allocate fused registers");          \
+                                                                               \
+            _Pragma("omp for schedule(static)") for (size_t t = 0;             \
+                                                     t < num_tiles; t++) {     \
+                size_t start = t * FUSED_TILE;                                 \
+                size_t n = (total_size - start < FUSED_TILE)                   \
+                               ? total_size - start                            \
+                               : FUSED_TILE;                                   \
+                                                                               \
+                _fused_tile_##S(instrs, root, live, regs, srcs, layout,        \
+                                start, n);                                     \
+                memcpy(out + start, _REG(regs, root), n * sizeof(T));          \
+            }                                                                  \
+            free(regs);                                                        \
+        }                                                                      \
+    }                                                                          \
+                                                                               \
+    static void _fused_grad_##S(const FusedInstr *instrs, int root,            \
+                                const bool *live, T *const *srcs,              \
+                                const T *grad, const FusedLayout *layout,      \
+                                size_t grad_k, T *const *adjoints) {           \
+        size_t total_size = layout->total_size;                                \
+        size_t num_tiles = (total_size + FUSED_TILE - 1) / FUSED_TILE;         \
+        size_t num_regs = (size_t)(root + 1) * FUSED_TILE;                     \
+                                                                               \
+        _Pragma("omp parallel") {                                              \
+            T *regs = malloc(2 * num_regs * sizeof(T));                        \
+            if (!regs)                                                         \
+                RUNTIME_ERROR(ARRAY_INIT_FAILURE,                              \
+                              "Failure to allocate fused registers");          \
+            T *adj = regs + num_regs;                                          \
+                                                                               \
+            _Pragma("omp for schedule(static)") for (size_t t = 0;             \
+                                                     t < num_tiles; t++) {     \
+                size_t start = t * FUSED_TILE;                                 \
+                size_t n = (total_size - start < FUSED_TILE)                   \
+                               ? total_size - start                            \
+                               : FUSED_TILE;                                   \
+                                                                               \
+                _fused_tile_##S(instrs, root, live, regs, srcs, layout,        \
+                                start, n);                                     \
+                memset(adj, 0, num_regs * sizeof(T));                          \
+                _fused_load_##S(_REG(adj, root), grad,                         \
+                                layout->strides[grad_k],                       \
+                                layout->dense[grad_k], layout, start, n);      \
+                _fused_tile_grad_##S(instrs, root, live, regs, adj,            \
+                                     adjoints, start, n);                      \
+            }                                                                  \
+            free(regs);                                                        \
+        }                                                                      \
+    }
+
+_FUSED_KERNELS(f, float)
+_FUSED_KERNELS(d, double)
+
+static DType _fused_dtype(ndArray **inputs, size_t num_inputs) {
+    if (num_inputs == 0)
+        return DTYPE_FLOAT;
+
+    DType dtype = get_dtype(inputs[0]);
+    for (size_t k = 1; k < num_inputs; k++)
+        if (get_dtype(inputs[k]) != dtype)
+            RUNTIME_ERRORF(INVALID_DTYPE,
+                           "Fused inputs must share a dtype, got `%s` and "
+                           "`%s`",
+                           DTypeNames[dtype], DTypeNames[get_dtype(inputs[k])]);
+
+    if (dtype != DTYPE_FLOAT && dtype != DTYPE_DOUBLE)
+        RUNTIME_ERRORF(INVALID_DTYPE, "Unsupported dtype for fusion - `%s`",
+                       DTypeNames[dtype]);
+
+    return dtype;
+}
+
+ndArray *array_fused_eval(const FusedInstr *instrs, int root, ndArray **inputs,
+                          size_t num_inputs) {
+    _check_program(instrs, root, num_inputs);
+    DType dtype = _fused_dtype(inputs, num_inputs);
+
+    FusedLayout layout;
+    _layout_init(&layout, inputs, num_inputs);
+
+    bool live[root + 1];
+    _live_mask(instrs, root, live);
+
+    void *srcs[num_inputs + 1];
+    for (size_t k = 0; k < num_inputs; k++)
+        srcs[k] = get_array_data(inputs[k]);
+
+    ndArray *result = array_init(layout.ndim, layout.shape, dtype);
+    if (dtype == DTYPE_FLOAT)
+        _fused_eval_f(instrs, root, live, (float *const *)srcs, &layout,
+                      get_array_data(result));
+    else
+        _fused_eval_d(instrs, root, live, (double *const *)srcs, &layout,
+                      get_array_data(result));
+
+    _free_layout(&layout);
+    return result;
+}
+
+void array_fused_grad(const FusedInstr *instrs, int root, ndArray **inputs,
+                      size_t num_inputs, ndArray *grad,
+                      const bool *requires_grad, ndArray **adjoints) {
+    _check_program(instrs, root, num_inputs);
+    DType dtype = _fused_dtype(inputs, num_inputs);
+    if (get_dtype(grad) != dtype)
+        RUNTIME_ERRORF(INVALID_DTYPE,
+                       "Fused gradient dtype `%s` does not match `%s`",
+                       DTypeNames[get_dtype(grad)], DTypeNames[dtype]);
+
+    FusedLayout layout;
+    _layout_init(&layout, inputs, num_inputs);
+    _layout_strides(grad, &layout, layout.strides[num_inputs],
+                    &layout.dense[num_inputs]);
+
+    bool live[root + 1];
+    _live_mask(instrs, root, live);
+
+    void *srcs[num_inputs + 1], *dsts[num_inputs + 1];
+    for (size_t k = 0; k < num_inputs; k++) {
+        srcs[k] = get_array_data(inputs[k]);
+        dsts[k] = NULL;
+        adjoints[k] = NULL;
+        if (!requires_grad[k])
+            continue;
+
+        adjoints[k] = zeros(layout.ndim, layout.shape, dtype);
+        dsts[k] = get_array_data(adjoints[k]);
+    }
+
+    if (dtype == DTYPE_FLOAT)
+        _fused_grad_f(instrs, root, live, (float *const *)srcs,
+                      get_array_data(grad), &layout, num_inputs,
+                      (float *const *)dsts);
+    else
+        _fused_grad_d(instrs, root, live, (double *const *)srcs,
+                      get_array_data(grad), &layout, num_inputs,
+                      (double *const *)dsts);
+
+    _free_layout(&layout);
+}
@@ -0,0 +1,260 @@
+#include "fusion.h"
+#include "array.h"
+#include "autograd.h"
+#include "capture.h"
+#include "error_codes.h"
+#include "tensor.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+struct FusedExpr {
+    FusedInstr *instrs;
+    size_t num_instrs;
+    size_t instrs_capacity;
+
+    Tensor **inputs;
+    size_t num_inputs;
+    size_t inputs_capacity;
+};
+
+FusedExpr *fused_expr_init() {
+    FusedExpr *expr = malloc(sizeof(FusedExpr));
+    if (!expr)
+        RUNTIME_ERROR(INVALID_FUSED_EXPR,
+                      "Failure to allocate fused expression");
+
+    expr->instrs_capacity = 16;
+    expr->num_instrs = 0;
+    expr->instrs = malloc(expr->instrs_capacity * sizeof(FusedInstr));
+
+    expr->inputs_capacity = 4;
+    expr->num_inputs = 0;
+    expr->inputs = malloc(expr->inputs_capacity * sizeof(Tensor *));
+
+    if (!expr->instrs || !expr->inputs)
+        RUNTIME_ERROR(INVALID_FUSED_EXPR,
+                      "Failure to allocate fused expression buffers");
+
+    return expr;
+}
+
+void free_fused_expr(FusedExpr *expr) {
+    if (!expr)
+        return;
+
+    free(expr->instrs);
+    free(expr->inputs);
+    free(expr);
+}
+
+static int _push_instr(FusedExpr *expr, FusedInstr instr) {
+    if (expr->num_instrs == expr->instrs_capacity) {
+        size_t new_capacity = 2 * expr->instrs_capacity;
+        FusedInstr *new_instrs =
+            realloc(expr->instrs, new_capacity * sizeof(FusedInstr));
+        if (!new_instrs)
+            RUNTIME_ERROR(INVALID_FUSED_EXPR,
+                          "Failure to grow fused expression");
+
+        expr->instrs = new_instrs;
+        expr->instrs_capacity = new_capacity;
+    }
+
+    expr->instrs[expr->num_instrs] = instr;
+    return (int)expr->num_instrs++;
+}
+
+static void _check_value(const FusedExpr *expr, int value) {
+    if (value < 0 || (size_t)value >= expr->num_instrs)
+        RUNTIME_ERRORF(INVALID_FUSED_EXPR,
+                       "Invalid fused value %d, expression has %zu values",
+                       value, expr->num_instrs);
+}
+
+// a tensor read twice is loaded once, its gradients are summed in-kernel
+int fused_input(FusedExpr *expr, Tensor *tensor) {
+    for (size_t i = 0; i < expr->num_instrs; i++) {
+        const FusedInstr *instr = &expr->instrs[i];
+        if (instr->op == FUSED_INPUT && expr->inputs[instr->a] == tensor)
+            return (int)i;
+    }
+
+    if (expr->num_inputs == expr->inputs_capacity) {
+        size_t new_capacity = 2 * expr->inputs_capacity;
+        Tensor **new_inputs =
+            realloc(expr->inputs, new_capacity * sizeof(Tensor *));
+        if (!new_inputs)
+            RUNTIME_ERROR(INVALID_FUSED_EXPR,
+                          "Failure to grow fused expression inputs");
+
+        expr->inputs = new_inputs;
+        expr->inputs_capacity = new_capacity;
+    }
+
+    int k = (int)expr->num_inputs;
+    expr->inputs[expr->num_inputs++] = tensor;
+    return _push_instr(expr, (FusedInstr){.op = FUSED_INPUT, .a = k});
+}
+
+int fused_scalar(FusedExpr *expr, double value) {
+    return _push_instr(expr,
+                       (FusedInstr){.op = FUSED_SCALAR, .value = value});
+}
+
+static int _fused_binary(FusedExpr *expr, FusedOpKind op, int a, int b) {
+    _check_value(expr, a);
+    _check_value(expr, b);
+
+    return _push_instr(expr, (FusedInstr){.op = op, .a = a, .b = b});
+}
+
+int fused_add(FusedExpr *expr, int a, int b) {
+    return _fused_binary(expr, FUSED_ADD, a, b);
+}
+
+int fused_sub(FusedExpr *expr, int a, int b) {
+    return _fused_binary(expr, FUSED_SUB, a, b);
+}
+
+int fused_mul(FusedExpr *expr, int a, int b) {
+    return _fused_binary(expr, FUSED_MUL, a, b);
+}
+
+int fused_div(FusedExpr *expr, int a, int b) {
+    return _fused_binary(expr, FUSED_DIV, a, b);
+}
+
+int fused_max(FusedExpr *expr, int a, int b) {
+    return _fused_binary(expr, FUSED_MAX, a, b);
+}
+
+int fused_min(FusedExpr *expr, int a, int b) {
+    return _fused_binary(expr, FUSED_MIN, a, b);
+}
+
+int fused_neg(FusedExpr *expr, int a) {
+    _check_value(expr, a);
+    return _push_instr(expr, (FusedInstr){.op = FUSED_NEG, .a = a});
+}
+
+static Tensor *_scalar_tensor(double value, DType dtype, Environment *env) {
+    ndArray *array = array_init(0, (const size_t[]){}, dtype);
+
+    ArrayVal val;
+    if (dtype == DTYPE_DOUBLE)
+        val.double_val = value;
+    else
+        val.float_val = (float)value;
+
+    set_value(array, NULL, val);
+    return tensor_init(array, NO_GRAD, env);
+}
+
+void fused_replay(const FusedInstr *instrs, int root, Tensor **inputs,
+                  DType dtype, Environment *env, Tensor **values) {
+    for (int i = 0; i <= root; i++) {
+        const FusedInstr *instr = &instrs[i];
+        Tensor *x = NULL, *y = NULL;
+        if (instr->op != FUSED_INPUT && instr->op != FUSED_SCALAR) {
+            x = values[instr->a];
+            y = (instr->op == FUSED_NEG) ? NULL : values[instr->b];
+        }
+
+        switch (instr->op) {
+        case FUSED_INPUT:
+            values[i] = inputs[instr->a];
+            break;
+        case FUSED_SCALAR:
+            values[i] = _scalar_tensor(instr->value, dtype, env);
+            break;
+        case FUSED_ADD:
+            values[i] = tensor_add(x, y);
+            break;
+        case FUSED_SUB:
+            values[i] = tensor_sub(x, y);
+            break;
+        case FUSED_MUL:
+            values[i] = tensor_mul(x, y);
+            break;
+        case FUSED_DIV:
+            values[i] = tensor_div(x, y);
+            break;
+        case FUSED_MAX:
+            values[i] = tensor_max(x, y);
+            break;
+        case FUSED_MIN:
+            values[i] = tensor_min(x, y);
+            break;
+        case FUSED_NEG:
+            values[i] = tensor_neg(x);
+            break;
+        }
+    }
+}
+
+// forward mode runs the ops one by one, each propagates its tangent
+static Tensor *_fused_eval_tangents(FusedExpr *expr, int root,
+                                    Environment *env) {
+    Tensor *values[root + 1];
+    fused_replay(expr->instrs, root, expr->inputs,
+                 get_tensor_dtype(expr->inputs[0]), env, values);
+
+    for (int i = 0; i < root; i++)
+        if (expr->instrs[i].op != FUSED_INPUT)
+            tensor_release(values[i]);
+
+    return values[root];
+}
+
+// folds resolve_environ over the inputs, locked (module) environments lose
+static Environment *_resolve_inputs_environ(Tensor **inputs,
+                                            size_t num_inputs) {
+    Tensor *owner = inputs[0];
+    for (size_t k = 1; k < num_inputs; k++)
+        if (resolve_environ(owner, inputs[k]) != get_tensor_environ(owner))
+            owner = inputs[k];
+
+    return get_tensor_environ(owner);
+}
+
+Tensor *fused_eval(FusedExpr *expr, int root) {
+    _check_value(expr, root);
+    if (is_capturing())
+        RUNTIME_ERROR(INVALID_CAPTURE_STATE,
+                      "fused_eval cannot be captured");
+
+    size_t num_inputs = expr->num_inputs;
+    if (num_inputs == 0)
+        RUNTIME_ERROR(INVALID_FUSED_EXPR, "Fused expression reads no tensor");
+
+    Environment *env = _resolve_inputs_environ(expr->inputs, num_inputs);
+
+    ndArray *datas[num_inputs];
+    bool requires_grad = false;
+    for (size_t k = 0; k < num_inputs; k++) {
+        if (get_tensor_tangent(expr->inputs[k]))
+            return _fused_eval_tangents(expr, root, env);
+
+        datas[k] = get_tensor_data(expr->inputs[k]);
+        requires_grad = requires_grad || get_requires_grad(expr->inputs[k]);
+    }
+    requires_grad = requires_grad && is_grad_enabled();
+
+    ndArray *data = array_fused_eval(expr->instrs, root, datas, num_inputs);
+    Tensor *tensor = tensor_init(data, requires_grad, env);
+
+    if (requires_grad) {
+        BackwardFn *backward_fn = FusedBackward((Tensor *[]){tensor},
+                                                expr->inputs, 1, num_inputs);
+
+        FusedCtx ctx = {.instrs = expr->instrs,
+                        .num_instrs = (size_t)root + 1};
+        set_ctx(backward_fn, &ctx, FUSED_CTX);
+        set_backward_fn(tensor, backward_fn);
+    }
+
+    return tensor;
+}
@@ -0,0 +1,107 @@
+#include "private/grad_chunks.h"
+#include "array.h"
+#include "error_codes.h"
+#include "nn.h"
+#include "tensor.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define _SQUARED_NORM_KERNEL(NAME, T)                                          \
+    static double NAME(const GradChunk *chunks, size_t num_chunks) {           \
+        double total = 0.0;                                                    \
+        _Pragma("omp parallel for reduction(+ : total) if (num_chunks > 1)")   \
+            for (size_t c = 0; c < num_chunks; c++) {                          \
+            const T *G = (const T *)chunks[c].data;                            \
+            double acc = 0.0;                                                  \
+            _Pragma("omp simd reduction(+ : acc)")                             \
+                for (size_t i = 0; i < chunks[c].len; i++)                     \
+                    acc += (double)G[i] * (double)G[i];                        \
+            total += acc;                                                      \
+        }                                                                      \
+        return total;                                                          \
+    }
+
+#define _SCALE_KERNEL(NAME, T)                                                 \
+    static void NAME(const GradChunk *chunks, size_t num_chunks,               \
+                     double scale) {                                           \
+        const T s = (T)scale;                                                  \
+        _Pragma("omp parallel for if (num_chunks > 1)")                        \
+            for (size_t c = 0; c < num_chunks; c++) {                          \
+            T *G = (T *)chunks[c].data;                                        \
+            _Pragma("omp simd") for (size_t i = 0; i < chunks[c].len; i++)     \
+                G[i] *= s;                                                     \
+        }                                                                      \
+    }
+
+#define _CLAMP_KERNEL(NAME, T)                                                 \
+    static void NAME(const GradChunk *chunks, size_t num_chunks,               \
+                     double bound) {                                           \
+        const T hi = (T)bound, lo = -(T)bound;                                 \
+        _Pragma("omp parallel for if (num_chunks > 1)")                        \
+            for (size_t c = 0; c < num_chunks; c++) {                          \
+            T *G = (T *)chunks[c].data;                                        \
+            _Pragma("omp simd") for (size_t i = 0; i < chunks[c].len; i++)     \
+                G[i] = G[i] > hi ? hi : (G[i] < lo ? lo : G[i]);               \
+        }                                                                      \
+    }
+
+_SQUARED_NORM_KERNEL(_squared_norm_F, float)
+_SQUARED_NORM_KERNEL(_squared_norm_D, double)
+_SCALE_KERNEL(_scale_F, float)
+_SCALE_KERNEL(_scale_D, double)
+_CLAMP_KERNEL(_clamp_F, float)
+_CLAMP_KERNEL(_clamp_D, double)
+
+static void _check_clip_dtype(DType dtype) {
+    if (dtype != DTYPE_FLOAT && dtype != DTYPE_DOUBLE)
+        RUNTIME_ERRORF(INVALID_DTYPE,
+                       "Clipped gradients must be DTYPE_FLOAT or DTYPE_DOUBLE, "
+                       "found `%s`",
+                       DTypeNames[dtype]);
+}
+
+double clip_grad_norm(Module *module, double max_norm) {
+    if (max_norm < 0)
+        RUNTIME_ERROR(INVALID_GRAD, "Invalid negative max_norm");
+
+    DType dtype = DTYPE_FLOAT;
+    GradChunk *chunks;
+    size_t num_chunks = grad_chunks(module, &dtype, NULL, &chunks);
+    _check_clip_dtype(dtype);
+
+    bool is_double = dtype == DTYPE_DOUBLE;
+    double norm = sqrt(is_double ? _squared_norm_D(chunks, num_chunks)
+                                 : _squared_norm_F(chunks, num_chunks));
+
+    if (norm > max_norm) {
+        double scale = max_norm / (norm + 1e-6);
+        if (is_double)
+            _scale_D(chunks, num_chunks, scale);
+        else
+            _scale_F(chunks, num_chunks, scale);
+    }
+
+    free(chunks);
+    return norm;
+}
+
+void clip_grad_value(Module *module, double clip_value) {
+    if (clip_value < 0)
+        RUNTIME_ERROR(INVALID_GRAD, "Invalid negative clip_value");
+
+    DType dtype = DTYPE_FLOAT;
+    GradChunk *chunks;
+    size_t num_chunks = grad_chunks(module, &dtype, NULL, &chunks);
+    _check_clip_dtype(dtype);
+
+    if (dtype == DTYPE_DOUBLE)
+        _clamp_D(chunks, num_chunks, clip_value);
+    else
+        _clamp_F(chunks, num_chunks, clip_value);
+
+    free(chunks);
+}
@@ -28,8 +28,14 @@ struct sequential {
 Tensor *_sequential_forward(void *module, Tensor *input) {
     Module *m = (Module *)module;
     Tensor *output = input;
-    for (size_t i = 0; i < m->num_modules; i++)
-        output = module_call(m->modules[i], output);
+    for (size_t i = 0; i < m->num_modules; i++) {
+        Tensor *hidden = output;
+        output = module_call(m->modules[i], hidden);
+
+        // intermediate activations are not visible to the caller
+        if (hidden != input && hidden != output)
+            tensor_release(hidden);
+    }
 
     return output;
 }
@@ -70,3 +76,38 @@ sequential *_Sequential(size_t num_modules, Module **modules) {
     set_lock(env);
     return layer;
 }
+
+struct checkpoint {
+    Module base;
+};
+
+Tensor *_checkpoint_forward(void *module, Tensor *input) {
+    Module *m = (Module *)module;
+    return _checkpoint(m->modules[0], input);
+}
+
+checkpoint *_Checkpoint(Module *module) {
+    checkpoint *layer = calloc(1, sizeof(checkpoint));
+    if (!layer)
+        RUNTIME_ERROR(MODULE_ALLOC_FAILURE,
+                      "Failed to allocate Checkpoint layer");
+
+    module_init(&layer->base);
+    layer->base.forward = _checkpoint_forward;
+    add_module(&layer->base, module);
+
+    size_t needed = strlen(module->repr) + 16;
+    char *tmp = malloc(needed);
+    if (!tmp)
+        RUNTIME_ERROR(
+            MODULE_ALLOC_FAILURE,
+            "Failed to allocate string representation for Checkpoint");
+
+    snprintf(tmp, needed, "Checkpoint(%s)", module->repr);
+    layer->base.repr = tmp;
+    layer->base.repr_dynamic = true;
+
+    Environment *env = get_environ(&layer->base);
+    set_lock(env);
+    return layer;
+}
@@ -0,0 +1,259 @@
+#include "array.h"
+#include "error_codes.h"
+#include "nn.h"
+#include "tensor.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define FLAT_ALIGNMENT 64
+
+struct FlatParameters {
+    void *params;
+    void *grads;
+    ndArray *params_view; // 1-d views over the slabs
+    ndArray *grads_view;
+};
+
+struct ModuleHeader {
+    char magic[8]; // "C-MODULE"
+    uint32_t dtype;
+    uint32_t num_params;
+    uint64_t total_elems;
+};
+
+// aligned_alloc needs a non-zero multiple of the alignment
+static void *_aligned_slab(size_t bytes) {
+    size_t padded = (bytes / FLAT_ALIGNMENT + 1) * FLAT_ALIGNMENT;
+    void *slab = aligned_alloc(FLAT_ALIGNMENT, padded);
+    if (!slab)
+        RUNTIME_ERROR(MODULE_ALLOC_FAILURE,
+                      "Failure to allocate flat parameter buffer");
+
+    return slab;
+}
+
+/*
+ * A contiguous view into `slab` at `offset` bytes in the shape and dtype of
+ * `like`, holding a copy of `src` cast to that dtype.
+ */
+static ndArray *_slab_view(char *slab, size_t offset, const ndArray *like,
+                           const ndArray *src) {
+    DType dtype = get_dtype(like);
+    ndArray *view = array_from_buffer(get_ndim(like), get_shape(like), dtype,
+                                      slab + offset);
+
+    ndArray *cast = get_dtype(src) != dtype ? array_cast(src, dtype) : NULL;
+    const ndArray *from = cast ? cast : src;
+    ndArray *aligned = array_align_layout(from, view);
+    array_cast_out(aligned ? aligned : from, view);
+    if (aligned)
+        free_array(aligned);
+    if (cast)
+        free_array(cast);
+
+    return view;
+}
+
+// a slab nested in another would leave stale views behind
+static bool _has_flat(const Module *module) {
+    if (module->flat)
+        return true;
+
+    for (size_t i = 0; i < module->num_modules; i++)
+        if (_has_flat(module->modules[i]))
+            return true;
+
+    return false;
+}
+
+void flatten_parameters(Module *module) {
+    if (_has_flat(module))
+        RUNTIME_ERROR(MODULE_ALLOC_FAILURE,
+                      "Module or one of its children is already flattened");
+
+    size_t num_params = num_parameters(module);
+    Tensor *params[num_params];
+    parameters(module, params);
+
+    DType dtype = num_params ? get_tensor_dtype(params[0]) : DTYPE_FLOAT;
+    size_t total = 0;
+    for (size_t i = 0; i < num_params; i++) {
+        ndArray *data = get_tensor_data(params[i]);
+        if (get_dtype(data) != dtype)
+            RUNTIME_ERRORF(INVALID_DTYPE,
+                           "Flat parameters must share a dtype, found `%s` "
+                           "and `%s`",
+                           DTypeNames[dtype], DTypeNames[get_dtype(data)]);
+        if (!is_array_contiguous(data))
+            RUNTIME_ERROR(INVALID_ARRAY,
+                          "Flat parameters must be contiguous");
+
+        total += get_total_size(data);
+    }
+
+    FlatParameters *flat = malloc(sizeof(FlatParameters));
+    if (!flat)
+        RUNTIME_ERROR(MODULE_ALLOC_FAILURE,
+                      "Failure to allocate flat parameters");
+
+    size_t itemsize =
+        num_params ? get_itemsize(get_tensor_data(params[0])) : 1;
+    flat->params = _aligned_slab(total * itemsize);
+    flat->grads = _aligned_slab(total * itemsize);
+    memset(flat->grads, 0, total * itemsize);
+
+    size_t offset = 0;
+    for (size_t i = 0; i < num_params; i++) {
+        Tensor *param = params[i];
+        ndArray *src = get_tensor_data(param);
+        replace_tensor_data(param,
+                            _slab_view(flat->params, offset, src, src));
+        ndArray *data = get_tensor_data(param);
+
+        // existing gradients carry over in the slab's dtype, others start at
+        // zero
+        Tensor *grad = get_tensor_grad(param);
+        if (grad) {
+            replace_tensor_data(grad, _slab_view(flat->grads, offset, data,
+                                                 get_tensor_data(grad)));
+        } else {
+            ndArray *view = array_from_buffer(get_ndim(data), get_shape(data),
+                                              dtype,
+                                              (char *)flat->grads + offset);
+            set_tensor_grad(param, tensor_init(view, NO_GRAD, NULL));
+        }
+
+        offset += get_total_size(data) * itemsize;
+    }
+
+    flat->params_view =
+        array_from_buffer(1, (const size_t[]){total}, dtype, flat->params);
+    flat->grads_view =
+        array_from_buffer(1, (const size_t[]){total}, dtype, flat->grads);
+    module->flat = flat;
+}
+
+void free_flat_parameters(FlatParameters *flat) {
+    if (!flat)
+        return;
+
+    free_array(flat->params_view);
+    free_array(flat->grads_view);
+    free(flat->params);
+    free(flat->grads);
+    free(flat);
+}
+
+bool is_flattened(const Module *module) { return module->flat != NULL; }
+
+ndArray *get_flat_parameters(const Module *module) {
+    return module->flat ? module->flat->params_view : NULL;
+}
+
+ndArray *get_flat_grads(const Module *module) {
+    return module->flat ? module->flat->grads_view : NULL;
+}
+
+static size_t _total_elems(Tensor **tensors, size_t num_tensors) {
+    size_t total = 0;
+    for (size_t i = 0; i < num_tensors; i++)
+        total += get_total_size(get_tensor_data(tensors[i]));
+
+    return total;
+}
+
+void save_module(Module *module, const char *path) {
+    FILE *file = fopen(path, "wb");
+    if (!file)
+        RUNTIME_ERRORF(FILE_WRITE_FAILURE,
+                       "Failure to open write binary file: %s", path);
+
+    size_t num_params = num_parameters(module), num_bufs = num_buffers(module);
+    Tensor *params[num_params], *bufs[num_bufs];
+    parameters(module, params);
+    buffers(module, bufs);
+
+    size_t total = _total_elems(params, num_params);
+    struct ModuleHeader header = {
+        .magic = "C-MODULE",
+        .dtype = num_params ? (uint32_t)get_tensor_dtype(params[0]) : 0,
+        .num_params = (uint32_t)(num_params + num_bufs),
+        .total_elems = (uint64_t)(total + _total_elems(bufs, num_bufs)),
+    };
+    fwrite(&header, sizeof(header), 1, file);
+
+    // a flat module is a single write
+    ndArray *flat = get_flat_parameters(module);
+    if (flat) {
+        fwrite(get_array_data(flat), get_itemsize(flat), total, file);
+    } else {
+        for (size_t i = 0; i < num_params; i++) {
+            ndArray *data = get_tensor_data(params[i]);
+            fwrite(get_array_data(data), get_itemsize(data),
+                   get_total_size(data), file);
+        }
+    }
+
+    // buffers follow the parameters, each in its own dtype
+    for (size_t i = 0; i < num_bufs; i++) {
+        ndArray *data = get_tensor_data(bufs[i]);
+        fwrite(get_array_data(data), get_itemsize(data), get_total_size(data),
+               file);
+    }
+
+    fclose(file);
+}
+
+void load_module(Module *module, const char *path) {
+    FILE *file = fopen(path, "rb");
+    if (!file)
+        RUNTIME_ERRORF(FILE_READ_FAILURE,
+                       "Failure to open read binary file: %s", path);
+
+    size_t num_params = num_parameters(module), num_bufs = num_buffers(module);
+    Tensor *params[num_params], *bufs[num_bufs];
+    parameters(module, params);
+    buffers(module, bufs);
+
+    struct ModuleHeader header;
+    if (fread(&header, sizeof(header), 1, file) != 1 ||
+        memcmp(header.magic, "C-MODULE", 8) != 0)
+        RUNTIME_ERROR(FILE_FORMAT_ERROR, "Invalid module file identifier");
+
+    size_t total = _total_elems(params, num_params);
+    if (header.num_params != num_params + num_bufs ||
+        header.total_elems != total + _total_elems(bufs, num_bufs) ||
+        (num_params && header.dtype != (uint32_t)get_tensor_dtype(params[0])))
+        RUNTIME_ERROR(FILE_FORMAT_ERROR,
+                      "Module file does not match the module's parameters");
+
+    bool complete = true;
+    ndArray *flat = get_flat_parameters(module);
+    if (flat) {
+        complete = fread(get_array_data(flat), get_itemsize(flat), total,
+                         file) == total;
+    } else {
+        for (size_t i = 0; complete && i < num_params; i++) {
+            ndArray *data = get_tensor_data(params[i]);
+            size_t n = get_total_size(data);
+            complete = fread(get_array_data(data), get_itemsize(data), n,
+                             file) == n;
+        }
+    }
+
+    for (size_t i = 0; complete && i < num_bufs; i++) {
+        ndArray *data = get_tensor_data(bufs[i]);
+        size_t n = get_total_size(data);
+        complete =
+            fread(get_array_data(data), get_itemsize(data), n, file) == n;
+    }
+
+    fclose(file);
+    if (!complete)
+        RUNTIME_ERROR(FILE_READ_FAILURE, "Truncated module file");
+}
@@ -1,3 +1,4 @@
+#include "autograd.h"
 #include "nn.h"
 #include "tensor.h"
 
@@ -5,15 +6,119 @@
 
 Tensor *_linear(Tensor *input, Tensor *weight, Tensor *bias) {
     Tensor *output = tensor_matmul(input, weight);
-    if (bias)
-        output = tensor_add(output, bias);
+    if (bias) {
+        Tensor *product = output;
+        output = tensor_add(product, bias);
+        tensor_release(product);
+    }
 
     return output;
 }
 
-Tensor *_relu(Tensor *input) {
-    bool requires_grad = get_requires_grad(input);
-    Environment *env = get_tensor_environ(input);
+Tensor *_relu(Tensor *input) { return tensor_relu(input); }
 
-    return tensor_max(zeros_like(input, requires_grad, env), input);
+Tensor *_leaky_relu(Tensor *input, double negative_slope) {
+    return tensor_leaky_relu(input, negative_slope);
+}
+
+Tensor *_relu6(Tensor *input) { return tensor_relu6(input); }
+
+Tensor *_gelu(Tensor *input) { return tensor_gelu(input); }
+Tensor *_silu(Tensor *input) { return tensor_silu(input); }
+Tensor *_tanh(Tensor *input) { return tensor_tanh(input); }
+Tensor *_sigmoid(Tensor *input) { return tensor_sigmoid(input); }
+
+Tensor *_softmax(Tensor *input, int dim) { return tensor_softmax(input, dim); }
+
+Tensor *_log_softmax(Tensor *input, int dim) {
+    return tensor_log_softmax(input, dim);
+}
+
+Tensor *_conv(Tensor *input, Tensor *weight, Tensor *bias,
+              const ConvParams *params) {
+    return tensor_conv(input, weight, bias, params);
+}
+
+Tensor *_pool(Tensor *input, const PoolParams *params) {
+    return tensor_pool(input, params);
+}
+
+Tensor *_norm(Tensor *input, Tensor *weight, Tensor *bias,
+              Tensor *running_mean, Tensor *running_var,
+              const NormParams *params) {
+    return tensor_norm(input, weight, bias, running_mean, running_var, params);
+}
+
+Tensor *_nll_loss(Tensor *input, Tensor *target, Reduction reduction) {
+    return tensor_nll_loss(input, target, reduction);
+}
+
+Tensor *_cross_entropy(Tensor *input, Tensor *target, Reduction reduction) {
+    return tensor_cross_entropy(input, target, reduction);
+}
+
+Tensor *_mse_loss(Tensor *input, Tensor *target, Reduction reduction) {
+    return tensor_mse_loss(input, target, reduction);
+}
+
+Tensor *_bce_with_logits(Tensor *input, Tensor *target, Reduction reduction) {
+    return tensor_bce_with_logits(input, target, reduction);
+}
+
+Tensor *loss_call(const Loss *loss, Tensor *input, Tensor *target) {
+    return loss->forward(input, target, loss->reduction);
+}
+
+// the parameters a segment's backward hands gradients to
+static size_t _trainable_params(Module *module, Tensor **trainable) {
+    size_t num_params = num_parameters(module), num_trainable = 0;
+    Tensor *params[num_params + 1];
+    parameters(module, params);
+
+    for (size_t i = 0; i < num_params; i++)
+        if (get_requires_grad(params[i]))
+            trainable[num_trainable++] = params[i];
+
+    return num_trainable;
+}
+
+Tensor *_checkpoint(Module *module, Tensor *input) {
+    if (!is_grad_enabled())
+        return module_call(module, input);
+
+    // inference mode frees the segment's activations as it goes
+    ctorch_inference_mode_enter();
+    Tensor *output = module_call(module, input);
+    ctorch_inference_mode_exit();
+
+    if (output == input)
+        return output;
+
+    // the segment's forward ran every op, tangents included, and its output
+    // is caller-owned, so it is adopted as is
+    set_tensor_environ(output, get_tensor_environ(input));
+
+    Tensor *params[num_parameters(module) + 1];
+    size_t num_params = _trainable_params(module, params);
+    bool requires_grad = get_requires_grad(input) || num_params > 0;
+    set_requires_grad(output, requires_grad);
+
+    // parameters are outputs of the node, their AccumulateGrad runs in the
+    // outer pass like for any other op
+    if (requires_grad) {
+        Tensor *op_tensors[num_params + 1];
+        op_tensors[0] = input;
+        for (size_t i = 0; i < num_params; i++)
+            op_tensors[i + 1] = params[i];
+
+        BackwardFn *backward_fn = CheckpointBackward(
+            (Tensor *[]){output}, op_tensors, 1, num_params + 1);
+
+        CheckpointCtx ctx = {.forward = get_callable(module),
+                             .module = module};
+        set_ctx(backward_fn, &ctx, CHECKPOINT_CTX);
+        set_backward_fn(output, backward_fn);
+    }
+
+    return output;
 }
@@ -1,4 +1,5 @@
 #include "array.h"
+#include "autograd.h"
 #include "error_codes.h"
 #include "nn.h"
 #include "random.h"
@@ -68,3 +69,374 @@ relu *_ReLU() {
     set_lock(env);
     return layer;
 }
+
+struct leaky_relu {
+    Module base;
+    double negative_slope;
+};
+
+Tensor *leaky_relu_forward(void *module, Tensor *input) {
+    leaky_relu *m = (leaky_relu *)module;
+    return _leaky_relu(input, m->negative_slope);
+}
+
+leaky_relu *_LeakyReLU(double negative_slope) {
+    leaky_relu *layer = calloc(1, sizeof(leaky_relu));
+    if (!layer)
+        RUNTIME_ERROR(MODULE_ALLOC_FAILURE,
+                      "Failed to allocate LeakyReLU layer");
+
+    module_init(&layer->base);
+    layer->base.forward = leaky_relu_forward;
+    layer->negative_slope = negative_slope;
+
+    char tmp[64];
+    snprintf(tmp, 64, "LeakyReLU(negative_slope=%g)", negative_slope);
+    layer->base.repr = strdup(tmp);
+    layer->base.repr_dynamic = true;
+
+    Environment *env = get_environ(&layer->base);
+    set_lock(env);
+    return layer;
+}
+
+struct relu6 {
+    Module base;
+};
+
+Tensor *relu6_forward(void *module, Tensor *input) { return _relu6(input); }
+
+relu6 *_ReLU6() {
+    relu6 *layer = calloc(1, sizeof(relu6));
+    if (!layer)
+        RUNTIME_ERROR(MODULE_ALLOC_FAILURE, "Failed to allocate ReLU6 layer");
+
+    module_init(&layer->base);
+    layer->base.forward = relu6_forward;
+    layer->base.repr = "ReLU6()";
+
+    Environment *env = get_environ(&layer->base);
+    set_lock(env);
+    return layer;
+}
+
+#define _DEFINE_ACTIVATION_MODULE(TYPE, NAME, FN)                              \
+    struct TYPE {                                                              \
+        Module base;                                                           \
+    };                                                                         \
+                                                                               \
+    Tensor *TYPE##_forward(void *module, Tensor *input) { return FN(input); }  \
+                                                                               \
+    TYPE *_##NAME() {                                                          \
+        TYPE *layer = calloc(1, sizeof(TYPE));                                 \
+        if (!layer)                                                            \
+            RUNTIME_ERROR(MODULE_ALLOC_FAILURE,                                \
+                          "Failed to allocate " #NAME " layer");               \
+                                                                               \
+        module_init(&layer->base);                                             \
+        layer->base.forward = TYPE##_forward;                                  \
+        layer->base.repr = #NAME "()";                                         \
+                                                                               \
+        set_lock(get_environ(&layer->base));                                   \
+        return layer;                                                          \
+    }
+
+_DEFINE_ACTIVATION_MODULE(gelu, GELU, _gelu)
+_DEFINE_ACTIVATION_MODULE(silu, SiLU, _silu)
+_DEFINE_ACTIVATION_MODULE(tanh_layer, Tanh, _tanh)
+_DEFINE_ACTIVATION_MODULE(sigmoid, Sigmoid, _sigmoid)
+
+struct softmax {
+    Module base;
+    int dim;
+    bool log_space;
+};
+
+Tensor *softmax_forward(void *module, Tensor *input) {
+    softmax *m = (softmax *)module;
+    return m->log_space ? _log_softmax(input, m->dim)
+                        : _softmax(input, m->dim);
+}
+
+softmax *_Softmax(int dim, bool log_space) {
+    softmax *layer = calloc(1, sizeof(softmax));
+    if (!layer)
+        RUNTIME_ERROR(MODULE_ALLOC_FAILURE, "Failed to allocate Softmax layer");
+
+    module_init(&layer->base);
+    layer->base.forward = softmax_forward;
+    layer->dim = dim;
+    layer->log_space = log_space;
+
+    char tmp[64];
+    snprintf(tmp, 64, "%s(dim=%d)", log_space ? "LogSoftmax" : "Softmax",
+             dim);
+    layer->base.repr = strdup(tmp);
+    layer->base.repr_dynamic = true;
+
+    Environment *env = get_environ(&layer->base);
+    set_lock(env);
+    return layer;
+}
+
+struct conv {
+    Module base;
+    Tensor *weight;
+    Tensor *bias;
+    ConvParams params;
+};
+
+Tensor *conv_forward(void *module, Tensor *input) {
+    conv *m = (conv *)module;
+    return _conv(input, m->weight, m->bias, &m->params);
+}
+
+conv *_Conv(int ndim, size_t in_channels, size_t out_channels,
+            size_t kernel_size, size_t stride, size_t padding,
+            size_t dilation, size_t groups, bool bias) {
+    if (ndim != 1 && ndim != 2)
+        RUNTIME_ERRORF(MODULE_ALLOC_FAILURE,
+                       "Convolutions have 1 or 2 spatial dims, got %d", ndim);
+    if (groups == 0 || in_channels % groups || out_channels % groups)
+        RUNTIME_ERRORF(MODULE_ALLOC_FAILURE,
+                       "Channels (%zu in, %zu out) are not divisible by "
+                       "%zu groups",
+                       in_channels, out_channels, groups);
+
+    conv *layer = calloc(1, sizeof(conv));
+    if (!layer)
+        RUNTIME_ERROR(MODULE_ALLOC_FAILURE, "Failed to allocate Conv layer");
+
+    module_init(&layer->base);
+    Environment *env = get_environ(&layer->base);
+
+    layer->base.forward = conv_forward;
+    layer->params = (ConvParams){
+        .ndim = ndim,
+        .stride = {stride, stride},
+        .padding = {padding, padding},
+        .dilation = {dilation, dilation},
+        .groups = groups,
+    };
+
+    char tmp[192];
+    snprintf(tmp, 192,
+             "Conv%dd(%zu, %zu, kernel_size=%zu, stride=%zu, padding=%zu, "
+             "dilation=%zu, groups=%zu, bias=%s)",
+             ndim, in_channels, out_channels, kernel_size, stride, padding,
+             dilation, groups, bias ? "True" : "False");
+    layer->base.repr = strdup(tmp);
+    layer->base.repr_dynamic = true;
+
+    size_t fan_in = in_channels / groups * kernel_size;
+    if (ndim == 2)
+        fan_in *= kernel_size;
+
+    float bound = 1 / sqrtf((float)fan_in);
+    const size_t shape[] = {out_channels, in_channels / groups, kernel_size,
+                            kernel_size};
+    layer->weight =
+        uniform(ndim + 2, shape, bound, DTYPE_FLOAT, true, env);
+    if (bias)
+        layer->bias =
+            uniform(SHAPE(out_channels), bound, DTYPE_FLOAT, true, env);
+
+    set_lock(env);
+    return layer;
+}
+
+struct pool {
+    Module base;
+    PoolParams params;
+};
+
+Tensor *pool_forward(void *module, Tensor *input) {
+    pool *m = (pool *)module;
+    return _pool(input, &m->params);
+}
+
+static pool *_pool_layer(const PoolParams *params, const char *repr) {
+    if (params->ndim != 1 && params->ndim != 2)
+        RUNTIME_ERRORF(MODULE_ALLOC_FAILURE,
+                       "Pooling has 1 or 2 spatial dims, got %d",
+                       params->ndim);
+
+    pool *layer = calloc(1, sizeof(pool));
+    if (!layer)
+        RUNTIME_ERROR(MODULE_ALLOC_FAILURE, "Failed to allocate Pool layer");
+
+    module_init(&layer->base);
+    layer->base.forward = pool_forward;
+    layer->params = *params;
+    layer->base.repr = strdup(repr);
+    layer->base.repr_dynamic = true;
+
+    set_lock(get_environ(&layer->base));
+    return layer;
+}
+
+pool *_Pool(PoolKind kind, int ndim, size_t kernel_size, size_t stride,
+            size_t padding) {
+    if (kind == POOL_ADAPTIVE_AVG)
+        RUNTIME_ERROR(MODULE_ALLOC_FAILURE,
+                      "Adaptive pooling takes output sizes, see "
+                      "`_AdaptiveAvgPool`");
+
+    PoolParams params = {
+        .kind = kind,
+        .ndim = ndim,
+        .kernel_size = {kernel_size, kernel_size},
+        .stride = {stride, stride},
+        .padding = {padding, padding},
+    };
+
+    char tmp[128];
+    snprintf(tmp, 128, "%sPool%dd(kernel_size=%zu, stride=%zu, padding=%zu)",
+             kind == POOL_MAX ? "Max" : "Avg", ndim, kernel_size, stride,
+             padding);
+    return _pool_layer(&params, tmp);
+}
+
+pool *_AdaptiveAvgPool(int ndim, const size_t *output_size) {
+    PoolParams params = {.kind = POOL_ADAPTIVE_AVG, .ndim = ndim};
+    for (int d = 0; d < ndim && d < 2; d++)
+        params.output_size[d] = output_size[d];
+
+    char tmp[128];
+    if (ndim == 2)
+        snprintf(tmp, 128, "AdaptiveAvgPool2d(output_size=(%zu, %zu))",
+                 output_size[0], output_size[1]);
+    else
+        snprintf(tmp, 128, "AdaptiveAvgPool%dd(output_size=%zu)", ndim,
+                 output_size[0]);
+    return _pool_layer(&params, tmp);
+}
+
+struct norm {
+    Module base;
+    Tensor *weight;
+    Tensor *bias;
+    Tensor *running_mean;
+    Tensor *running_var;
+    NormParams params;
+    int spatial_ndim; // batch norms
+};
+
+Tensor *norm_forward(void *module, Tensor *input) {
+    norm *m = (norm *)module;
+    NormParams params = m->params;
+
+    if (params.kind == NORM_BATCH) {
+        int ndim = get_tensor_ndim(input);
+        bool valid = m->spatial_ndim == 1 ? ndim == 2 || ndim == 3 : ndim == 4;
+        if (!valid)
+            RUNTIME_ERRORF(SHAPE_MISMATCH,
+                           "BatchNorm%dd expects a %s input, got %d-d",
+                           m->spatial_ndim,
+                           m->spatial_ndim == 1 ? "2-d or 3-d" : "4-d", ndim);
+        params.training = m->base.training;
+    }
+
+    // a checkpoint's recompute must not update the running statistics again
+    if (params.training && is_recomputing())
+        return _norm(input, m->weight, m->bias, NULL, NULL, &params);
+
+    return _norm(input, m->weight, m->bias, m->running_mean, m->running_var,
+                 &params);
+}
+
+static norm *_norm_layer(const NormParams *params, const char *repr) {
+    norm *layer = calloc(1, sizeof(norm));
+    if (!layer)
+        RUNTIME_ERROR(MODULE_ALLOC_FAILURE, "Failed to allocate Norm layer");
+
+    module_init(&layer->base);
+    layer->base.forward = norm_forward;
+    layer->params = *params;
+
+    layer->base.repr = strdup(repr);
+    layer->base.repr_dynamic = true;
+    return layer;
+}
+
+// weight starts at one and bias at zero, RMS norm has no bias
+static norm *_trailing_norm(NormKind kind, int ndim,
+                            const size_t *normalized_shape, double eps,
+                            bool elementwise_affine) {
+    const char *name = kind == NORM_RMS ? "RMSNorm" : "LayerNorm";
+    if (ndim < 1)
+        RUNTIME_ERRORF(MODULE_ALLOC_FAILURE,
+                       "%s needs a normalized shape, got %d dims", name, ndim);
+
+    char shape[96] = "(";
+    for (int d = 0; d < ndim; d++) {
+        size_t len = strlen(shape);
+        snprintf(shape + len, sizeof(shape) - len, "%zu%s",
+                 normalized_shape[d], d + 1 < ndim ? ", " : ")");
+    }
+
+    char tmp[192];
+    snprintf(tmp, 192, "%s(%s, eps=%g, elementwise_affine=%s)", name, shape,
+             eps, elementwise_affine ? "True" : "False");
+
+    NormParams params = {.kind = kind, .normalized_ndim = ndim, .eps = eps};
+    norm *layer = _norm_layer(&params, tmp);
+
+    Environment *env = get_environ(&layer->base);
+    if (elementwise_affine) {
+        layer->weight =
+            ones_tensor(ndim, normalized_shape, DTYPE_FLOAT, true, env);
+        if (kind == NORM_LAYER)
+            layer->bias =
+                zeros_tensor(ndim, normalized_shape, DTYPE_FLOAT, true, env);
+    }
+
+    set_lock(env);
+    return layer;
+}
+
+norm *_LayerNorm(int ndim, const size_t *normalized_shape, double eps,
+                 bool elementwise_affine) {
+    return _trailing_norm(NORM_LAYER, ndim, normalized_shape, eps,
+                          elementwise_affine);
+}
+
+norm *_RMSNorm(int ndim, const size_t *normalized_shape, double eps,
+               bool elementwise_affine) {
+    return _trailing_norm(NORM_RMS, ndim, normalized_shape, eps,
+                          elementwise_affine);
+}
+
+norm *_BatchNorm(int ndim, size_t num_features, double eps, double momentum,
+                 bool affine) {
+    if (ndim != 1 && ndim != 2)
+        RUNTIME_ERRORF(MODULE_ALLOC_FAILURE,
+                       "Batch norms have 1 or 2 spatial dims, got %d", ndim);
+
+    char tmp[128];
+    snprintf(tmp, 128, "BatchNorm%dd(%zu, eps=%g, momentum=%g, affine=%s)",
+             ndim, num_features, eps, momentum, affine ? "True" : "False");
+
+    NormParams params = {.kind = NORM_BATCH,
+                         .eps = eps,
+                         .momentum = momentum,
+                         .training = true};
+    norm *layer = _norm_layer(&params, tmp);
+    layer->spatial_ndim = ndim;
+
+    Environment *env = get_environ(&layer->base);
+    if (affine) {
+        layer->weight =
+            ones_tensor(SHAPE(num_features), DTYPE_FLOAT, true, env);
+        layer->bias = zeros_tensor(SHAPE(num_features), DTYPE_FLOAT, true, env);
+    }
+    Environment *buffers = get_buffers_environ(&layer->base);
+    layer->running_mean =
+        zeros_tensor(SHAPE(num_features), DTYPE_FLOAT, NO_GRAD, buffers);
+    layer->running_var =
+        ones_tensor(SHAPE(num_features), DTYPE_FLOAT, NO_GRAD, buffers);
+
+    set_lock(env);
+    set_lock(buffers);
+    return layer;
+}
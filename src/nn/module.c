@@ -1,3 +1,4 @@
+#include "private/grad_chunks.h"
 #include "array.h"
 #include "error_codes.h"
 #include "nn.h"
@@ -8,6 +9,7 @@
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 Tensor *Parameter(int ndim, const size_t *shape, float bound,
                   Environment *env) {
@@ -32,13 +34,53 @@ void unfreeze(Module *module) {
         set_requires_grad(params[i], true);
 }
 
+void set_training(Module *module, bool training) {
+    module->training = training;
+    for (size_t i = 0; i < module->num_modules; i++)
+        set_training(module->modules[i], training);
+}
+
+bool is_training(const Module *module) { return module->training; }
+
+void module_zero_grad(Module *module, bool set_to_none) {
+    size_t num_params = num_parameters(module), num_strided;
+    if (set_to_none) {
+        Tensor *params[num_params];
+        parameters(module, params);
+
+        for (size_t i = 0; i < num_params; i++) {
+            Tensor *grad = get_tensor_grad(params[i]);
+            if (grad && !is_array_view(get_tensor_data(grad)))
+                set_tensor_grad(params[i], NULL);
+        }
+    }
+
+    // mixed dtypes are zeroed byte-wise, strided grads one by one
+    Tensor *strided[num_params + 1];
+    GradChunk *chunks;
+    size_t num_chunks =
+        grad_byte_chunks(module, &chunks, strided, &num_strided);
+
+    _Pragma("omp parallel for if (num_chunks > 1)")
+    for (size_t c = 0; c < num_chunks; c++)
+        memset(chunks[c].data, 0, chunks[c].len);
+
+    for (size_t i = 0; i < num_strided; i++)
+        zero_grad(strided[i]);
+
+    free(chunks);
+}
+
 void module_init(Module *module) {
     module->modules = NULL;
     module->num_modules = 0;
     module->env = env_init();
+    module->buffers = env_init();
     module->forward = NULL;
 
     module->repr = NULL;
+    module->flat = NULL;
+    module->training = true;
 }
 
 void add_module(Module *base, Module *child) {
@@ -84,6 +126,29 @@ void parameters(Module *module, Tensor **out) {
     _parameters(module, out, &idx);
 }
 
+size_t num_buffers(Module *module) {
+    size_t count = get_num_tensors(module->buffers);
+    for (size_t i = 0; i < module->num_modules; i++)
+        count += num_buffers(module->modules[i]);
+
+    return count;
+}
+
+static void _buffers(Module *module, Tensor **out, size_t *count) {
+    size_t num_tensors = get_num_tensors(module->buffers);
+    Tensor **env_tensors = get_tensors(module->buffers);
+    for (size_t i = 0; i < num_tensors; i++)
+        out[(*count)++] = env_tensors[i];
+
+    for (size_t i = 0; i < module->num_modules; i++)
+        _buffers(module->modules[i], out, count);
+}
+
+void buffers(Module *module, Tensor **out) {
+    size_t idx = 0;
+    _buffers(module, out, &idx);
+}
+
 size_t num_trainable_variables(Module *module) {
     size_t num_params = num_parameters(module);
     Tensor *params[num_params];
@@ -115,10 +180,19 @@ size_t num_non_trainable_variables(Module *module) {
         num_non_trainable_vars += get_total_size(get_tensor_data(param));
     }
 
+    size_t num_bufs = num_buffers(module);
+    Tensor *bufs[num_bufs];
+    buffers(module, bufs);
+    for (size_t i = 0; i < num_bufs; i++)
+        num_non_trainable_vars += get_total_size(get_tensor_data(bufs[i]));
+
     return num_non_trainable_vars;
 }
 
 Environment *get_environ(const Module *module) { return module->env; }
+Environment *get_buffers_environ(const Module *module) {
+    return module->buffers;
+}
 CallableModule get_callable(const Module *module) { return module->forward; }
 
 void free_module(Module *module) {
@@ -129,6 +203,8 @@ void free_module(Module *module) {
         free(module->modules);
 
     free_env(module->env);
+    free_env(module->buffers);
+    free_flat_parameters(module->flat);
     if (module->repr && module->repr_dynamic)
         free((void *)module->repr);
     free(module);
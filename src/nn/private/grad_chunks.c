@@ -0,0 +1,113 @@
+#include "grad_chunks.h"
+#include "array.h"
+#include "error_codes.h"
+#include "nn.h"
+#include "tensor.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// cuts `spans` of `unit`-sized items into chunks of at most `chunk_len`
+static size_t _split_spans(const GradChunk *spans, size_t num_spans,
+                           size_t unit, size_t chunk_len, GradChunk **out) {
+    size_t num_chunks = 0;
+    for (size_t s = 0; s < num_spans; s++)
+        num_chunks += (spans[s].len + chunk_len - 1) / chunk_len;
+
+    GradChunk *chunks = malloc((num_chunks + 1) * sizeof(GradChunk));
+    if (!chunks)
+        RUNTIME_ERROR(INVALID_GRAD, "Failure to allocate gradient chunks");
+
+    size_t c = 0;
+    for (size_t s = 0; s < num_spans; s++) {
+        size_t len = spans[s].len;
+        for (size_t start = 0; start < len; start += chunk_len) {
+            size_t rest = len - start;
+            chunks[c++] = (GradChunk){
+                .data = spans[s].data + start * unit,
+                .len = rest < chunk_len ? rest : chunk_len,
+            };
+        }
+    }
+
+    *out = chunks;
+    return num_chunks;
+}
+
+// extends the last span when `start` directly follows it in memory
+static void _append_span(GradChunk *spans, size_t *num_spans, char *start,
+                         size_t len, size_t unit) {
+    GradChunk *last = *num_spans ? &spans[*num_spans - 1] : NULL;
+    if (last && last->data + last->len * unit == start)
+        last->len += len;
+    else
+        spans[(*num_spans)++] = (GradChunk){.data = start, .len = len};
+}
+
+size_t grad_chunks(Module *module, DType *dtype, size_t *itemsize,
+                   GradChunk **out) {
+    size_t num_params = num_parameters(module);
+    Tensor *params[num_params];
+    parameters(module, params);
+
+    GradChunk spans[num_params + 1];
+    size_t num_spans = 0, size = 0;
+    bool first = true;
+    for (size_t i = 0; i < num_params; i++) {
+        Tensor *grad = get_tensor_grad(params[i]);
+        if (!grad)
+            continue;
+
+        ndArray *data = get_tensor_data(grad);
+        if (first) {
+            *dtype = get_dtype(data);
+            size = get_itemsize(data);
+            first = false;
+        }
+
+        if (get_dtype(data) != *dtype)
+            RUNTIME_ERRORF(INVALID_DTYPE,
+                           "Module gradients must share a dtype, found `%s` "
+                           "and `%s`",
+                           DTypeNames[*dtype], DTypeNames[get_dtype(data)]);
+        if (!is_array_contiguous(data))
+            RUNTIME_ERROR(INVALID_GRAD, "Module gradients must be contiguous");
+
+        _append_span(spans, &num_spans, get_array_data(data),
+                     get_total_size(data), size);
+    }
+
+    if (itemsize)
+        *itemsize = size;
+    return _split_spans(spans, num_spans, size, GRAD_CHUNK_SIZE, out);
+}
+
+size_t grad_byte_chunks(Module *module, GradChunk **out, Tensor **strided,
+                        size_t *num_strided) {
+    size_t num_params = num_parameters(module);
+    Tensor *params[num_params];
+    parameters(module, params);
+
+    GradChunk spans[num_params + 1];
+    size_t num_spans = 0;
+    *num_strided = 0;
+    for (size_t i = 0; i < num_params; i++) {
+        Tensor *grad = get_tensor_grad(params[i]);
+        if (!grad)
+            continue;
+
+        ndArray *data = get_tensor_data(grad);
+        if (!is_array_contiguous(data)) {
+            strided[(*num_strided)++] = params[i];
+            continue;
+        }
+
+        _append_span(spans, &num_spans, get_array_data(data),
+                     get_total_size(data) * get_itemsize(data), 1);
+    }
+
+    return _split_spans(spans, num_spans, 1, GRAD_CHUNK_SIZE * sizeof(float),
+                        out);
+}
@@ -0,0 +1,38 @@
+#ifndef GRAD_CHUNKS_H
+#define GRAD_CHUNKS_H
+
+#include "array.h"
+#include "nn.h"
+#include "tensor.h"
+
+#include <stddef.h>
+
+// elements per work item of whole-module gradient passes
+#define GRAD_CHUNK_SIZE (1 << 14)
+
+// a run of gradient elements contiguous in memory
+typedef struct GradChunk {
+    char *data;
+    size_t len;
+} GradChunk;
+
+/*
+ * Splits the gradients of `module`, which must share a dtype, into chunks
+ * for a parallel loop. Neighbours in memory are merged first, so a
+ * flattened module's gradient slab is cut evenly regardless of parameter
+ * boundaries. `*out` is malloc'd, the number of chunks is returned and
+ * `itemsize` may be NULL.
+ */
+size_t grad_chunks(Module *module, DType *dtype, size_t *itemsize,
+                   GradChunk **out);
+
+/*
+ * The same split for passes that only touch bytes: gradients of any dtype
+ * are merged and `len` counts bytes, GRAD_CHUNK_SIZE floats' worth per
+ * chunk. Params whose gradient is not contiguous are left out and written
+ * to `strided`, sized for every parameter, their count to `num_strided`.
+ */
+size_t grad_byte_chunks(Module *module, GradChunk **out, Tensor **strided,
+                        size_t *num_strided);
+
+#endif // !GRAD_CHUNKS_H
@@ -0,0 +1,379 @@
+#include "optim.h"
+#include "array.h"
+#include "error_codes.h"
+#include "nn.h"
+#include "tensor.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// elements per work item, small parameters make a single chunk
+#define OPTIM_CHUNK_SIZE (1 << 14)
+
+typedef enum OptimKind {
+    OPTIM_SGD,
+    OPTIM_ADAM,
+} OptimKind;
+
+// the per-parameter scalars of one step
+typedef struct StepArgs {
+    double lr;
+    double weight_decay;
+
+    double momentum;
+    double dampening;
+    bool nesterov;
+    bool first; // the momentum buffer starts at the gradient
+
+    double beta1;
+    double beta2;
+    double eps;
+    double step_size;       // lr / (1 - beta1^t)
+    double bias_corr2_sqrt; // sqrt(1 - beta2^t)
+    double decay;           // 1 - lr * weight_decay for AdamW, else 1
+    bool decoupled;
+} StepArgs;
+
+typedef struct OptimChunk {
+    size_t param;
+    size_t start;
+    size_t len;
+} OptimChunk;
+
+struct Optimizer {
+    OptimKind kind;
+    DType dtype;
+
+    Tensor **params;
+    size_t num_params;
+    size_t *offsets; // of each parameter in the state buffers, in elements
+    size_t *steps;
+    size_t total;
+
+    void *state[2]; // momentum / first moment, second moment, NULL if unused
+
+    double lr;
+    double weight_decay;
+    double momentum;
+    double dampening;
+    bool nesterov;
+    double beta1;
+    double beta2;
+    double eps;
+    bool decoupled;
+};
+
+#define _SGD_KERNEL(NAME, T)                                                   \
+    static void NAME(void *param, const void *grad, void *state0,              \
+                     void *state1, size_t n, const StepArgs *args) {           \
+        (void)state1;                                                          \
+        T *restrict P = param, *restrict B = state0;                           \
+        const T *restrict G = grad;                                            \
+        const T lr = args->lr, wd = args->weight_decay, mu = args->momentum,   \
+                damp = 1 - args->dampening;                                    \
+        bool first = args->first, nesterov = args->nesterov;                   \
+                                                                               \
+        if (!B) {                                                              \
+            _Pragma("omp simd") for (size_t i = 0; i < n; i++)                 \
+                P[i] -= lr * (G[i] + wd * P[i]);                               \
+            return;                                                            \
+        }                                                                      \
+        _Pragma("omp simd") for (size_t i = 0; i < n; i++) {                   \
+            T g = G[i] + wd * P[i];                                            \
+            T b = first ? g : mu * B[i] + damp * g;                            \
+            B[i] = b;                                                          \
+            P[i] -= lr * (nesterov ? g + mu * b : b);                          \
+        }                                                                      \
+    }
+
+#define _ADAM_KERNEL(NAME, T, SQRT)                                            \
+    static void NAME(void *param, const void *grad, void *state0,              \
+                     void *state1, size_t n, const StepArgs *args) {           \
+        T *restrict P = param, *restrict M = state0, *restrict V = state1;     \
+        const T *restrict G = grad;                                            \
+        const T b1 = args->beta1, b2 = args->beta2, eps = args->eps,           \
+                step_size = args->step_size,                                   \
+                inv_corr2 = 1 / args->bias_corr2_sqrt, decay = args->decay,    \
+                wd = args->decoupled ? 0 : args->weight_decay;                 \
+                                                                               \
+        _Pragma("omp simd") for (size_t i = 0; i < n; i++) {                   \
+            T g = G[i] + wd * P[i];                                            \
+            T m = b1 * M[i] + (1 - b1) * g;                                    \
+            T v = b2 * V[i] + (1 - b2) * g * g;                                \
+            M[i] = m;                                                          \
+            V[i] = v;                                                          \
+            P[i] = decay * P[i] - step_size * m / (SQRT(v) * inv_corr2 + eps); \
+        }                                                                      \
+    }
+
+_SGD_KERNEL(_sgd_F, float)
+_SGD_KERNEL(_sgd_D, double)
+_ADAM_KERNEL(_adam_F, float, sqrtf)
+_ADAM_KERNEL(_adam_D, double, sqrt)
+
+typedef void (*OptimKernel)(void *param, const void *grad, void *state0,
+                            void *state1, size_t n, const StepArgs *args);
+
+static const OptimKernel optim_kernels[2][6] = {
+    [OPTIM_SGD] = {[DTYPE_FLOAT] = _sgd_F, [DTYPE_DOUBLE] = _sgd_D},
+    [OPTIM_ADAM] = {[DTYPE_FLOAT] = _adam_F, [DTYPE_DOUBLE] = _adam_D},
+};
+
+static Optimizer *_optim_init(Module *module, OptimKind kind, double lr,
+                              size_t num_states) {
+    if (lr < 0)
+        RUNTIME_ERROR(OPTIM_INIT_FAILURE, "Invalid negative learning rate");
+
+    size_t num_candidates = num_parameters(module);
+    Tensor *candidates[num_candidates];
+    parameters(module, candidates);
+
+    Optimizer *optim = calloc(1, sizeof(Optimizer));
+    if (!optim)
+        RUNTIME_ERROR(OPTIM_INIT_FAILURE, "Failure to allocate optimizer");
+
+    optim->params = malloc((num_candidates + 1) * sizeof(Tensor *));
+    optim->offsets = malloc((num_candidates + 1) * sizeof(size_t));
+    if (!optim->params || !optim->offsets)
+        RUNTIME_ERROR(OPTIM_INIT_FAILURE, "Failure to allocate optimizer");
+
+    optim->kind = kind;
+    optim->dtype = DTYPE_FLOAT;
+    optim->lr = lr;
+
+    for (size_t i = 0; i < num_candidates; i++) {
+        Tensor *param = candidates[i];
+        if (!get_requires_grad(param))
+            continue;
+
+        ndArray *data = get_tensor_data(param);
+        DType dtype = get_dtype(data);
+        if (optim->num_params == 0)
+            optim->dtype = dtype;
+
+        if (dtype != optim->dtype ||
+            (dtype != DTYPE_FLOAT && dtype != DTYPE_DOUBLE))
+            RUNTIME_ERRORF(OPTIM_INIT_FAILURE,
+                           "Optimizer parameters must all be DTYPE_FLOAT or "
+                           "all DTYPE_DOUBLE, found `%s`",
+                           DTypeNames[dtype]);
+        if (!is_array_contiguous(data))
+            RUNTIME_ERROR(OPTIM_INIT_FAILURE,
+                          "Optimizer parameters must be contiguous");
+
+        optim->offsets[optim->num_params] = optim->total;
+        optim->params[optim->num_params++] = param;
+        optim->total += get_total_size(data);
+    }
+
+    optim->steps = calloc(optim->num_params + 1, sizeof(size_t));
+    if (!optim->steps)
+        RUNTIME_ERROR(OPTIM_INIT_FAILURE, "Failure to allocate optimizer");
+
+    size_t itemsize = optim->dtype == DTYPE_DOUBLE ? sizeof(double)
+                                                   : sizeof(float);
+    for (size_t s = 0; s < num_states; s++) {
+        optim->state[s] = calloc(optim->total + 1, itemsize);
+        if (!optim->state[s])
+            RUNTIME_ERROR(OPTIM_INIT_FAILURE,
+                          "Failure to allocate optimizer state");
+    }
+
+    return optim;
+}
+
+Optimizer *sgd_init(Module *module, double lr, double momentum,
+                    double dampening, double weight_decay, bool nesterov) {
+    if (momentum < 0 || weight_decay < 0)
+        RUNTIME_ERROR(OPTIM_INIT_FAILURE,
+                      "Invalid SGD arguments, expected momentum >= 0 and "
+                      "weight_decay >= 0");
+    if (nesterov && (momentum == 0 || dampening != 0))
+        RUNTIME_ERROR(OPTIM_INIT_FAILURE,
+                      "Nesterov momentum needs momentum > 0 and no dampening");
+
+    Optimizer *optim = _optim_init(module, OPTIM_SGD, lr, momentum > 0);
+    optim->momentum = momentum;
+    optim->dampening = dampening;
+    optim->weight_decay = weight_decay;
+    optim->nesterov = nesterov;
+
+    return optim;
+}
+
+Optimizer *adam_init(Module *module, double lr, double beta1, double beta2,
+                     double eps, double weight_decay, bool decoupled) {
+    if (beta1 < 0 || beta1 >= 1 || beta2 < 0 || beta2 >= 1 || eps < 0 ||
+        weight_decay < 0)
+        RUNTIME_ERROR(OPTIM_INIT_FAILURE,
+                      "Invalid Adam arguments, expected 0 <= beta1, beta2 < 1, "
+                      "eps >= 0 and weight_decay >= 0");
+
+    Optimizer *optim = _optim_init(module, OPTIM_ADAM, lr, 2);
+    optim->beta1 = beta1;
+    optim->beta2 = beta2;
+    optim->eps = eps;
+    optim->weight_decay = weight_decay;
+    optim->decoupled = decoupled;
+
+    return optim;
+}
+
+void free_optimizer(Optimizer *optim) {
+    if (!optim)
+        return;
+
+    free(optim->params);
+    free(optim->offsets);
+    free(optim->steps);
+    free(optim->state[0]);
+    free(optim->state[1]);
+    free(optim);
+}
+
+static StepArgs _step_args(const Optimizer *optim, size_t step) {
+    StepArgs args = {
+        .lr = optim->lr,
+        .weight_decay = optim->weight_decay,
+        .momentum = optim->momentum,
+        .dampening = optim->dampening,
+        .nesterov = optim->nesterov,
+        .first = step == 1,
+        .beta1 = optim->beta1,
+        .beta2 = optim->beta2,
+        .eps = optim->eps,
+        .decay = 1.0,
+        .decoupled = optim->decoupled,
+    };
+
+    if (optim->kind == OPTIM_ADAM) {
+        args.step_size = optim->lr / (1 - pow(optim->beta1, (double)step));
+        args.bias_corr2_sqrt = sqrt(1 - pow(optim->beta2, (double)step));
+        if (optim->decoupled)
+            args.decay = 1 - optim->lr * optim->weight_decay;
+    }
+
+    return args;
+}
+
+// the gradient's buffer in its parameter's layout and dtype
+static ndArray *_step_grad(Tensor *param) {
+    Tensor *grad = get_tensor_grad(param);
+    if (!grad)
+        return NULL;
+
+    ndArray *data = get_tensor_data(param), *grad_data = get_tensor_data(grad);
+    if (get_dtype(grad_data) != get_dtype(data))
+        RUNTIME_ERRORF(INVALID_GRAD,
+                       "Gradient dtype `%s` does not match its parameter's",
+                       DTypeNames[get_dtype(grad_data)]);
+
+    ndArray *aligned = array_align_layout(grad_data, data);
+    if (aligned) {
+        replace_tensor_data(grad, aligned);
+        grad_data = aligned;
+    }
+
+    return grad_data;
+}
+
+/*
+ * Parameters and gradients laid out back to back in the state's order (see
+ * `flatten_parameters`) that share a step count are updated as one span,
+ * chunks then cross parameter boundaries.
+ */
+static bool _is_flat(const Optimizer *optim, void **grads, size_t itemsize) {
+    char *param0 = get_array_data(get_tensor_data(optim->params[0])),
+         *grad0 = grads[0];
+    for (size_t i = 0; i < optim->num_params; i++) {
+        size_t offset = optim->offsets[i] * itemsize;
+        char *param = get_array_data(get_tensor_data(optim->params[i]));
+        if (!grads[i] || optim->steps[i] != optim->steps[0] ||
+            param != param0 + offset || (char *)grads[i] != grad0 + offset)
+            return false;
+    }
+
+    return true;
+}
+
+void optim_step(Optimizer *optim) {
+    size_t num_params = optim->num_params;
+    if (num_params == 0)
+        return;
+
+    void *grads[num_params];
+    StepArgs args[num_params];
+
+    size_t itemsize = optim->dtype == DTYPE_DOUBLE ? sizeof(double)
+                                                   : sizeof(float);
+    for (size_t i = 0; i < num_params; i++) {
+        ndArray *grad = _step_grad(optim->params[i]);
+        grads[i] = grad ? get_array_data(grad) : NULL;
+        if (grad)
+            args[i] = _step_args(optim, ++optim->steps[i]);
+    }
+
+    // spans of (parameter, number of elements)
+    bool flat = _is_flat(optim, grads, itemsize);
+    size_t num_spans = flat ? 1 : num_params, sizes[num_spans];
+    size_t num_chunks = 0;
+    for (size_t i = 0; i < num_spans; i++) {
+        if (flat)
+            sizes[i] = optim->total;
+        else if (grads[i])
+            sizes[i] = get_total_size(get_tensor_data(optim->params[i]));
+        else
+            sizes[i] = 0;
+        num_chunks += (sizes[i] + OPTIM_CHUNK_SIZE - 1) / OPTIM_CHUNK_SIZE;
+    }
+
+    OptimChunk *chunks = malloc((num_chunks + 1) * sizeof(OptimChunk));
+    if (!chunks)
+        RUNTIME_ERROR(OPTIM_INIT_FAILURE, "Failure to allocate step chunks");
+
+    size_t c = 0;
+    for (size_t i = 0; i < num_spans; i++) {
+        size_t n = sizes[i];
+        for (size_t start = 0; start < n; start += OPTIM_CHUNK_SIZE) {
+            size_t len = n - start < OPTIM_CHUNK_SIZE ? n - start
+                                                       : OPTIM_CHUNK_SIZE;
+            chunks[c++] = (OptimChunk){.param = i, .start = start, .len = len};
+        }
+    }
+
+    OptimKernel kernel = optim_kernels[optim->kind][optim->dtype];
+    char *state0 = optim->state[0], *state1 = optim->state[1];
+
+    _Pragma("omp parallel for schedule(dynamic, 1) if (num_chunks > 1)")
+    for (size_t k = 0; k < num_chunks; k++) {
+        const OptimChunk *chunk = &chunks[k];
+        size_t i = chunk->param;
+        size_t offset = chunk->start * itemsize,
+               state_offset = (optim->offsets[i] + chunk->start) * itemsize;
+
+        char *param = get_array_data(get_tensor_data(optim->params[i]));
+        kernel(param + offset, (char *)grads[i] + offset,
+               state0 ? state0 + state_offset : NULL,
+               state1 ? state1 + state_offset : NULL, chunk->len, &args[i]);
+    }
+
+    free(chunks);
+}
+
+double get_lr(const Optimizer *optim) { return optim->lr; }
+
+void set_lr(Optimizer *optim, double lr) {
+    if (lr < 0)
+        RUNTIME_ERROR(OPTIM_INIT_FAILURE, "Invalid negative learning rate");
+    optim->lr = lr;
+}
+
+size_t get_num_optim_params(const Optimizer *optim) {
+    return optim->num_params;
+}
+
+Tensor **get_optim_params(const Optimizer *optim) { return optim->params; }
@@ -0,0 +1,335 @@
+#include "sparse.h"
+#include "array.h"
+#include "error_codes.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+const char *SparseFormatNames[] = {
+    "SPARSE_COO",
+    "SPARSE_CSR",
+};
+
+struct SparseArray {
+    SparseFormat format;
+    DType dtype;
+    size_t itemsize;
+
+    size_t rows;
+    size_t cols;
+    size_t nnz;
+
+    size_t *row_idx; // COO: nnz row indices, CSR: rows + 1 row pointers
+    size_t *col_idx;
+    void *values;
+};
+
+static size_t sparse_itemsize(DType dtype) {
+    switch (dtype) {
+    case DTYPE_INT:
+        return sizeof(int);
+    case DTYPE_FLOAT:
+        return sizeof(float);
+    case DTYPE_DOUBLE:
+        return sizeof(double);
+    case DTYPE_LONG:
+        return sizeof(long);
+    case DTYPE_BF16:
+    case DTYPE_HALF:
+        return sizeof(uint16_t);
+    }
+    return 0;
+}
+
+static SparseArray *sparse_alloc(SparseFormat format, size_t rows, size_t cols,
+                                 size_t nnz, DType dtype) {
+    SparseArray *sparse = malloc(sizeof(SparseArray));
+    if (!sparse)
+        RUNTIME_ERROR(SPARSE_INIT_FAILURE, "Failed to initialize sparse array");
+
+    sparse->format = format;
+    sparse->dtype = dtype;
+    sparse->itemsize = sparse_itemsize(dtype);
+    sparse->rows = rows;
+    sparse->cols = cols;
+    sparse->nnz = nnz;
+
+    size_t num_row_idx = (format == SPARSE_CSR) ? rows + 1 : nnz;
+
+    // malloc(0) may return NULL, keep at least one slot around
+    sparse->row_idx = malloc((num_row_idx ? num_row_idx : 1) * sizeof(size_t));
+    sparse->col_idx = malloc((nnz ? nnz : 1) * sizeof(size_t));
+    sparse->values = malloc((nnz ? nnz : 1) * sparse->itemsize);
+
+    if (!(sparse->row_idx && sparse->col_idx && sparse->values))
+        RUNTIME_ERROR(SPARSE_INIT_FAILURE,
+                      "Failed to allocate sparse array buffers");
+
+    return sparse;
+}
+
+SparseArray *sparse_coo_init(size_t rows, size_t cols, size_t nnz,
+                             const size_t *row_idx, const size_t *col_idx,
+                             const void *values, DType dtype) {
+    for (size_t i = 0; i < nnz; i++) {
+        if (row_idx[i] >= rows || col_idx[i] >= cols)
+            RUNTIME_ERRORF(INVALID_IDX,
+                           "Invalid sparse index (%zu, %zu) for shape "
+                           "(%zu, %zu)",
+                           row_idx[i], col_idx[i], rows, cols);
+    }
+
+    SparseArray *sparse = sparse_alloc(SPARSE_COO, rows, cols, nnz, dtype);
+    memcpy(sparse->row_idx, row_idx, nnz * sizeof(size_t));
+    memcpy(sparse->col_idx, col_idx, nnz * sizeof(size_t));
+    memcpy(sparse->values, values, nnz * sparse->itemsize);
+
+    return sparse;
+}
+
+SparseArray *sparse_csr_init(size_t rows, size_t cols, size_t nnz,
+                             const size_t *row_ptr, const size_t *col_idx,
+                             const void *values, DType dtype) {
+    if (row_ptr[0] != 0 || row_ptr[rows] != nnz)
+        RUNTIME_ERRORF(SPARSE_INIT_FAILURE,
+                       "Invalid CSR row pointers, expected [0, %zu] bounds",
+                       nnz);
+
+    for (size_t r = 0; r < rows; r++) {
+        if (row_ptr[r] > row_ptr[r + 1])
+            RUNTIME_ERRORF(SPARSE_INIT_FAILURE,
+                           "Decreasing CSR row pointer at row `%zu`", r);
+    }
+
+    for (size_t i = 0; i < nnz; i++) {
+        if (col_idx[i] >= cols)
+            RUNTIME_ERRORF(INVALID_IDX, "Invalid sparse column index `%zu`",
+                           col_idx[i]);
+    }
+
+    SparseArray *sparse = sparse_alloc(SPARSE_CSR, rows, cols, nnz, dtype);
+    memcpy(sparse->row_idx, row_ptr, (rows + 1) * sizeof(size_t));
+    memcpy(sparse->col_idx, col_idx, nnz * sizeof(size_t));
+    memcpy(sparse->values, values, nnz * sparse->itemsize);
+
+    return sparse;
+}
+
+void free_sparse(SparseArray *sparse) {
+    if (!sparse)
+        return;
+
+    free(sparse->row_idx);
+    free(sparse->col_idx);
+    free(sparse->values);
+    free(sparse);
+}
+
+SparseFormat get_sparse_format(const SparseArray *sparse) {
+    return sparse->format;
+}
+DType get_sparse_dtype(const SparseArray *sparse) { return sparse->dtype; }
+size_t get_sparse_rows(const SparseArray *sparse) { return sparse->rows; }
+size_t get_sparse_cols(const SparseArray *sparse) { return sparse->cols; }
+size_t get_sparse_nnz(const SparseArray *sparse) { return sparse->nnz; }
+size_t *get_sparse_row_idx(const SparseArray *sparse) {
+    return sparse->row_idx;
+}
+size_t *get_sparse_col_idx(const SparseArray *sparse) {
+    return sparse->col_idx;
+}
+void *get_sparse_values(const SparseArray *sparse) { return sparse->values; }
+
+SparseArray *copy_sparse(const SparseArray *sparse) {
+    SparseArray *copy = sparse_alloc(sparse->format, sparse->rows,
+                                     sparse->cols, sparse->nnz, sparse->dtype);
+
+    size_t num_row_idx =
+        (sparse->format == SPARSE_CSR) ? sparse->rows + 1 : sparse->nnz;
+    memcpy(copy->row_idx, sparse->row_idx, num_row_idx * sizeof(size_t));
+    memcpy(copy->col_idx, sparse->col_idx, sparse->nnz * sizeof(size_t));
+    memcpy(copy->values, sparse->values, sparse->nnz * sparse->itemsize);
+
+    return copy;
+}
+
+/*
+ * Counting sort of (major, minor, value) triplets on `major`, producing CSR
+ * pointers of length `num_major + 1`. Stable, so an already sorted minor
+ * order is preserved within each major index.
+ */
+static void _bucket_by_major(const size_t *major, const size_t *minor,
+                             const void *values, size_t nnz, size_t num_major,
+                             size_t itemsize, size_t *ptr, size_t *out_minor,
+                             void *out_values) {
+    memset(ptr, 0, (num_major + 1) * sizeof(size_t));
+    for (size_t i = 0; i < nnz; i++)
+        ptr[major[i] + 1]++;
+
+    for (size_t r = 0; r < num_major; r++)
+        ptr[r + 1] += ptr[r];
+
+    size_t *next = malloc((num_major ? num_major : 1) * sizeof(size_t));
+    if (!next)
+        RUNTIME_ERROR(SPARSE_INIT_FAILURE, "Failed to allocate sparse buffer");
+    memcpy(next, ptr, num_major * sizeof(size_t));
+
+    for (size_t i = 0; i < nnz; i++) {
+        size_t dst = next[major[i]]++;
+        out_minor[dst] = minor[i];
+        memcpy((char *)out_values + dst * itemsize,
+               (const char *)values + i * itemsize, itemsize);
+    }
+
+    free(next);
+}
+
+static void _sort_row(size_t *cols, char *values, size_t n, size_t itemsize) {
+    // rows of hashed features are short, insertion sort is enough
+    char tmp[sizeof(double)];
+    for (size_t i = 1; i < n; i++) {
+        size_t col = cols[i];
+        memcpy(tmp, values + i * itemsize, itemsize);
+
+        size_t j = i;
+        while (j > 0 && cols[j - 1] > col) {
+            cols[j] = cols[j - 1];
+            memcpy(values + j * itemsize, values + (j - 1) * itemsize,
+                   itemsize);
+            j--;
+        }
+        cols[j] = col;
+        memcpy(values + j * itemsize, tmp, itemsize);
+    }
+}
+
+SparseArray *sparse_to_csr(const SparseArray *sparse) {
+    if (sparse->format == SPARSE_CSR)
+        return copy_sparse(sparse);
+
+    SparseArray *csr = sparse_alloc(SPARSE_CSR, sparse->rows, sparse->cols,
+                                    sparse->nnz, sparse->dtype);
+
+    _bucket_by_major(sparse->row_idx, sparse->col_idx, sparse->values,
+                     sparse->nnz, sparse->rows, sparse->itemsize, csr->row_idx,
+                     csr->col_idx, csr->values);
+
+    size_t rows = csr->rows, itemsize = csr->itemsize;
+#pragma omp parallel for schedule(dynamic, 64)
+    for (size_t r = 0; r < rows; r++) {
+        size_t start = csr->row_idx[r], end = csr->row_idx[r + 1];
+        _sort_row(csr->col_idx + start,
+                  (char *)csr->values + start * itemsize, end - start,
+                  itemsize);
+    }
+
+    return csr;
+}
+
+SparseArray *sparse_to_coo(const SparseArray *sparse) {
+    if (sparse->format == SPARSE_COO)
+        return copy_sparse(sparse);
+
+    SparseArray *coo = sparse_alloc(SPARSE_COO, sparse->rows, sparse->cols,
+                                    sparse->nnz, sparse->dtype);
+
+    size_t rows = sparse->rows;
+#pragma omp parallel for schedule(dynamic, 64)
+    for (size_t r = 0; r < rows; r++) {
+        for (size_t i = sparse->row_idx[r]; i < sparse->row_idx[r + 1]; i++)
+            coo->row_idx[i] = r;
+    }
+
+    memcpy(coo->col_idx, sparse->col_idx, sparse->nnz * sizeof(size_t));
+    memcpy(coo->values, sparse->values, sparse->nnz * sparse->itemsize);
+
+    return coo;
+}
+
+SparseArray *sparse_transpose(const SparseArray *sparse) {
+    // a row-major COO bucketed by column keeps the new columns sorted
+    SparseArray *csr = sparse_to_csr(sparse);
+    SparseArray *coo = sparse_to_coo(csr);
+
+    SparseArray *transposed = sparse_alloc(SPARSE_CSR, sparse->cols,
+                                           sparse->rows, sparse->nnz,
+                                           sparse->dtype);
+    _bucket_by_major(coo->col_idx, coo->row_idx, coo->values, coo->nnz,
+                     transposed->rows, transposed->itemsize,
+                     transposed->row_idx, transposed->col_idx,
+                     transposed->values);
+
+    free_sparse(csr);
+    free_sparse(coo);
+    return transposed;
+}
+
+SparseArray *sparse_from_dense(const ndArray *array, SparseFormat format) {
+    if (get_ndim(array) != 2)
+        RUNTIME_ERRORF(INVALID_DIM,
+                       "Sparse arrays must be 2-D, given array with ndim %d",
+                       get_ndim(array));
+
+    size_t rows = get_shape(array)[0], cols = get_shape(array)[1];
+    DType dtype = get_dtype(array);
+    ArrayVal zero = array_val_zero(dtype);
+
+    size_t nnz = 0;
+    size_t idx[2];
+    for (size_t r = 0; r < rows; r++) {
+        for (size_t c = 0; c < cols; c++) {
+            idx[0] = r, idx[1] = c;
+            if (!array_val_equal(get_value(array, idx), zero, dtype))
+                nnz++;
+        }
+    }
+
+    SparseArray *csr = sparse_alloc(SPARSE_CSR, rows, cols, nnz, dtype);
+    size_t itemsize = csr->itemsize, pos = 0;
+
+    csr->row_idx[0] = 0;
+    for (size_t r = 0; r < rows; r++) {
+        for (size_t c = 0; c < cols; c++) {
+            idx[0] = r, idx[1] = c;
+            ArrayVal value = get_value(array, idx);
+            if (array_val_equal(value, zero, dtype))
+                continue;
+
+            csr->col_idx[pos] = c;
+            array_val_store((char *)csr->values + pos * itemsize, value,
+                            dtype);
+            pos++;
+        }
+        csr->row_idx[r + 1] = pos;
+    }
+
+    if (format == SPARSE_CSR)
+        return csr;
+
+    SparseArray *coo = sparse_to_coo(csr);
+    free_sparse(csr);
+    return coo;
+}
+
+ndArray *sparse_to_dense(const SparseArray *sparse) {
+    const size_t shape[] = {sparse->rows, sparse->cols};
+    ndArray *array = zeros(2, shape, sparse->dtype);
+
+    SparseArray *coo = sparse_to_coo(sparse);
+    size_t idx[2];
+    for (size_t i = 0; i < coo->nnz; i++) {
+        idx[0] = coo->row_idx[i], idx[1] = coo->col_idx[i];
+
+        ArrayVal value = array_val_load(
+            (const char *)coo->values + i * coo->itemsize, coo->dtype);
+        set_value(array, idx,
+                  array_val_add(get_value(array, idx), value, coo->dtype));
+    }
+
+    free_sparse(coo);
+    return array;
+}
@@ -0,0 +1,140 @@
+#include "array.h"
+#include "error_codes.h"
+#include "sparse.h"
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * C[r, :] (+)= sum_i values[i] * B[col_idx[i], :] over the CSR row `r`.
+ * Rows of C are independent, so the loop parallelizes without atomics and
+ * runs in O(nnz * n).
+ */
+#define _SPMM_KERNEL(T, NAME)                                                  \
+    static void NAME(const size_t *row_ptr, const size_t *col_idx,             \
+                     const T *values, size_t rows, const T *B, size_t sBr,     \
+                     size_t sBc, T *C, size_t n, bool accumulate) {            \
+        _Pragma("omp parallel for schedule(dynamic, 16)") for (size_t r = 0;   \
+                                                               r < rows;       \
+                                                               r++) {          \
+            T *c_row = C + r * n;                                              \
+            size_t start = row_ptr[r], end = row_ptr[r + 1];                   \
+            if (!accumulate)                                                   \
+                memset(c_row, 0, n * sizeof(T));                               \
+                                                                               \
+            for (size_t i = start; i < end; i++) {                             \
+                const T v = values[i];                                         \
+                const T *b_row = B + col_idx[i] * sBr;                         \
+                if (sBc == 1) {                                                \
+                    _Pragma("omp simd") for (size_t j = 0; j < n; j++)         \
+                        c_row[j] += v * b_row[j];                              \
+                } else {                                                       \
+                    for (size_t j = 0; j < n; j++)                             \
+                        c_row[j] += v * b_row[j * sBc];                        \
+                }                                                              \
+            }                                                                  \
+        }                                                                      \
+    }
+
+_SPMM_KERNEL(float, _spmm_f)
+_SPMM_KERNEL(double, _spmm_d)
+
+static void _check_spmm_args(const SparseArray *sparse, const ndArray *dense,
+                             size_t k) {
+    if (get_ndim(dense) != 2)
+        RUNTIME_ERROR(INVALID_ARRAY, "spmm requires a 2-D dense array");
+
+    DType sparse_dtype = get_sparse_dtype(sparse), dtype = get_dtype(dense);
+    if (sparse_dtype != dtype)
+        RUNTIME_ERRORF(INVALID_DTYPE,
+                       "Cannot spmm arrays with dtypes `%s` and `%s`",
+                       DTypeNames[sparse_dtype], DTypeNames[dtype]);
+
+    if (dtype != DTYPE_FLOAT && dtype != DTYPE_DOUBLE)
+        RUNTIME_ERRORF(INVALID_DTYPE,
+                       "Cannot spmm arrays with dtype - `%s`, only "
+                       "DTYPE_FLOAT and DTYPE_DOUBLE are supported",
+                       DTypeNames[dtype]);
+
+    if (get_shape(dense)[0] != k)
+        RUNTIME_ERRORF(SHAPE_MISMATCH,
+                       "spmm shape mismatch: k1 (%zu) != k2 (%zu) in (m, k1), "
+                       "(k2, n) -> (m, n)",
+                       k, get_shape(dense)[0]);
+}
+
+static void _spmm_csr(const SparseArray *csr, const ndArray *dense,
+                      ndArray *out, bool accumulate) {
+    size_t rows = get_sparse_rows(csr), n = get_shape(dense)[1];
+    size_t itemsize = get_itemsize(dense);
+    size_t sBr = get_strides(dense)[0] / itemsize,
+           sBc = get_strides(dense)[1] / itemsize;
+
+    const size_t *row_ptr = get_sparse_row_idx(csr),
+                 *col_idx = get_sparse_col_idx(csr);
+
+    switch (get_dtype(dense)) {
+    default:
+        break;
+    case DTYPE_FLOAT:
+        _spmm_f(row_ptr, col_idx, get_sparse_values(csr), rows,
+                get_array_data(dense), sBr, sBc, get_array_data(out), n,
+                accumulate);
+        break;
+    case DTYPE_DOUBLE:
+        _spmm_d(row_ptr, col_idx, get_sparse_values(csr), rows,
+                get_array_data(dense), sBr, sBc, get_array_data(out), n,
+                accumulate);
+        break;
+    }
+}
+
+ndArray *spmm(const SparseArray *sparse, const ndArray *dense) {
+    _check_spmm_args(sparse, dense, get_sparse_cols(sparse));
+
+    const size_t shape[] = {get_sparse_rows(sparse), get_shape(dense)[1]};
+    ndArray *result = array_init(2, shape, get_dtype(dense));
+
+    if (get_sparse_format(sparse) == SPARSE_CSR) {
+        _spmm_csr(sparse, dense, result, false);
+    } else {
+        SparseArray *csr = sparse_to_csr(sparse);
+        _spmm_csr(csr, dense, result, false);
+        free_sparse(csr);
+    }
+
+    return result;
+}
+
+/*
+(m, k) sparse, (m, n) dense -> (k, n) dense, i.e. sparse^T @ dense
+*/
+ndArray *spmm_t(const SparseArray *sparse, const ndArray *dense) {
+    SparseArray *transposed = sparse_transpose(sparse);
+    ndArray *result = spmm(transposed, dense);
+
+    free_sparse(transposed);
+    return result;
+}
+
+/*
+ * out += sparse^T @ dense, touching only the rows of `out` that correspond to
+ * non-empty columns of `sparse`. `out` must be a contiguous (k, n) array.
+ */
+void spmm_t_accumulate(const SparseArray *sparse, const ndArray *dense,
+                       ndArray *out) {
+    _check_spmm_args(sparse, dense, get_sparse_rows(sparse));
+
+    if (get_ndim(out) != 2 || !is_array_contiguous(out) ||
+        get_shape(out)[0] != get_sparse_cols(sparse) ||
+        get_shape(out)[1] != get_shape(dense)[1] ||
+        get_dtype(out) != get_dtype(dense))
+        RUNTIME_ERROR(SHAPE_MISMATCH,
+                      "Invalid output array for sparse accumulation");
+
+    SparseArray *transposed = sparse_transpose(sparse);
+    _spmm_csr(transposed, dense, out, true);
+    free_sparse(transposed);
+}
@@ -0,0 +1,141 @@
+#include "amp.h"
+#include "array.h"
+#include "autograd.h"
+#include "capture.h"
+#include "error_codes.h"
+#include "tensor.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+static Tensor *_tensor_rectify(Tensor *tensor, double negative_slope,
+                               double cap) {
+    Environment *env = get_tensor_environ(tensor);
+    Tensor *cast = autocast_tensor(tensor, env);
+
+    ndArray *data = array_relu(get_tensor_data(cast), negative_slope, cap);
+    bool requires_grad = is_grad_enabled() && get_requires_grad(cast);
+    if (requires_grad && negative_slope < 0)
+        RUNTIME_ERROR(INVALID_BACKWARD_PASS,
+                      "Rectifier gradients need a non-negative slope");
+
+    Tensor *new_tensor = tensor_init(data, requires_grad, env);
+    if (requires_grad) {
+        BackwardFn *backward_fn =
+            ReluBackward((Tensor *[]){new_tensor}, (Tensor *[]){cast}, 1, 1);
+
+        ReluCtx ctx = {.negative_slope = negative_slope, .cap = cap};
+        set_ctx(backward_fn, &ctx, RELU_CTX);
+        set_backward_fn(new_tensor, backward_fn);
+    }
+    tangent_relu(new_tensor, cast, negative_slope, cap);
+    capture_record_params(CAPTURE_RELU, cast, NULL, new_tensor, negative_slope,
+                          cap);
+
+    if (cast != tensor)
+        tensor_release(cast);
+
+    return new_tensor;
+}
+
+Tensor *tensor_relu(Tensor *tensor) {
+    return _tensor_rectify(tensor, 0.0, RELU_UNCAPPED);
+}
+
+Tensor *tensor_leaky_relu(Tensor *tensor, double negative_slope) {
+    return _tensor_rectify(tensor, negative_slope, RELU_UNCAPPED);
+}
+
+Tensor *tensor_relu6(Tensor *tensor) {
+    return _tensor_rectify(tensor, 0.0, 6.0);
+}
+
+static const BackwardFnInit activation_backward_fns[] = {
+    [ACTIVATION_GELU] = GeluBackward,
+    [ACTIVATION_SILU] = SiluBackward,
+    [ACTIVATION_TANH] = TanhBackward,
+    [ACTIVATION_SIGMOID] = SigmoidBackward,
+};
+
+static Tensor *_tensor_activation(Tensor *tensor, ActivationKind kind) {
+    Environment *env = get_tensor_environ(tensor);
+    Tensor *cast = autocast_tensor(tensor, env);
+
+    ndArray *data = array_activation(get_tensor_data(cast), kind);
+    bool requires_grad = is_grad_enabled() && get_requires_grad(cast);
+
+    Tensor *new_tensor = tensor_init(data, requires_grad, env);
+    if (requires_grad) {
+        BackwardFn *backward_fn = activation_backward_fns[kind](
+            (Tensor *[]){new_tensor}, (Tensor *[]){cast}, 1, 1);
+
+        ActivationCtx ctx = {.kind = kind};
+        set_ctx(backward_fn, &ctx, ACTIVATION_CTX);
+        set_backward_fn(new_tensor, backward_fn);
+    }
+    tangent_activation(new_tensor, cast, kind);
+    capture_record_params(CAPTURE_ACTIVATION, cast, NULL, new_tensor, kind,
+                          0.0);
+
+    if (cast != tensor)
+        tensor_release(cast);
+
+    return new_tensor;
+}
+
+Tensor *tensor_gelu(Tensor *tensor) {
+    return _tensor_activation(tensor, ACTIVATION_GELU);
+}
+
+Tensor *tensor_silu(Tensor *tensor) {
+    return _tensor_activation(tensor, ACTIVATION_SILU);
+}
+
+Tensor *tensor_tanh(Tensor *tensor) {
+    return _tensor_activation(tensor, ACTIVATION_TANH);
+}
+
+Tensor *tensor_sigmoid(Tensor *tensor) {
+    return _tensor_activation(tensor, ACTIVATION_SIGMOID);
+}
+
+// 16-bit inputs are normalized in fp32 inside autocast regions
+static Tensor *_tensor_softmax(Tensor *tensor, int dim, bool log_space) {
+    Environment *env = get_tensor_environ(tensor);
+    Tensor *cast = autocast_fp32_tensor(tensor, env);
+
+    ndArray *cast_data = get_tensor_data(cast);
+    dim = softmax_dim(cast_data, dim);
+
+    ndArray *data = array_softmax(cast_data, dim, log_space);
+    bool requires_grad = is_grad_enabled() && get_requires_grad(cast);
+
+    Tensor *new_tensor = tensor_init(data, requires_grad, env);
+    if (requires_grad) {
+        BackwardFn *backward_fn =
+            log_space ? LogSoftmaxBackward((Tensor *[]){new_tensor},
+                                           (Tensor *[]){cast}, 1, 1)
+                      : SoftmaxBackward((Tensor *[]){new_tensor},
+                                        (Tensor *[]){cast}, 1, 1);
+
+        SoftmaxCtx ctx = {.dim = dim, .log_space = log_space};
+        set_ctx(backward_fn, &ctx, SOFTMAX_CTX);
+        set_backward_fn(new_tensor, backward_fn);
+    }
+    tangent_softmax(new_tensor, cast, dim, log_space);
+    capture_record_params(CAPTURE_SOFTMAX, cast, NULL, new_tensor, dim,
+                          log_space);
+
+    if (cast != tensor)
+        tensor_release(cast);
+
+    return new_tensor;
+}
+
+Tensor *tensor_softmax(Tensor *tensor, int dim) {
+    return _tensor_softmax(tensor, dim, false);
+}
+
+Tensor *tensor_log_softmax(Tensor *tensor, int dim) {
+    return _tensor_softmax(tensor, dim, true);
+}
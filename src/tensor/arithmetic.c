@@ -1,106 +1,224 @@
+#include "amp.h"
 #include "array.h"
 #include "autograd.h"
+#include "capture.h"
 #include "tensor.h"
 
 #include <stdbool.h>
 #include <stddef.h>
 
 Tensor *tensor_add(Tensor *t1, Tensor *t2) {
-    ndArray *data1 = get_tensor_data(t1), *data2 = get_tensor_data(t2);
+    Environment *env = resolve_environ(t1, t2);
+    Tensor *a1 = autocast_tensor(t1, env), *a2 = autocast_tensor(t2, env);
+
+    ndArray *data1 = get_tensor_data(a1), *data2 = get_tensor_data(a2);
     ndArray *data = array_add(data1, data2);
 
-    bool t1_requires_grad = get_requires_grad(t1),
-         t2_requires_grad = get_requires_grad(t2);
-    bool requires_grad = t1_requires_grad || t2_requires_grad;
+    bool t1_requires_grad = get_requires_grad(a1),
+         t2_requires_grad = get_requires_grad(a2);
+    bool requires_grad =
+        is_grad_enabled() && (t1_requires_grad || t2_requires_grad);
 
-    Environment *env = resolve_environ(t1, t2);
     Tensor *tensor = tensor_init(data, requires_grad, env);
     if (requires_grad) {
         BackwardFn *backward_fn =
-            AddBackward((Tensor *[]){tensor}, (Tensor *[]){t1, t2}, 1, 2);
+            AddBackward((Tensor *[]){tensor}, (Tensor *[]){a1, a2}, 1, 2);
         set_backward_fn(tensor, backward_fn);
     }
+    tangent_add(tensor, a1, a2);
+    capture_record(CAPTURE_ADD, a1, a2, tensor);
+
+    if (a1 != t1)
+        tensor_release(a1);
+    if (a2 != t2)
+        tensor_release(a2);
 
     return tensor;
 }
 
 Tensor *tensor_sub(Tensor *t1, Tensor *t2) {
-    Tensor *t2_neg = tensor_neg(t2);
-    Tensor *result = tensor_add(t1, t2_neg);
+    Environment *env = resolve_environ(t1, t2);
+    Tensor *a1 = autocast_tensor(t1, env), *a2 = autocast_tensor(t2, env);
+
+    ndArray *data1 = get_tensor_data(a1), *data2 = get_tensor_data(a2);
+    ndArray *data = array_sub(data1, data2);
+
+    bool t1_requires_grad = get_requires_grad(a1),
+         t2_requires_grad = get_requires_grad(a2);
+    bool requires_grad =
+        is_grad_enabled() && (t1_requires_grad || t2_requires_grad);
+
+    Tensor *tensor = tensor_init(data, requires_grad, env);
+    if (requires_grad) {
+        BackwardFn *backward_fn =
+            SubBackward((Tensor *[]){tensor}, (Tensor *[]){a1, a2}, 1, 2);
+        set_backward_fn(tensor, backward_fn);
+    }
+    tangent_sub(tensor, a1, a2);
+    capture_record(CAPTURE_SUB, a1, a2, tensor);
+
+    if (a1 != t1)
+        tensor_release(a1);
+    if (a2 != t2)
+        tensor_release(a2);
 
-    return result;
+    return tensor;
 }
 
 Tensor *tensor_mul(Tensor *t1, Tensor *t2) {
-    ndArray *data1 = get_tensor_data(t1), *data2 = get_tensor_data(t2);
+    Environment *env = resolve_environ(t1, t2);
+    Tensor *a1 = autocast_tensor(t1, env), *a2 = autocast_tensor(t2, env);
+
+    ndArray *data1 = get_tensor_data(a1), *data2 = get_tensor_data(a2);
     ndArray *data = array_mul(data1, data2);
 
-    bool t1_requires_grad = get_requires_grad(t1),
-         t2_requires_grad = get_requires_grad(t2);
-    bool requires_grad = t1_requires_grad || t2_requires_grad;
+    bool t1_requires_grad = get_requires_grad(a1),
+         t2_requires_grad = get_requires_grad(a2);
+    bool requires_grad =
+        is_grad_enabled() && (t1_requires_grad || t2_requires_grad);
 
-    Environment *env = resolve_environ(t1, t2);
     Tensor *tensor = tensor_init(data, requires_grad, env);
     if (requires_grad) {
         BackwardFn *backward_fn =
-            MulBackward((Tensor *[]){tensor}, (Tensor *[]){t1, t2}, 1, 2);
+            MulBackward((Tensor *[]){tensor}, (Tensor *[]){a1, a2}, 1, 2);
         set_backward_fn(tensor, backward_fn);
     }
+    tangent_mul(tensor, a1, a2);
+    capture_record(CAPTURE_MUL, a1, a2, tensor);
+
+    if (a1 != t1)
+        tensor_release(a1);
+    if (a2 != t2)
+        tensor_release(a2);
 
     return tensor;
 }
 
 Tensor *tensor_div(Tensor *t1, Tensor *t2) {
-    Tensor *t2_inv = tensor_inv(t2);
-    Tensor *result = tensor_mul(t1, t2_inv);
+    Environment *env = resolve_environ(t1, t2);
+    Tensor *a1 = autocast_tensor(t1, env), *a2 = autocast_tensor(t2, env);
+
+    ndArray *data1 = get_tensor_data(a1), *data2 = get_tensor_data(a2);
+    ndArray *data = array_div(data1, data2);
+
+    bool t1_requires_grad = get_requires_grad(a1),
+         t2_requires_grad = get_requires_grad(a2);
+    bool requires_grad =
+        is_grad_enabled() && (t1_requires_grad || t2_requires_grad);
+
+    Tensor *tensor = tensor_init(data, requires_grad, env);
+    if (requires_grad) {
+        BackwardFn *backward_fn =
+            DivBackward((Tensor *[]){tensor}, (Tensor *[]){a1, a2}, 1, 2);
+        set_backward_fn(tensor, backward_fn);
+    }
+    tangent_div(tensor, a1, a2);
+    capture_record(CAPTURE_DIV, a1, a2, tensor);
 
-    return result;
+    if (a1 != t1)
+        tensor_release(a1);
+    if (a2 != t2)
+        tensor_release(a2);
+
+    return tensor;
 }
 
 Tensor *tensor_neg(Tensor *tensor) {
-    ndArray *data = get_tensor_data(tensor);
+    Environment *env = get_tensor_environ(tensor);
+    Tensor *cast = autocast_tensor(tensor, env);
+
+    ndArray *data = get_tensor_data(cast);
     ndArray *new_data = negative(data);
-    bool requires_grad = get_requires_grad(tensor);
+    bool requires_grad = is_grad_enabled() && get_requires_grad(cast);
 
-    Tensor *new_tensor =
-        tensor_init(new_data, requires_grad, get_tensor_environ(tensor));
+    Tensor *new_tensor = tensor_init(new_data, requires_grad, env);
     if (requires_grad) {
         BackwardFn *backward_fn =
-            NegBackward((Tensor *[]){new_tensor}, (Tensor *[]){tensor}, 1, 1);
+            NegBackward((Tensor *[]){new_tensor}, (Tensor *[]){cast}, 1, 1);
         set_backward_fn(new_tensor, backward_fn);
     }
+    tangent_neg(new_tensor, cast);
+    capture_record(CAPTURE_NEG, cast, NULL, new_tensor);
+
+    if (cast != tensor)
+        tensor_release(cast);
 
     return new_tensor;
 }
 
 Tensor *tensor_inv(Tensor *tensor) {
-    ndArray *data = get_tensor_data(tensor);
+    Environment *env = get_tensor_environ(tensor);
+    Tensor *cast = autocast_tensor(tensor, env);
+
+    ndArray *data = get_tensor_data(cast);
     ndArray *new_data = inverse(data);
-    bool requires_grad = get_requires_grad(tensor);
+    bool requires_grad = is_grad_enabled() && get_requires_grad(cast);
 
-    Tensor *new_tensor =
-        tensor_init(new_data, requires_grad, get_tensor_environ(tensor));
+    Tensor *new_tensor = tensor_init(new_data, requires_grad, env);
     if (requires_grad) {
         BackwardFn *backward_fn =
-            InvBackward((Tensor *[]){new_tensor}, (Tensor *[]){tensor}, 1, 1);
+            InvBackward((Tensor *[]){new_tensor}, (Tensor *[]){cast}, 1, 1);
         set_backward_fn(new_tensor, backward_fn);
     }
+    tangent_inv(new_tensor, cast);
+    capture_record(CAPTURE_INV, cast, NULL, new_tensor);
+
+    if (cast != tensor)
+        tensor_release(cast);
 
     return new_tensor;
 }
 
 Tensor *tensor_max(Tensor *t1, Tensor *t2) {
-    ndArray *data1 = get_tensor_data(t1), *data2 = get_tensor_data(t2);
+    Environment *env = resolve_environ(t1, t2);
+    Tensor *a1 = autocast_tensor(t1, env), *a2 = autocast_tensor(t2, env);
+
+    ndArray *data1 = get_tensor_data(a1), *data2 = get_tensor_data(a2);
     ndArray *data = array_max(data1, data2);
-    bool requires_grad = get_requires_grad(t1) || get_requires_grad(t2);
+    bool requires_grad =
+        is_grad_enabled() && (get_requires_grad(a1) || get_requires_grad(a2));
 
+    Tensor *tensor = tensor_init(data, requires_grad, env);
+    if (requires_grad) {
+        BackwardFn *backward_fn =
+            MaxBackward((Tensor *[]){tensor}, (Tensor *[]){a1, a2}, 1, 2);
+        set_select_mask(backward_fn, data1, data2, true);
+        set_backward_fn(tensor, backward_fn);
+    }
+    tangent_max(tensor, a1, a2);
+    capture_record(CAPTURE_MAX, a1, a2, tensor);
+
+    if (a1 != t1)
+        tensor_release(a1);
+    if (a2 != t2)
+        tensor_release(a2);
+
+    return tensor;
+}
+
+Tensor *tensor_min(Tensor *t1, Tensor *t2) {
     Environment *env = resolve_environ(t1, t2);
+    Tensor *a1 = autocast_tensor(t1, env), *a2 = autocast_tensor(t2, env);
+
+    ndArray *data1 = get_tensor_data(a1), *data2 = get_tensor_data(a2);
+    ndArray *data = array_min(data1, data2);
+    bool requires_grad =
+        is_grad_enabled() && (get_requires_grad(a1) || get_requires_grad(a2));
+
     Tensor *tensor = tensor_init(data, requires_grad, env);
     if (requires_grad) {
         BackwardFn *backward_fn =
-            MaxBackward((Tensor *[]){tensor}, (Tensor *[]){t1, t2}, 1, 2);
+            MinBackward((Tensor *[]){tensor}, (Tensor *[]){a1, a2}, 1, 2);
+        set_select_mask(backward_fn, data1, data2, false);
         set_backward_fn(tensor, backward_fn);
     }
+    tangent_min(tensor, a1, a2);
+    capture_record(CAPTURE_MIN, a1, a2, tensor);
+
+    if (a1 != t1)
+        tensor_release(a1);
+    if (a2 != t2)
+        tensor_release(a2);
 
     return tensor;
 }
@@ -112,6 +230,7 @@ Tensor *tensor_gt(Tensor *t1, Tensor *t2) {
 
     Environment *env = resolve_environ(t1, t2);
     Tensor *tensor = tensor_init(data, requires_grad, env);
+    capture_record(CAPTURE_GT, t1, t2, tensor);
 
     return tensor;
 }
@@ -123,6 +242,7 @@ Tensor *tensor_ge(Tensor *t1, Tensor *t2) {
 
     Environment *env = resolve_environ(t1, t2);
     Tensor *tensor = tensor_init(data, requires_grad, env);
+    capture_record(CAPTURE_GE, t1, t2, tensor);
 
     return tensor;
 }
@@ -134,6 +254,7 @@ Tensor *tensor_lt(Tensor *t1, Tensor *t2) {
 
     Environment *env = resolve_environ(t1, t2);
     Tensor *tensor = tensor_init(data, requires_grad, env);
+    capture_record(CAPTURE_LT, t1, t2, tensor);
 
     return tensor;
 }
@@ -145,6 +266,7 @@ Tensor *tensor_le(Tensor *t1, Tensor *t2) {
 
     Environment *env = resolve_environ(t1, t2);
     Tensor *tensor = tensor_init(data, requires_grad, env);
+    capture_record(CAPTURE_LE, t1, t2, tensor);
 
     return tensor;
 }
@@ -156,6 +278,7 @@ Tensor *tensor_eq(Tensor *t1, Tensor *t2) {
 
     Environment *env = resolve_environ(t1, t2);
     Tensor *tensor = tensor_init(data, requires_grad, env);
+    capture_record(CAPTURE_EQ, t1, t2, tensor);
 
     return tensor;
 }
@@ -0,0 +1,50 @@
+#include "amp.h"
+#include "array.h"
+#include "autograd.h"
+#include "capture.h"
+#include "tensor.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+Tensor *tensor_conv(Tensor *input, Tensor *weight, Tensor *bias,
+                    const ConvParams *params) {
+    capture_unsupported("Convolutions");
+
+    Environment *env = resolve_environ(input, weight);
+    Tensor *cast = autocast_fp32_tensor(input, env),
+           *cast_weight = autocast_fp32_tensor(weight, env),
+           *cast_bias = bias ? autocast_fp32_tensor(bias, env) : NULL;
+
+    ndArray *data =
+        array_conv(get_tensor_data(cast), get_tensor_data(cast_weight),
+                   cast_bias ? get_tensor_data(cast_bias) : NULL, params);
+
+    bool requires_grad =
+        is_grad_enabled() &&
+        (get_requires_grad(cast) || get_requires_grad(cast_weight) ||
+         (cast_bias && get_requires_grad(cast_bias)));
+
+    Tensor *new_tensor = tensor_init(data, requires_grad, env);
+    if (requires_grad) {
+        size_t num_operands = cast_bias ? 3 : 2;
+        BackwardFn *backward_fn =
+            ConvBackward((Tensor *[]){new_tensor},
+                         (Tensor *[]){cast, cast_weight, cast_bias}, 1,
+                         num_operands);
+
+        ConvCtx ctx = {.params = *params};
+        set_ctx(backward_fn, &ctx, CONV_CTX);
+        set_backward_fn(new_tensor, backward_fn);
+    }
+    tangent_conv(new_tensor, cast, cast_weight, cast_bias, params);
+
+    if (cast != input)
+        tensor_release(cast);
+    if (cast_weight != weight)
+        tensor_release(cast_weight);
+    if (cast_bias != bias)
+        tensor_release(cast_bias);
+
+    return new_tensor;
+}
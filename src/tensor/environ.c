@@ -18,6 +18,27 @@ struct Environment {
     bool lock;
 };
 
+// tensors pushed by this thread inside scratch scopes, with their environment
+typedef struct ScratchEntry {
+    Environment *env;
+    Tensor *tensor;
+} ScratchEntry;
+
+static _Thread_local ScratchEntry *scratch = NULL;
+static _Thread_local size_t scratch_size = 0, scratch_capacity = 0;
+static _Thread_local int scratch_depth = 0;
+
+static void _scratch_record(Environment *env, Tensor *tensor) {
+    if (scratch_size == scratch_capacity) {
+        scratch_capacity = scratch_capacity ? 2 * scratch_capacity : 64;
+        scratch = realloc(scratch, scratch_capacity * sizeof(ScratchEntry));
+        if (!scratch)
+            RUNTIME_ERROR(ENV_PUSH_FAILURE, "Memory Re-allocation failure");
+    }
+
+    scratch[scratch_size++] = (ScratchEntry){env, tensor};
+}
+
 Environment *env_init() {
     Environment *env = malloc(sizeof(Environment));
     if (!env)
@@ -41,22 +62,30 @@ void free_env(Environment *env) {
     free(env);
 }
 
+// grad fns of a parallel backward pass push and remove concurrently
 void env_push(Environment *env, Tensor *tensor) {
-    if (env->lock)
-        RUNTIME_ERROR(INVALID_ARRAY, "Invalid access to locked environment");
-
-    if (env->num_tensors == env->capacity) {
-        size_t new_capacity = 2 * env->capacity;
-        Tensor **new_tensors =
-            realloc(env->tensors, new_capacity * sizeof(Tensor *));
-        if (!new_tensors)
-            RUNTIME_ERROR(ENV_PUSH_FAILURE, "Memory Re-allocation failure");
+    _Pragma("omp critical(ctorch_environ)") {
+        if (env->lock)
+            RUNTIME_ERROR(INVALID_ARRAY,
+                          "Invalid access to locked environment");
+
+        if (env->num_tensors == env->capacity) {
+            size_t new_capacity = 2 * env->capacity;
+            Tensor **new_tensors =
+                realloc(env->tensors, new_capacity * sizeof(Tensor *));
+            if (!new_tensors)
+                RUNTIME_ERROR(ENV_PUSH_FAILURE,
+                              "Memory Re-allocation failure");
+
+            env->tensors = new_tensors;
+            env->capacity = new_capacity;
+        }
 
-        env->tensors = new_tensors;
-        env->capacity = new_capacity;
+        env->tensors[env->num_tensors++] = tensor;
     }
 
-    env->tensors[env->num_tensors++] = tensor;
+    if (scratch_depth)
+        _scratch_record(env, tensor);
 }
 
 Tensor *env_pop(Environment *env) {
@@ -73,20 +102,51 @@ bool env_remove_and_free(Environment *env, const Tensor *target) {
     if (!env || !target)
         return false;
 
-    for (size_t i = 0; i < env->num_tensors; i++) {
-        if (env->tensors[i] == target) {
-            free_tensor(env->tensors[i]);
+    bool found = false;
 
-            for (size_t j = i + 1; j < env->num_tensors; j++) {
-                env->tensors[j - 1] = env->tensors[j];
-            }
+    // search from the back, removed tensors are usually recent temporaries
+    _Pragma("omp critical(ctorch_environ)") {
+        for (size_t i = env->num_tensors; i-- > 0;) {
+            if (env->tensors[i] == target) {
+                for (size_t j = i + 1; j < env->num_tensors; j++) {
+                    env->tensors[j - 1] = env->tensors[j];
+                }
 
-            env->num_tensors--;
-            return true;
+                env->num_tensors--;
+                found = true;
+                break;
+            }
         }
     }
 
-    return false;
+    if (found)
+        free_tensor((Tensor *)target);
+
+    return found;
+}
+
+size_t env_scratch_begin() {
+    scratch_depth++;
+    return scratch_size;
+}
+
+// newest first, tensors the scope already freed are no longer found
+void env_scratch_end(size_t mark) {
+    if (scratch_depth == 0)
+        RUNTIME_ERROR(INVALID_ARRAY,
+                      "env_scratch_end called outside of a scratch scope");
+
+    scratch_depth--;
+    while (scratch_size > mark) {
+        ScratchEntry entry = scratch[--scratch_size];
+        env_remove_and_free(entry.env, entry.tensor);
+    }
+
+    if (scratch_depth == 0) {
+        free(scratch);
+        scratch = NULL;
+        scratch_capacity = 0;
+    }
 }
 
 Tensor **get_tensors(const Environment *env) { return env->tensors; }
@@ -100,6 +160,10 @@ void open_lock(Environment *env) { env->lock = false; }
 Environment *resolve_environ(Tensor *t1, Tensor *t2) {
     Environment *env1 = get_tensor_environ(t1), *env2 = get_tensor_environ(t2);
 
+    // caller-owned (e.g. inference mode) tensors have no environment
+    if (!env1 || !env2)
+        return env1 ? env1 : env2;
+
     if (env1->lock) {
         if (env2->lock)
             RUNTIME_ERROR(
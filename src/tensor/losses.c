@@ -0,0 +1,77 @@
+#include "amp.h"
+#include "array.h"
+#include "autograd.h"
+#include "capture.h"
+#include "tensor.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+static const BackwardFnInit loss_backward_fns[] = {
+    [LOSS_NLL] = NllLossBackward,
+    [LOSS_CROSS_ENTROPY] = CrossEntropyBackward,
+    [LOSS_MSE] = MseLossBackward,
+    [LOSS_BCE_WITH_LOGITS] = BceWithLogitsBackward,
+};
+
+// losses are computed in fp32 inside autocast regions
+static Tensor *_tensor_loss(Tensor *input, Tensor *target, LossKind kind,
+                            Reduction reduction) {
+    Environment *env = resolve_environ(input, target);
+    Tensor *cast = autocast_fp32_tensor(input, env);
+    Tensor *cast_target = target;
+    if (kind == LOSS_MSE || kind == LOSS_BCE_WITH_LOGITS)
+        cast_target = autocast_fp32_tensor(target, env);
+
+    ndArray *data = get_tensor_data(cast),
+            *target_data = get_tensor_data(cast_target), *loss, *lse = NULL;
+    if (kind == LOSS_CROSS_ENTROPY)
+        loss = array_cross_entropy(data, target_data, reduction, &lse);
+    else if (kind == LOSS_NLL)
+        loss = array_nll_loss(data, target_data, reduction);
+    else
+        loss = array_pointwise_loss(data, target_data, kind, reduction);
+
+    bool requires_grad = is_grad_enabled() && (get_requires_grad(cast) ||
+                                               get_requires_grad(cast_target));
+
+    Tensor *new_tensor = tensor_init(loss, requires_grad, env);
+    if (requires_grad) {
+        BackwardFn *backward_fn = loss_backward_fns[kind](
+            (Tensor *[]){new_tensor}, (Tensor *[]){cast, cast_target}, 1, 2);
+
+        LossCtx ctx = {.kind = kind, .reduction = reduction, .lse = lse};
+        move_ctx(backward_fn, &ctx, LOSS_CTX);
+        set_backward_fn(new_tensor, backward_fn);
+    }
+    tangent_loss(new_tensor, cast, cast_target, kind, reduction, lse);
+    capture_record_params(CAPTURE_LOSS, cast, cast_target, new_tensor, kind,
+                          reduction);
+
+    if (lse && !requires_grad)
+        free_array(lse);
+    if (cast != input)
+        tensor_release(cast);
+    if (cast_target != target)
+        tensor_release(cast_target);
+
+    return new_tensor;
+}
+
+Tensor *tensor_nll_loss(Tensor *input, Tensor *target, Reduction reduction) {
+    return _tensor_loss(input, target, LOSS_NLL, reduction);
+}
+
+Tensor *tensor_cross_entropy(Tensor *logits, Tensor *target,
+                             Reduction reduction) {
+    return _tensor_loss(logits, target, LOSS_CROSS_ENTROPY, reduction);
+}
+
+Tensor *tensor_mse_loss(Tensor *input, Tensor *target, Reduction reduction) {
+    return _tensor_loss(input, target, LOSS_MSE, reduction);
+}
+
+Tensor *tensor_bce_with_logits(Tensor *logits, Tensor *target,
+                               Reduction reduction) {
+    return _tensor_loss(logits, target, LOSS_BCE_WITH_LOGITS, reduction);
+}
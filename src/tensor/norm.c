@@ -0,0 +1,70 @@
+#include "amp.h"
+#include "array.h"
+#include "autograd.h"
+#include "capture.h"
+#include "tensor.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+Tensor *tensor_norm(Tensor *input, Tensor *weight, Tensor *bias,
+                    Tensor *running_mean, Tensor *running_var,
+                    const NormParams *params) {
+    capture_unsupported("Normalizations");
+
+    Environment *env = weight ? resolve_environ(input, weight)
+                              : get_tensor_environ(input);
+    Tensor *cast = autocast_fp32_tensor(input, env),
+           *cast_weight = weight ? autocast_fp32_tensor(weight, env) : NULL,
+           *cast_bias = bias ? autocast_fp32_tensor(bias, env) : NULL;
+
+    bool requires_grad =
+        is_grad_enabled() &&
+        (get_requires_grad(cast) ||
+         (cast_weight && get_requires_grad(cast_weight)) ||
+         (cast_bias && get_requires_grad(cast_bias)));
+    bool has_tangent = get_tensor_tangent(cast) ||
+                       (cast_weight && get_tensor_tangent(cast_weight)) ||
+                       (cast_bias && get_tensor_tangent(cast_bias));
+
+    ndArray *stats = NULL;
+    ndArray *data = array_norm(
+        get_tensor_data(cast),
+        cast_weight ? get_tensor_data(cast_weight) : NULL,
+        cast_bias ? get_tensor_data(cast_bias) : NULL,
+        running_mean ? get_tensor_data(running_mean) : NULL,
+        running_var ? get_tensor_data(running_var) : NULL, params,
+        requires_grad || has_tangent ? &stats : NULL);
+
+    Tensor *new_tensor = tensor_init(data, requires_grad, env);
+    if (requires_grad) {
+        Tensor *operands[3] = {cast};
+        size_t num_operands = 1;
+        if (cast_weight)
+            operands[num_operands++] = cast_weight;
+        if (cast_bias)
+            operands[num_operands++] = cast_bias;
+
+        BackwardFn *backward_fn = NormBackward((Tensor *[]){new_tensor},
+                                               operands, 1, num_operands);
+
+        NormCtx ctx = {.params = *params,
+                       .stats = stats,
+                       .has_weight = cast_weight != NULL,
+                       .has_bias = cast_bias != NULL};
+        move_ctx(backward_fn, &ctx, NORM_CTX);
+        set_backward_fn(new_tensor, backward_fn);
+    }
+    tangent_norm(new_tensor, cast, cast_weight, cast_bias, params, stats);
+
+    if (stats && !requires_grad)
+        free_array(stats);
+    if (cast != input)
+        tensor_release(cast);
+    if (cast_weight != weight)
+        tensor_release(cast_weight);
+    if (cast_bias != bias)
+        tensor_release(cast_bias);
+
+    return new_tensor;
+}
@@ -0,0 +1,48 @@
+#include "amp.h"
+#include "array.h"
+#include "autograd.h"
+#include "capture.h"
+#include "tensor.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+static const BackwardFnInit pool_backward_fns[] = {
+    [POOL_MAX] = MaxPoolBackward,
+    [POOL_AVG] = AvgPoolBackward,
+    [POOL_ADAPTIVE_AVG] = AvgPoolBackward,
+};
+
+// the node keeps the argmax indices, not the input
+Tensor *tensor_pool(Tensor *tensor, const PoolParams *params) {
+    capture_unsupported("Pooling");
+
+    Environment *env = get_tensor_environ(tensor);
+    Tensor *cast = autocast_fp32_tensor(tensor, env);
+
+    bool requires_grad = is_grad_enabled() && get_requires_grad(cast);
+    bool keep_indices = params->kind == POOL_MAX &&
+                        (requires_grad || get_tensor_tangent(cast));
+
+    ndArray *indices = NULL;
+    ndArray *data = array_pool(get_tensor_data(cast), params,
+                               keep_indices ? &indices : NULL);
+
+    Tensor *new_tensor = tensor_init(data, requires_grad, env);
+    if (requires_grad) {
+        BackwardFn *backward_fn = pool_backward_fns[params->kind](
+            (Tensor *[]){new_tensor}, (Tensor *[]){cast}, 1, 1);
+
+        PoolCtx ctx = {.params = *params, .indices = indices};
+        move_ctx(backward_fn, &ctx, POOL_CTX);
+        set_backward_fn(new_tensor, backward_fn);
+    }
+    tangent_pool(new_tensor, cast, params, indices);
+
+    if (indices && !requires_grad)
+        free_array(indices);
+    if (cast != tensor)
+        tensor_release(cast);
+
+    return new_tensor;
+}
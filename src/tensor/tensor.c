@@ -1,7 +1,9 @@
 #include "tensor.h"
 #include "array.h"
 #include "autograd.h"
+#include "capture.h"
 #include "error_codes.h"
+#include "sparse.h"
 
 #include <stdbool.h>
 #include <stddef.h>
@@ -13,9 +15,22 @@
 struct Tensor {
     ndArray *data;
     Tensor *grad;
+    SparseArray *sparse_factor; // deferred `sparse^T @ data` gradient, owned
+    ndArray *tangent; // forward-mode directional derivative, owned
     BackwardFn *backward_fn;
     Environment *env;
     bool requires_grad;
+    bool saved; // some node reads `data` during backward
+    bool released; // given up by `tensor_release`, freed with its graph
+
+    void *packed; // `data` packed by saved-tensor hooks once released
+    SavedTensorHooks hooks; // active when it was saved, `pack` NULL if none
+    int num_unpacked; // nodes reading the buffer unpacked after a drop
+    // autocast's cast cache: the copy made for region `autocast_region`, and
+    // the tensor a cached copy was made from
+    Tensor *autocast_copy;
+    Tensor *autocast_source;
+    unsigned long autocast_region;
 };
 
 struct TensorHeader {
@@ -28,7 +43,8 @@ struct TensorHeader {
 Tensor *tensor_init(ndArray *data, bool requires_grad, Environment *env) {
     if (requires_grad) {
         DType dtype = get_dtype(data);
-        if (!(dtype == DTYPE_FLOAT || dtype == DTYPE_DOUBLE))
+        if (!(dtype == DTYPE_FLOAT || dtype == DTYPE_DOUBLE ||
+              dtype == DTYPE_BF16 || dtype == DTYPE_HALF))
             RUNTIME_ERROR(TENSOR_INIT_FAILURE,
                           "Invalid argument `requires_grad=True` for non-float "
                           "tensor");
@@ -40,10 +56,24 @@ Tensor *tensor_init(ndArray *data, bool requires_grad, Environment *env) {
 
     tensor->data = data;
     tensor->grad = NULL;
+    tensor->sparse_factor = NULL;
+    tensor->tangent = NULL;
+
+    // inference mode tensors are owned by the caller
+    if (is_inference_mode())
+        env = NULL;
 
     tensor->backward_fn = NULL;
     tensor->env = env;
     tensor->requires_grad = requires_grad;
+    tensor->saved = false;
+    tensor->released = false;
+    tensor->packed = NULL;
+    tensor->hooks = (SavedTensorHooks){0};
+    tensor->num_unpacked = 0;
+    tensor->autocast_copy = NULL;
+    tensor->autocast_source = NULL;
+    tensor->autocast_region = 0;
 
     if (env)
         env_push(env, tensor);
@@ -56,11 +86,112 @@ void free_tensor(Tensor *tensor) {
         return;
 
     free_array(tensor->data);
+    if (tensor->sparse_factor)
+        free_sparse(tensor->sparse_factor);
+    if (tensor->packed)
+        tensor->hooks.free_packed(tensor->hooks.ctx, tensor->packed);
+    if (tensor->tangent)
+        free_array(tensor->tangent);
     free_backward_fn(tensor->backward_fn);
+    if (tensor->grad && !tensor->grad->env)
+        free_tensor(tensor->grad);
+    if (tensor->autocast_copy)
+        tensor->autocast_copy->autocast_source = NULL;
+    if (tensor->autocast_source)
+        tensor->autocast_source->autocast_copy = NULL;
 
     free(tensor);
 }
 
+// keeps the shape, dtype and strides of `data` without its buffer
+static void _drop_buffer(Tensor *tensor) {
+    ndArray *data = tensor->data;
+    ndArray *header = array_from_buffer(get_ndim(data), get_shape(data),
+                                        get_dtype(data), NULL);
+    set_strides(header, get_strides(data));
+    replace_tensor_data(tensor, header);
+}
+
+static void _pack(Tensor *tensor, const SavedTensorHooks *hooks) {
+    tensor->hooks = *hooks;
+    tensor->packed = hooks->pack(hooks->ctx, tensor->data);
+}
+
+/*
+ * Frees a temporary created inside a composite op or module. Tensors made
+ * in inference mode are freed outright, everything else belongs to an
+ * environment and only loses its buffer: right away if no node saved it
+ * (the shape and dtype stay for the backward pass), once it is packed if
+ * saved-tensor hooks were active when it was saved (or are now). A backward
+ * pass that frees the graph frees the tensor itself. Captured graphs rerun
+ * into the buffers and keep them.
+ */
+void tensor_release(Tensor *tensor) {
+    if (!tensor)
+        return;
+
+    if (!tensor->env) {
+        if (is_inference_mode())
+            free_tensor(tensor);
+        return;
+    }
+
+    if (is_capturing())
+        return;
+    tensor->released = true;
+
+    // autocast's cast cache hands the copy out again
+    if (tensor->autocast_source || !get_array_data(tensor->data))
+        return;
+
+    if (tensor->saved && !tensor->packed) {
+        const SavedTensorHooks *hooks =
+            tensor->hooks.pack ? &tensor->hooks : get_saved_tensor_hooks();
+        if (!hooks)
+            return;
+
+        _pack(tensor, hooks);
+    }
+
+    _drop_buffer(tensor);
+}
+
+/*
+ * Nodes that share a saved tensor may run as concurrent backward tasks. A
+ * tensor whose buffer is still live is read as is, only a dropped buffer is
+ * unpacked.
+ */
+void tensor_unpack(Tensor *tensor) {
+    if (!tensor->packed)
+        return;
+
+    _Pragma("omp critical(ctorch_saved_tensors)") {
+        bool dropped = tensor->num_unpacked > 0 ||
+                       !get_array_data(tensor->data);
+        if (dropped && tensor->num_unpacked++ == 0) {
+            ndArray *like = tensor->data;
+            ndArray *data =
+                tensor->hooks.unpack(tensor->hooks.ctx, tensor->packed, like);
+            if (get_dtype(data) != get_dtype(like) ||
+                get_total_size(data) != get_total_size(like))
+                RUNTIME_ERROR(SAVED_TENSOR_HOOK_FAILURE,
+                              "Unpacked tensor does not match the saved one");
+
+            replace_tensor_data(tensor, data);
+        }
+    }
+}
+
+void tensor_repack(Tensor *tensor) {
+    if (!tensor->packed)
+        return;
+
+    _Pragma("omp critical(ctorch_saved_tensors)") {
+        if (tensor->num_unpacked > 0 && --tensor->num_unpacked == 0)
+            _drop_buffer(tensor);
+    }
+}
+
 void save_tensor(Tensor *tensor, const char *path) {
     FILE *file = fopen(path, "wb");
     if (!file)
@@ -146,6 +277,7 @@ Tensor *load_tensor(const char *path, bool requires_grad, Environment *env) {
 
 ndArray *get_tensor_data(const Tensor *tensor) { return tensor->data; }
 Tensor *get_tensor_grad(const Tensor *tensor) { return tensor->grad; }
+ndArray *get_tensor_tangent(const Tensor *tensor) { return tensor->tangent; }
 bool get_requires_grad(const Tensor *tensor) { return tensor->requires_grad; }
 int get_tensor_ndim(const Tensor *tensor) { return get_ndim(tensor->data); }
 
@@ -156,10 +288,24 @@ size_t *get_tensor_shape(const Tensor *tensor) {
 DType get_tensor_dtype(const Tensor *tensor) { return get_dtype(tensor->data); }
 Environment *get_tensor_environ(const Tensor *tensor) { return tensor->env; }
 
+// hands a caller-owned tensor, e.g. made in inference mode, to `env`
+void set_tensor_environ(Tensor *tensor, Environment *env) {
+    if (tensor->env)
+        RUNTIME_ERROR(ENV_PUSH_FAILURE,
+                      "Tensor already belongs to an environment");
+
+    tensor->env = env;
+    if (env)
+        env_push(env, tensor);
+}
+
 BackwardFn *get_backward_fn(const Tensor *tensor) {
     return tensor->backward_fn;
 }
 
+bool is_tensor_released(const Tensor *tensor) { return tensor->released; }
+bool is_tensor_saved(const Tensor *tensor) { return tensor->saved; }
+
 void set_requires_grad(Tensor *tensor, bool requires_grad) {
     tensor->requires_grad = requires_grad;
 }
@@ -171,42 +317,111 @@ void replace_tensor_data(Tensor *tensor, ndArray *data) {
     tensor->data = data;
 }
 
+// a gradient without an environment is owned by its tensor
 void set_tensor_grad(Tensor *tensor, Tensor *grad) {
     if (tensor->grad) {
         Environment *env = tensor->grad->env;
-        bool removed = env_remove_and_free(env, tensor->grad);
-        if (!removed)
+        if (!env)
+            free_tensor(tensor->grad);
+        else if (!env_remove_and_free(env, tensor->grad))
             RUNTIME_ERROR(INVALID_GRAD, "Gradient not found in envment");
     }
 
     tensor->grad = grad;
 }
 
+Tensor *sparse_grad_init(SparseArray *sparse, ndArray *data,
+                         Environment *env) {
+    Tensor *grad = tensor_init(data, NO_GRAD, env);
+    grad->sparse_factor = sparse;
+
+    return grad;
+}
+
+SparseArray *get_sparse_grad_factor(const Tensor *tensor) {
+    return tensor->sparse_factor;
+}
+
+void sparse_grad_densify(Tensor *grad) {
+    if (!grad->sparse_factor)
+        return;
+
+    replace_tensor_data(grad, spmm_t(grad->sparse_factor, grad->data));
+    free_sparse(grad->sparse_factor);
+    grad->sparse_factor = NULL;
+}
+
+// the tensor takes ownership of `tangent`, NULL drops the current one
+void set_tensor_tangent(Tensor *tensor, ndArray *tangent) {
+    if (tangent) {
+        int ndim = get_ndim(tensor->data);
+        bool valid = get_ndim(tangent) == ndim &&
+                     get_dtype(tangent) == get_dtype(tensor->data);
+        for (int d = 0; valid && d < ndim; d++)
+            valid = get_shape(tangent)[d] == get_shape(tensor->data)[d];
+
+        if (!valid)
+            RUNTIME_ERROR(INVALID_GRAD,
+                          "Tangent must match the tensor's shape and dtype");
+    }
+
+    if (tensor->tangent)
+        free_array(tensor->tangent);
+
+    tensor->tangent = tangent;
+}
+
 void set_backward_fn(Tensor *tensor, BackwardFn *backward_fn) {
     tensor->backward_fn = backward_fn;
 }
 
+Tensor *get_autocast_copy(const Tensor *tensor, unsigned long region) {
+    return tensor->autocast_region == region ? tensor->autocast_copy : NULL;
+}
+
+void set_autocast_copy(Tensor *tensor, Tensor *copy, unsigned long region) {
+    if (tensor->autocast_copy)
+        tensor->autocast_copy->autocast_source = NULL;
+
+    tensor->autocast_copy = copy;
+    tensor->autocast_region = region;
+    copy->autocast_source = tensor;
+}
+
+/*
+ * Inside a saved-tensor hooks region the tensor remembers the hooks and is
+ * packed with them when it is released, even after the region is gone.
+ * Captured graphs rerun into the saved buffers and are not packed.
+ */
+void mark_tensor_saved(Tensor *tensor) {
+    tensor->saved = true;
+
+    const SavedTensorHooks *hooks = get_saved_tensor_hooks();
+    if (hooks && !tensor->packed && !is_capturing())
+        tensor->hooks = *hooks;
+}
+
+/*
+ * An existing gradient is zeroed in place, so views into a flat gradient
+ * buffer stay views. A new one is owned by the tensor instead of joining
+ * its environment, which keeps gradients out of module parameter lists.
+ */
 void zero_grad(Tensor *tensor) {
     int ndim = get_ndim(tensor->data);
     const size_t *shape = get_shape(tensor->data);
     DType dtype = get_dtype(tensor->data);
 
     if (tensor->grad) {
-        replace_tensor_data(tensor->grad, zeros(ndim, shape, dtype));
+        ndArray *grad = tensor->grad->data;
+        if (is_array_contiguous(grad))
+            memset(get_array_data(grad), 0,
+                   get_total_size(grad) * get_itemsize(grad));
+        else
+            replace_tensor_data(tensor->grad, zeros(ndim, shape, dtype));
         return;
     }
 
-    Environment *env = tensor->env;
-    bool was_locked = false;
-    if (get_lock(env)) {
-        open_lock(env);
-        was_locked = true;
-    }
-
-    tensor->grad = zeros_tensor(ndim, shape, dtype, false, env);
-
-    if (was_locked)
-        set_lock(env);
+    tensor->grad = zeros_tensor(ndim, shape, dtype, false, NULL);
 }
 
 Tensor *eye_tensor(size_t m, size_t n, DType dtype, bool requires_grad,
@@ -265,7 +480,5 @@ ArrayVal item(const Tensor *tensor) {
         RUNTIME_ERROR(INVALID_DIM, "Invalid ndim for item");
 
     ndArray *data = get_tensor_data(tensor);
-    const ArrayVal *x = (ArrayVal *)get_array_data(data);
-    ArrayVal value = x[0];
-    return value;
+    return get_value(data, NULL);
 }
@@ -1,5 +1,9 @@
+#include "amp.h"
 #include "array.h"
 #include "autograd.h"
+#include "capture.h"
+#include "error_codes.h"
+#include "sparse.h"
 #include "tensor.h"
 
 #include <stdbool.h>
@@ -16,7 +20,7 @@ Tensor *tensor_transpose(Tensor *tensor, int *dims) {
     }
 
     ndArray *_data = get_tensor_data(tensor);
-    bool requires_grad = get_requires_grad(tensor);
+    bool requires_grad = is_grad_enabled() && get_requires_grad(tensor);
 
     Environment *env = get_tensor_environ(tensor);
     ndArray *data = transpose(_data, dims);
@@ -31,6 +35,8 @@ Tensor *tensor_transpose(Tensor *tensor, int *dims) {
         set_ctx(backward_fn, &ctx, TRANSPOSE_CTX);
         set_backward_fn(new_tensor, backward_fn);
     }
+    tangent_transpose(new_tensor, tensor, dims);
+    capture_record(CAPTURE_TRANSPOSE, tensor, NULL, new_tensor);
 
     return new_tensor;
 }
@@ -47,7 +53,7 @@ Tensor *tensor_transpose_env(Tensor *tensor, int *dims, Environment *env) {
     }
 
     ndArray *_data = get_tensor_data(tensor);
-    bool requires_grad = get_requires_grad(tensor);
+    bool requires_grad = is_grad_enabled() && get_requires_grad(tensor);
 
     ndArray *data = transpose(_data, dims);
     Tensor *new_tensor = tensor_init(data, requires_grad, env);
@@ -61,41 +67,118 @@ Tensor *tensor_transpose_env(Tensor *tensor, int *dims, Environment *env) {
         set_ctx(backward_fn, &ctx, TRANSPOSE_CTX);
         set_backward_fn(new_tensor, backward_fn);
     }
+    tangent_transpose(new_tensor, tensor, dims);
+    capture_record(CAPTURE_TRANSPOSE, tensor, NULL, new_tensor);
 
     return new_tensor;
 }
 
 Tensor *tensor_matmul(Tensor *t1, Tensor *t2) {
-    ndArray *data1 = get_tensor_data(t1), *data2 = get_tensor_data(t2);
+    Environment *env = resolve_environ(t1, t2);
+    Tensor *a1 = autocast_tensor(t1, env), *a2 = autocast_tensor(t2, env);
+
+    ndArray *data1 = get_tensor_data(a1), *data2 = get_tensor_data(a2);
     ndArray *data = matmul(data1, data2);
 
-    bool t1_requires_grad = get_requires_grad(t1),
-         t2_requires_grad = get_requires_grad(t2);
-    bool requires_grad = t1_requires_grad || t2_requires_grad;
+    bool t1_requires_grad = get_requires_grad(a1),
+         t2_requires_grad = get_requires_grad(a2);
+    bool requires_grad =
+        is_grad_enabled() && (t1_requires_grad || t2_requires_grad);
 
-    Environment *env = resolve_environ(t1, t2);
     Tensor *tensor = tensor_init(data, requires_grad, env);
     if (requires_grad) {
         BackwardFn *backward_fn =
-            MatMulBackward((Tensor *[]){tensor}, (Tensor *[]){t1, t2}, 1, 2);
+            MatMulBackward((Tensor *[]){tensor}, (Tensor *[]){a1, a2}, 1, 2);
         set_backward_fn(tensor, backward_fn);
     }
+    tangent_matmul(tensor, a1, a2);
+    capture_record(CAPTURE_MATMUL, a1, a2, tensor);
+
+    if (a1 != t1)
+        tensor_release(a1);
+    if (a2 != t2)
+        tensor_release(a2);
 
     return tensor;
 }
 
 Tensor *tensor_sum(Tensor *tensor) {
-    ndArray *data_ = get_tensor_data(tensor);
-    bool requires_grad = get_requires_grad(tensor);
+    Environment *env = get_tensor_environ(tensor);
+    Tensor *cast = autocast_fp32_tensor(tensor, env);
+
+    ndArray *data_ = get_tensor_data(cast);
+    bool requires_grad = is_grad_enabled() && get_requires_grad(cast);
     ndArray *data = array_sum(data_);
 
-    Tensor *new_tensor =
-        tensor_init(data, requires_grad, get_tensor_environ(tensor));
+    Tensor *new_tensor = tensor_init(data, requires_grad, env);
+    if (requires_grad) {
+        BackwardFn *backward_fn =
+            SumBackward((Tensor *[]){new_tensor}, (Tensor *[]){cast}, 1, 1);
+        set_backward_fn(new_tensor, backward_fn);
+    }
+    tangent_sum(new_tensor, cast);
+    capture_record(CAPTURE_SUM, cast, NULL, new_tensor);
+
+    if (cast != tensor)
+        tensor_release(cast);
+
+    return new_tensor;
+}
+
+/*
+ * Sparse-dense product, `sparse` is treated as a constant (no gradient).
+ * With `sparse_grad` and a leaf `dense`, backward hands AccumulateGrad a
+ * deferred gradient (see `sparse_grad_init`) that is scattered into the rows
+ * of `dense`'s gradient touched by non-zeros instead of producing a dense
+ * (k, n) gradient tensor.
+ */
+Tensor *tensor_spmm(SparseArray *sparse, Tensor *dense, bool sparse_grad,
+                    Environment *env) {
+    if (is_capturing())
+        RUNTIME_ERROR(INVALID_CAPTURE_STATE, "tensor_spmm cannot be captured");
+
+    ndArray *data = spmm(sparse, get_tensor_data(dense));
+    bool requires_grad = is_grad_enabled() && get_requires_grad(dense);
+
+    Tensor *tensor = tensor_init(data, requires_grad, env);
+    if (requires_grad) {
+        BackwardFn *backward_fn =
+            SpMMBackward((Tensor *[]){tensor}, (Tensor *[]){dense}, 1, 1);
+
+        SpMMCtx ctx = {.sparse = sparse,
+                       .sparse_grad = sparse_grad && is_leaf_tensor(dense)};
+        set_ctx(backward_fn, &ctx, SPMM_CTX);
+        set_backward_fn(tensor, backward_fn);
+    }
+    tangent_spmm(tensor, sparse, dense);
+
+    return tensor;
+}
+
+Tensor *tensor_to(Tensor *tensor, DType dtype) {
+    return tensor_to_env(tensor, dtype, get_tensor_environ(tensor));
+}
+
+/*
+ * Casting to the tensor's own dtype is a no-op and returns `tensor` itself,
+ * casting to an integer dtype detaches the result from the graph.
+ */
+Tensor *tensor_to_env(Tensor *tensor, DType dtype, Environment *env) {
+    if (get_tensor_dtype(tensor) == dtype)
+        return tensor;
+
+    ndArray *data = array_cast(get_tensor_data(tensor), dtype);
+    bool requires_grad = is_grad_enabled() && get_requires_grad(tensor) &&
+                         dtype != DTYPE_INT && dtype != DTYPE_LONG;
+
+    Tensor *new_tensor = tensor_init(data, requires_grad, env);
     if (requires_grad) {
         BackwardFn *backward_fn =
-            SumBackward((Tensor *[]){new_tensor}, (Tensor *[]){tensor}, 1, 1);
+            CastBackward((Tensor *[]){new_tensor}, (Tensor *[]){tensor}, 1, 1);
         set_backward_fn(new_tensor, backward_fn);
     }
+    tangent_cast(new_tensor, tensor);
+    capture_record(CAPTURE_CAST, tensor, NULL, new_tensor);
 
     return new_tensor;
 }
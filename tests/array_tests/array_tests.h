@@ -31,4 +31,17 @@ void test_array_transpose();
 void test_array_sum();
 void test_array_sum_dim();
 
+// half precision tests
+void test_half_conversion();
+void test_half_array_ops();
+void test_half_io();
+
+// cast tests
+void test_array_cast();
+void test_dtype_promotion();
+
+// sparse array tests
+void test_sparse_conversion();
+void test_spmm();
+
 #endif // !ARRAY_TESTS_H
@@ -0,0 +1,101 @@
+#include "array.h"
+#include "array_tests.h"
+
+#include <CUnit/CUnit.h>
+#include <omp.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+void test_array_cast() {
+    const size_t shape[] = {2, 3};
+    int ndim = sizeof(shape) / sizeof(shape[0]);
+
+    ndArray *ints = array_init(ndim, shape, DTYPE_INT);
+    populate_array(ints, (const int[]){1, -2, 3, 4, 5, -6});
+
+    ndArray *floats = array_cast(ints, DTYPE_FLOAT);
+    ndArray *expected = array_init(ndim, shape, DTYPE_FLOAT);
+    populate_array(expected,
+                   (const float[]){1.0f, -2.0f, 3.0f, 4.0f, 5.0f, -6.0f});
+    CU_ASSERT(array_equal(floats, expected));
+
+    // floating -> integer truncates toward zero
+    ndArray *fractions = array_init(ndim, shape, DTYPE_FLOAT);
+    populate_array(fractions,
+                   (const float[]){1.7f, -2.7f, 3.2f, 4.9f, 5.0f, -6.5f});
+    ndArray *truncated = array_cast(fractions, DTYPE_INT);
+    CU_ASSERT(array_equal(truncated, ints));
+
+    // transposed arrays keep their strides through the cast
+    ndArray *transposed = transpose(expected, (const int[]){1, 0});
+    ndArray *doubles = array_cast(transposed, DTYPE_DOUBLE);
+    for (size_t i = 0; i < shape[0]; i++) {
+        for (size_t j = 0; j < shape[1]; j++) {
+            float value = get_value(expected, (const size_t[]){i, j}).float_val;
+            CU_ASSERT(get_value(doubles, (const size_t[]){j, i}).double_val ==
+                      (double)value);
+        }
+    }
+
+    free_array(ints);
+    free_array(floats);
+    free_array(expected);
+    free_array(fractions);
+    free_array(truncated);
+    free_array(transposed);
+    free_array(doubles);
+}
+
+void test_dtype_promotion() {
+    CU_ASSERT(promote_types(DTYPE_INT, DTYPE_FLOAT) == DTYPE_FLOAT);
+    CU_ASSERT(promote_types(DTYPE_LONG, DTYPE_DOUBLE) == DTYPE_DOUBLE);
+    CU_ASSERT(promote_types(DTYPE_INT, DTYPE_LONG) == DTYPE_LONG);
+    CU_ASSERT(promote_types(DTYPE_HALF, DTYPE_FLOAT) == DTYPE_FLOAT);
+    CU_ASSERT(promote_types(DTYPE_BF16, DTYPE_HALF) == DTYPE_FLOAT);
+
+    ndArray *ints = array_init(1, (const size_t[]){3}, DTYPE_INT);
+    populate_array(ints, (const int[]){1, 2, 3});
+
+    ndArray *floats = array_init(2, (const size_t[]){2, 3}, DTYPE_FLOAT);
+    populate_array(floats,
+                   (const float[]){0.5f, 1.0f, 1.5f, -1.0f, -2.0f, -3.0f});
+
+    ndArray *halves = array_init(1, (const size_t[]){3}, DTYPE_HALF);
+    populate_array(halves, (const uint16_t[]){0x3c00, 0x4000, 0x3800});
+
+    set_dtype_promotion(true);
+
+    // broadcast int operand read straight from its buffer
+    ndArray *sum = array_add(floats, ints);
+    ndArray *expected_sum = array_init(2, (const size_t[]){2, 3}, DTYPE_FLOAT);
+    populate_array(expected_sum,
+                   (const float[]){1.5f, 3.0f, 4.5f, 0.0f, 0.0f, 0.0f});
+    CU_ASSERT(get_dtype(sum) == DTYPE_FLOAT);
+    CU_ASSERT(array_equal(sum, expected_sum));
+
+    // half operand is cast once before the fp32 kernel
+    ndArray *prod = array_mul(halves, floats);
+    ndArray *expected_prod =
+        array_init(2, (const size_t[]){2, 3}, DTYPE_FLOAT);
+    populate_array(expected_prod,
+                   (const float[]){0.5f, 2.0f, 0.75f, -1.0f, -4.0f, -1.5f});
+    CU_ASSERT(array_equal(prod, expected_prod));
+
+    // other threads keep their own setting
+    bool other_thread = false;
+    _Pragma("omp parallel num_threads(2)") {
+        if (omp_get_thread_num() == 1)
+            other_thread = get_dtype_promotion();
+    }
+    CU_ASSERT_FALSE(other_thread);
+
+    set_dtype_promotion(false);
+
+    free_array(ints);
+    free_array(floats);
+    free_array(halves);
+    free_array(sum);
+    free_array(expected_sum);
+    free_array(prod);
+    free_array(expected_prod);
+}
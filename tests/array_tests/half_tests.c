@@ -0,0 +1,173 @@
+#include "array.h"
+#include "array_tests.h"
+#include "print.h"
+#include "tensor.h"
+
+#include <CUnit/CUnit.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+void test_half_conversion() {
+    CU_ASSERT(float_to_bf16(1.0f) == 0x3f80);
+    CU_ASSERT(float_to_half(1.0f) == 0x3c00);
+    CU_ASSERT(float_to_half(-2.0f) == 0xc000);
+    CU_ASSERT(float_to_half(65504.0f) == 0x7bff);
+    CU_ASSERT(float_to_half(1e6f) == 0x7c00);
+
+    // smallest half subnormal and round-to-nearest-even in bf16
+    CU_ASSERT(half_to_float(0x0001) == 5.9604644775390625e-8f);
+    CU_ASSERT(float_to_half(5.9604644775390625e-8f) == 0x0001);
+    CU_ASSERT(float_to_bf16(1.00390625f) == 0x3f80);
+    CU_ASSERT(float_to_bf16(1.01171875f) == 0x3f82);
+
+    const float src[] = {0.0f, -1.5f, 3.140625f, 1024.0f, -0.0078125f,
+                         7.0f, 0.25f, 65504.0f, 100.0f};
+    size_t n = sizeof(src) / sizeof(src[0]);
+
+    uint16_t bf16[n], half[n];
+    float bf16_back[n], half_back[n];
+    float_to_bf16_buffer(src, bf16, n);
+    float_to_half_buffer(src, half, n);
+    bf16_to_float_buffer(bf16, bf16_back, n);
+    half_to_float_buffer(half, half_back, n);
+
+    for (size_t i = 0; i < n; i++) {
+        CU_ASSERT(half_back[i] == src[i]);
+        CU_ASSERT(bf16_to_float(float_to_bf16(src[i])) == bf16_back[i]);
+    }
+}
+
+void test_half_array_ops() {
+    const size_t shape[] = {64, 64};
+    int ndim = sizeof(shape) / sizeof(shape[0]);
+
+    // 4096 ones would saturate at 256 with bf16 accumulation
+    ndArray *bf16_ones = ones(ndim, shape, DTYPE_BF16);
+    ndArray *bf16_sum = array_sum(bf16_ones);
+    CU_ASSERT(get_value(bf16_sum, NULL).float_val == 4096.0f);
+
+    ndArray *half_ones = ones(ndim, shape, DTYPE_HALF);
+    ndArray *half_sum = array_add(half_ones, half_ones);
+    ndArray *half_twos = array_init(ndim, shape, DTYPE_HALF);
+    size_t idx[2];
+    for (size_t i = 0; i < shape[0]; i++) {
+        for (size_t j = 0; j < shape[1]; j++) {
+            idx[0] = i, idx[1] = j;
+            set_value(half_twos, idx, (ArrayVal){.float_val = 2.0f});
+        }
+    }
+    CU_ASSERT(array_equal(half_sum, half_twos));
+
+    const float data1[] = {0.47f, -0.68f, 0.24f,  -1.70f, 0.75f,  -1.53f,
+                           0.01f, -0.12f, -0.81f, 2.87f,  -0.60f, 0.47f};
+    const float data2[] = {-1.00f, -0.71f, 0.04f, -0.68f, -0.57f, -0.11f};
+    const float data3[] = {-0.6338f, 0.1026f, 2.6016f,  0.8652f,
+                           0.4468f,  0.1636f, -3.1602f, -1.6807f};
+
+    ndArray *arr1 = array_init(2, (size_t[]){4, 3}, DTYPE_HALF),
+            *arr2 = array_init(2, (size_t[]){3, 2}, DTYPE_HALF),
+            *arr3 = array_init(2, (size_t[]){4, 2}, DTYPE_HALF);
+
+    uint16_t buf1[12], buf2[6], buf3[8];
+    float_to_half_buffer(data1, buf1, 12);
+    float_to_half_buffer(data2, buf2, 6);
+    float_to_half_buffer(data3, buf3, 8);
+    populate_array(arr1, buf1);
+    populate_array(arr2, buf2);
+    populate_array(arr3, buf3);
+
+    ndArray *result = matmul(arr1, arr2);
+    CU_ASSERT(array_equal(result, arr3));
+
+    // a transposed operand is widened as is and handed to the GEMM transposed
+    float data1_T[12];
+    for (size_t i = 0; i < 4; i++)
+        for (size_t j = 0; j < 3; j++)
+            data1_T[j * 4 + i] = data1[i * 3 + j];
+
+    uint16_t buf1_T[12];
+    float_to_half_buffer(data1_T, buf1_T, 12);
+    ndArray *arr1_T = array_init(2, (size_t[]){3, 4}, DTYPE_HALF);
+    populate_array(arr1_T, buf1_T);
+    ndArray *transposed = transpose(arr1_T, (int[]){1, 0});
+    CU_ASSERT(get_strides(transposed)[0] == get_itemsize(transposed));
+
+    ndArray *result_T = matmul(transposed, arr2);
+    CU_ASSERT(array_equal(result_T, arr3));
+    free_array(arr1_T);
+    free_array(transposed);
+    free_array(result_T);
+
+    free_array(bf16_ones);
+    free_array(bf16_sum);
+    free_array(half_ones);
+    free_array(half_sum);
+    free_array(half_twos);
+    free_array(arr1);
+    free_array(arr2);
+    free_array(arr3);
+    free_array(result);
+}
+
+// what print_array writes to stdout
+static void _print_to(const ndArray *array, char *out, size_t n) {
+    FILE *capture = tmpfile();
+    CU_ASSERT_FATAL(capture != NULL);
+
+    fflush(stdout);
+    int saved = dup(STDOUT_FILENO);
+    dup2(fileno(capture), STDOUT_FILENO);
+    print_array(array, 0);
+    fflush(stdout);
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+
+    rewind(capture);
+    size_t len = fread(out, 1, n - 1, capture);
+    out[len] = '\0';
+    fclose(capture);
+}
+
+void test_half_io() {
+    const float data[] = {1.5f, -2.25f, 0.0f, 1024.0f, 0.125f, -7.0f};
+    DType dtypes[] = {DTYPE_BF16, DTYPE_HALF};
+
+    for (int i = 0; i < 2; i++) {
+        uint16_t bits[6];
+        if (dtypes[i] == DTYPE_BF16)
+            float_to_bf16_buffer(data, bits, 6);
+        else
+            float_to_half_buffer(data, bits, 6);
+        ndArray *array = array_init(2, (size_t[]){2, 3}, dtypes[i]);
+        populate_array(array, bits);
+
+        // 16-bit tensors round-trip through save and load unchanged
+        char path[] = "/tmp/ctorch_half_XXXXXX";
+        int fd = mkstemp(path);
+        CU_ASSERT_FATAL(fd >= 0);
+        close(fd);
+
+        Tensor *tensor = tensor_init(array, NO_GRAD, NULL);
+        save_tensor(tensor, path);
+        Tensor *loaded = load_tensor(path, NO_GRAD, NULL);
+        remove(path);
+
+        CU_ASSERT(get_tensor_dtype(loaded) == dtypes[i]);
+        CU_ASSERT(array_equal(get_tensor_data(loaded), array));
+
+        // values print as floats, not raw 16-bit patterns
+        char out[256];
+        _print_to(array, out, sizeof(out));
+        CU_ASSERT_PTR_NOT_NULL(strstr(out, "1.5000"));
+        CU_ASSERT_PTR_NOT_NULL(strstr(out, "-2.2500"));
+        CU_ASSERT_PTR_NOT_NULL(strstr(out, "1024.0000"));
+        CU_ASSERT_PTR_NOT_NULL(strstr(out, "-7.0000"));
+
+        free_tensor(tensor);
+        free_tensor(loaded);
+    }
+}
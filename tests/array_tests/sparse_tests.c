@@ -0,0 +1,110 @@
+#include "array.h"
+#include "array_tests.h"
+#include "sparse.h"
+
+#include <CUnit/CUnit.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+void test_sparse_conversion() {
+    const size_t shape[] = {3, 4};
+    int ndim = sizeof(shape) / sizeof(shape[0]);
+
+    ndArray *dense = array_init(ndim, shape, DTYPE_FLOAT);
+    const float data[] = {0.0f, 2.0f, 0.0f, 0.0f, 0.0f, 0.0f,
+                          0.0f, 0.0f, 1.5f, 0.0f, 0.0f, -3.0f};
+    populate_array(dense, data);
+
+    // unsorted COO with the same non-zeros
+    SparseArray *coo =
+        sparse_coo_init(3, 4, 3, (const size_t[]){2, 0, 2},
+                        (const size_t[]){3, 1, 0},
+                        (const float[]){-3.0f, 2.0f, 1.5f}, DTYPE_FLOAT);
+    SparseArray *csr = sparse_to_csr(coo);
+
+    const size_t row_ptr[] = {0, 1, 1, 3}, col_idx[] = {1, 0, 3};
+    for (size_t i = 0; i < 4; i++)
+        CU_ASSERT(get_sparse_row_idx(csr)[i] == row_ptr[i]);
+    for (size_t i = 0; i < 3; i++)
+        CU_ASSERT(get_sparse_col_idx(csr)[i] == col_idx[i]);
+
+    ndArray *from_csr = sparse_to_dense(csr);
+    CU_ASSERT(array_equal(from_csr, dense));
+
+    SparseArray *from_dense = sparse_from_dense(dense, SPARSE_COO);
+    CU_ASSERT(get_sparse_nnz(from_dense) == 3);
+    CU_ASSERT(get_sparse_format(from_dense) == SPARSE_COO);
+
+    SparseArray *transposed = sparse_transpose(from_dense);
+    ndArray *transposed_dense = sparse_to_dense(transposed);
+    ndArray *dense_T = transpose(dense, (int[]){1, 0});
+    CU_ASSERT(array_equal(transposed_dense, dense_T));
+
+    // 16-bit values round-trip through the element conversions
+    DType halves[] = {DTYPE_BF16, DTYPE_HALF};
+    for (int i = 0; i < 2; i++) {
+        uint16_t bits[12];
+        if (halves[i] == DTYPE_BF16)
+            float_to_bf16_buffer(data, bits, 12);
+        else
+            float_to_half_buffer(data, bits, 12);
+        ndArray *narrow = array_init(ndim, shape, halves[i]);
+        populate_array(narrow, bits);
+
+        SparseArray *sparse = sparse_from_dense(narrow, SPARSE_CSR);
+        CU_ASSERT(get_sparse_nnz(sparse) == 3);
+
+        ndArray *back = sparse_to_dense(sparse);
+        CU_ASSERT(array_equal(back, narrow));
+        free_array(back);
+        free_array(narrow);
+        free_sparse(sparse);
+    }
+
+    free_array(dense);
+    free_array(from_csr);
+    free_array(transposed_dense);
+    free_array(dense_T);
+    free_sparse(coo);
+    free_sparse(csr);
+    free_sparse(from_dense);
+    free_sparse(transposed);
+}
+
+void test_spmm() {
+    const size_t shape1[] = {3, 4}, shape2[] = {4, 2};
+    int ndim1 = sizeof(shape1) / sizeof(shape1[0]),
+        ndim2 = sizeof(shape2) / sizeof(shape2[0]);
+
+    ndArray *arr1 = array_init(ndim1, shape1, DTYPE_DOUBLE),
+            *arr2 = array_init(ndim2, shape2, DTYPE_DOUBLE);
+
+    const double data1[] = {0.0, 2.0, 0.0, 0.0, 0.0, 0.0,
+                            0.0, 0.0, 1.5, 0.0, 0.0, -3.0};
+    const double data2[] = {1.0, -1.0, 0.5, 2.0, -0.25, 4.0, 3.0, 0.0};
+    populate_array(arr1, data1);
+    populate_array(arr2, data2);
+
+    SparseArray *sparse = sparse_from_dense(arr1, SPARSE_CSR);
+
+    ndArray *result = spmm(sparse, arr2), *truth = matmul(arr1, arr2);
+    CU_ASSERT(array_equal(result, truth));
+
+    // non-contiguous dense operand
+    ndArray *arr3 = array_init(2, (size_t[]){2, 4}, DTYPE_DOUBLE);
+    populate_array(arr3,
+                   (const double[]){1.0, 0.5, -0.25, 3.0, -1.0, 2.0, 4.0, 0.0});
+    ndArray *arr3_T = transpose(arr3, (int[]){1, 0});
+    ndArray *result_T = spmm(sparse, arr3_T);
+    CU_ASSERT(array_equal(result_T, truth));
+
+    free_array(arr1);
+    free_array(arr2);
+    free_array(arr3);
+    free_array(arr3_T);
+    free_array(result);
+    free_array(result_T);
+    free_array(truth);
+    free_sparse(sparse);
+}
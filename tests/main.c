@@ -1,4 +1,5 @@
 #include "array_tests/array_tests.h"
+#include "ctorch.h"
 #include "tensor_tests/tensor_tests.h"
 
 #include <CUnit/Basic.h>
@@ -8,6 +9,7 @@ void ArrayUnitTests(CU_pSuite array_tests);
 void TensorUnitTests(CU_pSuite tensor_tests);
 
 int main() {
+    CTorchInit();
     CU_initialize_registry();
 
     CU_pSuite array_tests = CU_add_suite("ArrayTestSuite", 0, 0),
@@ -19,6 +21,7 @@ int main() {
     CU_basic_set_mode(CU_BRM_NORMAL);
     CU_basic_run_tests();
     CU_cleanup_registry();
+    CTorchClose();
 
     return 0;
 }
@@ -50,6 +53,20 @@ void ArrayUnitTests(CU_pSuite array_tests) {
     CU_add_test(array_tests, "Array Sum", test_array_sum);
     CU_add_test(array_tests, "Array Sum Across a Dimension",
                 test_array_sum_dim);
+
+    CU_add_test(array_tests, "Half Precision Conversion",
+                test_half_conversion);
+    CU_add_test(array_tests, "Half Precision Array Operations",
+                test_half_array_ops);
+    CU_add_test(array_tests, "Half Precision Save, Load and Print",
+                test_half_io);
+
+    CU_add_test(array_tests, "Array Cast", test_array_cast);
+    CU_add_test(array_tests, "Dtype Promotion", test_dtype_promotion);
+
+    CU_add_test(array_tests, "Sparse Array Conversion",
+                test_sparse_conversion);
+    CU_add_test(array_tests, "Sparse-Dense Matrix Multiplication", test_spmm);
 }
 
 void TensorUnitTests(CU_pSuite tensor_tests) {
@@ -64,4 +81,48 @@ void TensorUnitTests(CU_pSuite tensor_tests) {
     CU_add_test(tensor_tests, "Tensor Subtraction", test_tensor_sub);
     CU_add_test(tensor_tests, "Tensor Multiplication", test_tensor_mul);
     CU_add_test(tensor_tests, "Tensor Division", test_tensor_div);
+    CU_add_test(tensor_tests, "Tensor Minimum", test_tensor_min);
+    CU_add_test(tensor_tests, "Tensor Sparse Matrix Multiplication",
+                test_tensor_spmm);
+    CU_add_test(tensor_tests, "Tensor Dtype Cast", test_tensor_to);
+    CU_add_test(tensor_tests, "Tensor Rectifiers", test_tensor_relu);
+    CU_add_test(tensor_tests, "Tensor Activations", test_tensor_activations);
+    CU_add_test(tensor_tests, "Tensor Losses", test_tensor_losses);
+
+    CU_add_test(tensor_tests, "Backward Frees Graph", test_backward_free_graph);
+    CU_add_test(tensor_tests, "Backward Frees Training Steps",
+                test_backward_training_steps);
+    CU_add_test(tensor_tests, "Backward Retains Graph",
+                test_backward_retain_graph);
+    CU_add_test(tensor_tests, "Backward Through Freed Shared Node",
+                test_backward_shared_freed_graph);
+    CU_add_test(tensor_tests, "Parallel Backward", test_parallel_backward);
+    CU_add_test(tensor_tests, "Graph Replay", test_graph_replay);
+    CU_add_test(tensor_tests, "Graph Replay Leaky ReLU",
+                test_graph_replay_leaky_relu);
+    CU_add_test(tensor_tests, "Graph Replay Comparisons",
+                test_graph_replay_compare);
+    CU_add_test(tensor_tests, "Memory Plan", test_memory_plan);
+    CU_add_test(tensor_tests, "Forward Mode JVP", test_jvp);
+    CU_add_test(tensor_tests, "Hessian-Vector Product and Jacobian",
+                test_hvp_jacobian);
+    CU_add_test(tensor_tests, "Saved Tensors", test_saved_tensors);
+    CU_add_test(tensor_tests, "Saved Tensor Hooks", test_saved_tensor_hooks);
+
+    CU_add_test(tensor_tests, "Autocast Region", test_autocast);
+    CU_add_test(tensor_tests, "Dynamic Loss Scaling", test_grad_scaler);
+
+    CU_add_test(tensor_tests, "No Grad Mode", test_no_grad);
+    CU_add_test(tensor_tests, "Inference Mode", test_inference_mode);
+    CU_add_test(tensor_tests, "Activation Checkpointing", test_checkpoint);
+    CU_add_test(tensor_tests, "Fused Elementwise", test_fused_eval);
+
+    CU_add_test(tensor_tests, "SGD Optimizer", test_sgd);
+    CU_add_test(tensor_tests, "Adam Optimizer", test_adam);
+    CU_add_test(tensor_tests, "Flat Parameters", test_flat_parameters);
+    CU_add_test(tensor_tests, "Gradient Clipping", test_clip_grad);
+    CU_add_test(tensor_tests, "Module Zero Grad", test_module_zero_grad);
+    CU_add_test(tensor_tests, "Convolutions", test_conv);
+    CU_add_test(tensor_tests, "Pooling", test_pool);
+    CU_add_test(tensor_tests, "Normalization", test_norm);
 }
@@ -0,0 +1,117 @@
+#include "amp.h"
+#include "array.h"
+#include "autograd.h"
+#include "tensor.h"
+#include "tensor_tests.h"
+
+#include <CUnit/CUnit.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+void test_autocast() {
+    Environment *env = env_init();
+
+    ndArray *x_arr = array_init(2, (const size_t[]){2, 3}, DTYPE_FLOAT),
+            *W_arr = array_init(2, (const size_t[]){3, 2}, DTYPE_FLOAT),
+            *b_arr = array_init(2, (const size_t[]){1, 2}, DTYPE_FLOAT);
+    populate_array(x_arr, (const float[]){1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f});
+    populate_array(W_arr,
+                   (const float[]){0.5f, 1.0f, -1.0f, 2.0f, 0.25f, -0.5f});
+    populate_array(b_arr, (const float[]){1.0f, -1.0f});
+
+    Tensor *x = tensor_init(x_arr, NO_GRAD, env);
+    Tensor *W = tensor_init(W_arr, REQUIRES_GRAD, env);
+    Tensor *b = tensor_init(b_arr, REQUIRES_GRAD, env);
+
+    autocast_enter(DTYPE_BF16, true);
+    CU_ASSERT(is_autocast_enabled());
+
+    Tensor *y = tensor_add(tensor_matmul(x, W), b);
+    CU_ASSERT(get_tensor_dtype(y) == DTYPE_BF16);
+
+    Tensor *loss = tensor_sum(y);
+    CU_ASSERT(get_tensor_dtype(loss) == DTYPE_FLOAT);
+
+    autocast_exit();
+    CU_ASSERT(!is_autocast_enabled());
+
+    CU_ASSERT(item(loss).float_val == 12.25f);
+    backward(loss, NULL);
+
+    Tensor *W_grad = get_tensor_grad(W), *b_grad = get_tensor_grad(b);
+    CU_ASSERT(get_tensor_dtype(W_grad) == DTYPE_FLOAT);
+
+    ndArray *W_grad_arr = array_init(2, (const size_t[]){3, 2}, DTYPE_FLOAT),
+            *b_grad_arr = array_init(2, (const size_t[]){1, 2}, DTYPE_FLOAT);
+    populate_array(W_grad_arr,
+                   (const float[]){5.0f, 5.0f, 7.0f, 7.0f, 9.0f, 9.0f});
+    populate_array(b_grad_arr, (const float[]){2.0f, 2.0f});
+
+    CU_ASSERT(array_equal(get_tensor_data(W_grad), W_grad_arr));
+    CU_ASSERT(array_equal(get_tensor_data(b_grad), b_grad_arr));
+
+    // a parameter is cast once per region and both uses share the copy, the
+    // input is not a parameter and is cast for each op
+    zero_grad(W);
+    autocast_enter(DTYPE_BF16, true);
+    size_t num_tensors = get_num_tensors(env);
+    Tensor *h1 = tensor_matmul(x, W);
+    CU_ASSERT_EQUAL(get_num_tensors(env), num_tensors + 3);
+    Tensor *h2 = tensor_matmul(x, W);
+    CU_ASSERT_EQUAL(get_num_tensors(env), num_tensors + 5);
+    loss = tensor_sum(tensor_add(h1, h2));
+    autocast_exit();
+
+    backward(loss, NULL);
+    ndArray *twice = array_add(W_grad_arr, W_grad_arr);
+    CU_ASSERT(array_equal(get_tensor_data(get_tensor_grad(W)), twice));
+    free_array(twice);
+
+    // the next region casts afresh
+    autocast_enter(DTYPE_BF16, true);
+    num_tensors = get_num_tensors(env);
+    tensor_matmul(x, W);
+    CU_ASSERT_EQUAL(get_num_tensors(env), num_tensors + 3);
+    autocast_exit();
+
+    free_array(W_grad_arr);
+    free_array(b_grad_arr);
+    free_env(env);
+}
+
+void test_grad_scaler() {
+    Environment *env = env_init();
+    GradScaler *scaler = grad_scaler_init(1024.0f, 2.0f, 0.5f, 2);
+
+    Tensor *W = ones_tensor(SHAPE(2, 2), DTYPE_FLOAT, REQUIRES_GRAD, env);
+
+    ndArray *c_arr = array_init(2, (const size_t[]){2, 2}, DTYPE_FLOAT);
+    populate_array(c_arr, (const float[]){1.0f, -2.0f, 0.5f, 3.0f});
+    Tensor *c = tensor_init(c_arr, NO_GRAD, env);
+
+    // two finite steps grow the scale once
+    for (int step = 0; step < 2; step++) {
+        zero_grad(W);
+        Tensor *loss = tensor_sum(tensor_mul(W, c));
+        backward(grad_scaler_scale(scaler, loss), NULL);
+
+        CU_ASSERT(grad_scaler_unscale(scaler, TENSORS(W)));
+        CU_ASSERT(array_equal(get_tensor_data(get_tensor_grad(W)), c_arr));
+        grad_scaler_update(scaler);
+    }
+    CU_ASSERT(get_grad_scale(scaler) == 2048.0f);
+
+    // scaled gradient overflows fp32, the step is flagged and scale backs off
+    zero_grad(W);
+    Tensor *big =
+        scalar((ArrayVal){.float_val = 1e36f}, DTYPE_FLOAT, NO_GRAD, env);
+    Tensor *loss = tensor_sum(tensor_mul(tensor_mul(W, c), big));
+    backward(grad_scaler_scale(scaler, loss), NULL);
+
+    CU_ASSERT(!grad_scaler_unscale(scaler, TENSORS(W)));
+    grad_scaler_update(scaler);
+    CU_ASSERT(get_grad_scale(scaler) == 1024.0f);
+
+    free_grad_scaler(scaler);
+    free_env(env);
+}
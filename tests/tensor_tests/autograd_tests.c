@@ -0,0 +1,672 @@
+#include "array.h"
+#include "autograd.h"
+#include "capture.h"
+#include "error_codes.h"
+#include "nn.h"
+#include "optim.h"
+#include "random.h"
+#include "tensor.h"
+#include "tensor_tests.h"
+
+#include <CUnit/CUnit.h>
+#include <omp.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+void test_backward_free_graph() {
+    Environment *env = env_init();
+
+    ndArray *x_arr = array_init(1, (const size_t[]){3}, DTYPE_FLOAT);
+    populate_array(x_arr, (const float[]){1.0f, 2.0f, 3.0f});
+
+    Tensor *x = tensor_init(x_arr, NO_GRAD, env);
+    Tensor *W = ones_tensor(SHAPE(3), DTYPE_FLOAT, REQUIRES_GRAD, env);
+
+    // `h` feeds both operands, its gradients are summed before it runs
+    Tensor *h = tensor_mul(x, W);
+    Tensor *y = tensor_sum(tensor_mul(h, h));
+    size_t num_tensors = get_num_tensors(env);
+
+    backward(y, NULL);
+
+    ndArray *W_grad_arr = array_init(1, (const size_t[]){3}, DTYPE_FLOAT);
+    populate_array(W_grad_arr, (const float[]){2.0f, 8.0f, 18.0f});
+    CU_ASSERT(array_equal(get_tensor_data(get_tensor_grad(W)), W_grad_arr));
+
+    // W owns its gradient, graph nodes are gone and nothing is left behind
+    CU_ASSERT_EQUAL(get_num_tensors(env), num_tensors);
+    CU_ASSERT_PTR_NULL(get_backward_fn(y));
+    CU_ASSERT_PTR_NULL(get_backward_fn(h));
+
+    free_array(W_grad_arr);
+    free_env(env);
+}
+
+// live tensors of `env` and the bytes their buffers hold
+static size_t _env_bytes(Environment *env) {
+    size_t bytes = 0;
+    Tensor **tensors = get_tensors(env);
+    for (size_t i = 0; i < get_num_tensors(env); i++) {
+        ndArray *data = get_tensor_data(tensors[i]);
+        if (get_array_data(data))
+            bytes += get_total_size(data) * get_itemsize(data);
+    }
+
+    return bytes;
+}
+
+void test_backward_training_steps() {
+    Module *model = Sequential(Linear(3, 4), ReLU(), Linear(4, 2));
+    Environment *env = env_init();
+    Tensor *x = randn(SHAPE(8, 3), DTYPE_FLOAT, NO_GRAD, env);
+    Tensor *y = randn(SHAPE(8, 2), DTYPE_FLOAT, NO_GRAD, env);
+
+    Optimizer *optim = SGD(model, 0.01);
+    Loss criterion = MSELoss(REDUCTION_MEAN);
+    size_t num_tensors[2], bytes[2], model_tensors[2];
+    for (int step = 0; step < 30; step++) {
+        // the loss saves the released prediction, the graph frees it
+        Tensor *pred = module_call(model, x);
+        Tensor *loss = loss_call(&criterion, pred, y);
+        tensor_release(pred);
+
+        backward(loss, NULL);
+        optim_step(optim);
+        env_remove_and_free(env, loss);
+
+        // every step after the first finds the same tensors and buffers
+        int i = step > 0;
+        num_tensors[i] = get_num_tensors(env);
+        bytes[i] = _env_bytes(env);
+        model_tensors[i] = get_num_tensors(get_environ(model));
+    }
+    CU_ASSERT_EQUAL(num_tensors[1], num_tensors[0]);
+    CU_ASSERT_EQUAL(bytes[1], bytes[0]);
+    CU_ASSERT_EQUAL(model_tensors[1], model_tensors[0]);
+    CU_ASSERT_EQUAL(num_tensors[0], 2);
+
+    free_optimizer(optim);
+    free_env(env);
+    free_module(model);
+}
+
+void test_backward_retain_graph() {
+    Environment *env = env_init();
+
+    Tensor *W = ones_tensor(SHAPE(2, 2), DTYPE_FLOAT, REQUIRES_GRAD, env);
+    Tensor *y = tensor_sum(tensor_add(W, W));
+
+    run_backward(y, NULL, RETAIN_GRAPH);
+    CU_ASSERT_PTR_NOT_NULL(get_backward_fn(y));
+    run_backward(y, NULL, FREE_GRAPH);
+    CU_ASSERT_PTR_NULL(get_backward_fn(y));
+
+    ndArray *W_grad_arr = array_init(2, (const size_t[]){2, 2}, DTYPE_FLOAT);
+    populate_array(W_grad_arr, (const float[]){4.0f, 4.0f, 4.0f, 4.0f});
+    CU_ASSERT(array_equal(get_tensor_data(get_tensor_grad(W)), W_grad_arr));
+
+    free_array(W_grad_arr);
+    free_env(env);
+}
+
+// errors exit the process, so the pass runs in a child
+static int _backward_exit_code(Tensor *tensor) {
+    fflush(NULL);
+    pid_t pid = fork();
+    if (pid == 0) {
+        freopen("/dev/null", "w", stderr);
+        backward(tensor, NULL);
+        _exit(0);
+    }
+
+    int status = 0;
+    waitpid(pid, &status, 0);
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+void test_backward_shared_freed_graph() {
+    Environment *env = env_init();
+
+    ndArray *x_arr = array_init(1, (const size_t[]){3}, DTYPE_FLOAT);
+    populate_array(x_arr, (const float[]){1.0f, 2.0f, 3.0f});
+    Tensor *x = tensor_init(x_arr, REQUIRES_GRAD, env);
+
+    // both losses point at `h`'s node, the first backward frees it
+    Tensor *h = tensor_mul(x, x);
+    Tensor *a = tensor_sum(h), *b = tensor_sum(h);
+
+    backward(a, NULL);
+    CU_ASSERT_PTR_NULL(get_backward_fn(h));
+    CU_ASSERT_PTR_NOT_NULL(get_backward_fn(b));
+
+    ndArray *x_grad_arr = array_init(1, (const size_t[]){3}, DTYPE_FLOAT);
+    populate_array(x_grad_arr, (const float[]){2.0f, 4.0f, 6.0f});
+    CU_ASSERT(array_equal(get_tensor_data(get_tensor_grad(x)), x_grad_arr));
+
+    CU_ASSERT_EQUAL(_backward_exit_code(b), INVALID_BACKWARD_PASS & 0xff);
+
+    free_array(x_grad_arr);
+    free_env(env);
+}
+
+static Tensor *_towers_loss(Tensor *x, Tensor **W) {
+    Tensor *h1 = tensor_matmul(x, W[0]), *h2 = tensor_matmul(x, W[1]);
+    Tensor *h3 = tensor_matmul(h1, W[2]);
+
+    return tensor_add(tensor_sum(tensor_mul(h1, h2)), tensor_sum(h3));
+}
+
+void test_parallel_backward() {
+    Environment *env = env_init();
+    int num_threads = omp_get_max_threads();
+    omp_set_num_threads(4);
+
+    Tensor *x = randn(SHAPE(4, 3), DTYPE_FLOAT, NO_GRAD, env);
+    Tensor *W[3] = {randn(SHAPE(3, 3), DTYPE_FLOAT, REQUIRES_GRAD, env),
+                    randn(SHAPE(3, 3), DTYPE_FLOAT, REQUIRES_GRAD, env),
+                    randn(SHAPE(3, 2), DTYPE_FLOAT, REQUIRES_GRAD, env)};
+
+    CU_ASSERT(get_parallel_backward());
+    backward(_towers_loss(x, W), NULL);
+
+    ndArray *expected[3];
+    for (int i = 0; i < 3; i++) {
+        ndArray *grad = get_tensor_data(get_tensor_grad(W[i]));
+        expected[i] = copy_array(grad);
+        zero_grad(W[i]);
+    }
+
+    set_parallel_backward(false);
+    backward(_towers_loss(x, W), NULL);
+    set_parallel_backward(true);
+
+    for (int i = 0; i < 3; i++) {
+        CU_ASSERT(array_equal(get_tensor_data(get_tensor_grad(W[i])),
+                              expected[i]));
+        free_array(expected[i]);
+    }
+
+    // promotion is thread-local, the worker threads enable it themselves
+    Tensor *h1 = tensor_matmul(x, W[0]),
+           *h2 = tensor_to(tensor_matmul(x, W[1]), DTYPE_DOUBLE);
+    set_dtype_promotion(true);
+    Tensor *loss = tensor_add(tensor_sum(tensor_mul(h1, h2)),
+                              tensor_sum(tensor_matmul(h1, W[2])));
+    set_dtype_promotion(false);
+
+    for (int i = 0; i < 3; i++)
+        zero_grad(W[i]);
+    backward(loss, NULL);
+    CU_ASSERT_FALSE(get_dtype_promotion());
+    for (int i = 0; i < 3; i++)
+        CU_ASSERT(get_tensor_dtype(get_tensor_grad(W[i])) == DTYPE_FLOAT);
+
+    omp_set_num_threads(num_threads);
+    free_env(env);
+}
+
+static Tensor *_affine_loss(Tensor *x, Tensor *W, Tensor *b) {
+    Tensor *h = tensor_add(tensor_matmul(x, W), b);
+    return tensor_sum(tensor_mul(h, h));
+}
+
+static Tensor *_leaky_affine_loss(Tensor *x, Tensor *W, Tensor *b) {
+    Tensor *h = tensor_leaky_relu(tensor_add(tensor_matmul(x, W), b), 0.1);
+    return tensor_sum(tensor_mul(h, h));
+}
+
+void test_graph_replay() {
+    Environment *env = env_init();
+
+    Tensor *x = randn(SHAPE(4, 3), DTYPE_DOUBLE, NO_GRAD, env);
+    Tensor *W = randn(SHAPE(3, 2), DTYPE_DOUBLE, REQUIRES_GRAD, env);
+    Tensor *b = randn(SHAPE(2), DTYPE_DOUBLE, REQUIRES_GRAD, env);
+
+    capture_begin();
+    Tensor *loss = _affine_loss(x, W, b);
+    CapturedGraph *graph = capture_end(loss);
+    CU_ASSERT_EQUAL(get_num_captured_ops(graph), 4);
+
+    // feed a new batch, replay must match an eager step on it
+    Tensor *batch = randn(SHAPE(4, 3), DTYPE_DOUBLE, NO_GRAD, env);
+    ndArray *batch_data = get_tensor_data(batch);
+    replace_tensor_data(x, copy_array(batch_data));
+
+    graph_replay(graph);
+    size_t num_tensors = get_num_tensors(env);
+    zero_grad(W);
+    zero_grad(b);
+    graph_replay(graph);
+    CU_ASSERT_EQUAL(get_num_tensors(env), num_tensors);
+
+    ndArray *expected[3] = {get_tensor_data(loss),
+                            get_tensor_data(get_tensor_grad(W)),
+                            get_tensor_data(get_tensor_grad(b))};
+    for (int i = 0; i < 3; i++)
+        expected[i] = copy_array(expected[i]);
+    zero_grad(W);
+    zero_grad(b);
+
+    Tensor *eager = _affine_loss(batch, W, b);
+    backward(eager, NULL);
+
+    // the sums are OpenMP reductions, whose partials combine in any order,
+    // double precision keeps the difference within tolerance
+    CU_ASSERT(array_equal(get_tensor_data(eager), expected[0]));
+    CU_ASSERT(array_equal(get_tensor_data(get_tensor_grad(W)), expected[1]));
+    CU_ASSERT(array_equal(get_tensor_data(get_tensor_grad(b)), expected[2]));
+
+    for (int i = 0; i < 3; i++)
+        free_array(expected[i]);
+    free_captured_graph(graph);
+    free_env(env);
+}
+
+// leaky_relu replays with the slope it was captured with
+void test_graph_replay_leaky_relu() {
+    Environment *env = env_init();
+
+    Tensor *x = randn(SHAPE(4, 3), DTYPE_DOUBLE, NO_GRAD, env);
+    Tensor *W = randn(SHAPE(3, 2), DTYPE_DOUBLE, REQUIRES_GRAD, env);
+    Tensor *b = randn(SHAPE(2), DTYPE_DOUBLE, REQUIRES_GRAD, env);
+
+    capture_begin();
+    Tensor *loss = _leaky_affine_loss(x, W, b);
+    CapturedGraph *graph = capture_end(loss);
+    CU_ASSERT_EQUAL(get_num_captured_ops(graph), 5);
+
+    Tensor *batch = randn(SHAPE(4, 3), DTYPE_DOUBLE, NO_GRAD, env);
+    ndArray *batch_data = get_tensor_data(batch);
+    replace_tensor_data(x, copy_array(batch_data));
+
+    zero_grad(W);
+    zero_grad(b);
+    graph_replay(graph);
+
+    ndArray *expected[3] = {get_tensor_data(loss),
+                            get_tensor_data(get_tensor_grad(W)),
+                            get_tensor_data(get_tensor_grad(b))};
+    for (int i = 0; i < 3; i++)
+        expected[i] = copy_array(expected[i]);
+    zero_grad(W);
+    zero_grad(b);
+
+    Tensor *eager = _leaky_affine_loss(batch, W, b);
+    backward(eager, NULL);
+
+    CU_ASSERT(array_equal(get_tensor_data(eager), expected[0]));
+    CU_ASSERT(array_equal(get_tensor_data(get_tensor_grad(W)), expected[1]));
+    CU_ASSERT(array_equal(get_tensor_data(get_tensor_grad(b)), expected[2]));
+
+    for (int i = 0; i < 3; i++)
+        free_array(expected[i]);
+    free_captured_graph(graph);
+    free_env(env);
+}
+
+// masks from comparisons are recomputed on replay, and the two uses of `w`
+// sum into one gradient slot of the captured backward
+static Tensor *_masked_loss(Tensor *x, Tensor *zero, Tensor *w) {
+    Tensor *mask = tensor_gt(x, zero);
+    return tensor_sum(tensor_mul(tensor_mul(mask, x), tensor_add(w, w)));
+}
+
+void test_graph_replay_compare() {
+    Environment *env = env_init();
+
+    Tensor *x = randn(SHAPE(4, 3), DTYPE_DOUBLE, NO_GRAD, env);
+    Tensor *zero = zeros_tensor(SHAPE(4, 3), DTYPE_DOUBLE, NO_GRAD, env);
+    Tensor *w = randn(SHAPE(4, 3), DTYPE_DOUBLE, REQUIRES_GRAD, env);
+
+    capture_begin();
+    Tensor *loss = _masked_loss(x, zero, w);
+    CapturedGraph *graph = capture_end(loss);
+    CU_ASSERT_EQUAL(get_num_captured_ops(graph), 5);
+
+    Tensor *batch = randn(SHAPE(4, 3), DTYPE_DOUBLE, NO_GRAD, env);
+    replace_tensor_data(x, copy_array(get_tensor_data(batch)));
+
+    zero_grad(w);
+    size_t num_tensors = get_num_tensors(env);
+    graph_replay(graph);
+    CU_ASSERT_EQUAL(get_num_tensors(env), num_tensors);
+
+    ndArray *expected[2] = {copy_array(get_tensor_data(loss)),
+                            copy_array(get_tensor_data(get_tensor_grad(w)))};
+    zero_grad(w);
+
+    Tensor *eager = _masked_loss(batch, zero, w);
+    backward(eager, NULL);
+
+    CU_ASSERT(array_equal(get_tensor_data(eager), expected[0]));
+    CU_ASSERT(array_equal(get_tensor_data(get_tensor_grad(w)), expected[1]));
+
+    for (int i = 0; i < 2; i++)
+        free_array(expected[i]);
+    free_captured_graph(graph);
+    free_env(env);
+}
+
+void test_memory_plan() {
+    Environment *env = env_init();
+
+    // a chain of same-sized temporaries only needs two live buffers
+    Tensor *x = randn(SHAPE(8, 8), DTYPE_DOUBLE, NO_GRAD, env);
+    capture_begin();
+    Tensor *h = x;
+    for (int i = 0; i < 4; i++)
+        h = tensor_add(h, h);
+    Tensor *y = tensor_sum(h);
+    CapturedGraph *chain = capture_end(y);
+
+    MemoryPlan *chain_plan = plan_memory(chain);
+    size_t bytes = 8 * 8 * sizeof(double);
+    CU_ASSERT_EQUAL(get_num_planned_buffers(chain_plan), 4);
+    CU_ASSERT_EQUAL(get_unplanned_bytes(chain_plan), 4 * bytes);
+    CU_ASSERT_EQUAL(get_planned_peak(chain_plan), 2 * bytes);
+
+    ndArray *y_expected = array_cast(get_tensor_data(y), DTYPE_DOUBLE);
+    apply_memory_plan(chain_plan);
+    graph_replay(chain);
+    CU_ASSERT(array_equal(get_tensor_data(y), y_expected));
+
+    // activations read by backward stay live until the end of the step
+    Tensor *W = randn(SHAPE(3, 2), DTYPE_DOUBLE, REQUIRES_GRAD, env);
+    Tensor *b = randn(SHAPE(2), DTYPE_DOUBLE, REQUIRES_GRAD, env);
+    Tensor *batch = randn(SHAPE(4, 3), DTYPE_DOUBLE, NO_GRAD, env);
+
+    backward(_affine_loss(batch, W, b), NULL);
+    ndArray *W_grad = get_tensor_data(get_tensor_grad(W));
+    ndArray *W_expected = copy_array(W_grad);
+    zero_grad(W);
+    zero_grad(b);
+
+    // the three forward temporaries and the five gradient slots of the
+    // backward tape, each gradient is dropped once its consumer has run
+    capture_begin();
+    CapturedGraph *step = capture_end(_affine_loss(batch, W, b));
+    MemoryPlan *step_plan = plan_memory(step);
+    CU_ASSERT_EQUAL(get_num_planned_buffers(step_plan), 8);
+    CU_ASSERT(get_planned_peak(step_plan) < get_unplanned_bytes(step_plan));
+
+    apply_memory_plan(step_plan);
+    size_t num_tensors = get_num_tensors(env);
+    graph_replay(step);
+    CU_ASSERT_EQUAL(get_num_tensors(env), num_tensors);
+    CU_ASSERT(array_equal(get_tensor_data(get_tensor_grad(W)), W_expected));
+
+    zero_grad(W);
+    zero_grad(b);
+    graph_replay(step);
+    CU_ASSERT(array_equal(get_tensor_data(get_tensor_grad(W)), W_expected));
+
+    free_array(y_expected);
+    free_array(W_expected);
+    free_captured_graph(chain);
+    free_captured_graph(step);
+    free_env(env);
+    free_memory_plan(chain_plan);
+    free_memory_plan(step_plan);
+}
+
+static Tensor *_jvp_loss(void *ctx, Tensor **inputs) {
+    Tensor *W = ctx;
+    Tensor *h = tensor_matmul(inputs[0], W);
+    return tensor_sum(tensor_add(tensor_mul(h, h), tensor_inv(inputs[1])));
+}
+
+void test_jvp() {
+    Environment *env = env_init();
+
+    Tensor *W = randn(SHAPE(3, 2), DTYPE_DOUBLE, NO_GRAD, env);
+    Tensor *x = randn(SHAPE(4, 3), DTYPE_DOUBLE, REQUIRES_GRAD, env);
+    Tensor *b = ones_tensor(SHAPE(2), DTYPE_DOUBLE, REQUIRES_GRAD, env);
+
+    Tensor *vx = randn(SHAPE(4, 3), DTYPE_DOUBLE, NO_GRAD, env);
+    Tensor *vb = randn(SHAPE(2), DTYPE_DOUBLE, NO_GRAD, env);
+    ndArray *v[2] = {get_tensor_data(vx), get_tensor_data(vb)};
+
+    ndArray *tangent;
+    Tensor *y = jvp(_jvp_loss, W, 2, (Tensor *[]){x, b}, v, &tangent);
+    CU_ASSERT_PTR_NULL(get_tensor_tangent(x));
+
+    // a scalar output's JVP is the gradient dotted with the tangents
+    backward(y, NULL);
+    Tensor *inputs[2] = {x, b};
+    ndArray *expected = zeros(0, SHAPE_(), DTYPE_DOUBLE);
+    for (int i = 0; i < 2; i++) {
+        ndArray *dot = array_mul(get_tensor_data(get_tensor_grad(inputs[i])),
+                                 v[i]);
+        ndArray *dot_sum = array_sum(dot);
+        array_addi(&expected, dot_sum);
+
+        free_array(dot);
+        free_array(dot_sum);
+    }
+    CU_ASSERT(array_equal(tangent, expected));
+
+    free_array(tangent);
+    free_array(expected);
+    free_env(env);
+}
+
+// w * x^2, w lives in its own environment so temporaries land there first
+static Tensor *_weighted_square(void *ctx, Tensor **inputs) {
+    return tensor_mul(ctx, tensor_mul(inputs[0], inputs[0]));
+}
+
+static Tensor *_weighted_square_sum(void *ctx, Tensor **inputs) {
+    return tensor_sum(_weighted_square(ctx, inputs));
+}
+
+static Tensor *_weighted_rows(void *ctx, Tensor **inputs) {
+    return tensor_mul(ctx, inputs[0]);
+}
+
+void test_hvp_jacobian() {
+    Environment *env = env_init(), *w_env = env_init();
+
+    ndArray *w_arr = array_init(SHAPE(3), DTYPE_DOUBLE);
+    populate_array(w_arr, (const double[]){1.0, 2.0, 3.0});
+    Tensor *w = tensor_init(w_arr, NO_GRAD, w_env);
+    Tensor *x = randn(SHAPE(3), DTYPE_DOUBLE, REQUIRES_GRAD, env);
+    ndArray *v =
+        get_tensor_data(randn(SHAPE(2, 3), DTYPE_DOUBLE, NO_GRAD, env));
+    size_t num_tensors = get_num_tensors(env),
+           num_w_tensors = get_num_tensors(w_env);
+
+    // sum(w * x^2) has the Hessian 2 w, w * x^2 the diagonal Jacobian 2 w x
+    ndArray *hvps[1];
+    hvp(_weighted_square_sum, w, 1, (Tensor *[]){x}, (ndArray *[]){v}, hvps);
+    CU_ASSERT_PTR_NULL(get_tensor_grad(x));
+
+    ndArray *two_w = array_add(w_arr, w_arr);
+    ndArray *expected_hvp = array_mul(v, two_w);
+    CU_ASSERT(array_equal(hvps[0], expected_hvp));
+
+    ndArray *jacobians[1];
+    jacobian(_weighted_square, w, 1, (Tensor *[]){x}, jacobians);
+
+    ndArray *diag = array_mul(two_w, get_tensor_data(x));
+    for (size_t i = 0; i < 3; i++)
+        for (size_t j = 0; j < 3; j++) {
+            double expected =
+                (i == j) ? get_value(diag, SHAPE_(i)).double_val : 0.0;
+            double value = get_value(jacobians[0], SHAPE_(i, j)).double_val;
+            CU_ASSERT_DOUBLE_EQUAL(value, expected, 1e-9);
+        }
+    free_array(jacobians[0]);
+
+    // a (2, 3) output of a 3 element input is built column by column
+    Tensor *W = randn(SHAPE(2, 3), DTYPE_DOUBLE, NO_GRAD, w_env);
+    num_w_tensors++;
+    jacobian(_weighted_rows, W, 1, (Tensor *[]){x}, jacobians);
+    for (size_t r = 0; r < 2; r++)
+        for (size_t c = 0; c < 3; c++)
+            for (size_t k = 0; k < 3; k++) {
+                double expected =
+                    (c == k) ? get_value(get_tensor_data(W), SHAPE_(r, c))
+                                   .double_val
+                             : 0.0;
+                double value =
+                    get_value(jacobians[0], SHAPE_(r, c, k)).double_val;
+                CU_ASSERT_DOUBLE_EQUAL(value, expected, 1e-12);
+            }
+
+    // every pass frees its temporaries, wherever they were made
+    CU_ASSERT_EQUAL(get_num_tensors(env), num_tensors);
+    CU_ASSERT_EQUAL(get_num_tensors(w_env), num_w_tensors);
+
+    free_array(two_w);
+    free_array(diag);
+    free_array(expected_hvp);
+    free_array(hvps[0]);
+    free_array(jacobians[0]);
+    free_env(w_env);
+    free_env(env);
+}
+
+void test_saved_tensors() {
+    Environment *env = env_init();
+
+    Tensor *x = randn(SHAPE(2, 3), DTYPE_DOUBLE, REQUIRES_GRAD, env);
+    Tensor *w = randn(SHAPE(3), DTYPE_DOUBLE, NO_GRAD, env);
+
+    // max keeps a bitmask, neither the negation nor its input are saved
+    Tensor *neg = tensor_neg(x);
+    Tensor *y = tensor_max(neg, w);
+    CU_ASSERT_EQUAL(get_saved(get_backward_fn(y)), SAVE_MASK);
+    CU_ASSERT_FALSE(is_tensor_saved(neg));
+
+    Tensor *product = tensor_mul(x, w);
+    CU_ASSERT_EQUAL(get_saved(get_backward_fn(product)), SAVE_INPUTS);
+    CU_ASSERT_TRUE(is_tensor_saved(x));
+
+    ndArray *selected = array_ge(get_tensor_data(neg), get_tensor_data(w));
+    ndArray *expected = negative(selected);
+
+    tensor_release(neg);
+    CU_ASSERT_PTR_NULL(get_array_data(get_tensor_data(neg)));
+    CU_ASSERT_EQUAL(get_tensor_ndim(neg), 2);
+
+    backward(tensor_sum(y), NULL);
+    CU_ASSERT(array_equal(get_tensor_data(get_tensor_grad(x)), expected));
+
+    free_array(selected);
+    free_array(expected);
+    free_env(env);
+}
+
+// the gradient of `w` is the column sum of the released temporary -x
+static void _check_hooks(SavedTensorHooks hooks, double tolerance) {
+    Environment *env = env_init();
+
+    Tensor *x = randn(SHAPE(2, 3), DTYPE_DOUBLE, REQUIRES_GRAD, env);
+    Tensor *w = randn(SHAPE(3), DTYPE_DOUBLE, REQUIRES_GRAD, env);
+
+    saved_tensor_hooks_enter(&hooks);
+    Tensor *neg = tensor_neg(x);
+    Tensor *y = tensor_mul(neg, w);
+    tensor_release(neg);
+    saved_tensor_hooks_exit();
+    CU_ASSERT_PTR_NULL(get_array_data(get_tensor_data(neg)));
+
+    // the freed graph takes the released `neg` along with its packed buffer
+    Tensor *loss = tensor_sum(y);
+    size_t num_tensors = get_num_tensors(env);
+    backward(loss, NULL);
+    CU_ASSERT_EQUAL(get_num_tensors(env), num_tensors - 1);
+
+    ndArray *w_grad = get_tensor_data(get_tensor_grad(w));
+    for (size_t j = 0; j < 3; j++) {
+        double expected = 0.0;
+        for (size_t i = 0; i < 2; i++)
+            expected -= get_value(get_tensor_data(x), SHAPE_(i, j)).double_val;
+
+        double value = get_value(w_grad, SHAPE_(j)).double_val;
+        CU_ASSERT_DOUBLE_EQUAL(value, expected, tolerance);
+    }
+
+    free_env(env);
+}
+
+static int num_packed = 0;
+
+static void *_counting_pack(void *ctx, const ndArray *data) {
+    num_packed++;
+    return ((SavedTensorHooks *)ctx)->pack(NULL, data);
+}
+
+static ndArray *_counting_unpack(void *ctx, void *packed,
+                                 const ndArray *like) {
+    return ((SavedTensorHooks *)ctx)->unpack(NULL, packed, like);
+}
+
+static void _counting_free(void *ctx, void *packed) {
+    ((SavedTensorHooks *)ctx)->free_packed(NULL, packed);
+}
+
+void test_saved_tensor_hooks() {
+    SavedTensorHooks disk = disk_saved_hooks();
+    _check_hooks(disk, 1e-9);
+    free_disk_saved_hooks(&disk);
+    CU_ASSERT_PTR_NULL(disk.ctx);
+
+    _check_hooks(bf16_saved_hooks(), 5e-2);
+
+    // saved tensors are packed once released, with the hooks they were
+    // saved under, never next to their live buffer
+    Environment *env = env_init();
+    SavedTensorHooks bf16 = bf16_saved_hooks();
+    SavedTensorHooks counting = {.pack = _counting_pack,
+                                 .unpack = _counting_unpack,
+                                 .free_packed = _counting_free,
+                                 .ctx = &bf16};
+
+    Tensor *x = randn(SHAPE(4), DTYPE_DOUBLE, REQUIRES_GRAD, env);
+    Tensor *w = randn(SHAPE(4), DTYPE_DOUBLE, REQUIRES_GRAD, env);
+
+    num_packed = 0;
+    saved_tensor_hooks_enter(&counting);
+    Tensor *neg = tensor_neg(x);
+    Tensor *y = tensor_mul(neg, w);
+    saved_tensor_hooks_exit();
+    CU_ASSERT_EQUAL(num_packed, 0);
+
+    tensor_release(neg);
+    CU_ASSERT_EQUAL(num_packed, 1);
+    CU_ASSERT_PTR_NULL(get_array_data(get_tensor_data(neg)));
+
+    backward(tensor_sum(y), NULL);
+    ndArray *expected = negative(get_tensor_data(w));
+    CU_ASSERT(array_equal(get_tensor_data(get_tensor_grad(x)), expected));
+    free_array(expected);
+    free_env(env);
+
+    // all tensors spilled with one set of hooks share a file descriptor
+    int before = dup(0);
+    close(before);
+
+    env = env_init();
+    disk = disk_saved_hooks();
+    saved_tensor_hooks_enter(&disk);
+    Tensor *h = randn(SHAPE(8), DTYPE_DOUBLE, REQUIRES_GRAD, env);
+    for (int i = 0; i < 64; i++) {
+        Tensor *next = tensor_mul(h, h);
+        tensor_release(h);
+        h = next;
+    }
+    saved_tensor_hooks_exit();
+
+    int after = dup(0);
+    close(after);
+    CU_ASSERT(after <= before + 1);
+
+    backward(tensor_sum(h), NULL);
+    free_env(env);
+    free_disk_saved_hooks(&disk);
+}
@@ -0,0 +1,53 @@
+#include "array.h"
+#include "autograd.h"
+#include "fusion.h"
+#include "random.h"
+#include "tensor.h"
+#include "tensor_tests.h"
+
+#include <CUnit/CUnit.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+void test_fused_eval() {
+    Environment *env = env_init();
+
+    Tensor *x = randn(SHAPE(4, 3), DTYPE_DOUBLE, REQUIRES_GRAD, env);
+    Tensor *b = randn(SHAPE(3), DTYPE_DOUBLE, REQUIRES_GRAD, env);
+    Tensor *one = ones_tensor(SHAPE(1), DTYPE_DOUBLE, NO_GRAD, env);
+
+    // (x - 1)^2 / b + max(x, b), broadcasting b over the rows of x
+    Tensor *diff = tensor_sub(x, one);
+    Tensor *eager = tensor_add(tensor_div(tensor_mul(diff, diff), b),
+                               tensor_max(x, b));
+    backward(tensor_sum(eager), NULL);
+
+    ndArray *expected[2];
+    Tensor *params[2] = {x, b};
+    for (int i = 0; i < 2; i++) {
+        ndArray *grad = get_tensor_data(get_tensor_grad(params[i]));
+        expected[i] = copy_array(grad);
+        zero_grad(params[i]);
+    }
+
+    FusedExpr *expr = fused_expr_init();
+    int ex = fused_input(expr, x), eb = fused_input(expr, b);
+    int ediff = fused_sub(expr, ex, fused_scalar(expr, 1.0));
+    int root = fused_add(expr,
+                         fused_div(expr, fused_mul(expr, ediff, ediff), eb),
+                         fused_max(expr, ex, eb));
+    Tensor *fused = fused_eval(expr, root);
+    free_fused_expr(expr);
+
+    CU_ASSERT(array_equal(get_tensor_data(fused), get_tensor_data(eager)));
+    CU_ASSERT_EQUAL(get_backward_outputs(get_backward_fn(fused)), 2);
+
+    backward(tensor_sum(fused), NULL);
+    for (int i = 0; i < 2; i++) {
+        ndArray *grad = get_tensor_data(get_tensor_grad(params[i]));
+        CU_ASSERT(array_equal(grad, expected[i]));
+        free_array(expected[i]);
+    }
+
+    free_env(env);
+}
@@ -0,0 +1,144 @@
+#include "array.h"
+#include "autograd.h"
+#include "ctorch.h"
+#include "nn.h"
+#include "random.h"
+#include "tensor.h"
+#include "tensor_tests.h"
+
+#include <CUnit/CUnit.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+void test_no_grad() {
+    Environment *env = env_init();
+
+    Tensor *W = ones_tensor(SHAPE(2, 2), DTYPE_FLOAT, REQUIRES_GRAD, env);
+    Tensor *x = ones_tensor(SHAPE(2, 2), DTYPE_FLOAT, NO_GRAD, env);
+
+    {
+        AutoNoGrad guard = ctorch_no_grad_enter();
+        CU_ASSERT(!is_grad_enabled());
+
+        Tensor *y = tensor_sum(tensor_matmul(x, W));
+        CU_ASSERT(!get_requires_grad(y));
+        CU_ASSERT_PTR_NULL(get_backward_fn(y));
+
+        // nested regions only re-enable grad once fully exited
+        ctorch_no_grad_enter();
+        ctorch_no_grad_exit();
+        CU_ASSERT(!is_grad_enabled());
+    }
+    CU_ASSERT(is_grad_enabled());
+
+    Tensor *y = tensor_sum(tensor_matmul(x, W));
+    CU_ASSERT(get_requires_grad(y));
+    CU_ASSERT_PTR_NOT_NULL(get_backward_fn(y));
+
+    free_env(env);
+}
+
+void test_inference_mode() {
+    Environment *env = env_init();
+    Module *model = Sequential(Linear(3, 4), ReLU(), Linear(4, 2));
+
+    Tensor *x = ones_tensor(SHAPE(5, 3), DTYPE_FLOAT, NO_GRAD, env);
+    size_t num_tensors = get_num_tensors(env);
+
+    Tensor *y = NULL;
+    {
+        AutoInferenceMode guard = ctorch_inference_mode_enter();
+        CU_ASSERT(is_inference_mode());
+        CU_ASSERT(!is_grad_enabled());
+
+        y = module_call(model, x);
+    }
+    CU_ASSERT(!is_inference_mode());
+
+    // outputs are owned by the caller, the environment is untouched
+    CU_ASSERT_PTR_NULL(get_tensor_environ(y));
+    CU_ASSERT(!get_requires_grad(y));
+    CU_ASSERT_EQUAL(get_num_tensors(env), num_tensors);
+    CU_ASSERT_EQUAL(get_tensor_shape(y)[0], 5);
+    CU_ASSERT_EQUAL(get_tensor_shape(y)[1], 2);
+
+    free_tensor(y);
+    free_module(model);
+    free_env(env);
+}
+
+void test_checkpoint() {
+    Environment *env = env_init();
+    Module *model = Sequential(Linear(3, 4), ReLU(), Linear(4, 2));
+    Module *checkpointed = Checkpoint(model);
+
+    size_t num_params = num_parameters(model);
+    Tensor *params[num_params];
+    parameters(model, params);
+
+    Tensor *x = randn(SHAPE(5, 3), DTYPE_FLOAT, REQUIRES_GRAD, env);
+    backward(tensor_sum(module_call(model, x)), NULL);
+
+    ndArray *expected[num_params + 1];
+    for (size_t i = 0; i < num_params; i++) {
+        ndArray *grad = get_tensor_data(get_tensor_grad(params[i]));
+        expected[i] = copy_array(grad);
+        zero_grad(params[i]);
+    }
+    ndArray *x_grad = get_tensor_data(get_tensor_grad(x));
+    expected[num_params] = copy_array(x_grad);
+    zero_grad(x);
+
+    // only the segment's output is kept alive by the forward
+    size_t num_tensors = get_num_tensors(env);
+    Tensor *y = module_call(checkpointed, x);
+    CU_ASSERT_EQUAL(get_num_tensors(env), num_tensors + 1);
+
+    backward(tensor_sum(y), NULL);
+    for (size_t i = 0; i < num_params; i++) {
+        ndArray *grad = get_tensor_data(get_tensor_grad(params[i]));
+        CU_ASSERT(array_equal(grad, expected[i]));
+        zero_grad(params[i]);
+    }
+    CU_ASSERT(array_equal(get_tensor_data(get_tensor_grad(x)),
+                          expected[num_params]));
+
+    // the segment's parameter gradients flow through the outer graph, so
+    // `gradient` returns them and leaves `.grad` alone
+    Tensor *z = tensor_sum(module_call(checkpointed, x));
+    Tensor *grads[num_params];
+    for (size_t i = 0; i < num_params; i++)
+        grads[i] = NULL;
+    gradient(grads, num_params, params, 1, (Tensor *[]){z},
+             (Tensor *[]){ones_like(z, NO_GRAD, env)}, NO_GRAPH);
+
+    for (size_t i = 0; i < num_params; i++) {
+        CU_ASSERT_PTR_NOT_NULL(grads[i]);
+        if (grads[i])
+            CU_ASSERT(array_equal(get_tensor_data(grads[i]), expected[i]));
+
+        ndArray *grad = get_tensor_data(get_tensor_grad(params[i]));
+        ndArray *zero = zeros(get_ndim(grad), get_shape(grad), get_dtype(grad));
+        CU_ASSERT(array_equal(grad, zero));
+        free_array(zero);
+        free_array(expected[i]);
+    }
+    free_array(expected[num_params]);
+
+    // the recompute in backward leaves batch norm's running stats alone
+    Module *norms[2] = {BatchNorm1d(2), Checkpoint(BatchNorm1d(2))};
+    Tensor *batch = randn(SHAPE(6, 2), DTYPE_FLOAT, REQUIRES_GRAD, env);
+    Tensor *stats[2][2];
+    for (int m = 0; m < 2; m++) {
+        backward(tensor_sum(module_call(norms[m], batch)), NULL);
+        buffers(norms[m], stats[m]);
+    }
+    for (int i = 0; i < 2; i++)
+        CU_ASSERT(array_equal(get_tensor_data(stats[0][i]),
+                              get_tensor_data(stats[1][i])));
+
+    free_module(norms[0]);
+    free_module(norms[1]);
+    free_module(checkpointed);
+    free_env(env);
+}
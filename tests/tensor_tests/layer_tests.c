@@ -0,0 +1,397 @@
+#include "array.h"
+#include "autograd.h"
+#include "nn.h"
+#include "random.h"
+#include "tensor.h"
+#include "tensor_tests.h"
+
+#include <CUnit/CUnit.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static const float *_floats(const Tensor *tensor) {
+    return get_array_data(get_tensor_data(tensor));
+}
+
+static void _assert_close(const float *actual, const double *expected,
+                          size_t size, double tol) {
+    for (size_t i = 0; i < size; i++)
+        CU_ASSERT_DOUBLE_EQUAL(actual[i], expected[i], tol);
+}
+
+/*
+ * Direct 2-d reference of y = conv(x, w) + b and of its gradients for an
+ * upstream gradient g, a 1-d convolution has H = kH = 1.
+ */
+static void _reference_conv(const float *x, const float *w, const float *b,
+                            const float *g, size_t N, size_t C_in, size_t H,
+                            size_t W, size_t C_out, size_t kH, size_t kW,
+                            const size_t *s, const size_t *p, const size_t *d,
+                            size_t groups, size_t oH, size_t oW, double *y,
+                            double *dx, double *dw, double *db) {
+    size_t Cg_in = C_in / groups, Cg_out = C_out / groups;
+    for (size_t n = 0; n < N; n++)
+        for (size_t co = 0; co < C_out; co++)
+            for (size_t oh = 0; oh < oH; oh++)
+                for (size_t ow = 0; ow < oW; ow++) {
+                    size_t o = ((n * C_out + co) * oH + oh) * oW + ow;
+                    y[o] = b[co];
+                    db[co] += g[o];
+                    for (size_t ci = 0; ci < Cg_in; ci++)
+                        for (size_t kh = 0; kh < kH; kh++)
+                            for (size_t kw = 0; kw < kW; kw++) {
+                                long ih = (long)(oh * s[0] + kh * d[0]) -
+                                          (long)p[0];
+                                long iw = (long)(ow * s[1] + kw * d[1]) -
+                                          (long)p[1];
+                                if (ih < 0 || ih >= (long)H || iw < 0 ||
+                                    iw >= (long)W)
+                                    continue;
+
+                                size_t c = co / Cg_out * Cg_in + ci;
+                                size_t i = ((n * C_in + c) * H + ih) * W + iw;
+                                size_t k =
+                                    ((co * Cg_in + ci) * kH + kh) * kW + kw;
+                                y[o] += (double)w[k] * x[i];
+                                dx[i] += (double)w[k] * g[o];
+                                dw[k] += (double)x[i] * g[o];
+                            }
+                }
+}
+
+static void _check_conv(int ndim, size_t N, size_t C_in, size_t C_out,
+                        size_t H, size_t W, size_t k, size_t stride,
+                        size_t padding, size_t dilation, size_t groups) {
+    Environment *env = env_init();
+    ConvParams params = {.ndim = ndim,
+                         .stride = {stride, stride},
+                         .padding = {padding, padding},
+                         .dilation = {dilation, dilation},
+                         .groups = groups};
+    size_t kH = ndim == 2 ? k : 1, pH = ndim == 2 ? padding : 0;
+    size_t sH = ndim == 2 ? stride : 1, dH = ndim == 2 ? dilation : 1;
+    if (ndim == 1)
+        H = 1;
+
+    size_t x_shape[] = {N, C_in, H, W};
+    size_t w_shape[] = {C_out, C_in / groups, kH, k};
+    if (ndim == 1) {
+        x_shape[2] = W;
+        w_shape[2] = k;
+    }
+    Tensor *x = randn(ndim + 2, x_shape, DTYPE_FLOAT, true, env);
+    Tensor *w = randn(ndim + 2, w_shape, DTYPE_FLOAT, true, env);
+    Tensor *b = randn(SHAPE(C_out), DTYPE_FLOAT, true, env);
+
+    Tensor *y = tensor_conv(x, w, b, &params);
+    size_t oH = ndim == 2 ? get_tensor_shape(y)[2] : 1,
+           oW = get_tensor_shape(y)[ndim + 1];
+    size_t out_size = N * C_out * oH * oW;
+    Tensor *g = randn(get_tensor_ndim(y), get_tensor_shape(y), DTYPE_FLOAT,
+                      NO_GRAD, env);
+    backward(tensor_sum(tensor_mul(y, g)), NULL);
+
+    size_t x_size = N * C_in * H * W, w_size = C_out * (C_in / groups) * kH * k;
+    double *ref_y = calloc(out_size, sizeof(double)),
+           *ref_dx = calloc(x_size, sizeof(double)),
+           *ref_dw = calloc(w_size, sizeof(double)),
+           *ref_db = calloc(C_out, sizeof(double));
+    _reference_conv(_floats(x), _floats(w), _floats(b), _floats(g), N, C_in,
+                    H, W, C_out, kH, k, SHAPE_(sH, stride), SHAPE_(pH, padding),
+                    SHAPE_(dH, dilation), groups, oH, oW, ref_y, ref_dx,
+                    ref_dw, ref_db);
+
+    CU_ASSERT_EQUAL(get_tensor_ndim(y), ndim + 2);
+    _assert_close(_floats(y), ref_y, out_size, 1e-4);
+    _assert_close(_floats(get_tensor_grad(x)), ref_dx, x_size, 1e-4);
+    _assert_close(_floats(get_tensor_grad(w)), ref_dw, w_size, 1e-3);
+    _assert_close(_floats(get_tensor_grad(b)), ref_db, C_out, 1e-3);
+
+    free(ref_y);
+    free(ref_dx);
+    free(ref_dw);
+    free(ref_db);
+    free_env(env);
+}
+
+void test_conv() {
+    // few channels per group run the direct kernels
+    _check_conv(2, 2, 4, 6, 7, 6, 3, 2, 1, 2, 2);
+    _check_conv(2, 3, 3, 1, 5, 5, 3, 1, 1, 1, 1);
+    // wider ones go through im2col and GEMM, 1x1 skips the column matrix
+    _check_conv(2, 2, 8, 16, 6, 5, 3, 1, 1, 1, 1);
+    _check_conv(2, 2, 16, 24, 9, 8, 3, 2, 2, 2, 2);
+    _check_conv(2, 2, 16, 8, 4, 3, 1, 1, 0, 1, 1);
+    _check_conv(1, 3, 12, 8, 1, 20, 5, 2, 2, 1, 1);
+    _check_conv(1, 2, 6, 6, 1, 11, 3, 1, 1, 1, 6);
+
+    // the module keeps its weights as parameters
+    Module *model = Sequential(Conv2dEx(3, 8, 3, 1, 1, 1, 1, true), ReLU());
+    CU_ASSERT_EQUAL(num_parameters(model), 2);
+
+    Environment *env = env_init();
+    Tensor *x = randn(SHAPE(2, 3, 8, 8), DTYPE_FLOAT, NO_GRAD, env);
+    Tensor *y = module_call(model, x);
+    CU_ASSERT_EQUAL(get_tensor_shape(y)[1], 8);
+    CU_ASSERT_EQUAL(get_tensor_shape(y)[2], 8);
+    CU_ASSERT_EQUAL(get_tensor_shape(y)[3], 8);
+
+    free_env(env);
+    free_module(model);
+}
+
+static Tensor *_pool_input(int ndim, const size_t *shape, const float *values,
+                           Environment *env) {
+    ndArray *data = array_init(ndim, shape, DTYPE_FLOAT);
+    populate_array(data, values);
+
+    return tensor_init(data, true, env);
+}
+
+static void _assert_pool(Module *layer, Tensor *x, const double *expected,
+                         const double *expected_grad) {
+    Tensor *y = module_call(layer, x);
+    _assert_close(_floats(y), expected, get_total_size(get_tensor_data(y)),
+                  1e-6);
+
+    set_tensor_grad(x, NULL);
+    backward(tensor_sum(y), NULL);
+    _assert_close(_floats(get_tensor_grad(x)), expected_grad,
+                  get_total_size(get_tensor_data(x)), 1e-6);
+
+    free_module(layer);
+}
+
+void test_pool() {
+    Environment *env = env_init();
+
+    // the gradient lands on each window's argmax only
+    const float plane[] = {1, 5, 2, 0, 3, 4, 9, 8, 7, 6, 1, 2, 0, 3, 5, 4};
+    Tensor *x = _pool_input(SHAPE(1, 1, 4, 4), plane, env);
+    double max_grad[16] = {[1] = 1, [6] = 1, [8] = 1, [14] = 1};
+    _assert_pool(MaxPool2d(2), x, (const double[]){5, 9, 7, 5}, max_grad);
+
+    // global average pooling
+    double mean = 0.0, mean_grad[16];
+    for (size_t i = 0; i < 16; i++) {
+        mean += plane[i] / 16.0;
+        mean_grad[i] = 1.0 / 16.0;
+    }
+    _assert_pool(AdaptiveAvgPool2d(1, 1), x, &mean, mean_grad);
+
+    // overlapping windows, averages count the padding as zeros
+    Tensor *row = _pool_input(SHAPE(1, 1, 3), (const float[]){3, 1, 2}, env);
+    _assert_pool(MaxPool1dEx(3, 1, 1), row, (const double[]){3, 3, 2},
+                 (const double[]){2, 0, 1});
+    _assert_pool(AvgPool1dEx(3, 1, 1), row,
+                 (const double[]){4.0 / 3.0, 2, 1},
+                 (const double[]){2.0 / 3.0, 1, 2.0 / 3.0});
+
+    // adaptive windows [0, 3), [2, 5) and [4, 7) overlap by one
+    Tensor *seq = _pool_input(SHAPE(1, 1, 7),
+                              (const float[]){0, 1, 2, 3, 4, 5, 6}, env);
+    _assert_pool(AdaptiveAvgPool1d(3), seq, (const double[]){1, 3, 5},
+                 (const double[]){1.0 / 3, 1.0 / 3, 2.0 / 3, 1.0 / 3,
+                                  2.0 / 3, 1.0 / 3, 1.0 / 3});
+
+    // a NaN wins its window and takes the gradient
+    Tensor *nan_row = _pool_input(SHAPE(1, 1, 4),
+                                  (const float[]){1, NAN, 3, 2}, env);
+    Module *layer = MaxPool1d(2);
+    Tensor *pooled = module_call(layer, nan_row);
+    CU_ASSERT(isnan(_floats(pooled)[0]));
+    CU_ASSERT_EQUAL(_floats(pooled)[1], 3.0f);
+
+    backward(tensor_sum(pooled), NULL);
+    _assert_close(_floats(get_tensor_grad(nan_row)),
+                  (const double[]){0, 1, 1, 0}, 4, 1e-6);
+    free_module(layer);
+
+    free_env(env);
+}
+
+/*
+ * Normalization of (outer, groups, inner) elements per group with either
+ * per-group or per-element affine parameters (`inner` of them), and its
+ * gradients for an upstream gradient g. `var` receives the biased
+ * variances (mean squares without centering).
+ */
+static void _reference_norm(const float *x, const float *w, const float *b,
+                            const float *g, size_t outer, size_t groups,
+                            size_t inner, bool per_group, bool center,
+                            double eps, double *y, double *dx, double *dw,
+                            double *db, double *var) {
+    double n = (double)(outer * inner);
+    for (size_t grp = 0; grp < groups; grp++) {
+        double mean = 0.0, sq = 0.0, m1 = 0.0, m2 = 0.0;
+        for (size_t o = 0; o < outer; o++)
+            for (size_t i = 0; i < inner; i++)
+                mean += center ? x[(o * groups + grp) * inner + i] / n : 0.0;
+        for (size_t o = 0; o < outer; o++)
+            for (size_t i = 0; i < inner; i++) {
+                double d = x[(o * groups + grp) * inner + i] - mean;
+                sq += d * d / n;
+            }
+        double r = 1.0 / sqrt(sq + eps);
+        var[grp] = sq;
+
+        for (size_t o = 0; o < outer; o++)
+            for (size_t i = 0; i < inner; i++) {
+                size_t e = (o * groups + grp) * inner + i,
+                       p = per_group ? grp : i;
+                double xhat = (x[e] - mean) * r, gy = (double)g[e] * w[p];
+                y[e] = xhat * w[p] + b[p];
+                dw[p] += g[e] * xhat;
+                db[p] += g[e];
+                m1 += center ? gy / n : 0.0;
+                m2 += gy * xhat / n;
+            }
+        for (size_t o = 0; o < outer; o++)
+            for (size_t i = 0; i < inner; i++) {
+                size_t e = (o * groups + grp) * inner + i,
+                       p = per_group ? grp : i;
+                double xhat = (x[e] - mean) * r;
+                dx[e] = r * ((double)g[e] * w[p] - m1 - xhat * m2);
+            }
+    }
+}
+
+/*
+ * Runs `layer` on a random (outer, groups, inner) input and checks the
+ * output and gradients, the affine parameters being set to non-trivial
+ * values first. Returns the reference variances, `affine` of them.
+ */
+static double *_check_norm(Module *layer, int ndim, const size_t *shape,
+                           size_t outer, size_t groups, size_t inner,
+                           bool per_group, bool center, double eps) {
+    Environment *env = env_init();
+    size_t num_params = num_parameters(layer);
+    Tensor *params[num_params];
+    parameters(layer, params);
+
+    size_t affine = per_group ? groups : inner;
+    float *w = malloc(affine * sizeof(float)),
+          *b = calloc(affine, sizeof(float));
+    for (size_t p = 0; p < affine; p++) {
+        w[p] = 0.5f + 0.01f * (float)(p % 97);
+        b[p] = center ? 0.02f * (float)(p % 13) - 0.1f : 0.0f;
+    }
+    populate_array(get_tensor_data(params[0]), w);
+    if (center)
+        populate_array(get_tensor_data(params[1]), b);
+
+    Tensor *x = randn(ndim, shape, DTYPE_FLOAT, true, env);
+    Tensor *y = module_call(layer, x);
+    Tensor *g = randn(ndim, shape, DTYPE_FLOAT, NO_GRAD, env);
+    backward(tensor_sum(tensor_mul(y, g)), NULL);
+
+    size_t size = outer * groups * inner;
+    double *ref_y = calloc(size, sizeof(double)),
+           *ref_dx = calloc(size, sizeof(double)),
+           *ref_dw = calloc(affine, sizeof(double)),
+           *ref_db = calloc(affine, sizeof(double)),
+           *var = calloc(groups, sizeof(double));
+    _reference_norm(_floats(x), w, b, _floats(g), outer, groups, inner,
+                    per_group, center, eps, ref_y, ref_dx, ref_dw, ref_db,
+                    var);
+
+    _assert_close(_floats(y), ref_y, size, 1e-4);
+    _assert_close(_floats(get_tensor_grad(x)), ref_dx, size, 1e-4);
+    _assert_close(_floats(get_tensor_grad(params[0])), ref_dw, affine, 1e-3);
+    if (center)
+        _assert_close(_floats(get_tensor_grad(params[1])), ref_db, affine,
+                      1e-3);
+
+    free(w);
+    free(b);
+    free(ref_y);
+    free(ref_dx);
+    free(ref_dw);
+    free(ref_db);
+    free_env(env);
+    return var;
+}
+
+static Tensor *_norm_jvp_fn(void *ctx, Tensor **inputs) {
+    return tensor_sum(module_call(ctx, inputs[0]));
+}
+
+void test_norm() {
+    // rows longer than a Welford block, enough of them to fork
+    Module *layer = LayerNorm(300);
+    free(_check_norm(layer, SHAPE(8, 8, 300), 1, 64, 300, false, true, 1e-5));
+    free_module(layer);
+
+    layer = LayerNorm(4, 5);
+    free(_check_norm(layer, SHAPE(7, 4, 5), 1, 7, 20, false, true, 1e-5));
+    free_module(layer);
+
+    layer = RMSNorm(16);
+    free(_check_norm(layer, SHAPE(9, 16), 1, 9, 16, false, false, 1e-6));
+    CU_ASSERT_EQUAL(num_parameters(layer), 1);
+    free_module(layer);
+
+    // training steps the running statistics by the momentum
+    Module *batch = BatchNorm2d(4);
+    CU_ASSERT_EQUAL(num_trainable_variables(batch), 8);
+    CU_ASSERT_EQUAL(num_non_trainable_variables(batch), 8);
+    CU_ASSERT_EQUAL(num_parameters(batch), 2);
+    CU_ASSERT_EQUAL(num_buffers(batch), 2);
+
+    size_t N = 3, C = 4, L = 5 * 6;
+    double *var = _check_norm(batch, SHAPE(N, C, 5, 6), N, C, L, true, true,
+                              1e-5);
+    Tensor *params[2], *stats[2];
+    parameters(batch, params);
+    buffers(batch, stats);
+    const float *running_var = _floats(stats[1]);
+    for (size_t c = 0; c < C; c++)
+        CU_ASSERT_DOUBLE_EQUAL(running_var[c],
+                               0.9 + 0.1 * var[c] * N * L / (N * L - 1),
+                               1e-5);
+    free(var);
+
+    // outside training the running statistics fold into a scale and shift
+    set_training(batch, false);
+    CU_ASSERT(!is_training(batch));
+
+    Environment *env = env_init();
+    Tensor *x = randn(SHAPE(N, C, 5, 6), DTYPE_FLOAT, true, env);
+    Tensor *y = module_call(batch, x);
+    backward(tensor_sum(y), NULL);
+
+    const float *w = _floats(params[0]), *b = _floats(params[1]),
+                *running_mean = _floats(stats[0]), *xs = _floats(x);
+    for (size_t e = 0; e < N * C * L; e++) {
+        size_t c = e / L % C;
+        double r = 1.0 / sqrt(running_var[c] + 1e-5);
+        CU_ASSERT_DOUBLE_EQUAL(_floats(y)[e],
+                               (xs[e] - running_mean[c]) * r * w[c] + b[c],
+                               1e-5);
+        CU_ASSERT_DOUBLE_EQUAL(_floats(get_tensor_grad(x))[e], w[c] * r,
+                               1e-5);
+    }
+    free_module(batch);
+
+    // a scalar output's tangent is the gradient dotted with the tangent
+    layer = Sequential(LayerNorm(8), Linear(8, 1));
+    Tensor *row = randn(SHAPE(1, 8), DTYPE_FLOAT, true, env);
+    Tensor *v = randn(SHAPE(1, 8), DTYPE_FLOAT, NO_GRAD, env);
+
+    ndArray *tangent;
+    Tensor *out = jvp(_norm_jvp_fn, layer, 1, &row,
+                      (ndArray *[]){get_tensor_data(v)}, &tangent);
+    backward(out, NULL);
+
+    double dot = 0.0;
+    for (size_t i = 0; i < 8; i++)
+        dot += (double)_floats(get_tensor_grad(row))[i] * _floats(v)[i];
+    CU_ASSERT_DOUBLE_EQUAL(((float *)get_array_data(tangent))[0], dot, 1e-4);
+
+    free_array(tangent);
+    free_module(layer);
+    free_env(env);
+}
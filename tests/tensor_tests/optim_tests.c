@@ -0,0 +1,328 @@
+#include "array.h"
+#include "autograd.h"
+#include "nn.h"
+#include "optim.h"
+#include "random.h"
+#include "tensor.h"
+#include "tensor_tests.h"
+
+#include <CUnit/CUnit.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+// every parameter gets a gradient of `value`, copies of the parameters
+static void _constant_grads(Optimizer *optim, float value, ndArray **before) {
+    Tensor **params = get_optim_params(optim);
+    for (size_t i = 0; i < get_num_optim_params(optim); i++) {
+        ndArray *data = get_tensor_data(params[i]);
+        zero_grad(params[i]);
+
+        ndArray *grad = get_tensor_data(get_tensor_grad(params[i]));
+        for (size_t j = 0; j < get_total_size(grad); j++)
+            ((float *)get_array_data(grad))[j] = value;
+
+        if (before)
+            before[i] = array_cast(data, DTYPE_FLOAT);
+    }
+}
+
+static void _assert_moved(Optimizer *optim, ndArray **before, double scale,
+                          double shift) {
+    Tensor **params = get_optim_params(optim);
+    for (size_t i = 0; i < get_num_optim_params(optim); i++) {
+        const float *p = get_array_data(get_tensor_data(params[i])),
+                    *p0 = get_array_data(before[i]);
+        for (size_t j = 0; j < get_total_size(before[i]); j++)
+            CU_ASSERT_DOUBLE_EQUAL(p[j], scale * p0[j] + shift, 1e-5);
+
+        free_array(before[i]);
+    }
+}
+
+void test_sgd() {
+    Module *model = Sequential(Linear(3, 4), ReLU(), Linear(4, 2));
+
+    Optimizer *optim = SGDNesterov(model, 0.1, 0.9);
+    CU_ASSERT_EQUAL(get_num_optim_params(optim), 4);
+
+    // under a constant gradient g, Nesterov moves by lr g (1 + mu) and then
+    // by lr g (1 + mu (1 + mu))
+    ndArray *before[4];
+    _constant_grads(optim, 0.5f, before);
+    optim_step(optim);
+    optim_step(optim);
+    _assert_moved(optim, before, 1.0, -0.1 * 0.5 * (1.9 + 2.71));
+    free_optimizer(optim);
+
+    // plain SGD keeps no state, weight decay shrinks the parameter
+    optim = sgd_init(model, 0.1, 0.0, 0.0, 0.5, false);
+    _constant_grads(optim, 0.0f, before);
+    optim_step(optim);
+    _assert_moved(optim, before, 0.95, 0.0);
+    free_optimizer(optim);
+    free_module(model);
+
+    // batch norm's running statistics are buffers, never trained or decayed
+    model = Sequential(Linear(2, 2), BatchNorm1d(2));
+    CU_ASSERT_EQUAL(num_parameters(model), 4);
+    freeze(model);
+    unfreeze(model);
+    flatten_parameters(model);
+
+    Tensor *stats[2];
+    buffers(model, stats);
+    CU_ASSERT_FALSE(get_requires_grad(stats[1]));
+    CU_ASSERT_PTR_NULL(get_tensor_grad(stats[1]));
+
+    optim = sgd_init(model, 0.1, 0.0, 0.0, 0.5, false);
+    CU_ASSERT_EQUAL(get_num_optim_params(optim), 4);
+    _constant_grads(optim, 0.0f, NULL);
+    optim_step(optim);
+    for (size_t c = 0; c < 2; c++)
+        CU_ASSERT_EQUAL(get_value(get_tensor_data(stats[1]), (size_t[]){c})
+                            .float_val,
+                        1.0f);
+
+    free_optimizer(optim);
+    free_module(model);
+}
+
+void test_adam() {
+    Module *model = Sequential(Linear(3, 4), ReLU(), Linear(4, 2));
+
+    // bias correction makes the first steps exactly lr * sign(g)
+    Optimizer *optim = Adam(model, 0.01);
+    ndArray *before[4];
+    _constant_grads(optim, -2.0f, before);
+    optim_step(optim);
+    optim_step(optim);
+    _assert_moved(optim, before, 1.0, 0.02);
+    free_optimizer(optim);
+
+    // AdamW decays the parameter, not the gradient the moments see
+    optim = AdamW(model, 0.01, 0.1);
+    _constant_grads(optim, 2.0f, before);
+    optim_step(optim);
+    _assert_moved(optim, before, 1.0 - 0.01 * 0.1, -0.01);
+    free_optimizer(optim);
+
+    // a few hundred steps fit a linear map
+    Module *fit = Linear(2, 1);
+    Environment *env = env_init();
+    Tensor *x = randn(SHAPE(16, 2), DTYPE_FLOAT, NO_GRAD, env);
+    ndArray *w_arr = array_init(SHAPE(2, 1), DTYPE_FLOAT);
+    populate_array(w_arr, (const float[]){1.5f, -0.5f});
+    Tensor *y = tensor_matmul(x, tensor_init(w_arr, NO_GRAD, env));
+
+    optim = Adam(fit, 0.05);
+    Loss criterion = MSELoss(REDUCTION_MEAN);
+    float first = 0.0f, last = 0.0f;
+    for (int step = 0; step < 300; step++) {
+        Tensor *loss = loss_call(&criterion, module_call(fit, x), y);
+        last = item(loss).float_val;
+        if (step == 0)
+            first = last;
+
+        _constant_grads(optim, 0.0f, NULL);
+        backward(loss, NULL);
+        optim_step(optim);
+    }
+    CU_ASSERT(last < 1e-3f * first);
+
+    free_optimizer(optim);
+    free_module(fit);
+    free_env(env);
+    free_module(model);
+}
+
+void test_flat_parameters() {
+    Module *model = Sequential(Linear(3, 4), ReLU(), Linear(4, 2));
+    Module *flat = Sequential(Linear(3, 4), ReLU(), Linear(4, 2));
+
+    // the same weights, one copy moved into a slab
+    char path[] = "/tmp/ctorch_module_XXXXXX";
+    int fd = mkstemp(path);
+    CU_ASSERT_FATAL(fd >= 0);
+    close(fd);
+    save_module(model, path);
+    load_module(flat, path);
+    remove(path);
+
+    flatten_parameters(flat);
+    CU_ASSERT(is_flattened(flat) && !is_flattened(model));
+
+    size_t num_params = num_parameters(flat);
+    Tensor *params[num_params];
+    parameters(flat, params);
+    CU_ASSERT_EQUAL(num_params, 4);
+
+    ndArray *slab = get_flat_parameters(flat);
+    CU_ASSERT_EQUAL(get_total_size(slab), 3 * 4 + 4 + 4 * 2 + 2);
+    CU_ASSERT_EQUAL((uintptr_t)get_array_data(slab) % 64, 0);
+
+    char *expected = get_array_data(slab);
+    for (size_t i = 0; i < num_params; i++) {
+        ndArray *data = get_tensor_data(params[i]);
+        CU_ASSERT_PTR_EQUAL(get_array_data(data), expected);
+        expected += get_total_size(data) * sizeof(float);
+    }
+
+    // backward accumulates into the slab and both models take equal steps
+    Environment *env = env_init();
+    Tensor *x = randn(SHAPE(5, 3), DTYPE_FLOAT, NO_GRAD, env);
+    Optimizer *optims[2] = {Adam(model, 0.01), Adam(flat, 0.01)};
+    Module *models[2] = {model, flat};
+
+    for (int step = 0; step < 3; step++) {
+        for (int m = 0; m < 2; m++) {
+            backward(tensor_sum(module_call(models[m], x)), NULL);
+            optim_step(optims[m]);
+        }
+    }
+    ndArray *grad = get_tensor_data(get_tensor_grad(params[0]));
+    CU_ASSERT_PTR_EQUAL(get_array_data(grad),
+                        get_array_data(get_flat_grads(flat)));
+
+    Tensor *reference[num_params];
+    parameters(model, reference);
+    for (size_t i = 0; i < num_params; i++)
+        CU_ASSERT(array_equal(get_tensor_data(reference[i]),
+                              get_tensor_data(params[i])));
+
+    free_optimizer(optims[0]);
+    free_optimizer(optims[1]);
+    free_env(env);
+    free_module(model);
+    free_module(flat);
+
+    // a gradient in another dtype is cast into the slab's
+    Module *linear = Linear(3, 2);
+    parameters(linear, params);
+    ndArray *wide = ones(2, (const size_t[]){3, 2}, DTYPE_DOUBLE);
+    set_tensor_grad(params[0], tensor_init(wide, NO_GRAD, NULL));
+
+    flatten_parameters(linear);
+    grad = get_tensor_data(get_tensor_grad(params[0]));
+    CU_ASSERT_EQUAL(get_dtype(grad), DTYPE_FLOAT);
+    CU_ASSERT_PTR_EQUAL(get_array_data(grad),
+                        get_array_data(get_flat_grads(linear)));
+    for (size_t j = 0; j < get_total_size(grad); j++)
+        CU_ASSERT_EQUAL(((float *)get_array_data(grad))[j], 1.0f);
+    free_module(linear);
+}
+
+void test_clip_grad() {
+    // large enough to span several work items once flattened
+    Module *model = Sequential(Linear(200, 100), ReLU(), Linear(100, 3));
+    flatten_parameters(model);
+    size_t n = get_total_size(get_flat_grads(model));
+
+    size_t num_params = num_parameters(model);
+    Tensor *params[num_params];
+    parameters(model, params);
+
+    float *grads = get_array_data(get_flat_grads(model));
+    double expected = 0.0;
+    for (size_t i = 0; i < n; i++) {
+        grads[i] = i % 2 ? 3.0f : -4.0f;
+        expected += grads[i] * grads[i];
+    }
+    expected = sqrt(expected);
+
+    // the norm covers every parameter, the rescale keeps the direction
+    double norm = clip_grad_norm(model, 1.0);
+    CU_ASSERT_DOUBLE_EQUAL(norm, expected, 1e-6 * expected);
+    CU_ASSERT_DOUBLE_EQUAL(grads[0], -4.0 / expected, 1e-6);
+    CU_ASSERT_DOUBLE_EQUAL(grads[n - 2], 3.0 / expected, 1e-6);
+
+    // a norm under the bound is left alone
+    norm = clip_grad_norm(model, 2.0);
+    CU_ASSERT_DOUBLE_EQUAL(norm, 1.0, 1e-5);
+    CU_ASSERT_DOUBLE_EQUAL(grads[0], -4.0 / expected, 1e-6);
+
+    for (size_t i = 0; i < n; i++)
+        grads[i] = i % 2 ? 3.0f : -4.0f;
+    clip_grad_value(model, 3.5);
+
+    ndArray *last = get_tensor_data(get_tensor_grad(params[num_params - 1]));
+    CU_ASSERT_DOUBLE_EQUAL(grads[0], -3.5, 1e-7);
+    CU_ASSERT_DOUBLE_EQUAL(grads[1], 3.0, 1e-7);
+    CU_ASSERT(fabs(get_value(last, (size_t[]){0, 0}).float_val) <= 3.5f);
+
+    free_module(model);
+}
+
+void test_module_zero_grad() {
+    Module *model = Sequential(Linear(3, 4), ReLU(), Linear(4, 2));
+    size_t num_params = num_parameters(model);
+    Tensor *params[num_params];
+    parameters(model, params);
+
+    Environment *env = env_init();
+    Tensor *x = randn(SHAPE(5, 3), DTYPE_FLOAT, NO_GRAD, env);
+    backward(tensor_sum(module_call(model, x)), NULL);
+
+    ndArray *first[num_params];
+    for (size_t i = 0; i < num_params; i++)
+        first[i] = array_cast(get_tensor_data(get_tensor_grad(params[i])),
+                              DTYPE_FLOAT);
+
+    // zeroing keeps the buffers
+    void *buffer = get_array_data(get_tensor_data(get_tensor_grad(params[0])));
+    module_zero_grad(model, false);
+    ndArray *grad = get_tensor_data(get_tensor_grad(params[0]));
+    CU_ASSERT_PTR_EQUAL(get_array_data(grad), buffer);
+    for (size_t j = 0; j < get_total_size(grad); j++)
+        CU_ASSERT_EQUAL(((float *)get_array_data(grad))[j], 0.0f);
+
+    // dropped gradients are written afresh by the next backward
+    module_zero_grad(model, true);
+    for (size_t i = 0; i < num_params; i++)
+        CU_ASSERT_PTR_NULL(get_tensor_grad(params[i]));
+
+    backward(tensor_sum(module_call(model, x)), NULL);
+    for (size_t i = 0; i < num_params; i++) {
+        CU_ASSERT(array_equal(get_tensor_data(get_tensor_grad(params[i])),
+                              first[i]));
+        free_array(first[i]);
+    }
+
+    // views into a flat slab are zeroed rather than dropped
+    flatten_parameters(model);
+    module_zero_grad(model, true);
+    ndArray *slab = get_flat_grads(model);
+    grad = get_tensor_data(get_tensor_grad(params[0]));
+    CU_ASSERT_PTR_EQUAL(get_array_data(grad), get_array_data(slab));
+    for (size_t j = 0; j < get_total_size(slab); j++)
+        CU_ASSERT_EQUAL(((float *)get_array_data(slab))[j], 0.0f);
+
+    free_env(env);
+    free_module(model);
+
+    // gradients in several dtypes and strided ones are zeroed as well
+    Module *linear = Linear(3, 2);
+    parameters(linear, params);
+    ndArray *weight = get_tensor_data(params[0]),
+            *bias = get_tensor_data(params[1]);
+    ndArray *wide = ones(get_ndim(bias), get_shape(bias), DTYPE_DOUBLE);
+    const size_t *shape = get_shape(weight);
+    ndArray *rows = ones(2, (const size_t[]){shape[1], shape[0]}, DTYPE_FLOAT);
+    ndArray *cols = transpose(rows, (const int[]){1, 0});
+    free_array(rows);
+    set_tensor_grad(params[0], tensor_init(cols, NO_GRAD, NULL));
+    set_tensor_grad(params[1], tensor_init(wide, NO_GRAD, NULL));
+
+    module_zero_grad(linear, false);
+    for (size_t i = 0; i < 2; i++) {
+        ndArray *g = get_tensor_data(get_tensor_grad(params[i]));
+        ndArray *zero = zeros(get_ndim(g), get_shape(g), get_dtype(g));
+        CU_ASSERT(array_equal(g, zero));
+        free_array(zero);
+    }
+    free_module(linear);
+}
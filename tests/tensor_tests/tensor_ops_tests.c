@@ -1,9 +1,13 @@
 #include "array.h"
 #include "autograd.h"
+#include "capture.h"
+#include "random.h"
+#include "sparse.h"
 #include "tensor.h"
 #include "tensor_tests.h"
 
 #include <CUnit/CUnit.h>
+#include <math.h>
 #include <stdbool.h>
 #include <stddef.h>
 
@@ -61,8 +65,13 @@ void test_tensor_sub() {
     populate_array(arr, data);
 
     Tensor *t2 = tensor_init(arr, true, env);
+    size_t num_tensors = get_num_tensors(env);
     Tensor *t3 = tensor_sub(t1, t2);
 
+    // one kernel and one node, no negated copy of t2
+    CU_ASSERT_EQUAL(get_num_tensors(env), num_tensors + 1);
+    CU_ASSERT_EQUAL(get_backward_outputs(get_backward_fn(t3)), 2);
+
     ndArray *result = array_init(ndim_result, shape_result, DTYPE_FLOAT);
     const float result_data[] = {-1.0f, -3.0f, -4.0f, -2.0f, -2.0f,
                                  -4.0f, -2.0f, -3.0f, -3.0f};
@@ -143,8 +152,13 @@ void test_tensor_div() {
     populate_array(arr, data);
 
     Tensor *t2 = tensor_init(arr, true, env);
+    size_t num_tensors = get_num_tensors(env);
     Tensor *t3 = tensor_div(t1, t2);
 
+    // one kernel and one node, no inverted copy of t2
+    CU_ASSERT_EQUAL(get_num_tensors(env), num_tensors + 1);
+    CU_ASSERT_EQUAL(get_backward_outputs(get_backward_fn(t3)), 2);
+
     ndArray *result = array_init(ndim_result, shape_result, DTYPE_FLOAT);
     const float result_data[] = {0.500000f, 0.000000f, 0.000000f,
                                  0.000000f, 0.333333f, 0.000000f,
@@ -174,3 +188,398 @@ void test_tensor_div() {
 
     free_env(env);
 }
+
+void test_tensor_min() {
+    const size_t shape[] = {3}, shape_result[] = {3, 3};
+    int ndim = sizeof(shape) / sizeof(shape[0]),
+        ndim_result = sizeof(shape_result) / sizeof(shape_result[0]);
+
+    Environment *env = env_init();
+
+    Tensor *t1 = eye_tensor(3, 3, DTYPE_FLOAT, true, env);
+
+    ndArray *arr = array_init(ndim, shape, DTYPE_FLOAT);
+    populate_array(arr, (const float[]){0.5f, -1.0f, 2.0f});
+
+    Tensor *t2 = tensor_init(arr, true, env);
+    Tensor *t3 = tensor_min(t1, t2);
+
+    ndArray *result = array_init(ndim_result, shape_result, DTYPE_FLOAT);
+    populate_array(result, (const float[]){0.5f, -1.0f, 0.0f, 0.0f, -1.0f,
+                                           0.0f, 0.0f, -1.0f, 1.0f});
+    CU_ASSERT(array_equal(result, get_tensor_data(t3)));
+
+    backward(t3, ones_like(t3, false, env));
+
+    Tensor *t1_grad = get_tensor_grad(t1), *t2_grad = get_tensor_grad(t2);
+
+    ndArray *t1_grad_arr = array_init(2, (const size_t[]){3, 3}, DTYPE_FLOAT),
+            *t2_grad_arr = array_init(ndim, shape, DTYPE_FLOAT);
+    populate_array(t1_grad_arr, (const float[]){0.0f, 0.0f, 1.0f, 1.0f, 0.0f,
+                                                1.0f, 1.0f, 0.0f, 1.0f});
+    populate_array(t2_grad_arr, (const float[]){1.0f, 3.0f, 0.0f});
+
+    CU_ASSERT(array_equal(get_tensor_data(t1_grad), t1_grad_arr));
+    CU_ASSERT(array_equal(get_tensor_data(t2_grad), t2_grad_arr));
+
+    // replay reruns the kernel on new data
+    Tensor *x = zeros_tensor(SHAPE(3), DTYPE_FLOAT, NO_GRAD, env),
+           *w = tensor_init(copy_array(arr), NO_GRAD, env);
+    capture_begin();
+    Tensor *y = tensor_min(x, w);
+    CapturedGraph *graph = capture_end(y);
+
+    ndArray *x_arr = array_init(ndim, shape, DTYPE_FLOAT),
+            *y_arr = array_init(ndim, shape, DTYPE_FLOAT);
+    populate_array(x_arr, (const float[]){0.25f, 3.0f, 5.0f});
+    populate_array(y_arr, (const float[]){0.25f, -1.0f, 2.0f});
+    replace_tensor_data(x, x_arr);
+
+    graph_replay(graph);
+    CU_ASSERT(array_equal(get_tensor_data(y), y_arr));
+
+    free_array(result);
+    free_array(t1_grad_arr);
+    free_array(t2_grad_arr);
+    free_array(y_arr);
+    free_captured_graph(graph);
+
+    free_env(env);
+}
+
+void test_tensor_spmm() {
+    const size_t shape[] = {4, 2};
+    int ndim = sizeof(shape) / sizeof(shape[0]);
+
+    Environment *env = env_init();
+
+    // rows 1 and 2 of the dense operand are never touched
+    SparseArray *sparse =
+        sparse_coo_init(3, 4, 3, (const size_t[]){0, 2, 2},
+                        (const size_t[]){1, 0, 3},
+                        (const float[]){2.0f, 1.5f, -3.0f}, DTYPE_FLOAT);
+
+    ndArray *arr = array_init(ndim, shape, DTYPE_FLOAT);
+    populate_array(arr, (const float[]){1.0f, -1.0f, 0.5f, 2.0f, -0.25f, 4.0f,
+                                        3.0f, 0.0f});
+
+    Tensor *dense_grad = tensor_init(arr, true, env);
+    Tensor *dense_sparse_grad = tensor_init(copy_array(arr), true, env);
+
+    Tensor *t1 = tensor_sum(tensor_spmm(sparse, dense_grad, DENSE_GRAD, env));
+    Tensor *t2 =
+        tensor_sum(tensor_spmm(sparse, dense_sparse_grad, SPARSE_GRAD, env));
+
+    ndArray *result = array_init(0, (size_t[]){}, DTYPE_FLOAT);
+    populate_array(result, (const float[]){-4.0f});
+    CU_ASSERT(array_equal(get_tensor_data(t1), result));
+    CU_ASSERT(array_equal(get_tensor_data(t2), result));
+
+    backward(t1, NULL);
+    backward(t2, NULL);
+
+    ndArray *grad_arr = array_init(ndim, shape, DTYPE_FLOAT);
+    populate_array(grad_arr, (const float[]){1.5f, 1.5f, 2.0f, 2.0f, 0.0f,
+                                             0.0f, -3.0f, -3.0f});
+
+    CU_ASSERT(array_equal(get_tensor_data(get_tensor_grad(dense_grad)),
+                          grad_arr));
+    CU_ASSERT(array_equal(get_tensor_data(get_tensor_grad(dense_sparse_grad)),
+                          grad_arr));
+
+    // `gradient` materializes the deferred gradient and leaves `.grad` alone
+    Tensor *t3 =
+        tensor_sum(tensor_spmm(sparse, dense_sparse_grad, SPARSE_GRAD, env));
+    Tensor *grads[1] = {NULL};
+    gradient(grads, 1, (Tensor *[]){dense_sparse_grad}, 1, (Tensor *[]){t3},
+             (Tensor *[]){ones_like(t3, NO_GRAD, env)}, NO_GRAPH);
+
+    CU_ASSERT_PTR_NOT_NULL(grads[0]);
+    if (grads[0])
+        CU_ASSERT(array_equal(get_tensor_data(grads[0]), grad_arr));
+    CU_ASSERT(array_equal(get_tensor_data(get_tensor_grad(dense_sparse_grad)),
+                          grad_arr));
+
+    // AccumulateGrad scatters it on top of the existing gradient
+    backward(t3, NULL);
+    ndArray *twice = array_add(grad_arr, grad_arr);
+    CU_ASSERT(array_equal(get_tensor_data(get_tensor_grad(dense_sparse_grad)),
+                          twice));
+
+    free_array(result);
+    free_array(grad_arr);
+    free_array(twice);
+    free_sparse(sparse);
+
+    free_env(env);
+}
+
+void test_tensor_to() {
+    Environment *env = env_init();
+
+    ndArray *w_arr = array_init(1, (const size_t[]){3}, DTYPE_FLOAT),
+            *idx_arr = array_init(1, (const size_t[]){3}, DTYPE_INT);
+    populate_array(w_arr, (const float[]){1.0f, 2.0f, 3.0f});
+    populate_array(idx_arr, (const int[]){2, 0, -1});
+
+    Tensor *w = tensor_init(w_arr, REQUIRES_GRAD, env);
+    Tensor *idx = tensor_init(idx_arr, NO_GRAD, env);
+
+    Tensor *w_double = tensor_to(w, DTYPE_DOUBLE);
+    CU_ASSERT(get_tensor_dtype(w_double) == DTYPE_DOUBLE);
+    CU_ASSERT(!get_requires_grad(tensor_to(w, DTYPE_INT)));
+
+    set_dtype_promotion(true);
+    Tensor *y = tensor_sum(tensor_mul(w_double, idx));
+    set_dtype_promotion(false);
+
+    CU_ASSERT(get_tensor_dtype(y) == DTYPE_DOUBLE);
+    CU_ASSERT(item(y).double_val == -1.0);
+
+    backward(y, NULL);
+
+    Tensor *w_grad = get_tensor_grad(w);
+    ndArray *w_grad_arr = array_init(1, (const size_t[]){3}, DTYPE_FLOAT);
+    populate_array(w_grad_arr, (const float[]){2.0f, 0.0f, -1.0f});
+
+    CU_ASSERT(get_tensor_dtype(w_grad) == DTYPE_FLOAT);
+    CU_ASSERT(array_equal(get_tensor_data(w_grad), w_grad_arr));
+
+    free_array(w_grad_arr);
+    free_env(env);
+}
+
+void test_tensor_relu() {
+    Environment *env = env_init();
+
+    ndArray *x_arr = array_init(1, (const size_t[]){5}, DTYPE_DOUBLE);
+    populate_array(x_arr, (const double[]){-2.0, -0.5, 0.5, 3.0, 7.0});
+    Tensor *x = tensor_init(x_arr, REQUIRES_GRAD, env);
+
+    Tensor *relu = tensor_relu(x), *leaky = tensor_leaky_relu(x, 0.1),
+           *relu6 = tensor_relu6(x);
+
+    ndArray *expected = array_init(1, (const size_t[]){5}, DTYPE_DOUBLE);
+    populate_array(expected, (const double[]){0.0, 0.0, 0.5, 3.0, 7.0});
+    CU_ASSERT(array_equal(get_tensor_data(relu), expected));
+    populate_array(expected, (const double[]){-0.2, -0.05, 0.5, 3.0, 7.0});
+    CU_ASSERT(array_equal(get_tensor_data(leaky), expected));
+    populate_array(expected, (const double[]){0.0, 0.0, 0.5, 3.0, 6.0});
+    CU_ASSERT(array_equal(get_tensor_data(relu6), expected));
+
+    // the backward reads only the outputs, the input is not saved
+    CU_ASSERT_FALSE(is_tensor_saved(x));
+
+    Tensor *y = tensor_sum(tensor_add(tensor_add(relu, leaky), relu6));
+    backward(y, NULL);
+
+    // past the cap relu6 is flat
+    populate_array(expected, (const double[]){0.1, 0.1, 3.0, 3.0, 2.0});
+    CU_ASSERT(array_equal(get_tensor_data(get_tensor_grad(x)), expected));
+
+    free_array(expected);
+    free_env(env);
+}
+
+static Tensor *_softmax_rows(Tensor *tensor) {
+    return tensor_softmax(tensor, -1);
+}
+
+static Tensor *_log_softmax_cols(Tensor *tensor) {
+    return tensor_log_softmax(tensor, 0);
+}
+
+static double _weighted_sum(Tensor *(*fn)(Tensor *), Tensor *x, Tensor *w) {
+    return item(tensor_sum(tensor_mul(fn(x), w))).double_val;
+}
+
+static Tensor *_gelu_sum(void *ctx, Tensor **inputs) {
+    return tensor_sum(tensor_gelu(inputs[0]));
+}
+
+void test_tensor_activations() {
+    Tensor *(*fns[])(Tensor *) = {tensor_gelu,   tensor_silu,
+                                  tensor_tanh,   tensor_sigmoid,
+                                  _softmax_rows, _log_softmax_cols};
+    const double x_vals[] = {-3.0, -0.5, 0.0, 0.25, 1.5, 4.0};
+    const double eps = 1e-6;
+
+    Environment *env = env_init();
+    ndArray *w_arr = array_init(2, (const size_t[]){2, 3}, DTYPE_DOUBLE);
+    populate_array(w_arr, (const double[]){0.3, -1.2, 0.7, 2.0, -0.4, 1.1});
+    Tensor *w = tensor_init(w_arr, NO_GRAD, env);
+
+    // the single-node gradients match central differences
+    for (size_t f = 0; f < sizeof(fns) / sizeof(fns[0]); f++) {
+        ndArray *x_arr = array_init(2, (const size_t[]){2, 3}, DTYPE_DOUBLE);
+        populate_array(x_arr, x_vals);
+        Tensor *x = tensor_init(x_arr, REQUIRES_GRAD, env);
+
+        Tensor *y = tensor_sum(tensor_mul(fns[f](x), w));
+        backward(y, NULL);
+        ndArray *grad = get_tensor_data(get_tensor_grad(x));
+
+        for (size_t i = 0; i < 6; i++) {
+            size_t idx[] = {i / 3, i % 3};
+            double plus[6], minus[6];
+            for (size_t j = 0; j < 6; j++)
+                plus[j] = minus[j] = x_vals[j];
+            plus[i] += eps;
+            minus[i] -= eps;
+
+            ndArray *p_arr = array_init(SHAPE(2, 3), DTYPE_DOUBLE),
+                    *m_arr = array_init(SHAPE(2, 3), DTYPE_DOUBLE);
+            populate_array(p_arr, plus);
+            populate_array(m_arr, minus);
+
+            double numeric =
+                (_weighted_sum(fns[f], tensor_init(p_arr, NO_GRAD, env), w) -
+                 _weighted_sum(fns[f], tensor_init(m_arr, NO_GRAD, env), w)) /
+                (2 * eps);
+            CU_ASSERT_DOUBLE_EQUAL(get_value(grad, idx).double_val, numeric,
+                                   1e-6);
+        }
+    }
+
+    // the row max is subtracted first, large logits stay finite
+    ndArray *big = array_init(1, (const size_t[]){3}, DTYPE_DOUBLE),
+            *small = array_init(1, (const size_t[]){3}, DTYPE_DOUBLE);
+    populate_array(big, (const double[]){1000.0, 1001.0, 1002.0});
+    populate_array(small, (const double[]){0.0, 1.0, 2.0});
+
+    Tensor *p_big = tensor_softmax(tensor_init(big, NO_GRAD, env), 0);
+    Tensor *p_small = tensor_softmax(tensor_init(small, NO_GRAD, env), 0);
+    CU_ASSERT(array_equal(get_tensor_data(p_big), get_tensor_data(p_small)));
+
+    // tanh keeps its relative precision near zero
+    const float tiny[] = {1e-5f, -3e-4f};
+    ndArray *tiny_arr = array_init(1, (const size_t[]){2}, DTYPE_FLOAT);
+    populate_array(tiny_arr, tiny);
+    ndArray *th =
+        get_tensor_data(tensor_tanh(tensor_init(tiny_arr, NO_GRAD, env)));
+    for (size_t i = 0; i < 2; i++) {
+        float v = get_value(th, (size_t[]){i}).float_val;
+        CU_ASSERT_DOUBLE_EQUAL(v / tanhf(tiny[i]), 1.0, 1e-6);
+    }
+
+    // GELU's gradient is itself differentiable
+    ndArray *x_arr = array_init(1, (const size_t[]){3}, DTYPE_DOUBLE);
+    populate_array(x_arr, (const double[]){-1.0, 0.5, 2.0});
+    Tensor *x = tensor_init(x_arr, REQUIRES_GRAD, env);
+
+    ndArray *ones_arr = ones(2, (const size_t[]){1, 3}, DTYPE_DOUBLE), *hvp_arr;
+    hvp(_gelu_sum, NULL, 1, (Tensor *[]){x}, &ones_arr, &hvp_arr);
+
+    for (size_t i = 0; i < 3; i++) {
+        double xi = get_value(x_arr, (size_t[]){i}).double_val;
+        ndArray *at = array_init(1, (const size_t[]){2}, DTYPE_DOUBLE),
+                *g = ones(1, (const size_t[]){2}, DTYPE_DOUBLE);
+        populate_array(at, (const double[]){xi + eps, xi - eps});
+        ndArray *d = array_activation_grad(g, at, ACTIVATION_GELU);
+
+        double numeric = (get_value(d, (size_t[]){0}).double_val -
+                          get_value(d, (size_t[]){1}).double_val) /
+                         (2 * eps);
+        CU_ASSERT_DOUBLE_EQUAL(get_value(hvp_arr, (size_t[]){0, i}).double_val,
+                               numeric, 1e-6);
+
+        free_array(at);
+        free_array(g);
+        free_array(d);
+    }
+
+    free_array(ones_arr);
+    free_array(hvp_arr);
+    free_env(env);
+}
+
+void test_tensor_losses() {
+    const double logits_vals[] = {2.0, -1.0, 0.5, 0.1, 0.2, 3.0};
+    const int labels[] = {0, 2};
+
+    Environment *env = env_init();
+    ndArray *logits_arr = array_init(SHAPE(2, 3), DTYPE_DOUBLE),
+            *labels_arr = array_init(SHAPE(2), DTYPE_INT);
+    populate_array(logits_arr, logits_vals);
+    populate_array(labels_arr, labels);
+    Tensor *logits = tensor_init(logits_arr, REQUIRES_GRAD, env),
+           *target = tensor_init(labels_arr, NO_GRAD, env);
+
+    // cross-entropy and its gradient match (softmax - one_hot) / N
+    Tensor *loss = tensor_cross_entropy(logits, target, REDUCTION_MEAN);
+    backward(loss, NULL);
+    ndArray *grad = get_tensor_data(get_tensor_grad(logits));
+
+    double expected = 0.0;
+    for (size_t i = 0; i < 2; i++) {
+        const double *row = logits_vals + 3 * i;
+        double total = exp(row[0]) + exp(row[1]) + exp(row[2]);
+        expected += (log(total) - row[labels[i]]) / 2;
+        for (size_t j = 0; j < 3; j++) {
+            double g = (exp(row[j]) / total - (j == (size_t)labels[i])) / 2;
+            CU_ASSERT_DOUBLE_EQUAL(
+                get_value(grad, (size_t[]){i, j}).double_val, g, 1e-12);
+        }
+    }
+    CU_ASSERT_DOUBLE_EQUAL(get_value(get_tensor_data(loss), NULL).double_val,
+                           expected, 1e-12);
+
+    // it equals NLL over log_softmax, unreduced
+    Tensor *fused = tensor_cross_entropy(logits, target, REDUCTION_NONE);
+    Tensor *composed = tensor_nll_loss(tensor_log_softmax(logits, 1), target,
+                                       REDUCTION_NONE);
+    CU_ASSERT(get_ndim(get_tensor_data(fused)) == 1);
+    CU_ASSERT(array_equal(get_tensor_data(fused), get_tensor_data(composed)));
+
+    // column-major logits are read in place, the target still found per row
+    ndArray *cols_arr = array_init(SHAPE(3, 2), DTYPE_DOUBLE);
+    populate_array(cols_arr, (const double[]){2.0, 0.1, -1.0, 0.2, 0.5, 3.0});
+    Tensor *rows = tensor_transpose(tensor_init(cols_arr, NO_GRAD, env),
+                                    (int[]){1, 0});
+    Tensor *strided = tensor_cross_entropy(rows, target, REDUCTION_NONE);
+    CU_ASSERT(array_equal(get_tensor_data(strided), get_tensor_data(fused)));
+
+    // pointwise losses differentiate both operands
+    ndArray *x_arr = array_init(SHAPE(3), DTYPE_DOUBLE),
+            *y_arr = array_init(SHAPE(3), DTYPE_DOUBLE);
+    populate_array(x_arr, (const double[]){-40.0, 0.5, 2.0});
+    populate_array(y_arr, (const double[]){0.0, 1.0, 0.25});
+    Tensor *x = tensor_init(x_arr, REQUIRES_GRAD, env),
+           *y = tensor_init(y_arr, REQUIRES_GRAD, env);
+
+    backward(tensor_mse_loss(x, y, REDUCTION_SUM), NULL);
+    ndArray *dx = get_tensor_data(get_tensor_grad(x)),
+            *dy = get_tensor_data(get_tensor_grad(y));
+    CU_ASSERT_DOUBLE_EQUAL(get_value(dx, (size_t[]){1}).double_val, -1.0,
+                           1e-12);
+    CU_ASSERT_DOUBLE_EQUAL(get_value(dy, (size_t[]){2}).double_val, -3.5,
+                           1e-12);
+
+    // BCE with logits stays finite far into the saturated range
+    Tensor *bce = tensor_bce_with_logits(x, y, REDUCTION_NONE);
+    ndArray *bce_data = get_tensor_data(bce);
+    CU_ASSERT_DOUBLE_EQUAL(get_value(bce_data, (size_t[]){0}).double_val,
+                           log1p(exp(-40.0)), 1e-12);
+    CU_ASSERT_DOUBLE_EQUAL(get_value(bce_data, (size_t[]){1}).double_val,
+                           log1p(exp(-0.5)), 1e-12);
+
+    // replay refreshes the saved row logsumexps with the new batch
+    Tensor *h = randn(SHAPE(2, 3), DTYPE_DOUBLE, REQUIRES_GRAD, env);
+    capture_begin();
+    Tensor *captured = tensor_cross_entropy(h, target, REDUCTION_SUM);
+    CapturedGraph *graph = capture_end(captured);
+
+    replace_tensor_data(h, array_cast(logits_arr, DTYPE_DOUBLE));
+    zero_grad(h);
+    graph_replay(graph);
+    CU_ASSERT_DOUBLE_EQUAL(
+        get_value(get_tensor_data(captured), NULL).double_val, 2 * expected,
+        1e-12);
+    ndArray *replay_grad = get_tensor_data(get_tensor_grad(h));
+    CU_ASSERT_DOUBLE_EQUAL(get_value(replay_grad, (size_t[]){1, 2}).double_val,
+                           2 * get_value(grad, (size_t[]){1, 2}).double_val,
+                           1e-12);
+
+    free_captured_graph(graph);
+    free_env(env);
+}
@@ -13,5 +13,48 @@ void test_tensor_add();
 void test_tensor_sub();
 void test_tensor_mul();
 void test_tensor_div();
+void test_tensor_min();
+void test_tensor_spmm();
+void test_tensor_to();
+void test_tensor_relu();
+void test_tensor_activations();
+void test_tensor_losses();
+
+// autograd tests
+void test_backward_free_graph();
+void test_backward_training_steps();
+void test_backward_retain_graph();
+void test_backward_shared_freed_graph();
+void test_parallel_backward();
+void test_graph_replay();
+void test_graph_replay_leaky_relu();
+void test_graph_replay_compare();
+void test_memory_plan();
+void test_jvp();
+void test_hvp_jacobian();
+void test_saved_tensors();
+void test_saved_tensor_hooks();
+
+// mixed precision tests
+void test_autocast();
+void test_grad_scaler();
+
+// grad mode tests
+void test_no_grad();
+void test_inference_mode();
+void test_checkpoint();
+
+// fusion tests
+void test_fused_eval();
+
+// optimizer tests
+void test_sgd();
+void test_adam();
+void test_flat_parameters();
+void test_clip_grad();
+void test_module_zero_grad();
+void test_conv();
+void test_pool();
+void test_norm();
 
 #endif // !TENSOR_TESTS_H